@@ -1,17 +1,29 @@
 
 #include <mutex>
+#include <algorithm>
+#if _WIN32
 #include "win32.h"
 #include <wininet.h>
 #include <DbgHelp.h>
+#else
+#include "linux.h"
+#endif
 
+#if _WIN32
 #include "benchmark/benchmark.h"
+#else
+// Use whatever version is installed system-wide, as it needs to match the lib we link against
+#include <benchmark/benchmark.h>
+#endif
 
+#if _WIN32
 #pragma comment(lib, "wininet")
 #if CONFIG_DEBUG
 #pragma comment(lib, "Debug/benchmark.lib")
 #else
 #pragma comment(lib, "Release/benchmark.lib")
 #endif
+#endif
 
 #pragma warning( push )
 #pragma warning( disable : 5262 )
@@ -27,6 +39,8 @@
 #include "threading.h"
 #include "datatypes.h"
 #include "logging.h"
+#include "jobs.h"
+#include "tasks.h"
 #include "serialization.h"
 #include "serialize_binary.h"
 
@@ -34,9 +48,16 @@
 
 #include "common.cpp"
 #include "strings.cpp"
+#include "memory.cpp"
 #include "logging.cpp"
+#include "jobs.cpp"
+#include "tasks.cpp"
 #include "platform.cpp"
+#if _WIN32
 #include "win32_platform.cpp"
+#else
+#include "linux_platform.cpp"
+#endif
 #pragma warning( pop )
 
 // Conflicts with benchmark.h
@@ -171,6 +192,887 @@ static void TestBinarySerializer( benchmark::State& state )
 }
 
 
+// Allocate a bunch of small blocks of varying sizes, then free them in a different order
+template <typename T>
+static void TestSmallAllocations( benchmark::State& state )
+{
+    static constexpr int blockCount = 10000;
+    static void* blocks[blockCount];
+    static sz sizes[blockCount];
+    static int freeOrder[blockCount];
+
+    srand( 1234 );
+    for( int i = 0; i < blockCount; ++i )
+    {
+        sizes[i] = 8 + rand() % 248;
+        freeOrder[i] = i;
+    }
+    for( int i = blockCount - 1; i > 0; --i )
+    {
+        int j = rand() % (i + 1);
+        int tmp = freeOrder[i];
+        freeOrder[i] = freeOrder[j];
+        freeOrder[j] = tmp;
+    }
+
+    T allocatorImpl;
+    Allocator allocator = Allocator::CreateFrom( &allocatorImpl );
+
+    for( auto _ : state )
+    {
+        for( int i = 0; i < blockCount; ++i )
+            DoNotOptimize( blocks[i] = ALLOC( &allocator, sizes[i], Memory::NoClear() ) );
+        for( int i = 0; i < blockCount; ++i )
+            FREE( &allocator, blocks[freeOrder[i]] );
+    }
+    state.SetItemsProcessed( state.iterations() * blockCount );
+}
+
+
+// A GenericHeap behind a single lock, as a baseline for SyncHeap
+struct LockedGenericHeap
+{
+    GenericHeap heap;
+    Mutex mutex;
+};
+
+INLINE ALLOC_FUNC( LockedGenericHeap )
+{
+    Mutex::Scope lock( data->mutex );
+    return data->heap.Alloc( sizeBytes, params );
+}
+
+INLINE FREE_FUNC( LockedGenericHeap )
+{
+    Mutex::Scope lock( data->mutex );
+    data->heap.Free( memoryBlock );
+}
+
+// Each thread allocates a batch of small blocks, then swaps it with whatever batch some other thread left in a shared
+// mailbox and frees that, so most blocks end up being freed by a thread different to the one that allocated them
+template <typename T>
+static void TestConcurrentAllocations( benchmark::State& state )
+{
+    static constexpr int maxThreads = 64;
+    static constexpr int batchSize = 256;
+
+    struct Batch
+    {
+        int count;
+        void* blocks[batchSize];
+    };
+    static Batch batches[maxThreads + 1];
+    static std::atomic<Batch*> mailbox;
+    static T* allocatorImpl;
+
+    if( state.thread_index() == 0 )
+    {
+        allocatorImpl = new T;
+        batches[maxThreads].count = 0;
+        mailbox.store( &batches[maxThreads] );
+    }
+    Batch* batch = &batches[state.thread_index()];
+    u32 seed = 1234 + (u32)state.thread_index();
+
+    for( auto _ : state )
+    {
+        Allocator allocator = Allocator::CreateFrom( allocatorImpl );
+
+        for( int i = 0; i < batchSize; ++i )
+        {
+            seed = seed * 1664525 + 1013904223;
+            DoNotOptimize( batch->blocks[i] = ALLOC( &allocator, 16 + (seed >> 24), Memory::NoClear() ) );
+        }
+        batch->count = batchSize;
+
+        batch = mailbox.exchange( batch, std::memory_order_acq_rel );
+        for( int i = 0; i < batch->count; ++i )
+            FREE( &allocator, batch->blocks[i] );
+        batch->count = 0;
+    }
+    state.SetItemsProcessed( state.iterations() * batchSize );
+
+    if( state.thread_index() == 0 )
+    {
+        Batch* last = mailbox.load();
+        for( int i = 0; i < last->count; ++i )
+            FREE( allocatorImpl, last->blocks[i] );
+        delete allocatorImpl;
+    }
+}
+
+
+// The old mutex-based SyncQueue, as a baseline
+template <typename T>
+struct LockedQueue
+{
+    Mutex mutex;
+    RingBuffer<T> buffer;
+
+    LockedQueue( i32 capacity )
+        : buffer( capacity )
+    {}
+
+    bool Push( T const& item )
+    {
+        Mutex::Scope lock( mutex );
+        if( !buffer.Available() )
+            return false;
+        buffer.Push( item );
+        return true;
+    }
+
+    bool TryPop( T* out )
+    {
+        Mutex::Scope lock( mutex );
+        return buffer.TryPop( out );
+    }
+};
+
+template <typename T>
+INLINE bool TryPush( T* queue, int item ) { return queue->Push( item ); }
+// Unbounded
+INLINE bool TryPush( SyncQueue<int>* queue, int item ) { queue->Push( item ); return true; }
+
+// Even threads produce and odd threads consume (a single thread does both), pushing a batch of items per iteration
+template <typename T>
+static void TestQueueThroughput( benchmark::State& state )
+{
+    static constexpr int batchSize = 1024;
+    static T* queue;
+
+    if( state.thread_index() == 0 )
+        queue = new T( 1024 );
+
+    bool producer = (state.thread_index() & 1) == 0;
+    bool consumer = !producer || state.threads() == 1;
+
+    for( auto _ : state )
+    {
+        if( producer )
+        {
+            for( int i = 0; i < batchSize; ++i )
+                while( !TryPush( queue, i ) )
+                    std::this_thread::yield();
+        }
+        if( consumer )
+        {
+            int item;
+            for( int i = 0; i < batchSize; ++i )
+            {
+                while( !queue->TryPop( &item ) )
+                    std::this_thread::yield();
+                DoNotOptimize( item );
+            }
+        }
+    }
+    state.SetItemsProcessed( state.iterations() * batchSize );
+
+    if( state.thread_index() == 0 )
+        delete queue;
+}
+
+
+// Same as above, but moving items in batches, with the consumer blocking whenever the queue is empty
+static void TestSpscQueueBatches( benchmark::State& state )
+{
+    static constexpr int batchSize = 1024;
+    static SpscQueue<int>* queue;
+
+    if( state.thread_index() == 0 )
+        queue = new SpscQueue<int>( 1024 );
+
+    int items[64];
+    for( auto _ : state )
+    {
+        if( state.thread_index() == 0 )
+        {
+            for( int i = 0; i < ARRAYCOUNT(items); ++i )
+                items[i] = i;
+            for( int pushed = 0; pushed < batchSize; )
+            {
+                int n = queue->PushN( items, Min( I32( ARRAYCOUNT(items) ), batchSize - pushed ) );
+                if( !n )
+                    std::this_thread::yield();
+                pushed += n;
+            }
+        }
+        else
+        {
+            for( int popped = 0; popped < batchSize; )
+                popped += queue->PopNWait( items, Min( I32( ARRAYCOUNT(items) ), batchSize - popped ) );
+            DoNotOptimize( items[0] );
+        }
+    }
+    state.SetItemsProcessed( state.iterations() * batchSize );
+
+    if( state.thread_index() == 0 )
+        delete queue;
+}
+
+
+// Pseudo-random keys (scaled down for floats, so they stay within a sane range)
+template <typename T>
+static T* CreateSortKeys( sz count )
+{
+    T* keys = (T*)ALLOC( CTX_ALLOC, count * SIZEOF(T), Memory::NoClear() );
+    u64 x = 0x9E3779B97F4A7C15ull;
+    for( sz i = 0; i < count; ++i )
+    {
+        // xorshift
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        IF( std::is_floating_point<T>::value )
+            keys[i] = (T)((i64)x >> 11) * (T)1e-6;
+        else
+            keys[i] = (T)x;
+    }
+    return keys;
+}
+
+// NOTE Both versions pay for copying the unsorted input every iteration
+template <typename T, bool Radix>
+static void TestSort( benchmark::State& state )
+{
+    const sz N = state.range(0);
+    T* input = CreateSortKeys<T>( N );
+    T* keys = (T*)ALLOC( CTX_ALLOC, N * SIZEOF(T), Memory::NoClear() );
+
+    MemoryArena scratch;
+    InitVirtualArena( &scratch, GIGABYTES(4) );
+
+    for( auto _ : state )
+    {
+        COPYP( input, keys, N * SIZEOF(T) );
+        IF( Radix )
+        {
+            RadixSort( keys, N, &scratch );
+            ClearArena( &scratch );
+        }
+        else
+            std::sort( keys, keys + N );
+        DoNotOptimize( keys[N / 2] );
+    }
+    state.SetItemsProcessed( state.iterations() * N );
+
+    ReleaseArena( &scratch );
+    FREE( CTX_ALLOC, keys );
+    FREE( CTX_ALLOC, input );
+}
+
+// Sort indices by key
+template <bool Radix>
+static void TestSortPairs( benchmark::State& state )
+{
+    const sz N = state.range(0);
+    u32* input = CreateSortKeys<u32>( N );
+    u32* keys = (u32*)ALLOC( CTX_ALLOC, N * SIZEOF(u32), Memory::NoClear() );
+    u32* indices = (u32*)ALLOC( CTX_ALLOC, N * SIZEOF(u32), Memory::NoClear() );
+
+    struct Pair
+    {
+        u32 key;
+        u32 index;
+        bool operator <( Pair const& other ) const { return key < other.key; }
+    };
+    Pair* pairs = (Pair*)ALLOC( CTX_ALLOC, N * SIZEOF(Pair), Memory::NoClear() );
+
+    MemoryArena scratch;
+    InitVirtualArena( &scratch, GIGABYTES(4) );
+
+    for( auto _ : state )
+    {
+        IF( Radix )
+        {
+            COPYP( input, keys, N * SIZEOF(u32) );
+            for( sz i = 0; i < N; ++i )
+                indices[i] = (u32)i;
+            RadixSort( keys, indices, N, &scratch );
+            ClearArena( &scratch );
+            DoNotOptimize( indices[N / 2] );
+        }
+        else
+        {
+            for( sz i = 0; i < N; ++i )
+                pairs[i] = { input[i], (u32)i };
+            std::stable_sort( pairs, pairs + N );
+            DoNotOptimize( pairs[N / 2] );
+        }
+    }
+    state.SetItemsProcessed( state.iterations() * N );
+
+    ReleaseArena( &scratch );
+    FREE( CTX_ALLOC, pairs );
+    FREE( CTX_ALLOC, indices );
+    FREE( CTX_ALLOC, keys );
+    FREE( CTX_ALLOC, input );
+}
+
+template <bool Radix>
+static void TestSortStrings( benchmark::State& state )
+{
+    const sz N = state.range(0);
+
+    // Random lowercase words of 3 to 12 chars
+    u32* seeds = CreateSortKeys<u32>( N );
+    char* chars = (char*)ALLOC( CTX_ALLOC, N * 13, Memory::NoClear() );
+    String* input = (String*)ALLOC( CTX_ALLOC, N * SIZEOF(String), Memory::NoClear() );
+    String* strings = (String*)ALLOC( CTX_ALLOC, N * SIZEOF(String), Memory::NoClear() );
+    for( sz i = 0; i < N; ++i )
+    {
+        char* word = chars + i * 13;
+        u32 x = seeds[i];
+        int len = 3 + x % 10;
+        for( int c = 0; c < len; ++c, x = x * 1664525u + 1013904223u )
+            word[c] = 'a' + (x >> 24) % 26;
+        word[len] = 0;
+        INIT( input[i] )( word );
+    }
+
+    MemoryArena scratch;
+    InitVirtualArena( &scratch, GIGABYTES(4) );
+
+    for( auto _ : state )
+    {
+        COPYP( input, strings, N * SIZEOF(String) );
+        IF( Radix )
+        {
+            RadixSort( strings, N, &scratch );
+            ClearArena( &scratch );
+        }
+        else
+            std::sort( strings, strings + N, []( String const& a, String const& b ) { return strcmp( a.data, b.data ) < 0; } );
+        DoNotOptimize( strings[N / 2].data );
+    }
+    state.SetItemsProcessed( state.iterations() * N );
+
+    ReleaseArena( &scratch );
+    FREE( CTX_ALLOC, strings );
+    FREE( CTX_ALLOC, input );
+    FREE( CTX_ALLOC, chars );
+    FREE( CTX_ALLOC, seeds );
+}
+
+// Lots of tiny sorts, where the sorting network kicks in
+template <bool Network>
+static void TestSortSmall( benchmark::State& state )
+{
+    const int N = (int)state.range(0);
+    const int batchCount = 1000;
+    i32* input = CreateSortKeys<i32>( N * batchCount );
+    i32* keys = (i32*)ALLOC( CTX_ALLOC, N * batchCount * SIZEOF(i32), Memory::NoClear() );
+
+    for( auto _ : state )
+    {
+        COPYP( input, keys, N * batchCount * SIZEOF(i32) );
+        for( int b = 0; b < batchCount; ++b )
+        {
+            i32* batch = keys + b * N;
+            IF( Network )
+                RadixSort( batch, N );
+            else
+                std::sort( batch, batch + N );
+        }
+        DoNotOptimize( keys[N / 2] );
+    }
+    state.SetItemsProcessed( state.iterations() * N * batchCount );
+
+    FREE( CTX_ALLOC, keys );
+    FREE( CTX_ALLOC, input );
+}
+
+// Typical 'fat' record where hot loops only care about a couple fields
+struct BenchParticle
+{
+    f32 pos[3];
+    f32 vel[3];
+    f32 color[4];
+    f32 mass;
+    f32 age;
+    u32 id;
+    u32 flags;
+};
+
+REFLECT( BenchParticle )
+{
+    BEGIN_FIELDS;
+    FIELD( 1, pos );
+    FIELD( 2, vel );
+    FIELD( 3, color );
+    FIELD( 4, mass );
+    FIELD( 5, age );
+    FIELD( 6, id );
+    FIELD( 7, flags );
+    return ReflectOk;
+}
+
+// Sum the masses of all particles
+template <bool SoA>
+static void TestFieldScan( benchmark::State& state )
+{
+    const int N = (int)state.range(0);
+
+    Array<BenchParticle> particles( N );
+    for( int i = 0; i < N; ++i )
+    {
+        BenchParticle* p = particles.PushEmpty();
+        p->mass = (f32)(i & 0xFF);
+    }
+    SoAArray<BenchParticle> soa( (Buffer<BenchParticle>)particles );
+
+    for( auto _ : state )
+    {
+        f32 total = 0;
+        IF( SoA )
+        {
+            for( f32 m : soa.Column( &BenchParticle::mass ) )
+                total += m;
+        }
+        else
+        {
+            for( BenchParticle const& p : particles )
+                total += p.mass;
+        }
+        DoNotOptimize( total );
+    }
+    state.SetItemsProcessed( state.iterations() * N );
+    state.SetBytesProcessed( state.iterations() * N * (SoA ? SIZEOF(f32) : SIZEOF(BenchParticle)) );
+}
+
+// Fill an array without knowing its final size upfront
+template <typename T>
+static void TestArrayGrowth( benchmark::State& state )
+{
+    const int N = (int)state.range(0);
+
+    MemoryArena arena;
+    InitVirtualArena( &arena, GIGABYTES(1) );
+    LazyAllocator lazy;
+
+    for( auto _ : state )
+    {
+        IF( std::is_same<T, MemoryArena>::value )
+        {
+            DynArray<int, MemoryArena> array( 0, &arena );
+            for( int i = 0; i < N; ++i )
+                array.Push( i );
+            DoNotOptimize( array.data );
+            ClearArena( &arena );
+        }
+        else IF( std::is_same<T, LazyAllocator>::value )
+        {
+            DynArray<int, LazyAllocator> array( 0, &lazy );
+            for( int i = 0; i < N; ++i )
+                array.Push( i );
+            DoNotOptimize( array.data );
+        }
+        else
+        {
+            // Baseline: sized upfront
+            Array<int, LazyAllocator> array( N, &lazy );
+            for( int i = 0; i < N; ++i )
+                array.Push( i );
+            DoNotOptimize( array.data );
+        }
+    }
+    state.SetItemsProcessed( state.iterations() * N );
+
+    ReleaseArena( &arena );
+}
+
+// Forwards to malloc, but keeps count of how many times it's been hit
+struct CountingAllocator
+{
+    LazyAllocator base;
+    i64 allocCount;
+};
+
+ALLOC_FUNC( CountingAllocator )
+{
+    data->allocCount++;
+    return Alloc( &data->base, sizeBytes, filename, line, params );
+}
+
+FREE_FUNC( CountingAllocator )
+{
+    Free( &data->base, memoryBlock, params );
+}
+
+template <typename T>
+static T CreateSmallArray( int count, CountingAllocator* alloc );
+
+template <>
+Array<int, CountingAllocator> CreateSmallArray( int count, CountingAllocator* alloc )
+{
+    // A plain array needs to know its size upfront
+    return Array<int, CountingAllocator>( count, alloc );
+}
+
+template <>
+SmallArray<int, 8, CountingAllocator> CreateSmallArray( int count, CountingAllocator* alloc )
+{
+    return SmallArray<int, 8, CountingAllocator>( alloc );
+}
+
+// Build lots of short-lived arrays holding just a few items each (the sizes most of our arrays actually have)
+template <typename T>
+static void TestSmallArrays( benchmark::State& state )
+{
+    const int N = (int)state.range(0);
+    const int arrayCount = 1000;
+
+    CountingAllocator alloc = {};
+    for( auto _ : state )
+    {
+        int sum = 0;
+        for( int a = 0; a < arrayCount; ++a )
+        {
+            T array = CreateSmallArray<T>( N, &alloc );
+            for( int i = 0; i < N; ++i )
+                array.Push( a + i );
+            for( int v : array )
+                sum += v;
+            array.Destroy();
+        }
+        DoNotOptimize( sum );
+    }
+    state.SetItemsProcessed( state.iterations() * arrayCount * N );
+    state.counters["allocs"] = benchmark::Counter( (double)alloc.allocCount / ((double)state.iterations() * arrayCount) );
+}
+
+// Unique, non-zero and well scattered keys
+static u64* CreateHashtableKeys( int count )
+{
+    u64* keys = (u64*)ALLOC( CTX_ALLOC, count * SIZEOF(u64), Memory::NoClear() );
+    for( int i = 0; i < count; ++i )
+        keys[i] = (u64)(i + 1) * 0x9E3779B97F4A7C15ull;
+    return keys;
+}
+
+template <typename T>
+static void TestHashtableInsert( benchmark::State& state )
+{
+    const int N = (int)state.range(0);
+    u64* keys = CreateHashtableKeys( N );
+
+    for( auto _ : state )
+    {
+        T table( 0 );
+        for( int i = 0; i < N; ++i )
+            table.Put( keys[i], (u64)i );
+        DoNotOptimize( table.count );
+    }
+    state.SetItemsProcessed( state.iterations() * N );
+
+    FREE( CTX_ALLOC, keys );
+}
+
+template <typename T>
+static void TestHashtableLookup( benchmark::State& state )
+{
+    const int N = (int)state.range(0);
+    u64* keys = CreateHashtableKeys( N );
+
+    T table( N );
+    for( int i = 0; i < N; ++i )
+        table.Put( keys[i], (u64)i );
+
+    // Look up keys in a different order from how they were inserted, and half of them not present
+    for( auto _ : state )
+    {
+        u64 sum = 0;
+        for( int i = 0; i < N; ++i )
+        {
+            u64 key = (i & 1) ? keys[N - 1 - i] : keys[i] + 1;
+            u64 const* value = table.Get( key );
+            sum += value ? *value : 0;
+        }
+        DoNotOptimize( sum );
+    }
+    state.SetItemsProcessed( state.iterations() * N );
+
+    FREE( CTX_ALLOC, keys );
+}
+
+
+// Walks a big table holding only a few entries, given as a permille of its capacity
+static void TestHashtableIterate( benchmark::State& state )
+{
+    const int capacity = 1 << 20;
+    const int N = (int)(capacity * state.range(0) / 1000);
+    u64* keys = CreateHashtableKeys( N );
+
+    Hashtable<u64, u64> table( capacity / 2 );
+    ASSERT( table.capacity == capacity );
+    for( int i = 0; i < N; ++i )
+        table.Put( keys[i], (u64)i );
+
+    for( auto _ : state )
+    {
+        u64 sum = 0;
+        for( auto it = table.Values(); it; ++it )
+            sum += *it;
+        DoNotOptimize( sum );
+    }
+    state.SetItemsProcessed( state.iterations() * capacity );
+
+    FREE( CTX_ALLOC, keys );
+}
+
+// A single mutex around a plain Hashtable, as a baseline
+struct LockedHashtable
+{
+    LazyAllocator allocator;
+    Mutex mutex;
+    Hashtable<u64, u64, LazyAllocator> table;
+
+    LockedHashtable( int expectedEntryCount )
+        : table( expectedEntryCount, &allocator )
+    {}
+
+    bool Get( u64 key, u64* valueOut )
+    {
+        Mutex::Scope lock( mutex );
+        u64 const* value = table.Get( key );
+        if( value )
+            *valueOut = *value;
+        return value != nullptr;
+    }
+
+    void Put( u64 key, u64 value )
+    {
+        Mutex::Scope lock( mutex );
+        table.Put( key, value );
+    }
+};
+
+struct ShardedHashtable
+{
+    LazyAllocator allocator;
+    ConcurrentHashtable<u64, u64, LazyAllocator> table;
+
+    ShardedHashtable( int expectedEntryCount )
+        : table( expectedEntryCount, &allocator )
+    {}
+
+    bool Get( u64 key, u64* valueOut )     { return table.Get( key, valueOut ); }
+    void Put( u64 key, u64 value )          { table.Put( key, value ); }
+};
+
+// All threads do a random mix of lookups & updates on a shared set of keys
+JOB_FUNC(EmptyJob)
+{
+    DoNotOptimize( userdata );
+}
+
+// Raw cost of scheduling & waiting on lots of tiny jobs
+static void TestJobOverhead( benchmark::State& state )
+{
+    const int batchSize = 1024;
+    Jobs::State jobs;
+    Jobs::Init( &jobs, (int)state.range(0) );
+
+    Jobs::JobDecl batch[batchSize];
+    for( Jobs::JobDecl& job : batch )
+        job = { EmptyJob, nullptr };
+
+    for( auto _ : state )
+    {
+        Jobs::Counter counter;
+        Jobs::Run( batch, batchSize, &counter );
+        Jobs::WaitForCounter( &counter );
+    }
+    state.SetItemsProcessed( state.iterations() * batchSize );
+
+    Jobs::Shutdown( &jobs );
+}
+
+JOB_FUNC(SpawnAndWaitJob)
+{
+    Jobs::Counter counter;
+    Jobs::Run( EmptyJob, nullptr, &counter );
+    Jobs::WaitForCounter( &counter );
+}
+
+// Jobs that have to wait on a child job, which suspends & resumes their fiber
+static void TestJobSuspend( benchmark::State& state )
+{
+    const int batchSize = 128;
+    Jobs::State jobs;
+    Jobs::Init( &jobs, (int)state.range(0) );
+
+    Jobs::JobDecl batch[batchSize];
+    for( Jobs::JobDecl& job : batch )
+        job = { SpawnAndWaitJob, nullptr };
+
+    for( auto _ : state )
+    {
+        Jobs::Counter counter;
+        Jobs::Run( batch, batchSize, &counter );
+        Jobs::WaitForCounter( &counter );
+    }
+    state.SetItemsProcessed( state.iterations() * batchSize );
+
+    Jobs::Shutdown( &jobs );
+}
+
+static Task<int> ChildTask( int i )
+{
+    co_return i;
+}
+
+static Task<int> ParentTask( int count )
+{
+    int result = 0;
+    for( int i = 0; i < count; ++i )
+        result += co_await ChildTask( i );
+    co_return result;
+}
+
+// Creating, awaiting & freeing tiny tasks, with frames from the default pooled heap (0) or an arena (1)
+static void TestTaskAwait( benchmark::State& state )
+{
+    const int batchSize = 1024;
+
+    MemoryArena arena;
+    InitArena( &arena );
+    Allocator allocator = Allocator::CreateFrom( &arena );
+    if( state.range(0) )
+        Tasks::SetFrameAllocator( &allocator );
+
+    for( auto _ : state )
+    {
+        Task<int> task = ParentTask( batchSize );
+        task.Start();
+        benchmark::DoNotOptimize( task.Result() );
+
+        task.Destroy();
+        if( state.range(0) )
+            ClearArena( &arena );
+    }
+    state.SetItemsProcessed( state.iterations() * batchSize );
+
+    Tasks::SetFrameAllocator( nullptr );
+    ReleaseArena( &arena );
+}
+
+// Hash a big buffer in 1MB chunks, then hash all chunk hashes together (in order)
+static void TestParallelHash( benchmark::State& state )
+{
+    const sz size = (sz)state.range(1) * 1024 * 1024;
+    Jobs::State jobs;
+    Jobs::Init( &jobs, (int)state.range(0) );
+
+    MemoryArena arena;
+    InitVirtualArena( &arena, size );
+    Buffer<u8> data( PUSH_ARRAY( &arena, u8, size, Memory::NoClear() ), size );
+    ParallelFor( data, MEGABYTES(16), []( Buffer<u8> chunk, sz first )
+    {
+        for( sz i = 0; i < chunk.length; ++i )
+            chunk.data[i] = (u8)((first + i) * 2654435761u >> 13);
+    } );
+
+    for( auto _ : state )
+    {
+        u64 hash = ParallelReduce( data, MEGABYTES(1), (u64)0, []( Buffer<u8> chunk )
+        {
+            return Hash64( chunk.data, chunk.length );
+        }, []( u64 a, u64 b )
+        {
+            u64 pair[2] = { a, b };
+            return Hash64( pair, SIZEOF(pair) );
+        } );
+        DoNotOptimize( hash );
+    }
+    state.SetBytesProcessed( state.iterations() * size );
+
+    ReleaseArena( &arena );
+    Jobs::Shutdown( &jobs );
+}
+
+// Sum the mass column of a SoA particle array
+static void TestParallelColumnSum( benchmark::State& state )
+{
+    const int N = (int)state.range(1);
+    Jobs::State jobs;
+    Jobs::Init( &jobs, (int)state.range(0) );
+
+    // Big enough that it must go back to the OS afterwards
+    MemoryArena arena;
+    InitVirtualArena( &arena, GIGABYTES(2) );
+    Allocator alloc = Allocator::CreateFrom( &arena );
+    {
+        Array<BenchParticle> particles( N, &alloc );
+        for( int i = 0; i < N; ++i )
+        {
+            BenchParticle* p = particles.PushEmpty();
+            p->mass = (f32)(i & 0xFF);
+        }
+        SoAArray<BenchParticle> soa( (Buffer<BenchParticle>)particles, &alloc );
+        Buffer<f32> masses = soa.Column( &BenchParticle::mass );
+
+        for( auto _ : state )
+        {
+            f32 total = ParallelReduce( masses, 256 * 1024, 0.f, []( Buffer<f32> chunk )
+            {
+                f32 sum = 0;
+                for( f32 m : chunk )
+                    sum += m;
+                return sum;
+            }, []( f32 a, f32 b ) { return a + b; } );
+            DoNotOptimize( total );
+        }
+        state.SetItemsProcessed( state.iterations() * N );
+        state.SetBytesProcessed( state.iterations() * N * SIZEOF(f32) );
+    }
+
+    ReleaseArena( &arena );
+    Jobs::Shutdown( &jobs );
+}
+
+template <typename T, int WritePercent>
+static void TestConcurrentHashtable( benchmark::State& state )
+{
+    static constexpr int keyCount = 64 * 1024;
+    static constexpr int batchSize = 1024;
+    static T* table;
+
+    if( state.thread_index() == 0 )
+    {
+        table = new T( keyCount );
+        for( int i = 0; i < keyCount; ++i )
+            table->Put( (u64)i + 1, (u64)i );
+    }
+
+    u32 seed = 1234u + (u32)state.thread_index();
+    for( auto _ : state )
+    {
+        u64 sum = 0;
+        for( int i = 0; i < batchSize; ++i )
+        {
+            // xorshift32
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+
+            u64 key = seed % keyCount + 1;
+            if( (int)(seed >> 16) % 100 < WritePercent )
+                table->Put( key, (u64)i );
+            else
+            {
+                u64 value = 0;
+                table->Get( key, &value );
+                sum += value;
+            }
+        }
+        DoNotOptimize( sum );
+    }
+    state.SetItemsProcessed( state.iterations() * batchSize );
+
+    if( state.thread_index() == 0 )
+        delete table;
+}
+
+
 using HashFunc = u64( void const*, sz );
 
 template <HashFunc* F>
@@ -218,13 +1120,16 @@ static void TestHashFunctionBig( benchmark::State& state )
 TEST_MUTEX(Mutex);
 TEST_MUTEX(RecursiveMutex);
 TEST_MUTEX(PlatformMutex);
+TEST_MUTEX(FutexMutex);
 
 TEST_MUTEX(Benaphore<PlatformSemaphore>);
 TEST_MUTEX(Benaphore<PreshingSemaphore>);
 TEST_MUTEX(Benaphore<Semaphore>);
+TEST_MUTEX(Benaphore<FutexSemaphore>);
 TEST_MUTEX(RecursiveBenaphore<PlatformSemaphore>);
 TEST_MUTEX(RecursiveBenaphore<PreshingSemaphore>);
 TEST_MUTEX(RecursiveBenaphore<Semaphore>);
+TEST_MUTEX(RecursiveBenaphore<FutexSemaphore>);
 
 TEST_MUTEX(SpinLockMutex);
 #endif
@@ -236,6 +1141,131 @@ BENCHMARK(TestBinarySerializer)
     ->MeasureProcessCPUTime();
 #endif
 
+#if 1
+BENCHMARK_TEMPLATE(TestSmallAllocations, LazyAllocator)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(TestSmallAllocations, PoolAllocator)
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(TestSmallAllocations, GenericHeap)
+    ->Unit(benchmark::kMicrosecond);
+#endif
+
+#define TEST_QUEUE_THROUGHPUT(T)                                            \
+    BENCHMARK_TEMPLATE(TestQueueThroughput, T)                              \
+        ->Unit(benchmark::kMicrosecond)                                     \
+        ->Threads(1)->Threads(2)->Threads(4)->Threads(8)->Threads(16)       \
+        ->UseRealTime()
+
+#if 1
+TEST_QUEUE_THROUGHPUT(LockedQueue<int>);
+TEST_QUEUE_THROUGHPUT(SyncRingBuffer<int>);
+TEST_QUEUE_THROUGHPUT(SyncQueue<int>);
+// Only one producer & one consumer
+BENCHMARK_TEMPLATE(TestQueueThroughput, SpscQueue<int>)
+    ->Unit(benchmark::kMicrosecond)
+    ->Threads(1)->Threads(2)
+    ->UseRealTime();
+BENCHMARK(TestSpscQueueBatches)
+    ->Unit(benchmark::kMicrosecond)
+    ->Threads(2)
+    ->UseRealTime();
+#endif
+
+#define TEST_CONCURRENT_ALLOCATIONS(T)                      \
+    BENCHMARK_TEMPLATE(TestConcurrentAllocations, T)        \
+        ->Unit(benchmark::kMicrosecond)                     \
+        ->Threads(1)->Threads(2)->Threads(4)->Threads(8)    \
+        ->UseRealTime()
+
+#if 1
+TEST_CONCURRENT_ALLOCATIONS(LazyAllocator);
+TEST_CONCURRENT_ALLOCATIONS(LockedGenericHeap);
+TEST_CONCURRENT_ALLOCATIONS(SyncHeap);
+#endif
+
+#define TEST_SORT(T)                                                        \
+    BENCHMARK_TEMPLATE(TestSort, T, false)                                  \
+        ->RangeMultiplier(10)->Range(1000, 100000000)                       \
+        ->Unit(benchmark::kMicrosecond);                                    \
+    BENCHMARK_TEMPLATE(TestSort, T, true)                                   \
+        ->RangeMultiplier(10)->Range(1000, 100000000)                       \
+        ->Unit(benchmark::kMicrosecond)
+
+TEST_SORT(u32);
+TEST_SORT(u64);
+TEST_SORT(f32);
+BENCHMARK_TEMPLATE(TestSortPairs, false)
+    ->RangeMultiplier(10)->Range(1000, 100000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(TestSortPairs, true)
+    ->RangeMultiplier(10)->Range(1000, 100000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(TestSortStrings, false)
+    ->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(TestSortStrings, true)
+    ->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(TestSortSmall, false)
+    ->DenseRange(4, 16, 4);
+BENCHMARK_TEMPLATE(TestSortSmall, true)
+    ->DenseRange(4, 16, 4);
+
+BENCHMARK_TEMPLATE(TestFieldScan, false)
+    ->RangeMultiplier(16)->Range(1<<10, 1<<22);
+BENCHMARK_TEMPLATE(TestFieldScan, true)
+    ->RangeMultiplier(16)->Range(1<<10, 1<<22);
+
+BENCHMARK_TEMPLATE(TestArrayGrowth, void)
+    ->RangeMultiplier(16)->Range(16, 1<<20);
+BENCHMARK_TEMPLATE(TestArrayGrowth, LazyAllocator)
+    ->RangeMultiplier(16)->Range(16, 1<<20);
+BENCHMARK_TEMPLATE(TestArrayGrowth, MemoryArena)
+    ->RangeMultiplier(16)->Range(16, 1<<20);
+
+BENCHMARK_TEMPLATE(TestSmallArrays, Array<int, CountingAllocator>)
+    ->RangeMultiplier(2)->Range(1, 32);
+BENCHMARK_TEMPLATE(TestSmallArrays, SmallArray<int, 8, CountingAllocator>)
+    ->RangeMultiplier(2)->Range(1, 32);
+
+#define TEST_HASHTABLE(T)                                                   \
+    BENCHMARK_TEMPLATE(TestHashtableInsert, T)                              \
+        ->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond);   \
+    BENCHMARK_TEMPLATE(TestHashtableLookup, T)                              \
+        ->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond)
+
+// Permille of the table that's occupied
+BENCHMARK(TestHashtableIterate)->Arg(1)->Arg(10)->Arg(100)->Arg(450)->Unit(benchmark::kMicrosecond);
+
+#if 1
+using U64Hashtable = Hashtable<u64, u64>;
+using U64FlatHashtable = FlatHashtable<u64, u64>;
+TEST_HASHTABLE(U64Hashtable);
+TEST_HASHTABLE(U64FlatHashtable);
+#endif
+
+#define TEST_CONCURRENT_HASHTABLE(T, WritePercent)                          \
+    BENCHMARK_TEMPLATE(TestConcurrentHashtable, T, WritePercent)            \
+        ->Unit(benchmark::kMicrosecond)                                     \
+        ->Threads(1)->Threads(2)->Threads(4)->Threads(8)->Threads(16)       \
+        ->UseRealTime()
+
+#if 1
+// Read-heavy
+TEST_CONCURRENT_HASHTABLE(LockedHashtable, 5);
+TEST_CONCURRENT_HASHTABLE(ShardedHashtable, 5);
+// Write-heavy
+TEST_CONCURRENT_HASHTABLE(LockedHashtable, 50);
+TEST_CONCURRENT_HASHTABLE(ShardedHashtable, 50);
+
+BENCHMARK(TestJobOverhead)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+BENCHMARK(TestJobSuspend)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+BENCHMARK(TestTaskAwait)->Arg(0)->Arg(1);
+
+// Worker count, buffer size in MB
+BENCHMARK(TestParallelHash)->ArgsProduct({ { 1, 2, 4, 8, 16, 32 }, { 4096 } })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+// Worker count, item count
+BENCHMARK(TestParallelColumnSum)->ArgsProduct({ { 1, 2, 4, 8, 16, 32 }, { 16 * 1024 * 1024 } })
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+#endif
+
 #if 0
 BENCHMARK_TEMPLATE(TestHashFunctionSmall, CompileTimeHash64);
 BENCHMARK_TEMPLATE(TestHashFunctionSmall, MurmurHash3_x64_64);
@@ -254,13 +1284,21 @@ BENCHMARK_TEMPLATE(TestHashFunctionBig, MetroHash128::Hash64Inc);
 
 int main(int argc, char** argv)
 {
+#if _WIN32
     SetUnhandledExceptionFilter( Win32::ExceptionHandler );
+#else
+    Linux::InstallDefaultCrashHandler();
+#endif
     Logging::ChannelDecl channels[] =
     {
         { "Platform" },
         { "Net" },
     };
+#if _WIN32
     Win32::InitGlobalPlatform( (Buffer<Logging::ChannelDecl>)channels );
+#else
+    Linux::InitGlobalPlatform( (Buffer<Logging::ChannelDecl>)channels );
+#endif
 
     ::benchmark::Initialize(&argc, argv);
     if (::benchmark::ReportUnrecognizedArguments(argc, argv))
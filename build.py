@@ -35,7 +35,7 @@ platform_win = Platform(
         compiler              = 'cl.exe',
         toolset               = 'CL',
         common_compiler_flags = [
-            '-nologo', '-FC', '-Oi', '-GR-', '-EHa-', '-Wall', '-WX', '-std:c++17',
+            '-nologo', '-FC', '-Oi', '-GR-', '-EHa-', '-Wall', '-WX', '-std:c++20',
             '-D_HAS_EXCEPTIONS=0', '-D_CRT_SECURE_NO_WARNINGS', '-D_HAS_TR1_NAMESPACE=1',
             '-wd4061',          # Unhandled enum case in switch
             '-wd4062',          # Unhandled enum case in switch
@@ -62,7 +62,7 @@ platform_win = Platform(
             '-wd5027',          # Move assignment implicitly deleted
             '-wd5045',          # Spectre mitigations
             ],
-        libs                  = ['dbghelp.lib', 'ws2_32.lib', 'advapi32.lib', 'shlwapi.lib'],
+        libs                  = ['dbghelp.lib', 'ws2_32.lib', 'advapi32.lib', 'shlwapi.lib', 'synchronization.lib'],
                                 #'user32.lib', 'gdi32.lib', 'winmm.lib', 'ole32.lib', 'opengl32.lib', ],
         common_linker_flags   = ['/opt:ref', '/incremental:no']
 )
@@ -82,6 +82,26 @@ platform_win_clang = platform_win._replace(
 )
 
 
+platform_linux = Platform(
+        name                  = 'linux',
+        compiler              = 'clang++',
+        toolset               = 'GCC',
+        common_compiler_flags = [
+            '-std=c++20', '-march=native', '-fno-exceptions', '-fno-rtti',
+            '-Wall',
+            '-Wno-unknown-pragmas',             # MSVC warning pragmas
+            '-Wno-missing-braces',
+            '-Wno-unused-variable',
+            '-Wno-unused-function',
+            '-Wno-missing-field-initializers',
+            '-Wno-invalid-offsetof',
+            '-Wno-int-to-pointer-cast',
+            ],
+        libs                  = ['-lpthread', '-ldl'],
+        common_linker_flags   = ['-rdynamic']   # So backtrace_symbols can resolve our own functions
+)
+
+
 
 Config = namedtuple('Configuration', ['name', 'platform', 'cmdline_opts', 'compiler_flags', 'linker_flags'])
 
@@ -109,10 +129,41 @@ config_win_release = Config(
         linker_flags   = ['/debug:full', '/LTCG']
 )
 
+config_linux_debug = Config(
+        name           = 'Debug',
+        platform       = platform_linux,
+        cmdline_opts   = ['d', 'dbg', 'debug'],
+        compiler_flags = ['-DCONFIG_DEBUG=1', '-g', '-O0'],
+        linker_flags   = []
+)
+config_linux_develop = Config(
+        name           = 'Develop',
+        platform       = platform_linux,
+        cmdline_opts   = ['dev', 'develop'],
+        compiler_flags = ['-DCONFIG_DEVELOP=1', '-g', '-O2'],
+        linker_flags   = []
+)
+config_linux_release = Config(
+        name           = 'Release',
+        platform       = platform_linux,
+        cmdline_opts   = ['r', 'rel', 'release'],
+        compiler_flags = ['-DCONFIG_RELEASE=1', '-g', '-O2'],
+        linker_flags   = []
+)
+
+all_configs = [
+    config_win_debug, config_win_develop, config_win_release,
+    config_linux_debug, config_linux_develop, config_linux_release,
+]
 
-default_config = config_win_debug
-# default_config = config_win_develop
-default_platform = platform_win
+
+if sys.platform.startswith('linux'):
+    default_config = config_linux_debug
+    default_platform = platform_linux
+else:
+    default_config = config_win_debug
+    # default_config = config_win_develop
+    default_platform = platform_win
 
 include_dirs = [
     'src',
@@ -130,6 +181,10 @@ user_libs = [
     # '3rdparty/mbedtls/lib/Release/mbedTLS.lib',
 ]
 
+# There's no prebuilt mbedTLS for Linux, so it's built from source into the bin folder the first time round
+mbedtls_src_dir = '3rdparty/mbedtls/library'
+mbedtls_linux_lib = 'libmbedtls.a'
+
 
 class colors:
     GRAY = '\033[1;30m'
@@ -158,11 +213,44 @@ def print_color(text, color_string):
 
 
 def begin_time():
-    subprocess.call(['ctime', '-begin', 'bricks.time'])
+    if shutil.which('ctime'):
+        subprocess.call(['ctime', '-begin', 'bricks.time'])
 
 def end_time():
     # TODO Check this picks up failures etc.
-    subprocess.call(['ctime', '-end', 'bricks.time'])
+    if shutil.which('ctime'):
+        subprocess.call(['ctime', '-end', 'bricks.time'])
+
+
+def find_config(platform, opt):
+    return next(c for c in all_configs if c.platform == platform and opt in c.cmdline_opts)
+
+
+def build_mbedtls_linux(rootpath, binpath, verbose):
+    libpath = os.path.join(binpath, mbedtls_linux_lib)
+    if os.path.exists(libpath):
+        return 0, libpath
+
+    print('Building mbedTLS..')
+    objpath = os.path.join(binpath, 'mbedtls')
+    if not os.path.exists(objpath):
+        os.mkdir(objpath)
+
+    srcpath = os.path.join(rootpath, mbedtls_src_dir)
+    objs = []
+    for src in sorted(fnmatch.filter(os.listdir(srcpath), '*.c')):
+        obj = os.path.join(objpath, os.path.splitext(src)[0] + '.o')
+        out_args = ['clang', '-c', '-O2', '-fPIC', f'-I{os.path.join(rootpath, "3rdparty/mbedtls/include")}',
+                    f'-I{srcpath}', os.path.join(srcpath, src), '-o', obj]
+        if verbose:
+            print_color(out_args, colors.GRAY)
+        ret = subprocess.call(out_args, cwd=binpath)
+        if ret != 0:
+            return ret, None
+        objs.append(obj)
+
+    ret = subprocess.call(['ar', 'rcs', libpath] + objs, cwd=binpath)
+    return ret, libpath
 
     
 if __name__ == '__main__':
@@ -207,11 +295,11 @@ if __name__ == '__main__':
     platform = default_platform
     config = default_config
     if in_args.debug:
-        config = config_win_debug
+        config = find_config(platform, 'debug')
     elif in_args.dev:
-        config = config_win_develop
+        config = find_config(platform, 'dev')
     elif in_args.release:
-        config = config_win_release
+        config = find_config(platform, 'release')
 
 
     ### Generate compilation database
@@ -331,6 +419,41 @@ if __name__ == '__main__':
 
             ret |= subprocess.call(out_args, cwd=binpath)
 
+        elif platform.toolset == 'GCC':
+            ret, mbedtls_lib = build_mbedtls_linux(rootpath, binpath, in_args.verbose)
+
+            targets = [
+                ('test suite', 'test/test.cpp', 'test', []),
+                ('benchmarks', 'bench/bench.cpp', 'bench', ['-lbenchmark']),
+            ]
+            for desc, src, exe, extra_libs in targets:
+                if ret != 0:
+                    break
+
+                out_args = [platform.compiler]
+                out_args.extend(platform.common_compiler_flags)
+                out_args.extend(config.compiler_flags)
+                for inc in include_dirs:
+                    # NOTE Can't use -I, as our strings.h would shadow the system one
+                    out_args.append(f'-iquote{os.path.join(rootpath, inc)}')
+                # MSVC looks for quoted includes in the folders of every file up the include chain, so mimic that for the vendored libs
+                out_args.append(f'-iquote{os.path.join(rootpath, os.path.dirname(src))}')
+                out_args.append(f'-I{os.path.join(rootpath, "3rdparty/mbedtls/include")}')
+                out_args.append(os.path.join(rootpath, src))
+                out_args.extend(['-o', exe])
+                out_args.extend(platform.common_linker_flags)
+                out_args.extend(config.linker_flags)
+                out_args.append(mbedtls_lib)
+                out_args.extend(extra_libs)
+                out_args.extend(platform.libs)
+
+                if in_args.verbose:
+                    print(f'\nBuilding {desc}...')
+                    print_color(out_args, colors.GRAY)
+                cfg_file.write(f'{desc.capitalize()} args:\n{out_args}\n\n')
+
+                ret = subprocess.call(out_args, cwd=binpath)
+
         else:
             sys.exit('Unsupported toolset')
 
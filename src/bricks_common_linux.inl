@@ -0,0 +1,25 @@
+#include "linux.h"
+
+#include "magic.h"
+#include "common.h"
+#include "intrinsics.h"
+#include "maths.h"
+#include "strings.h"
+#include "platform.h"
+#include "clock.h"
+#include "memory.h"
+#include "context.h"
+#include "threading.h"
+#include "datatypes.h"
+#include "logging.h"
+#include "jobs.h"
+#include "tasks.h"
+
+#include "common.cpp"
+#include "strings.cpp"
+#include "memory.cpp"
+#include "logging.cpp"
+#include "jobs.cpp"
+#include "tasks.cpp"
+#include "platform.cpp"
+#include "linux_platform.cpp"
@@ -15,10 +15,15 @@
 #include "threading.h"
 #include "datatypes.h"
 #include "logging.h"
+#include "jobs.h"
+#include "tasks.h"
 #include "clock.h"
 #include "strings.h"
 
 #include "common.cpp"
+#include "memory.cpp"
 #include "logging.cpp"
+#include "jobs.cpp"
+#include "tasks.cpp"
 #include "platform.cpp"
 #include "win32_platform.cpp"
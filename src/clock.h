@@ -19,10 +19,14 @@ namespace Clock
         tm* now_struct = nullptr;
         if( time_out )
         {
+#if _WIN32
             errno_t err = gmtime_s( time_out, &now );
             // TODO Check err etc
             if( !err )
                 now_struct = time_out;
+#else
+            now_struct = gmtime_r( &now, time_out );
+#endif
         }
         else
             now_struct = gmtime( &now );
@@ -11,7 +11,7 @@ Platform::API globalPlatform;
 
 // Global Context
 
-Context& GetContext()
+NOINLINE Context& GetContext()
 {
     // Cache the pointer so we dont have to call through to the platform each time
     persistent thread_local Context** globalContext = nullptr;
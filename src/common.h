@@ -74,6 +74,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #if COMPILER_MSVC
     #define INLINE __forceinline
+    #define NOINLINE __declspec(noinline)
     #if __cplusplus > 201703L || _MSVC_LANG > 201703L
         #define INLINE_LAMBDA [[msvc::forceinline]]
     #else
@@ -81,12 +82,18 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
     #endif
 #else
     #define INLINE inline __attribute__((always_inline))
+    #define NOINLINE __attribute__((noinline))
     #define INLINE_LAMBDA __attribute__((always_inline))
 #endif
 
 
-// TODO Some POSIX version of this
-#define TRAP __debugbreak()
+#if _WIN32
+    #define TRAP __debugbreak()
+#elif defined(__has_builtin) && __has_builtin(__builtin_debugtrap)
+    #define TRAP __builtin_debugtrap()
+#else
+    #define TRAP __builtin_trap()
+#endif
 
 #if CONFIG_RELEASE
 #define ASSERT(expr, ...) ((void)0)
@@ -116,8 +123,7 @@ void SetGlobalAssertHandler( AssertHandlerFunc* f );
 #if CONFIG_RELEASE
 #define DEBUGBREAK(expr) ((void)0)
 #else
-// TODO Some POSIX version of this
-#define DEBUGBREAK(expr) ((void)(expr && IsDebuggerPresent() && (__debugbreak(), 1)))
+#define DEBUGBREAK(expr) ((void)(expr && IsDebuggerPresent() && (TRAP, 1)))
 #endif
 
 #define SIZEOF(s) ((sz)sizeof(s))
@@ -232,6 +238,7 @@ typedef double   f64;
 
 typedef std::atomic<bool> atomic_bool;
 typedef std::atomic<i32> atomic_i32;
+typedef std::atomic<u32> atomic_u32;
 typedef std::atomic<i64> atomic_i64;
 typedef std::atomic<u64> atomic_u64;
 
@@ -647,7 +654,7 @@ public:
                                                                                     \
     template <typename T = valueType,                                               \
               std::enable_if_t< !std::is_same<T, InvalidValueType>() >* = nullptr>  \
-    static enumName FromValue( valueType const& value )                             \
+    static enumName FromValue( T const& value )                                     \
     {                                                                               \
         enumName result;                                                            \
         bool match = false;                                                         \
@@ -715,6 +722,7 @@ UNIQUE(Deferred) UNIQUE(_deferred_) { UNIQUE(_deferred_func_) };
 // Some forward declarations
 struct Allocator;
 struct Context;
+struct ContextStack;
 template <typename T, typename AllocType = Allocator> struct Array;
 template <typename T, typename AllocType = Allocator> struct BucketArray;
 
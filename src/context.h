@@ -5,6 +5,10 @@ namespace Logging
 {
     struct State;
 }
+namespace Jobs
+{
+    struct State;
+}
 
 // Global context to use across the entire application
 // NOTE We wanna make sure everything inside here is not generally synchronized across threads to keep it fast!
@@ -14,14 +18,25 @@ struct Context
     Allocator       tmpAllocator;
 
     Logging::State* logState;
+    // Set for the thread calling Jobs::Init and all job workers
+    Jobs::State*    jobState;
 
     // ...
     // TODO Application-defined custom data
 };
 Context InitContext( MemoryArena* mainArena, MemoryArena* tmpArena, Logging::State* logState );
 
+// Contexts pushed on top of a base one. Every thread has its own, but so does every job fiber, which the job system
+// swaps in whenever it switches to it, so the whole stack follows the fiber around from thread to thread
+struct ContextStack
+{
+    Context         entries[64];
+    Context*        top;
+};
+
 // Access the platform's thread-local Context from anywhere in the app
-Context& GetContext();
+// NOTE Never inlined, so the compiler can't reuse a thread-local address across a fiber switch
+NOINLINE Context& GetContext();
 #define CTX          ::GetContext()
 #define CTX_ALLOC    &CTX.allocator
 #define CTX_TMPALLOC &CTX.tmpAllocator
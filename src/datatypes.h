@@ -35,6 +35,8 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 // Actually, a reference to an array of any size and type somewhere in memory, so more like a 'buffer view' as it's called in do-lang
 // (although we have semantics for Push/Pop/Remove etc. so it is not read-only)
+// Arrays are fixed-size by default and will assert when they overflow, unless they're marked as growable (see DynArray below),
+// in which case they double their capacity through their allocator (in place whenever it supports that)
 
 template <typename T, typename AllocType /*= Allocator*/>
 struct Array
@@ -45,6 +47,7 @@ struct Array
 
     AllocType* allocator;
     MemoryParams memParams;
+    bool growable;
 
 
 #if 0
@@ -57,6 +60,7 @@ struct Array
         , capacity( 0 )
         , allocator( nullptr )
         , memParams{}
+        , growable( false )
     {}
 
     // NOTE All newly allocated arrays start empty
@@ -66,6 +70,7 @@ struct Array
         , capacity( capacity_ )
         , allocator( alloc )
         , memParams( params )
+        , growable( false )
     {
         ASSERT( allocator );
         data = ALLOC_ARRAY( allocator, T, capacity, memParams );
@@ -90,6 +95,7 @@ struct Array
         , capacity( bufferLen )
         , allocator( nullptr )
         , memParams{}
+        , growable( false )
     {
         ASSERT( count >= 0 && count <= capacity );
     }
@@ -148,6 +154,34 @@ struct Array
         capacity = 0;
         allocator = nullptr;
         memParams = {};
+        growable = false;
+    }
+
+    // Make room for at least the given number of items, keeping the current ones
+    void Reserve( i32 new_capacity )
+    {
+        if( new_capacity <= capacity )
+            return;
+
+        ASSERT( allocator, "Array has no allocator to grow with" );
+        data = (T*)REALLOC( allocator, data, capacity * SIZEOF(T), new_capacity * SIZEOF(T), memParams );
+        capacity = new_capacity;
+    }
+
+    // Give back any unused capacity
+    void ShrinkToFit()
+    {
+        if( !allocator || count == capacity )
+            return;
+
+        if( count == 0 )
+        {
+            FREE( allocator, data, memParams );
+            data = nullptr;
+        }
+        else
+            data = (T*)REALLOC( allocator, data, capacity * SIZEOF(T), count * SIZEOF(T), memParams );
+        capacity = count;
     }
 
 
@@ -158,6 +192,7 @@ struct Array
         capacity  = other.capacity;
         allocator = other.allocator;
         memParams = other.memParams;
+        growable  = other.growable;
 
         ZERO( other );
     }
@@ -228,7 +263,8 @@ struct Array
     // https://en.cppreference.com/w/cpp/named_req/StandardLayoutType
     T* PushEmpty( bool clear = true )
     {
-        ASSERT( count < capacity, "Array[%d] overflow", capacity );
+        if( count == capacity )
+            Grow( count + 1 );
         T* slot = data + count++;
         if( clear )
             // TODO Call constructor or clear to zero depending on std::is_trivially_copyable(T)
@@ -239,17 +275,19 @@ struct Array
 
     T* Push( const T& item )
     {
+        T const* src = GrowForItem( &item );
         T* slot = PushEmpty( false );
         // TODO Call constructor or clear to zero depending on std::is_trivially_copyable(T)
-        INIT( *slot )( item );
+        INIT( *slot )( *src );
 
         return slot;
     }
 
     T* Push( T&& item )
     {
+        T* src = (T*)GrowForItem( &item );
         T* slot = PushEmpty( false );
-        INIT( *slot )( std::move(item) );
+        INIT( *slot )( std::move(*src) );
 
         return slot;
     }
@@ -342,7 +380,15 @@ struct Array
 
     void Push( T const* buffer, int bufferLen )
     {
-        ASSERT( Available() >= bufferLen );
+        if( Available() < bufferLen )
+        {
+            // Growing may free the old block, so find the items again afterwards if they came from it
+            bool own = buffer >= data && buffer < data + count;
+            sz offset = own ? buffer - data : 0;
+            Grow( count + bufferLen );
+            if( own )
+                buffer = data + offset;
+        }
 
         COPYP( buffer, data + count, bufferLen * SIZEOF(T) );
         count += bufferLen;
@@ -354,6 +400,27 @@ struct Array
         Push( array.data, array.count );
     }
 
+    void Grow( i32 min_capacity )
+    {
+        ASSERT( growable, "Array[%d] overflow", capacity );
+        Reserve( Max( Max( capacity * 2, min_capacity ), 8 ) );
+    }
+
+private:
+    // Make room for one more item, returning where the given item is afterwards (it may be one of our own)
+    T const* GrowForItem( T const* item )
+    {
+        if( count < capacity )
+            return item;
+
+        bool own = item >= data && item < data + count;
+        sz offset = own ? item - data : 0;
+        Grow( count + 1 );
+        return own ? data + offset : item;
+    }
+
+public:
+
     // Deep copy
     template <typename AllocType2 = Allocator>
     Array<T, AllocType2> Clone( AllocType2* alloc = nullptr ) const
@@ -418,240 +485,237 @@ template <typename T, typename AllocType>
 const Array<T, AllocType> Array<T, AllocType>::Empty = {};
 #endif
 
+// Just an Array that starts out growable, so it can still be passed around as a plain Array
+// NOTE Pointers to items are invalidated whenever it grows
+template <typename T, typename AllocType = Allocator>
+struct DynArray : public Array<T, AllocType>
+{
+    explicit DynArray( i32 capacity_ = 0, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+    {
+        this->allocator = alloc;
+        this->memParams = params;
+        this->growable  = true;
+        this->Reserve( capacity_ );
+    }
+};
+
 
-/////     BUCKET ARRAY     /////
+/////     SMALL ARRAY    /////
 
-// Growable container that allocates its items in pages, or 'buckets', so no extra copying occurs whatsoever when new items get pushed.
-// The buckets themselves are indexed in a linear array, which should stay reasonably hot when iterated often, and could easily
-// be modified in a lock-free fashion for a potential multithreaded version.
-// Items are always kept compact, so iteration remains really fast. Since bucket sizes are Po2, it can be iterated using a normal integer
-// index or with the provided iterator (for new-style 'for each').
+// Growable array that keeps its first N items inline, and only goes to the allocator once it needs to hold more than that.
+// Meant for the many arrays that almost always hold just a handful of items, so they cost no allocations or extra indirections.
+// Unlike Array, it owns its items, so they're properly constructed, moved and destroyed.
+// NOTE Since the inline items live inside the object itself, pointers to them are invalidated when the array is moved
 
-// TODO Incorporate stuff & fixes from KoM's version
-// TODO Benchmark this against std::vector and the compact_vector proposed in https://www.sebastiansylvan.com/post/space-efficient-rresizable-arrays/
-// (the twitter thread https://twitter.com/andy_kelley/status/1516949533413892096?t=vEW63veywf4fqhfBfPRQSA&s=03 is quite interesting)
-template <typename T, typename AllocType /*= Allocator*/>
-struct BucketArray
+template <typename T, int N, typename AllocType = Allocator>
+struct SmallArray
 {
-    // TODO Do we wanna keep the count+capacity in the array of buckets or do we wanna put them inline with the bucket memory?
-    // (more buckets per cache line vs. dereferencing each bucket block more often)
-    struct Bucket
-    {
-        T* data;
-        i32 count;
-        i32 capacity;
-    };
+    static_assert( N > 0, "Use a plain Array instead" );
 
-    // TODO Pack this down
-    AllocType* allocator;
-    Bucket* bucketBuffer;
-    i32 bucketBufferCount;
-    i32 bucketBufferCapacity;
-    sz count;
-    // TODO Remove freelist (keep buckets in the bucket buffer unless destroy()ed)
-    T* firstFree;
-    i32 bucketCapacity;
+    T* data;
+    i32 count;
+    i32 capacity;
 
+    AllocType* allocator;
     MemoryParams memParams;
 
-
-    template <typename A>
-    struct IteratorBase
-    {
-        A array;
-        sz index;
-
-        INLINE bool             operator ==( IteratorBase<A> const& rhs ) const { return array == rhs.array && index == rhs.index; }
-        INLINE bool             operator !=( IteratorBase<A> const& rhs ) const { return array != rhs.array || index != rhs.index; }
-        INLINE IteratorBase<A>& operator ++()                                   { ++index; return *this; }
-        INLINE IteratorBase<A>  operator ++( int)                               { IteratorBase<A> result(*this); index++; return result; }
-    };
-    struct Iterator : public IteratorBase< BucketArray<T, AllocType>* >
-    {
-        INLINE T&               operator *() const                              { return (*array)[index]; }
-    };
-    struct ConstIterator : public IteratorBase< BucketArray<T, AllocType> const* >
-    {
-        INLINE T const&         operator *() const                              { return (*array)[index]; }
-    };
+    alignas(T) u8 inlineItems[ N * sizeof(T) ];
 
 
-    BucketArray( i32 bucketSize = 16, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
-        : allocator( nullptr )
-        , bucketBuffer( nullptr )
-        , bucketBufferCount( 0 )
-        , bucketBufferCapacity( 0 )
+    explicit SmallArray( AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : data( (T*)inlineItems )
         , count( 0 )
-        , firstFree( nullptr )
-    {
-        Reset( bucketSize, alloc, params );
-    }
+        , capacity( N )
+        , allocator( alloc )
+        , memParams( params )
+    {}
 
     // NOTE Move only (copy implicitly deleted)
-    BucketArray( BucketArray&& other )
-        : allocator( other.allocator )
-        , bucketBuffer( nullptr )
-        , bucketBufferCount( 0 )
-        , bucketBufferCapacity( 0 )
-        , count( 0 )
-        , firstFree( nullptr )
-        , memParams( other.memParams )
+    SmallArray( SmallArray&& other )
+        : SmallArray( other.allocator, other.memParams )
     {
         *this = std::move( other );
     }
 
-    ~BucketArray()
+    ~SmallArray()
     {
         Destroy();
     }
 
-
-    void operator =( BucketArray&& other )
+    void operator =( SmallArray&& other )
     {
-        // TODO Force a copy if not true, I guess
-        ASSERT( allocator == other.allocator );
+        if( this == &other )
+            return;
 
         Destroy();
 
-        bucketBuffer         = other.bucketBuffer;
-        bucketBufferCount    = other.bucketBufferCount;
-        bucketBufferCapacity = other.bucketBufferCapacity;
-        count                = other.count;
-        firstFree            = other.firstFree;
-        bucketCapacity       = other.bucketCapacity;
+        allocator = other.allocator;
+        memParams = other.memParams;
 
-        ZERO( other );
-    }
+        if( other.IsInline() )
+        {
+            for( int i = 0; i < other.count; ++i )
+            {
+                INIT( data[i] )( std::move( other.data[i] ) );
+                other.data[i].~T();
+            }
+            count = other.count;
+        }
+        else
+        {
+            // Just steal the buffer
+            data     = other.data;
+            count    = other.count;
+            capacity = other.capacity;
 
+            other.data     = (T*)other.inlineItems;
+            other.capacity = N;
+        }
+        other.count = 0;
+    }
 
-    // Absolutely no idea why this requires double braces on MSVC
-    INLINE Iterator         begin()          { return {{ this, 0 }}; }
-    INLINE ConstIterator    begin() const    { return {{ this, 0 }}; }
-    INLINE Iterator         end()            { return {{ this, count }}; }
-    INLINE ConstIterator    end() const      { return {{ this, count }}; }
+    void Destroy()
+    {
+        Clear();
 
-    INLINE T&          First()          { return (*this)[0]; }
-    INLINE T const&    First() const    { return (*this)[0]; }
-    INLINE T&          Last()           { return (*this)[count - 1]; }
-    INLINE T const&    Last() const     { return (*this)[count - 1]; }
+        if( !IsInline() )
+            FREE( allocator, data, memParams );
 
-    INLINE sz          Size() const     { return count * SIZEOF(T); }
-    INLINE sz          Capacity() const { return bucketBufferCount * bucketCapacity; }
-    INLINE bool        Empty() const    { return count == 0; }
+        data = (T*)inlineItems;
+        capacity = N;
+    }
 
 
-    INLINE void FindBucket( sz index, int* bucketIndex, int* indexInBucket ) const
+    INLINE explicit operator Buffer<T>()
     {
-        const int bucketShift = Log2( bucketCapacity );
-        *bucketIndex   = (int)(index >> bucketShift);
-        *indexInBucket = (int)(index & (bucketCapacity - 1));
+        return Buffer<T>( data, count );
     }
 
-    // Same as an Array, we don't allow gaps in between elements, so the given index acts as a mask of the bucket index + index in the bucket
-    INLINE T& operator []( sz index )
-    { 
-        ASSERT( index >= 0 && index < count, "BucketArray[%d] out of bounds (%d)", index, count );
+    INLINE bool        IsInline() const    { return data == (T const*)inlineItems; }
 
-        int bucketIndex, indexInBucket;
-        FindBucket( index, &bucketIndex, &indexInBucket );
+    INLINE T*          begin()             { return data; }
+    INLINE const T*    begin() const       { return data; }
+    INLINE T*          end()               { return data + count; }
+    INLINE const T*    end() const         { return data + count; }
 
-        return bucketBuffer[ bucketIndex ].data[ indexInBucket ];
-    }
-    INLINE T const& operator []( sz index ) const    
-    { 
-        return (*(BucketArray<T, AllocType>*)this)[ index ];
-    }
+    INLINE T&          First()             { ASSERT( count > 0 ); return data[0]; }
+    INLINE T const&    First() const       { ASSERT( count > 0 ); return data[0]; }
+    INLINE T&          Last()              { ASSERT( count > 0 ); return data[count - 1]; }
+    INLINE T const&    Last() const        { ASSERT( count > 0 ); return data[count - 1]; }
 
-    INLINE Bucket* GetLastBucket()
+    INLINE sz          Size() const        { return count * SIZEOF(T); }
+    INLINE bool        Empty() const       { return count == 0; }
+    INLINE i32         Available() const   { return capacity - count; }
+
+    T& operator[]( int i )
     {
-        return bucketBufferCount ? &bucketBuffer[bucketBufferCount - 1] : nullptr;
+        ASSERT( i >= 0 && i < count );
+        return data[i];
     }
 
-
-    void Reset( i32 bucketSize = 16, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+    const T& operator[]( int i ) const
     {
-        Destroy();
-
-        ASSERT( alloc );
-        allocator = alloc;
-        bucketCapacity = NextPowerOf2( bucketSize );
-        memParams = params;
-
-        ASSERT( IsPowerOf2( bucketCapacity ) );
-        // We need a minimum size to be able to chain it to the freelist when retiring
-        ASSERT( bucketCapacity * sizeof(T) >= sizeof(T*), "Bucket size too small" );
+        ASSERT( i >= 0 && i < count );
+        return data[i];
     }
 
-    void Destroy()
+    void Reserve( i32 newCapacity )
     {
-        for( int i = 0; i < bucketBufferCount; ++i )
-            FREE( allocator, bucketBuffer[i].data, memParams );
+        if( newCapacity <= capacity )
+            return;
 
-        while( firstFree )
+        ASSERT( allocator, "SmallArray needs an allocator to grow past its inline capacity" );
+        T* newData = ALLOC_ARRAY( allocator, T, newCapacity, memParams );
+        IF( std::is_trivially_copyable<T>::value )
+            memcpy( newData, data, Size() );
+        else
         {
-            T* data = firstFree;
-            firstFree = *(T**)&firstFree[0];
-
-            FREE( allocator, data, memParams );
+            for( int i = 0; i < count; ++i )
+            {
+                INIT( newData[i] )( std::move( data[i] ) );
+                data[i].~T();
+            }
         }
 
-        if( bucketBuffer )
-            FREE( allocator, bucketBuffer, memParams );
+        if( !IsInline() )
+            FREE( allocator, data, memParams );
 
-        bucketBuffer = nullptr;
-        bucketBufferCount = 0;
-        bucketBufferCapacity = 0;
-        count = 0;
-        firstFree = nullptr;
-        bucketCapacity = 0;
+        data = newData;
+        capacity = newCapacity;
     }
 
-    void Reserve( sz capacity )
+    // Default-construct any new items
+    void Resize( i32 newCount )
     {
-        if( capacity <= Capacity() )
-            return;
+        ASSERT( newCount >= 0 );
 
-        int newBucketCount = (int)((capacity + bucketCapacity - 1) / bucketCapacity);
-        GrowBucketBuffer( newBucketCount );
+        if( newCount > count )
+        {
+            Reserve( newCount );
+            for( int i = count; i < newCount; ++i )
+                INIT( data[i] )();
+        }
+        else
+        {
+            for( int i = newCount; i < count; ++i )
+                data[i].~T();
+        }
+        count = newCount;
+    }
 
-        for( int i = bucketBufferCount; i < newBucketCount; ++i )
-            AllocBucket();
+    void Clear()
+    {
+        for( int i = 0; i < count; ++i )
+            data[i].~T();
+        count = 0;
     }
 
 private:
-    // NOTE Separate any initialization calls so that only the relevant constructors
-    // are required in the user type
     INLINE T* PushInternal()
     {
-        Bucket* lastBucket = GetLastBucket();
-        if( !lastBucket || lastBucket->count == lastBucket->capacity )
-            lastBucket = AllocBucket();
+        if( count == capacity )
+            Reserve( capacity * 2 );
+        return data + count++;
+    }
 
-        T* slot = lastBucket->data + lastBucket->count++;
-        count++;
+    // Make room for one more item, returning where the given item is afterwards (it may be one of our own,
+    // which Reserve moves over to the new block)
+    T* GrowForItem( T* item )
+    {
+        if( count < capacity )
+            return item;
 
-        return slot;
+        bool own = item >= data && item < data + count;
+        sz offset = own ? item - data : 0;
+        Reserve( capacity * 2 );
+        return own ? data + offset : item;
     }
 
 public:
-    T* PushEmpty()
+    T* PushEmpty( bool clear = true )
     {
         T* slot = PushInternal();
-        INIT( *slot );
+        if( clear )
+            INIT( *slot );
+
         return slot;
     }
 
     T* Push( const T& item )
     {
+        T const* src = GrowForItem( (T*)&item );
         T* slot = PushInternal();
-        INIT( *slot )( item );
+        INIT( *slot )( *src );
+
         return slot;
     }
 
     T* Push( T&& item )
     {
+        T* src = GrowForItem( &item );
         T* slot = PushInternal();
-        INIT( *slot )( std::move(item) );
+        INIT( *slot )( std::move(*src) );
+
         return slot;
     }
 
@@ -664,2030 +728,4811 @@ public:
         return slot;
     }
 
-    void PushEmpty( int itemCount, bool clear = true )
+    void Push( T const* buffer, int bufferLen )
     {
-        Bucket* lastBucket = GetLastBucket();
-        if( !lastBucket || lastBucket->count == lastBucket->capacity )
-            lastBucket = AllocBucket();
-
-        int remaining = itemCount, itemsToAdd = 0;
-        while( remaining > 0 )
+        if( Available() < bufferLen )
         {
-            itemsToAdd = Min( remaining, lastBucket->capacity - lastBucket->count );
-            if( clear )
-                ZEROP( lastBucket->data + lastBucket->count, itemsToAdd * SIZEOF(T) );
-
-            lastBucket->count += itemsToAdd;
-            remaining -= itemsToAdd;
-
-            if( remaining )
-                lastBucket = AllocBucket();
-        }
-
-        count += itemCount;
-    }
-
-    INLINE void Push( T const* buffer, sz bufferLen )
-    {
-        Bucket* lastBucket = GetLastBucket();
-        if( !lastBucket || lastBucket->count == lastBucket->capacity )
-            lastBucket = AllocBucket();
-
-        sz remaining = bufferLen; int itemsToCopy = 0;
-        while( remaining > 0 )
-        {
-            itemsToCopy = (int)Min( remaining, (sz)lastBucket->capacity - lastBucket->count );
-            COPYP( buffer, lastBucket->data + lastBucket->count, itemsToCopy * SIZEOF(T) );
-
-            lastBucket->count += itemsToCopy;
-            buffer += itemsToCopy;
-            remaining -= itemsToCopy;
-
-            if( remaining )
-                lastBucket = AllocBucket();
+            // Our own items are moved over to the new block, so find them again afterwards
+            bool own = buffer >= data && buffer < data + count;
+            sz offset = own ? buffer - data : 0;
+            Reserve( Max( capacity * 2, count + bufferLen ) );
+            if( own )
+                buffer = data + offset;
         }
 
+        for( int i = 0; i < bufferLen; ++i )
+            INIT( data[count + i] )( buffer[i] );
         count += bufferLen;
     }
 
-    T Pop()
+    template <typename AllocType2 = Allocator>
+    void Append( Array<T, AllocType2> const& array )
     {
-        Bucket* lastBucket = GetLastBucket();
-        ASSERT( lastBucket );
-
-        int idx = --lastBucket->count;
-        T result = std::move(lastBucket->data[ idx ]);
-
-        if( idx == 0 )
-            RetireBucket( lastBucket );
-        count--;
-
-        return result;
+        Push( array.data, array.count );
     }
 
-    // TODO Remove (swap)
-    // TODO Insert
-    // TODO RemoveOrdered
-
-    void Clear()
+    template <int N2, typename AllocType2 = Allocator>
+    void Append( SmallArray<T, N2, AllocType2> const& array )
     {
-        // Add all buckets to the free list (backwards so its faster)
-        // Leave bucket 0 in place since it's probably gonna be reused anyway
-        for( int i = bucketBufferCount - 1; i > 0; --i )
-            RetireBucket( bucketBuffer + i );
-
-        if( bucketBufferCount > 0 )
-            bucketBuffer[0].count = 0;
-        count = 0;
+        Push( array.data, array.count );
     }
 
-
-    // TODO Add Find
-    // TODO Add LowerBound search (see Algorithm.h)
-
-    // Copy on top of the existing elements, without altering the total count
-    // Return how many were actually copied
-    INLINE sz CopyFrom( T* buffer, sz itemCount, sz startOffset )
+    void Remove( T* item )
     {
-        ASSERT( startOffset >= 0 );
-        ASSERT( startOffset + itemCount <= count );
-
-        int bucketIndex, indexInBucket;
-        FindBucket( startOffset, &bucketIndex, &indexInBucket );
-
-        T* bufferStart = buffer;
-        Bucket const* b = bucketBuffer + bucketIndex;
-        sz remaining = Min( itemCount, count - startOffset );
-        while( remaining > 0 )
-        {
-            sz itemsToCopy = Min( (sz)bucketCapacity - indexInBucket, remaining );
-            COPYP( buffer, b->data + indexInBucket, itemsToCopy * SIZEOF(T) );
-            indexInBucket = 0;
+        ASSERT( item >= begin() && item < end() );
 
-            buffer += itemsToCopy;
-            remaining -= itemsToCopy;
-            ++b;
-        }
+        T* last = &Last();
+        if( item != last )
+            *item = std::move( *last );
 
-        return buffer - bufferStart;
+        last->~T();
+        --count;
     }
 
-    // Return how many items were actually copied
-    // FIXME All methods using memcpy should check if the type is trivially copyable!
-    INLINE sz CopyTo( T* buffer, sz itemCount, sz startOffset = 0 ) const
+    T Pop()
     {
-        ASSERT( startOffset >= 0 );
-
-        int bucketIndex, indexInBucket;
-        FindBucket( startOffset, &bucketIndex, &indexInBucket );
-
-        T* bufferStart = buffer;
-        Bucket const* b = bucketBuffer + bucketIndex;
-        sz remaining = Min( itemCount, count - startOffset );
-        while( remaining > 0 )
-        {
-            sz itemsToCopy = Min( (sz)b->count - indexInBucket, remaining );
-            COPYP( b->data + indexInBucket, buffer, itemsToCopy * SIZEOF(T) );
-            indexInBucket = 0;
-
-            buffer += itemsToCopy;
-            remaining -= itemsToCopy;
-            ++b;
-        }
+        T result = std::move( Last() );
+        Remove( &Last() );
 
-        return buffer - bufferStart;
+        return result;
     }
 
-    template <typename AllocType2 = Allocator>
-    void CopyTo( Array<T, AllocType2>* array ) const
+    T* Find( const T& item )
     {
-        array->Reset( I32(count) );
-        array->ResizeToCapacity();
-
-        T* buffer = array->data;
-        for( int i = 0; i < bucketBufferCount; ++i )
+        for( int i = 0; i < count; ++i )
         {
-            Bucket const& b = bucketBuffer[i];
-            COPYP( b.data, buffer, b.count * SIZEOF(T) );
-            buffer += b.count;
+            if( data[i] == item )
+                return &data[i];
         }
+        return nullptr;
     }
 
-    template <typename AllocType2 = Allocator>
-    Array<T, AllocType2> CopyToArray( AllocType2* alloc = nullptr ) const
+    T const* Find( const T& item ) const
     {
-        Array<T, AllocType2> result( I32(count), alloc ? alloc : CTX_ALLOC );
-        result.ResizeToCapacity();
-        CopyTo( &result );
-
-        return result;
+        return ((SmallArray*)this)->Find( item );
     }
 
-    void MoveTo( T* buffer, sz itemCount )
+    bool Contains( T const& item ) const
     {
-        ASSERT( count <= itemCount );
+        return Find( item ) != nullptr;
+    }
 
-        for( int i = 0; i < bucketBufferCount; ++i )
+    template <class Predicate>
+    T* Find( Predicate&& p )
+    {
+        for( int i = 0; i < count; ++i )
         {
-            Bucket& b = bucketBuffer[i];
-            T* end = b.data + b.count;
-            for( T* src = b.data; src < end; src++ )
-            {
-                *buffer = std::move( *src );
-                buffer++;
-            }
+            if( p( data[i] ) )
+                return &data[i];
         }
+        return nullptr;
     }
 
-    template <typename AllocType2 = Allocator>
-    void MoveTo( Array<T, AllocType2>* array )
+    template <class Predicate>
+    T const* Find( Predicate&& p ) const
     {
-        array->Reset( I32(count) );
-        array->ResizeToCapacity();
-        MoveTo( array->begin(), array->capacity );
+        return ((SmallArray*)this)->Find( p );
     }
 
-
-    Array<Buffer<T>> const ToBufferArray() const
+    template <class Predicate>
+    bool Contains( Predicate&& p ) const
     {
-        Array<Buffer<T>> result( bucketBufferCount );
-
-        for( int i = 0; i < bucketBufferCount; ++i )
-        {
-            Bucket const& b = bucketBuffer[i];
-            result.Push( Buffer<T>( b.data, b.count ) );
-        }
-        return result;
+        return Find( p ) != nullptr;
     }
+};
 
-    Array<Buffer<>> const ToRawBufferArray() const
-    {
-        Array<Buffer<>> result( bucketBufferCount );
 
-        for( int i = 0; i < bucketBufferCount; ++i )
-        {
-            Bucket const& b = bucketBuffer[i];
-            result.Push( Buffer<>( b.data, b.count * SIZEOF(T) ) );
-        }
-        return result;
-    }
+/////     BUCKET ARRAY     /////
 
+// Growable container that allocates its items in pages, or 'buckets', so no extra copying occurs whatsoever when new items get pushed.
+// The buckets themselves are indexed in a linear array, which should stay reasonably hot when iterated often, and could easily
+// be modified in a lock-free fashion for a potential multithreaded version.
+// Items are always kept compact, so iteration remains really fast. Since bucket sizes are Po2, it can be iterated using a normal integer
+// index or with the provided iterator (for new-style 'for each').
+// For tight loops, prefer going over each bucket's items as a contiguous Buffer, using either Spans() or ForEachSpan().
 
-    u64 HashContents()
+// TODO Incorporate stuff & fixes from KoM's version
+// TODO Benchmark this against std::vector and the compact_vector proposed in https://www.sebastiansylvan.com/post/space-efficient-rresizable-arrays/
+// (the twitter thread https://twitter.com/andy_kelley/status/1516949533413892096?t=vEW63veywf4fqhfBfPRQSA&s=03 is quite interesting)
+template <typename T, typename AllocType /*= Allocator*/>
+struct BucketArray
+{
+    // TODO Do we wanna keep the count+capacity in the array of buckets or do we wanna put them inline with the bucket memory?
+    // (more buckets per cache line vs. dereferencing each bucket block more often)
+    struct Bucket
     {
-        HashBuilder h;
-        for( Bucket* b = bucketBuffer; b < bucketBuffer + bucketBufferCount; ++b )
-            HashAdd( &h, b->data, b->count * SIZEOF(T) );
+        T* data;
+        i32 count;
+        i32 capacity;
+    };
 
-        // TODO I assume this returns 0 on an empty buffer.. how do we want to signal that?
-        return Hash64( &h );
-    }
+    // TODO Pack this down
+    AllocType* allocator;
+    Bucket* bucketBuffer;
+    i32 bucketBufferCount;
+    i32 bucketBufferCapacity;
+    sz count;
+    // TODO Remove freelist (keep buckets in the bucket buffer unless destroy()ed)
+    T* firstFree;
+    i32 bucketCapacity;
+    i32 bucketShift;
 
+    MemoryParams memParams;
 
-private:
-    Bucket* AllocBucket()
+
+    template <typename A>
+    struct IteratorBase
     {
-        if( bucketBufferCount == bucketBufferCapacity )
-            GrowBucketBuffer();
+        A array;
+        sz index;
 
-        Bucket* new_bucket   = &bucketBuffer[ bucketBufferCount++ ];
-        new_bucket->data     = ALLOC_ARRAY( allocator, T, bucketCapacity, memParams );
-        new_bucket->count    = 0;
-        new_bucket->capacity = bucketCapacity;
+        INLINE bool             operator ==( IteratorBase<A> const& rhs ) const { return array == rhs.array && index == rhs.index; }
+        INLINE bool             operator !=( IteratorBase<A> const& rhs ) const { return array != rhs.array || index != rhs.index; }
+        INLINE IteratorBase<A>& operator ++()                                   { ++index; return *this; }
+        INLINE IteratorBase<A>  operator ++( int)                               { IteratorBase<A> result(*this); index++; return result; }
+    };
+    struct Iterator : public IteratorBase< BucketArray<T, AllocType>* >
+    {
+        INLINE T&               operator *() const                              { return (*this->array)[this->index]; }
+    };
+    struct ConstIterator : public IteratorBase< BucketArray<T, AllocType> const* >
+    {
+        INLINE T const&         operator *() const                              { return (*this->array)[this->index]; }
+    };
 
-        return new_bucket;
-    }
+    // Yields the items in each bucket as a single contiguous Buffer
+    struct SpanIterator
+    {
+        Bucket const* bucket;
 
-    void RetireBucket( Bucket* b )
+        INLINE bool             operator ==( SpanIterator const& rhs ) const    { return bucket == rhs.bucket; }
+        INLINE bool             operator !=( SpanIterator const& rhs ) const    { return bucket != rhs.bucket; }
+        INLINE SpanIterator&    operator ++()                                   { ++bucket; return *this; }
+        INLINE Buffer<T>        operator *() const                              { return Buffer<T>( bucket->data, bucket->count ); }
+    };
+    struct SpanRange
     {
-        // If we're the last guy just don't
-        if( b == bucketBuffer )
-            return;
+        Bucket const* first;
+        Bucket const* last;
 
-        // Stick a pointer to the next guy at the beginning of the buffer
+        INLINE SpanIterator     begin() const                                   { return { first }; }
+        INLINE SpanIterator     end() const                                     { return { last }; }
+    };
+
+
+    BucketArray( i32 bucketSize = 16, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : allocator( nullptr )
+        , bucketBuffer( nullptr )
+        , bucketBufferCount( 0 )
+        , bucketBufferCapacity( 0 )
+        , count( 0 )
+        , firstFree( nullptr )
+    {
+        Reset( bucketSize, alloc, params );
+    }
+
+    // NOTE Move only (copy implicitly deleted)
+    BucketArray( BucketArray&& other )
+        : allocator( other.allocator )
+        , bucketBuffer( nullptr )
+        , bucketBufferCount( 0 )
+        , bucketBufferCapacity( 0 )
+        , count( 0 )
+        , firstFree( nullptr )
+        , memParams( other.memParams )
+    {
+        *this = std::move( other );
+    }
+
+    ~BucketArray()
+    {
+        Destroy();
+    }
+
+
+    void operator =( BucketArray&& other )
+    {
+        // TODO Force a copy if not true, I guess
+        ASSERT( allocator == other.allocator );
+
+        Destroy();
+
+        bucketBuffer         = other.bucketBuffer;
+        bucketBufferCount    = other.bucketBufferCount;
+        bucketBufferCapacity = other.bucketBufferCapacity;
+        count                = other.count;
+        firstFree            = other.firstFree;
+        bucketCapacity       = other.bucketCapacity;
+        bucketShift          = other.bucketShift;
+
+        ZERO( other );
+    }
+
+
+    // Absolutely no idea why this requires double braces on MSVC
+    INLINE Iterator         begin()          { return {{ this, 0 }}; }
+    INLINE ConstIterator    begin() const    { return {{ this, 0 }}; }
+    INLINE Iterator         end()            { return {{ this, count }}; }
+    INLINE ConstIterator    end() const      { return {{ this, count }}; }
+
+    INLINE T&          First()          { return (*this)[0]; }
+    INLINE T const&    First() const    { return (*this)[0]; }
+    INLINE T&          Last()           { return (*this)[count - 1]; }
+    INLINE T const&    Last() const     { return (*this)[count - 1]; }
+
+    INLINE sz          Size() const     { return count * SIZEOF(T); }
+    INLINE sz          Capacity() const { return bucketBufferCount * bucketCapacity; }
+    INLINE bool        Empty() const    { return count == 0; }
+
+
+    // All buckets have the same Po2 capacity and all but the last one are always full, so this is just a shift & mask
+    INLINE void FindBucket( sz index, int* bucketIndex, int* indexInBucket ) const
+    {
+        *bucketIndex   = (int)(index >> bucketShift);
+        *indexInBucket = (int)(index & (bucketCapacity - 1));
+    }
+
+    // Same as an Array, we don't allow gaps in between elements, so the given index acts as a mask of the bucket index + index in the bucket
+    INLINE T& operator []( sz index )
+    { 
+        ASSERT( index >= 0 && index < count, "BucketArray[%d] out of bounds (%d)", index, count );
+
+        int bucketIndex, indexInBucket;
+        FindBucket( index, &bucketIndex, &indexInBucket );
+
+        return bucketBuffer[ bucketIndex ].data[ indexInBucket ];
+    }
+    INLINE T const& operator []( sz index ) const    
+    { 
+        return (*(BucketArray<T, AllocType>*)this)[ index ];
+    }
+
+    INLINE Bucket* GetLastBucket()
+    {
+        return bucketBufferCount ? &bucketBuffer[bucketBufferCount - 1] : nullptr;
+    }
+
+    INLINE SpanRange Spans() const   { return { bucketBuffer, bucketBuffer + bucketBufferCount }; }
+
+    // Call the given function with each bucket's items as a Buffer<T>
+    template <typename F>
+    INLINE void ForEachSpan( F&& callback ) const
+    {
+        for( Bucket const* b = bucketBuffer; b < bucketBuffer + bucketBufferCount; ++b )
+            if( b->count )
+                callback( Buffer<T>( b->data, b->count ) );
+    }
+
+    // Contiguous items starting at the given index up to the end of its bucket
+    INLINE Buffer<T> SpanAt( sz index ) const
+    {
+        ASSERT( index >= 0 && index < count, "BucketArray span at %d out of bounds (%d)", index, count );
+
+        int bucketIndex, indexInBucket;
+        FindBucket( index, &bucketIndex, &indexInBucket );
+
+        Bucket const& b = bucketBuffer[ bucketIndex ];
+        return Buffer<T>( b.data + indexInBucket, b.count - indexInBucket );
+    }
+
+    // Return all items as a single contiguous Buffer. If they're all in one bucket already, this is just a view into it,
+    // otherwise they're copied into a new block from the given allocator (temporary memory by default)
+    template <typename AllocType2 = Allocator>
+    Buffer<T> Linearize( AllocType2* alloc = CTX_TMPALLOC ) const
+    {
+        if( bucketBufferCount <= 1 )
+            return bucketBufferCount ? Buffer<T>( bucketBuffer[0].data, bucketBuffer[0].count ) : Buffer<T>();
+
+        T* data = ALLOC_ARRAY( alloc, T, count, Memory::NoClear() );
+        CopyTo( data, count );
+
+        return Buffer<T>( data, count );
+    }
+
+
+    void Reset( i32 bucketSize = 16, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+    {
+        Destroy();
+
+        ASSERT( alloc );
+        allocator = alloc;
+        bucketCapacity = NextPowerOf2( bucketSize );
+        bucketShift = Log2( bucketCapacity );
+        memParams = params;
+
+        ASSERT( IsPowerOf2( bucketCapacity ) );
+        // We need a minimum size to be able to chain it to the freelist when retiring
+        ASSERT( bucketCapacity * sizeof(T) >= sizeof(T*), "Bucket size too small" );
+    }
+
+    void Destroy()
+    {
+        for( int i = 0; i < bucketBufferCount; ++i )
+            FREE( allocator, bucketBuffer[i].data, memParams );
+
+        while( firstFree )
+        {
+            T* data = firstFree;
+            firstFree = *(T**)&firstFree[0];
+
+            FREE( allocator, data, memParams );
+        }
+
+        if( bucketBuffer )
+            FREE( allocator, bucketBuffer, memParams );
+
+        bucketBuffer = nullptr;
+        bucketBufferCount = 0;
+        bucketBufferCapacity = 0;
+        count = 0;
+        firstFree = nullptr;
+        bucketCapacity = 0;
+        bucketShift = 0;
+    }
+
+    void Reserve( sz capacity )
+    {
+        if( capacity <= Capacity() )
+            return;
+
+        int newBucketCount = (int)((capacity + bucketCapacity - 1) / bucketCapacity);
+        GrowBucketBuffer( newBucketCount );
+
+        for( int i = bucketBufferCount; i < newBucketCount; ++i )
+            AllocBucket();
+    }
+
+private:
+    // NOTE Separate any initialization calls so that only the relevant constructors
+    // are required in the user type
+    INLINE T* PushInternal()
+    {
+        Bucket* lastBucket = GetLastBucket();
+        if( !lastBucket || lastBucket->count == lastBucket->capacity )
+            lastBucket = AllocBucket();
+
+        T* slot = lastBucket->data + lastBucket->count++;
+        count++;
+
+        return slot;
+    }
+
+public:
+    T* PushEmpty()
+    {
+        T* slot = PushInternal();
+        INIT( *slot );
+        return slot;
+    }
+
+    T* Push( const T& item )
+    {
+        T* slot = PushInternal();
+        INIT( *slot )( item );
+        return slot;
+    }
+
+    T* Push( T&& item )
+    {
+        T* slot = PushInternal();
+        INIT( *slot )( std::move(item) );
+        return slot;
+    }
+
+    template <class... TInitArgs>
+    T* PushInit( TInitArgs&&... args )
+    {
+        T* slot = PushInternal();
+        INIT( *slot )( args... );
+
+        return slot;
+    }
+
+    void PushEmpty( int itemCount, bool clear = true )
+    {
+        Bucket* lastBucket = GetLastBucket();
+        if( !lastBucket || lastBucket->count == lastBucket->capacity )
+            lastBucket = AllocBucket();
+
+        int remaining = itemCount, itemsToAdd = 0;
+        while( remaining > 0 )
+        {
+            itemsToAdd = Min( remaining, lastBucket->capacity - lastBucket->count );
+            if( clear )
+                ZEROP( lastBucket->data + lastBucket->count, itemsToAdd * SIZEOF(T) );
+
+            lastBucket->count += itemsToAdd;
+            remaining -= itemsToAdd;
+
+            if( remaining )
+                lastBucket = AllocBucket();
+        }
+
+        count += itemCount;
+    }
+
+    INLINE void Push( T const* buffer, sz bufferLen )
+    {
+        Bucket* lastBucket = GetLastBucket();
+        if( !lastBucket || lastBucket->count == lastBucket->capacity )
+            lastBucket = AllocBucket();
+
+        sz remaining = bufferLen; int itemsToCopy = 0;
+        while( remaining > 0 )
+        {
+            itemsToCopy = (int)Min( remaining, (sz)lastBucket->capacity - lastBucket->count );
+            COPYP( buffer, lastBucket->data + lastBucket->count, itemsToCopy * SIZEOF(T) );
+
+            lastBucket->count += itemsToCopy;
+            buffer += itemsToCopy;
+            remaining -= itemsToCopy;
+
+            if( remaining )
+                lastBucket = AllocBucket();
+        }
+
+        count += bufferLen;
+    }
+
+    T Pop()
+    {
+        Bucket* lastBucket = GetLastBucket();
+        ASSERT( lastBucket );
+
+        int idx = --lastBucket->count;
+        T result = std::move(lastBucket->data[ idx ]);
+
+        if( idx == 0 )
+            RetireBucket( lastBucket );
+        count--;
+
+        return result;
+    }
+
+    // TODO Remove (swap)
+    // TODO Insert
+    // TODO RemoveOrdered
+
+    void Clear()
+    {
+        // Add all buckets to the free list (backwards so its faster)
+        // Leave bucket 0 in place since it's probably gonna be reused anyway
+        for( int i = bucketBufferCount - 1; i > 0; --i )
+            RetireBucket( bucketBuffer + i );
+
+        if( bucketBufferCount > 0 )
+            bucketBuffer[0].count = 0;
+        count = 0;
+    }
+
+
+    // TODO Add Find
+    // TODO Add LowerBound search (see Algorithm.h)
+
+    // Copy on top of the existing elements, without altering the total count
+    // Return how many were actually copied
+    INLINE sz CopyFrom( T* buffer, sz itemCount, sz startOffset )
+    {
+        ASSERT( startOffset >= 0 );
+        ASSERT( startOffset + itemCount <= count );
+
+        int bucketIndex, indexInBucket;
+        FindBucket( startOffset, &bucketIndex, &indexInBucket );
+
+        T* bufferStart = buffer;
+        Bucket const* b = bucketBuffer + bucketIndex;
+        sz remaining = Min( itemCount, count - startOffset );
+        while( remaining > 0 )
+        {
+            sz itemsToCopy = Min( (sz)bucketCapacity - indexInBucket, remaining );
+            COPYP( buffer, b->data + indexInBucket, itemsToCopy * SIZEOF(T) );
+            indexInBucket = 0;
+
+            buffer += itemsToCopy;
+            remaining -= itemsToCopy;
+            ++b;
+        }
+
+        return buffer - bufferStart;
+    }
+
+    // Return how many items were actually copied
+    // FIXME All methods using memcpy should check if the type is trivially copyable!
+    INLINE sz CopyTo( T* buffer, sz itemCount, sz startOffset = 0 ) const
+    {
+        ASSERT( startOffset >= 0 );
+
+        int bucketIndex, indexInBucket;
+        FindBucket( startOffset, &bucketIndex, &indexInBucket );
+
+        T* bufferStart = buffer;
+        Bucket const* b = bucketBuffer + bucketIndex;
+        sz remaining = Min( itemCount, count - startOffset );
+        while( remaining > 0 )
+        {
+            sz itemsToCopy = Min( (sz)b->count - indexInBucket, remaining );
+            COPYP( b->data + indexInBucket, buffer, itemsToCopy * SIZEOF(T) );
+            indexInBucket = 0;
+
+            buffer += itemsToCopy;
+            remaining -= itemsToCopy;
+            ++b;
+        }
+
+        return buffer - bufferStart;
+    }
+
+    template <typename AllocType2 = Allocator>
+    void CopyTo( Array<T, AllocType2>* array ) const
+    {
+        array->Reset( I32(count) );
+        array->ResizeToCapacity();
+
+        T* buffer = array->data;
+        for( int i = 0; i < bucketBufferCount; ++i )
+        {
+            Bucket const& b = bucketBuffer[i];
+            COPYP( b.data, buffer, b.count * SIZEOF(T) );
+            buffer += b.count;
+        }
+    }
+
+    template <typename AllocType2 = Allocator>
+    Array<T, AllocType2> CopyToArray( AllocType2* alloc = nullptr ) const
+    {
+        Array<T, AllocType2> result( I32(count), alloc ? alloc : CTX_ALLOC );
+        result.ResizeToCapacity();
+        CopyTo( &result );
+
+        return result;
+    }
+
+    void MoveTo( T* buffer, sz itemCount )
+    {
+        ASSERT( count <= itemCount );
+
+        for( int i = 0; i < bucketBufferCount; ++i )
+        {
+            Bucket& b = bucketBuffer[i];
+            T* end = b.data + b.count;
+            for( T* src = b.data; src < end; src++ )
+            {
+                *buffer = std::move( *src );
+                buffer++;
+            }
+        }
+    }
+
+    template <typename AllocType2 = Allocator>
+    void MoveTo( Array<T, AllocType2>* array )
+    {
+        array->Reset( I32(count) );
+        array->ResizeToCapacity();
+        MoveTo( array->begin(), array->capacity );
+    }
+
+
+    Array<Buffer<T>> const ToBufferArray() const
+    {
+        Array<Buffer<T>> result( bucketBufferCount );
+
+        for( int i = 0; i < bucketBufferCount; ++i )
+        {
+            Bucket const& b = bucketBuffer[i];
+            result.Push( Buffer<T>( b.data, b.count ) );
+        }
+        return result;
+    }
+
+    Array<Buffer<>> const ToRawBufferArray() const
+    {
+        Array<Buffer<>> result( bucketBufferCount );
+
+        for( int i = 0; i < bucketBufferCount; ++i )
+        {
+            Bucket const& b = bucketBuffer[i];
+            result.Push( Buffer<>( (u8*)b.data, b.count * SIZEOF(T) ) );
+        }
+        return result;
+    }
+
+
+    u64 HashContents()
+    {
+        HashBuilder h;
+        for( Bucket* b = bucketBuffer; b < bucketBuffer + bucketBufferCount; ++b )
+            HashAdd( &h, b->data, b->count * SIZEOF(T) );
+
+        // TODO I assume this returns 0 on an empty buffer.. how do we want to signal that?
+        return Hash64( &h );
+    }
+
+
+private:
+    Bucket* AllocBucket()
+    {
+        if( bucketBufferCount == bucketBufferCapacity )
+            GrowBucketBuffer();
+
+        Bucket* new_bucket   = &bucketBuffer[ bucketBufferCount++ ];
+        new_bucket->data     = ALLOC_ARRAY( allocator, T, bucketCapacity, memParams );
+        new_bucket->count    = 0;
+        new_bucket->capacity = bucketCapacity;
+
+        return new_bucket;
+    }
+
+    void RetireBucket( Bucket* b )
+    {
+        // If we're the last guy just don't
+        if( b == bucketBuffer )
+            return;
+
+        // Stick a pointer to the next guy at the beginning of the buffer
         *(T**)&b->data[0] = firstFree;
         firstFree = b->data;
 
-        // Move everybody following in the array of buckets forward
-        sz idx = b - bucketBuffer;
-        for( sz i = idx; i < bucketBufferCount - 1; ++i )
-            bucketBuffer[i] = bucketBuffer[i + 1];
+        // Move everybody following in the array of buckets forward
+        sz idx = b - bucketBuffer;
+        for( sz i = idx; i < bucketBufferCount - 1; ++i )
+            bucketBuffer[i] = bucketBuffer[i + 1];
+
+        bucketBuffer[ --bucketBufferCount ] = {};
+    }
+
+    void GrowBucketBuffer( int new_bucket_capacity = 0 )
+    {
+        new_bucket_capacity = Max( 4, new_bucket_capacity
+            ? new_bucket_capacity : bucketBufferCapacity * 2 );
+
+        Bucket* new_buffer = ALLOC_ARRAY( allocator, Bucket, new_bucket_capacity, memParams );
+        COPYP( bucketBuffer, new_buffer, bucketBufferCount * SIZEOF(Bucket) );
+
+        FREE( allocator, bucketBuffer, memParams );
+        bucketBuffer = new_buffer;
+        bucketBufferCapacity = new_bucket_capacity;
+    }
+};
+
+
+
+
+
+
+// TODO There's two conflicting views on this datatype rn:
+// 1 One would be that we want to keep it fast (both to iterate and to compact into an array), so we want to keep buckets compacted
+//   at all times, where any item removed is swapped with the last one (or subsequent items are moved down) so that we can iterate
+//   each bucket fast with just the pointer to the start of the bucket and its count.
+// 2 The second view is that this is a datatype used mainly for storage, and so we want items to keep a stable address, and be able
+//   to return an Idx/Handle to them. For that we'd need to keep items in place always, and keep something like an occupancy bitfield.
+//
+// Now, Part Pools in KoM have this same exact duality, and I think the concept of a roster used there can help, but used in the
+// opposite sense it's currently being used there.. Instead of the roster being a way to iterate consecutively even in the presence
+// of gaps in the pool, we'd much rather have the buckets be consecutive always (option 1) and use the roster as the thing that
+// a Handle points to (for option 2).
+//
+// The smart thing to do is probably separate these two objectives in two separate datatypes: BucketArray tries to be as simple as
+// possible and just compacts its items down inside each bucket, while PagedPool is composed of a BucketArray plus a roster that it
+// uses to hand out Handles to any added items (complete with generation numbers etc.)
+
+// TODO Rewrite more in the style of PagedPool in KoM (where pages are just a linear array of pointers) to make it faster to 
+// iterate & access in line with the first objective above .. BUT compacting means we can never have an index
+// Once you remove elements inside a bucket..
+//   · How does that bucket get filled up again? (insertion)
+//   · What happens when it's fully empty? (the array of page pointers gets rewritten)
+//   · BUT if we can never ref. items directly why do we need/want a linear array of pages? (easier for the page array to stay hot, easier to multithread..)
+//   · Will also need a RemoveOrdered for usage as a i.e. StringBuilder
+
+
+// TODO It seems really that the stable referencing is the true differentiating factor, and hence there's two things here:
+// - BucketArray that iterates fast by compacting but doesnt provide any means of referencing individual items
+// - PagedPool that has an occupancy mask and provides Handles (a composed index to the page + index inside the page) with gen. numbers and even naked pointers but is slower to iterate
+// We could then add:
+// - CompactPool composed of a BucketArray + roster that both iterates fast and provides storable Handles in exchange for complexity
+template <typename T, typename AllocType = Allocator>
+struct OldBucketArray
+{
+    struct Bucket
+    {
+        Bucket *next;
+        Bucket *prev;               // TODO Do we really use this?
+        AllocType* allocator;
+
+        T* data;
+        i32 count;
+        i32 capacity;
+        MemoryParams memParams;
+
+        Bucket()
+            : next( nullptr )
+            , prev( nullptr )
+            , allocator( nullptr )
+            , data( nullptr )
+            , count( 0 )
+            , capacity( 0 )
+        {}
+
+        Bucket( i32 capacity_, AllocType* alloc, MemoryParams memParams_ )
+            : next( nullptr )
+            , prev( nullptr )
+            , allocator( alloc )
+            , count( 0 )
+            , capacity( capacity_ )
+            , memParams( memParams_ )
+        {
+            ASSERT( capacity > 0 );
+            ASSERT( allocator );
+            data = ALLOC_ARRAY( allocator, T, capacity, memParams );
+        }
+
+        ~Bucket()
+        {
+            Clear();
+            FREE( allocator, data, memParams );
+        }
+
+        bool Empty() const { return count == 0; }
+
+        void Clear()
+        {
+            count = 0;
+            next = prev = nullptr;
+        }
+    };
+
+    template <typename V, typename B>
+    struct IdxBase
+    {
+        B base;
+        i32 index;
+
+        IdxBase( B base_ = nullptr, i32 index_ = 0 )
+            : base( base_ )
+            , index( index_ )
+        {}
+
+        // FIXME Additionally check that base is not in the free list
+        bool IsValid() const { return base && index >= 0 && index < base->count; }
+        explicit operator bool() const { return IsValid(); }
+
+        operator   V() const { ASSERT( IsValid() ); return base->data[index]; }
+        V operator *() const { return (V)*this; }
+
+        bool operator ==( IdxBase<V, B> const& other ) const { return base == other.base && index == other.index; }
+        bool operator !=( IdxBase<V, B> const& other ) const { return !(*this == other); }
+
+
+        void Next()
+        {
+            if( index < base->count )
+                index++;
+            // If there's no next bucket, stay at end()
+            if( index == base->count && base->next )
+            {
+                base = base->next;
+                index = 0;
+            }
+        }
+
+        IdxBase& operator ++()      { Next(); return *this; }
+        IdxBase  operator ++( int ) { IdxBase result(*this); Next(); return result; }
+
+        void Prev()
+        {
+            if( index > 0 )
+                index--;
+            // If there's no previous bucket, stay at begin()
+            if( index == 0 && base->prev )
+            {
+                base = base->prev;
+                index = base->count - 1;
+            }
+        }
+
+        IdxBase& operator --() { Prev(); return *this; }
+        IdxBase operator --( int ) { IdxBase result(*this); Prev(); return result; }
+    };
+
+    using Idx = IdxBase<T&, Bucket*>;
+    using ConstIdx = IdxBase<T const&, Bucket const*>;
+
+
+    Bucket first;
+    Bucket* last;
+    Bucket* firstFree;
+
+    AllocType* allocator;
+    MemoryParams memParams;
+    i32 count;
+
+
+#if 0
+    static const OldBucketArray<T> Empty;
+#endif
+
+    OldBucketArray()
+        : last( nullptr )
+        , firstFree( nullptr )
+        , allocator( nullptr )
+        , memParams{}
+        , count( 0 )
+    {}
+
+    explicit OldBucketArray( i32 bucketSize, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : first( bucketSize, alloc, params )
+        , last( &first )
+        , firstFree( nullptr )
+        , allocator( alloc )
+        , memParams( params )
+        , count( 0 )
+    {
+        ASSERT( allocator );
+    }
+
+    OldBucketArray( OldBucketArray<T>&& other )
+        : first( other.first )
+        , last( other.last )
+        , firstFree( other.firstFree )
+        , memParams( other.memoryParams )
+        , count( other.count )
+    {
+        other.first = {};
+        other.last = nullptr;
+        other.firstFree = nullptr;
+        other.memoryParams = {};
+        other.count = 0;
+    }
+
+    ~OldBucketArray()
+    {
+        Clear();
+        
+        while( firstFree )
+        {
+            Bucket* b = firstFree;
+            DELETE( allocator, b, Bucket, memParams );
+
+            firstFree = firstFree->next;
+        }
+    }
+
+    // Disallow implicit copying
+    OldBucketArray( const OldBucketArray& ) = delete;
+    OldBucketArray& operator =( const OldBucketArray& ) = delete;
+
+    bool        Empty() const { return count == 0; }
+
+    Idx         begin()       { return { &first, 0 }; }
+    ConstIdx    begin() const { return { &first, 0 }; }
+    Idx         end()         { return { last, last->count }; }
+    ConstIdx    end()   const { return { last, last->count }; }
+
+    Idx         Begin()       { return { &first, 0 }; }
+    ConstIdx    Begin() const { return { &first, 0 }; }
+    Idx         End()         { return { last, last->count }; }
+    ConstIdx    End()   const { return { last, last->count }; }
+    Idx         First()       { return { &first, 0 }; }
+    ConstIdx    First() const { return { &first, 0 }; }
+    Idx         Last()        { return { last, last->count - 1 }; }
+    ConstIdx    Last()  const { return { last, last->count - 1 }; }
+
+    T& operator[]( const Idx& idx ) { ASSERT( idx.IsValid() ); return (T&)idx; }
+    const T& operator[]( const ConstIdx& idx ) const { ASSERT( idx.IsValid() ); return (T const&)idx; }
+
+    template <typename AllocType2 = Allocator>
+    bool operator ==( Array<T, AllocType2> const& other ) const
+    {
+        if( count != other.count)
+            return false;
+
+        int i = 0;
+        auto idx = First(); 
+        while( idx )
+        {
+            T const& e = *idx;
+            if( e != other[i++] )
+                return false;
+
+            idx.Next();
+        }
+
+        return true;
+    }
+
+    void Clear()
+    {
+        if( last != &first )
+        {
+            // Place all chained buckets in the free list
+            last->next = firstFree;
+            firstFree = first.next;
+        }
+
+        first.Clear();
+        count = 0;
+        last = &first;
+    }
+
+    T* PushEmpty( bool clear = true )
+    {
+        if( last->count == last->capacity )
+            AddEmptyBucket();
+
+        count++;
+        T* slot = &last->data[last->count++];
+        if( clear )
+            // TODO Call constructor or clear to zero depending on std::is_trivially_copyable(T)
+            INIT( *slot );
+
+        return slot;
+    }
+
+    T* Push( const T& item )
+    {
+        T* slot = PushEmpty( false );
+        // TODO Call constructor or clear to zero depending on std::is_trivially_copyable(T)
+        INIT( *slot )( item );
+        return slot;
+    }
+
+    // TODO Test
+    // FIXME This is totally incompatible with the Idx idea
+    void Remove( const Idx& index, T* itemOut = nullptr )
+    {
+        ASSERT( index.IsValid() );
+
+        T* item = &(*index);
+        if( itemOut )
+            *itemOut = *item;
+
+        Bucket* b = index.base;
+        // If index is not pointing to last item in the bucket, swap it
+        // FIXME This is totally incompatible with the Idx idea
+        T* lastItem = &b->data[ b->count - 1 ];
+        if( item != lastItem )
+            *item = *lastItem;
+
+        lastItem->~T();
+        b->count--;
+
+        if( b->count == 0 && b != &first )
+        {
+            // Empty now, so unlink it and place it at the beginning of the free list
+            b->prev->next = b->next;
+            b->next->prev = b->prev;
+
+            // NOTE We don't maintain the prev pointer for stuff in the freelist as it seems pointless?
+            b->prev = nullptr;
+            b->next = firstFree;
+            firstFree = b;
+        }
+
+        count--;
+    }
+
+    T Pop()
+    {
+        T result;
+        Remove( Last(), &result );
+        return result;
+    }
+
+    // Inclusive
+    void PopUntil( const Idx& index )
+    {
+        while( index.IsValid() )
+            Pop();
+    }
+
+    // TODO Untested
+#if 0
+    // Not particularly fast
+    T const& At( int index ) const
+    {
+        ASSERT( index >= 0 && index < count );
+
+        Bucket const* base = &first;
+        const int bucketSize = first.count;
+
+        while( index >= bucketSize )
+        {
+            index -= bucketSize;
+            base = base->next;
+        }
+
+        return base->data[index];
+    }
+    T& At( int index )
+    {
+        return const_cast<OldBucketArray const*>(this)->At( index );
+    }
+
+    void Grow( int newCount )
+    {
+        // TODO This can be used to create gaps, which might be a problem in other situations?
+        if( newCount > count )
+        {
+            Bucket const* base = &first;
+            const int bucketSize = first.count;
+
+            int index = newCount;
+            while( index >= bucketSize )
+            {
+                index -= bucketSize;
+                if( base == last )
+                    AddEmptyBucket();
+                base = base->next;
+            }
+        }
+    }
+
+    void Resize( int newCount )
+    {
+        if( newCount > count )
+            Grow( newCount );
+        //else
+            // TODO Add invalidated buckets to freelist?
+
+        count = newCount;
+    }
+#endif
+
+    T* Find( T const& item )
+    {
+        T* result = nullptr;
+
+        auto idx = First();
+        while( idx )
+        {
+            if( cmp( item, *idx ) )
+                break;
+
+            idx.Next();
+        }
+
+        if( idx )
+            result = &*idx;
+
+        return result;
+    }
+
+    T const* Find( T const& item ) const
+    {
+        T* result = ((OldBucketArray<T, AllocType>*)this)->Find( item );
+        return result;
+    }
+
+    bool Contains( T const& item ) const
+    {
+        T const* result = Find( item );
+        return result != nullptr;
+    }
+
+    template <class Predicate>
+    T* Find( Predicate&& p )
+    {
+        T* result = nullptr;
+
+        auto idx = First();
+        while( idx )
+        {
+            if( p( *idx ) )
+                break;
+
+            idx.Next();
+        }
+
+        if( idx )
+            result = &*idx;
+
+        return result;
+    }
+
+    template <class Predicate>
+    T const* Find( Predicate&& p ) const
+    {
+        T* slot = ((OldBucketArray<T, AllocType>*)this)->Find( p );
+        return slot;
+    }
+
+    template <class Predicate>
+    bool Contains( Predicate&& p ) const
+    {
+        T const* slot = Find( p );
+        return slot != nullptr;
+    }
+
+
+    void Push( T const* buffer, int bufferLen )
+    {
+        int totalCopied = 0;
+        Bucket*& bucket = last;
+
+        while( totalCopied < bufferLen )
+        {
+            int remaining = bufferLen - totalCopied;
+            int available = bucket->capacity - bucket->count;
+
+            int copied = Min( remaining, available );
+            COPYP( buffer + totalCopied, bucket->data + bucket->count, copied * SIZEOF(T) );
+            totalCopied += copied;
+
+            bucket->count += copied;
+            if( bucket->count == bucket->capacity )
+                AddEmptyBucket();
+        }
+
+        count += totalCopied;
+    }
+
+    template <typename AllocType2 = Allocator>
+    void Append( Array<T, AllocType2> const& array )
+    {
+        Push( array.data, array.count );
+    }
+
+    void CopyTo( T* buffer, sz bufferLen ) const
+    {
+        ASSERT( count <= bufferLen );
+
+        const Bucket* bucket = &first;
+        while( bucket )
+        {
+            COPYP( bucket->data, buffer, bucket->count * SIZEOF(T) );
+            buffer += bucket->count;
+            bucket = bucket->next;
+        }
+    }
+
+    template <typename AllocType2 = Allocator>
+    void CopyTo( Array<T, AllocType2>* array ) const
+    {
+        ASSERT( count <= array->capacity );
+        array->Resize( count );
+
+        T* buffer = array->data;
+        const Bucket* bucket = &first;
+        while( bucket )
+        {
+            COPYP( bucket->data, buffer, bucket->count * SIZEOF(T) );
+            buffer += bucket->count;
+            bucket = bucket->next;
+        }
+    }
+
+    template <typename AllocType2 = Allocator>
+    Array<T, AllocType2> ToArray( AllocType2* alloc = nullptr ) const
+    {
+        Array<T, AllocType2> result( count, alloc ? alloc : CTX_ALLOC );
+        result.ResizeToCapacity();
+        CopyTo( &result );
+
+        return result;
+    }
+
+private:
+
+    void AddEmptyBucket()
+    {
+        Bucket* newBucket;
+        if( firstFree )
+        {
+            newBucket = firstFree;
+            firstFree = firstFree->next;
+            newBucket->Clear();
+        }
+        else
+        {
+            // TODO Inline this with the actual contents
+            newBucket = NEW( allocator, Bucket, memParams )( first.capacity, allocator, memParams );
+        }
+        newBucket->prev = last;
+        last->next = newBucket;
+
+        last = newBucket;
+    }
+};
+
+#if 0
+template <typename T, typename AllocType>
+const OldBucketArray<T, AllocType> OldBucketArray<T, AllocType>::Empty = {};
+#endif
+
+
+/////     SLOT MAP     /////
+
+// Pool of items addressed through generational handles instead of pointers.
+// Items are kept densely packed (so iterating them is just a linear scan), while handles go through a table of slots
+// that remembers where each item currently lives, so insert, remove and lookup are all O(1).
+// Each slot counts how many times it's been reused, and that generation is baked into its handles,
+// so a handle to an item that has since been removed (even if its slot has been reused) just fails to resolve.
+// Handles can be 32 bits (up to 1M live items, 4096 generations per slot) or 64 bits (4G items & generations).
+// NOTE Generations wrap around, so a stale handle resolves again (to whatever now lives in its slot) once the slot has been
+// reused exactly 4095 times (2^32 - 1 for 64 bit handles). Use 64 bit handles if they can be kept around for that long
+// NOTE Removing swaps the last item into the hole, so pointers to items are only valid until the next Insert or Remove
+template <typename T, typename IdType = u32, typename AllocType = Allocator>
+struct SlotMap
+{
+    static_assert( std::is_same<IdType, u32>::value || std::is_same<IdType, u64>::value, "Handles must be 32 or 64 bits" );
+
+    static constexpr int IndexBits = sizeof(IdType) == 4 ? 20 : 32;
+    static constexpr IdType IndexMask = ((IdType)1 << IndexBits) - 1;
+    static constexpr IdType GenerationMask = (IdType)~(IdType)0 >> IndexBits;
+    static constexpr u32 MaxSlots = (u32)IndexMask;
+
+    struct Handle
+    {
+        IdType id;
+
+        INLINE u32 Index() const        { return (u32)(id & IndexMask); }
+        INLINE u32 Generation() const   { return (u32)(id >> IndexBits); }
+
+        // Generations start at 1, so a zeroed handle is never valid
+        INLINE explicit operator bool() const             { return id != 0; }
+        INLINE bool operator ==( Handle const& o ) const  { return id == o.id; }
+        INLINE bool operator !=( Handle const& o ) const  { return id != o.id; }
+    };
+
+    struct Slot
+    {
+        // Index into items while the slot is in use, next free slot otherwise
+        u32 index;
+        u32 generation;
+    };
+
+
+    T* items;
+    // Slot index for each item, so we can fix up the slot of the item that gets moved around on removal
+    u32* itemSlots;
+    Slot* slots;
+
+    i32 count;
+    i32 capacity;
+    // How many slots have ever been used (the rest are untouched)
+    u32 slotCount;
+    u32 freeSlot;
+
+    AllocType* allocator;
+    MemoryParams memParams;
+
+
+    static constexpr u32 NoSlot = ~0u;
+
+    explicit SlotMap( i32 capacity_ = 0, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : items( nullptr )
+        , itemSlots( nullptr )
+        , slots( nullptr )
+        , count( 0 )
+        , capacity( 0 )
+        , slotCount( 0 )
+        , freeSlot( NoSlot )
+        , allocator( alloc )
+        , memParams( params )
+    {
+        Reserve( capacity_ );
+    }
+
+    // NOTE Move only (copy implicitly deleted)
+    SlotMap( SlotMap&& other )
+        : SlotMap( 0, other.allocator, other.memParams )
+    {
+        *this = std::move( other );
+    }
+
+    ~SlotMap()
+    {
+        Destroy();
+    }
+
+    void operator =( SlotMap&& other )
+    {
+        if( this == &other )
+            return;
+
+        Destroy();
+
+        items     = other.items;
+        itemSlots = other.itemSlots;
+        slots     = other.slots;
+        count     = other.count;
+        capacity  = other.capacity;
+        slotCount = other.slotCount;
+        freeSlot  = other.freeSlot;
+        allocator = other.allocator;
+        memParams = other.memParams;
+
+        ZERO( other );
+        other.freeSlot = NoSlot;
+    }
+
+    void Destroy()
+    {
+        for( int i = 0; i < count; ++i )
+            items[i].~T();
+
+        if( capacity )
+        {
+            FREE( allocator, items, memParams );
+            FREE( allocator, itemSlots, memParams );
+            FREE( allocator, slots, memParams );
+        }
+
+        items = nullptr;
+        itemSlots = nullptr;
+        slots = nullptr;
+        count = 0;
+        capacity = 0;
+        slotCount = 0;
+        freeSlot = NoSlot;
+    }
+
+    INLINE T*          begin()         { return items; }
+    INLINE const T*    begin() const   { return items; }
+    INLINE T*          end()           { return items + count; }
+    INLINE const T*    end() const     { return items + count; }
+
+    INLINE bool        Empty() const   { return count == 0; }
+
+    void Reserve( i32 newCapacity )
+    {
+        if( newCapacity <= capacity )
+            return;
+
+        ASSERT( (u32)newCapacity <= MaxSlots, "SlotMap can't hold more than %u items", MaxSlots );
+        ASSERT( allocator );
+        // Items are relocated bitwise, same as everywhere else
+        items     = (T*)REALLOC( allocator, items, capacity * SIZEOF(T), newCapacity * SIZEOF(T), memParams );
+        itemSlots = (u32*)REALLOC( allocator, itemSlots, capacity * SIZEOF(u32), newCapacity * SIZEOF(u32), memParams );
+        slots     = (Slot*)REALLOC( allocator, slots, capacity * SIZEOF(Slot), newCapacity * SIZEOF(Slot), memParams );
+        capacity  = newCapacity;
+    }
+
+    template <class... TInitArgs>
+    Handle Emplace( TInitArgs&&... args )
+    {
+        if( count == capacity )
+            Reserve( Max( capacity * 2, 16 ) );
+
+        u32 s = freeSlot;
+        if( s != NoSlot )
+            freeSlot = slots[s].index;
+        else
+        {
+            s = slotCount++;
+            slots[s].generation = 1;
+        }
+
+        Slot& slot = slots[s];
+        slot.index = (u32)count;
+        itemSlots[count] = s;
+        INIT( items[count] )( std::forward<TInitArgs>( args )... );
+        count++;
+
+        return MakeHandle( s, slot.generation );
+    }
+
+    // Items may come from this same map
+    INLINE Handle Insert( T const& item )  { return Emplace( *GrowForItem( (T*)&item ) ); }
+    INLINE Handle Insert( T&& item )       { return Emplace( std::move( *GrowForItem( &item ) ) ); }
+
+    // Returns null for stale or invalid handles
+    T* Get( Handle h )
+    {
+        Slot const* slot = Resolve( h );
+        return slot ? &items[slot->index] : nullptr;
+    }
+
+    T const* Get( Handle h ) const
+    {
+        return ((SlotMap*)this)->Get( h );
+    }
+
+    INLINE bool Contains( Handle h ) const
+    {
+        return Resolve( h ) != nullptr;
+    }
+
+    // Returns false if the handle was already stale
+    bool Remove( Handle h )
+    {
+        Slot* slot = (Slot*)Resolve( h );
+        if( !slot )
+            return false;
+
+        u32 index = slot->index;
+        u32 last = (u32)(count - 1);
+        if( index != last )
+        {
+            items[index] = std::move( items[last] );
+            itemSlots[index] = itemSlots[last];
+            slots[itemSlots[index]].index = index;
+        }
+        items[last].~T();
+        count--;
+
+        Release( h.Index() );
+        return true;
+    }
+
+    // Invalidates all outstanding handles
+    void Clear()
+    {
+        for( int i = 0; i < count; ++i )
+        {
+            items[i].~T();
+            Release( itemSlots[i] );
+        }
+        count = 0;
+    }
+
+    // Handle for the item at the given position in the dense array (i.e. while iterating)
+    Handle HandleAt( i32 index ) const
+    {
+        ASSERT( index >= 0 && index < count );
+        u32 s = itemSlots[index];
+        return MakeHandle( s, slots[s].generation );
+    }
+
+private:
+    // Make room for one more item, returning where the given item is afterwards (it may be one of our own)
+    T* GrowForItem( T* item )
+    {
+        if( count < capacity )
+            return item;
+
+        bool own = item >= items && item < items + count;
+        sz offset = own ? item - items : 0;
+        Reserve( Max( capacity * 2, 16 ) );
+        return own ? items + offset : item;
+    }
+
+    static INLINE Handle MakeHandle( u32 slot, u32 generation )
+    {
+        return { (IdType)slot | ((IdType)generation << IndexBits) };
+    }
+
+    INLINE Slot const* Resolve( Handle h ) const
+    {
+        u32 s = h.Index();
+        if( s >= slotCount )
+            return nullptr;
+
+        Slot const* slot = &slots[s];
+        // Free slots always have a newer generation than any of their handles
+        return slot->generation == h.Generation() ? slot : nullptr;
+    }
+
+    void Release( u32 s )
+    {
+        Slot& slot = slots[s];
+        // Generation 0 is reserved for null handles
+        slot.generation = (u32)((slot.generation + 1) & GenerationMask);
+        if( !slot.generation )
+            slot.generation = 1;
+
+        slot.index = freeSlot;
+        freeSlot = s;
+    }
+};
+
+
+/////     STRING BUILDER     /////
+
+// String builder to help compose Strings piece by piece
+// NOTE This uses temporary memory by default!
+struct StringBuilder
+{
+    BucketArray<char> buckets;
+
+    explicit StringBuilder( Allocator* allocator = CTX_TMPALLOC )
+        : buckets( 32, allocator )
+    {}
+
+    bool Empty() const { return buckets.count == 0; }
+
+    void Clear()
+    {
+        buckets.Clear();
+    }
+
+    void Append( char const* str, int length = 0 )
+    {
+        if( !length )
+            length = StringLength( str );
+
+        // Not including null terminator
+        buckets.Push( str, length );
+    }
+
+    // TODO No way to use this as it will always prefer the above!
+    template <size_t N>
+    void Append( char (&&str)[N] )
+    {
+        // Not including null terminator
+        buckets.Push( str, N - 1 );
+    }
+
+    void AppendFormat( char const* fmt, ... )
+    {
+        va_list args;
+        va_start( args, fmt );
+
+        int n = 1 + vsnprintf( nullptr, 0, fmt, args );
+        char* buf = ALLOC_ARRAY( CTX_TMPALLOC, char, n, Memory::NoClear() );
+        va_end( args );
+
+        va_start( args, fmt );
+        vsnprintf( buf, SizeT( n ), fmt, args );
+        va_end( args );
+
+        // TODO We probably want this struct to be made out of irregular buckets that are allocated exactly of the
+        // length needed for each append (n above) so we don't need this extra copy
+        buckets.Push( buf, n - 1 );
+    }
+
+    String ToString()
+    {
+        buckets.Push( '\0' );
+        return String::Clone( buckets );
+    }
+    String ToStringTmp()
+    {
+        buckets.Push( '\0' );
+        return String::CloneTmp( buckets );
+    }
+    char const* ToCStringTmp()
+    {
+        return ToStringTmp().c();
+    }
+};
+
+
+/////     BIT ARRAY     /////
+
+// Helpers working on plain arrays of 64-bit words, shared by BitSet, BitArray and the Hashtable occupancy mask.
+// Bit i lives in word i / 64 at position i % 64, and any bits past the end of the last word must always be kept clear.
+namespace Bits
+{
+    INLINE constexpr int WordCount( int bitCount )      { return (bitCount + 63) / 64; }
+    // Valid bits in the last word
+    INLINE constexpr u64 LastWordMask( int bitCount )   { return (bitCount & 63) ? ((u64)1 << (bitCount & 63)) - 1 : ~(u64)0; }
+
+    INLINE bool Test( u64 const* words, int i )         { return (words[i >> 6] >> (i & 63)) & 1; }
+    INLINE void Set( u64* words, int i )                { words[i >> 6] |= (u64)1 << (i & 63); }
+    INLINE void Clear( u64* words, int i )              { words[i >> 6] &= ~((u64)1 << (i & 63)); }
+    INLINE void Toggle( u64* words, int i )             { words[i >> 6] ^= (u64)1 << (i & 63); }
+
+    INLINE void SetAll( u64* words, int bitCount )
+    {
+        int wordCount = WordCount( bitCount );
+        if( wordCount )
+        {
+            memset( words, 0xFF, wordCount * sizeof(u64) );
+            words[wordCount - 1] = LastWordMask( bitCount );
+        }
+    }
+
+    INLINE int Count( u64 const* words, int wordCount )
+    {
+        int result = 0;
+        for( int w = 0; w < wordCount; ++w )
+            result += PopCount( words[w] );
+        return result;
+    }
+
+    INLINE bool Any( u64 const* words, int wordCount )
+    {
+        for( int w = 0; w < wordCount; ++w )
+            if( words[w] )
+                return true;
+        return false;
+    }
+
+    // Index of the first set bit at or after 'from', or -1 if there's none
+    INLINE int FindNext( u64 const* words, int bitCount, int from )
+    {
+        if( from >= bitCount )
+            return -1;
+
+        int w = from >> 6;
+        int wordCount = WordCount( bitCount );
+        u64 word = words[w] & (~(u64)0 << (from & 63));
+        while( !word )
+        {
+            if( ++w >= wordCount )
+                return -1;
+            word = words[w];
+        }
+        return (w << 6) + CountTrailingZeros( word );
+    }
+
+    // Index of the first clear bit at or after 'from', or -1 if there's none
+    INLINE int FindNextClear( u64 const* words, int bitCount, int from )
+    {
+        if( from >= bitCount )
+            return -1;
+
+        int w = from >> 6;
+        int wordCount = WordCount( bitCount );
+        u64 word = ~words[w] & (~(u64)0 << (from & 63));
+        while( !word )
+        {
+            if( ++w >= wordCount )
+                return -1;
+            word = ~words[w];
+        }
+        int result = (w << 6) + CountTrailingZeros( word );
+        return result < bitCount ? result : -1;
+    }
+
+    // Number of set bits before index i
+    INLINE int Rank( u64 const* words, int i )
+    {
+        int w = i >> 6;
+        int result = Count( words, w );
+        if( i & 63 )
+            result += PopCount( words[w] & (((u64)1 << (i & 63)) - 1) );
+        return result;
+    }
+
+    // Index of the k-th (0-based) set bit, or -1 if there's not that many
+    INLINE int Select( u64 const* words, int wordCount, int k )
+    {
+        for( int w = 0; w < wordCount; ++w )
+        {
+            int c = PopCount( words[w] );
+            if( k < c )
+                return (w << 6) + SelectBit( words[w], k );
+            k -= c;
+        }
+        return -1;
+    }
+
+
+    enum class Op
+    {
+        And,
+        Or,
+        Xor,
+        AndNot,     // a & ~b
+    };
+
+    template <Op O>
+    INLINE u64 Apply( u64 a, u64 b )
+    {
+        IF( O == Op::And )
+            return a & b;
+        else IF( O == Op::Or )
+            return a | b;
+        else IF( O == Op::Xor )
+            return a ^ b;
+        else
+            return a & ~b;
+    }
+
+#if defined(__AVX2__)
+    template <Op O>
+    INLINE __m256i Apply( __m256i a, __m256i b )
+    {
+        IF( O == Op::And )
+            return _mm256_and_si256( a, b );
+        else IF( O == Op::Or )
+            return _mm256_or_si256( a, b );
+        else IF( O == Op::Xor )
+            return _mm256_xor_si256( a, b );
+        else
+            return _mm256_andnot_si256( b, a );
+    }
+#endif
+
+    // dst = a <op> b, word by word (dst can alias either input)
+    template <Op O>
+    INLINE void Combine( u64* dst, u64 const* a, u64 const* b, int wordCount )
+    {
+        int w = 0;
+#if defined(__AVX2__)
+        for( ; w + 4 <= wordCount; w += 4 )
+        {
+            __m256i va = _mm256_loadu_si256( (__m256i const*)(a + w) );
+            __m256i vb = _mm256_loadu_si256( (__m256i const*)(b + w) );
+            _mm256_storeu_si256( (__m256i*)(dst + w), Apply<O>( va, vb ) );
+        }
+#endif
+        for( ; w < wordCount; ++w )
+            dst[w] = Apply<O>( a[w], b[w] );
+    }
+
+
+    // Walks the indices of all set bits, clearing the lowest one from a copy of the current word each step
+    struct Iterator
+    {
+        u64 const* words;
+        int wordCount;
+        int wordIndex;
+        u64 word;
+
+        Iterator( u64 const* words_, int wordCount_, int wordIndex_ )
+            : words( words_ )
+            , wordCount( wordCount_ )
+            , wordIndex( wordIndex_ )
+            , word( wordIndex_ < wordCount_ ? words_[wordIndex_] : 0 )
+        {
+            SkipEmpty();
+        }
+
+        INLINE int operator *() const                           { return (wordIndex << 6) + CountTrailingZeros( word ); }
+        INLINE bool operator !=( Iterator const& other ) const  { return word != other.word || wordIndex != other.wordIndex; }
+
+        INLINE Iterator& operator ++()
+        {
+            word &= word - 1;
+            SkipEmpty();
+            return *this;
+        }
+
+    private:
+        INLINE void SkipEmpty()
+        {
+            while( !word && wordIndex < wordCount )
+                word = ++wordIndex < wordCount ? words[wordIndex] : 0;
+        }
+    };
+}
+
+
+// Fixed-size set of N bits stored inline
+template <int N>
+struct BitSet
+{
+    static constexpr int WordCount = Bits::WordCount( N );
+
+    u64 words[WordCount];
+
+
+    BitSet()
+        : words{}
+    {}
+
+    INLINE int Size() const                 { return N; }
+
+    INLINE bool Test( int i ) const         { ASSERT( i >= 0 && i < N ); return Bits::Test( words, i ); }
+    INLINE bool operator []( int i ) const  { return Test( i ); }
+    INLINE void Set( int i )                { ASSERT( i >= 0 && i < N ); Bits::Set( words, i ); }
+    INLINE void Set( int i, bool value )    { if( value ) Set( i ); else Clear( i ); }
+    INLINE void Clear( int i )              { ASSERT( i >= 0 && i < N ); Bits::Clear( words, i ); }
+    INLINE void Toggle( int i )             { ASSERT( i >= 0 && i < N ); Bits::Toggle( words, i ); }
+
+    INLINE void SetAll()                    { Bits::SetAll( words, N ); }
+    INLINE void ClearAll()                  { ZERO( words ); }
+
+    INLINE int  Count() const               { return Bits::Count( words, WordCount ); }
+    INLINE bool Any() const                 { return Bits::Any( words, WordCount ); }
+    INLINE bool None() const                { return !Any(); }
+
+    INLINE int FindNext( int from = 0 ) const       { return Bits::FindNext( words, N, from ); }
+    INLINE int FindNextClear( int from = 0 ) const  { return Bits::FindNextClear( words, N, from ); }
+    INLINE int Rank( int i ) const                  { ASSERT( i >= 0 && i <= N ); return Bits::Rank( words, i ); }
+    INLINE int Select( int k ) const                { return Bits::Select( words, WordCount, k ); }
+
+    INLINE BitSet& operator &=( BitSet const& o )   { Bits::Combine<Bits::Op::And>( words, words, o.words, WordCount ); return *this; }
+    INLINE BitSet& operator |=( BitSet const& o )   { Bits::Combine<Bits::Op::Or>( words, words, o.words, WordCount ); return *this; }
+    INLINE BitSet& operator ^=( BitSet const& o )   { Bits::Combine<Bits::Op::Xor>( words, words, o.words, WordCount ); return *this; }
+    INLINE BitSet& AndNot( BitSet const& o )        { Bits::Combine<Bits::Op::AndNot>( words, words, o.words, WordCount ); return *this; }
+
+    INLINE bool operator ==( BitSet const& o ) const { return memcmp( words, o.words, sizeof(words) ) == 0; }
+    INLINE bool operator !=( BitSet const& o ) const { return !(*this == o); }
+
+    // Iterates the indices of all set bits
+    INLINE Bits::Iterator begin() const     { return Bits::Iterator( words, WordCount, 0 ); }
+    INLINE Bits::Iterator end() const       { return Bits::Iterator( words, WordCount, WordCount ); }
+};
+
+
+// Same as BitSet, but sized at runtime and heap allocated. New bits always start cleared.
+template <typename AllocType = Allocator>
+struct BitArray
+{
+    u64* words;
+    i32 count;          // In bits
+    i32 wordCapacity;
+
+    AllocType* allocator;
+    MemoryParams memParams;
+
+
+    explicit BitArray( i32 bitCount = 0, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : words( nullptr )
+        , count( 0 )
+        , wordCapacity( 0 )
+        , allocator( alloc )
+        , memParams( params )
+    {
+        Resize( bitCount );
+    }
+
+    // NOTE Move only (copy implicitly deleted)
+    BitArray( BitArray&& other )
+        : BitArray( 0, other.allocator, other.memParams )
+    {
+        *this = std::move( other );
+    }
+
+    ~BitArray()
+    {
+        Destroy();
+    }
+
+    void operator =( BitArray&& other )
+    {
+        if( this == &other )
+            return;
+
+        Destroy();
+
+        words        = other.words;
+        count        = other.count;
+        wordCapacity = other.wordCapacity;
+        allocator    = other.allocator;
+        memParams    = other.memParams;
+
+        ZERO( other );
+    }
+
+    void Destroy()
+    {
+        if( wordCapacity )
+            FREE( allocator, words, memParams );
+
+        words = nullptr;
+        count = 0;
+        wordCapacity = 0;
+    }
+
+    void Resize( i32 bitCount )
+    {
+        ASSERT( bitCount >= 0 );
+
+        int wordCount = Bits::WordCount( bitCount );
+        if( wordCount > wordCapacity )
+        {
+            ASSERT( allocator );
+            int newCapacity = Max( wordCount, wordCapacity * 2 );
+            words = (u64*)REALLOC( allocator, words, wordCapacity * SIZEOF(u64), newCapacity * SIZEOF(u64), memParams );
+            wordCapacity = newCapacity;
+        }
+
+        if( bitCount > count )
+        {
+            // Everything past the old count is clear already within its last word
+            int oldWordCount = Bits::WordCount( count );
+            memset( words + oldWordCount, 0, (wordCount - oldWordCount) * sizeof(u64) );
+        }
+        else if( wordCount )
+        {
+            // Keep the tail clear
+            words[wordCount - 1] &= Bits::LastWordMask( bitCount );
+        }
+        count = bitCount;
+    }
+
+    INLINE int  Size() const                { return count; }
+    INLINE int  WordCount() const           { return Bits::WordCount( count ); }
+
+    INLINE bool Test( int i ) const         { ASSERT( i >= 0 && i < count ); return Bits::Test( words, i ); }
+    INLINE bool operator []( int i ) const  { return Test( i ); }
+    INLINE void Set( int i )                { ASSERT( i >= 0 && i < count ); Bits::Set( words, i ); }
+    INLINE void Set( int i, bool value )    { if( value ) Set( i ); else Clear( i ); }
+    INLINE void Clear( int i )              { ASSERT( i >= 0 && i < count ); Bits::Clear( words, i ); }
+    INLINE void Toggle( int i )             { ASSERT( i >= 0 && i < count ); Bits::Toggle( words, i ); }
+
+    INLINE void SetAll()                    { Bits::SetAll( words, count ); }
+    INLINE void ClearAll()                  { if( count ) memset( words, 0, WordCount() * sizeof(u64) ); }
+
+    INLINE int  Count() const               { return Bits::Count( words, WordCount() ); }
+    INLINE bool Any() const                 { return Bits::Any( words, WordCount() ); }
+    INLINE bool None() const                { return !Any(); }
+
+    INLINE int FindNext( int from = 0 ) const       { return Bits::FindNext( words, count, from ); }
+    INLINE int FindNextClear( int from = 0 ) const  { return Bits::FindNextClear( words, count, from ); }
+    INLINE int Rank( int i ) const                  { ASSERT( i >= 0 && i <= count ); return Bits::Rank( words, i ); }
+    INLINE int Select( int k ) const                { return Bits::Select( words, WordCount(), k ); }
+
+    // Both sides must be the same size
+    INLINE BitArray& operator &=( BitArray const& o )   { return Combine<Bits::Op::And>( o ); }
+    INLINE BitArray& operator |=( BitArray const& o )   { return Combine<Bits::Op::Or>( o ); }
+    INLINE BitArray& operator ^=( BitArray const& o )   { return Combine<Bits::Op::Xor>( o ); }
+    INLINE BitArray& AndNot( BitArray const& o )        { return Combine<Bits::Op::AndNot>( o ); }
+
+    INLINE Bits::Iterator begin() const     { return Bits::Iterator( words, WordCount(), 0 ); }
+    INLINE Bits::Iterator end() const       { return Bits::Iterator( words, WordCount(), WordCount() ); }
+
+private:
+    template <Bits::Op O>
+    INLINE BitArray& Combine( BitArray const& o )
+    {
+        ASSERT( o.count == count );
+        Bits::Combine<O>( words, words, o.words, WordCount() );
+        return *this;
+    }
+};
+
+
+/////     HASHTABLE     /////
+
+/*
+After watching how Bitwise handles open addressing for pointer hashtables, I think I want to keep separate data structures
+for pointer-sized data vs. the rest, when generalizing this data structure to hold any type of data.
+
+So, for pointers we'd have something like:
+*/
+
+struct PtrHashtable
+{
+    struct Item
+    {
+        void* key;
+        void* value;
+    };
+
+    Item* items;
+    i32 count;
+    i32 capacity;
+};
+
+/*
+We're trying to optimize for the "hole-in-1" approach here, assuming a sufficiently good hash function, and we'll also keep the
+occupancy quite low by doing an ASSERT( count * 2 < capacity ) before each insertion, so for the few times that we don't hit
+the correct entry on the first try, it makes sense to keep the values inlined with the keys, as the correct result will be hopefully
+just a couple entries away and hence will still be in the same cache line, so we'll _hopefully_ still only have one cache miss even if
+we fail the first hit.
+
+Now, for generic keys & values, that picture changes significantly, and having both keys & values inlined is now quite probably bad
+for cache efficiency. Here then, we'd have them separate, which means a minimum of _two_ cache misses per lookup: */
+
+template <typename T>
+struct ItemHashtable
+{
+    u64* keys;
+    T* values;
+
+    i32 count;
+    i32 capacity;
+};
+
+/*
+So, for the generic case (and to be able to validate these assumptions through proper testing) we're going to want
+to be able to have either keys + values as separate or as interleaved.
+
+The problem is how to do this without having to write the code twice and without affecting performance.
+We could somehow templatize an internal structure that dictates the layout, based on the size of K and V types, but then all access
+would be through pass-through methods in that structure, which I guess is fine as long as they're inlined?
+*/
+
+template <typename K> INLINE u64  DefaultHashFunc( K const& key )           { return Hash64( &key, I32( SIZEOF(K) ) ); }
+template <typename K> INLINE bool DefaultEqFunc( K const& a, K const& b )   { return a == b; }
+
+// Some specializations
+template <> INLINE u64  DefaultHashFunc< char const* >( char const* const& key )                    { return Hash64( key, StringLength( key ) ); }
+template <> INLINE bool DefaultEqFunc< const char* >( char const* const& a, char const* const& b )  { return StringEquals( a, b ); }
+template <> INLINE u64  DefaultHashFunc< String >( String const& key )      { return key.Hash(); }
+
+
+// Which slots are in use is tracked in a separate occupancy bitmap, so any key value is allowed (including the default
+// constructed one), keys & values are only ever constructed for occupied slots, and iteration can skip empty slots 64 at a time
+template <typename K, typename V, typename AllocType = Allocator>
+struct Hashtable
+{
+    struct Item
+    {
+        K const& key;
+        V& value;
+    };
+
+    using HashFunc = u64 (*)( K const& key );
+    using KeysEqFunc = bool (*)( K const& a, K const& b );
+
+    enum Flags
+    {
+        None = 0,
+        FixedSize = 0x1,    // For stable pointers to content, must provide expectedSize as appropriate (and never Remove)
+    };
+
+
+    K* keys;
+    V* values;
+    u64* occupancy;     // One bit per slot
+
+    AllocType* allocator;
+    HashFunc hashFunc;
+    KeysEqFunc eqFunc;
+    i32 count;
+    i32 capacity;
+    u32 flags;
+
+
+    explicit Hashtable( int expectedEntryCount = 0, AllocType* alloc = CTX_ALLOC, 
+                        HashFunc hashFunc_ = DefaultHashFunc<K>, KeysEqFunc eqFunc_ = DefaultEqFunc<K>, u32 flags_ = 0 )
+        : keys( nullptr )
+        , values( nullptr )
+        , occupancy( nullptr )
+        , allocator( alloc )
+        , hashFunc( hashFunc_ )
+        , eqFunc( eqFunc_ )
+        , count( 0 )
+        , capacity( 0 )
+        , flags( flags_ )
+    {
+        ASSERT( expectedEntryCount || !(flags & FixedSize) );
+        // Can be set later, as long as it's before the first insertion
+        ASSERT( allocator || !expectedEntryCount );
+
+        if( expectedEntryCount )
+            Resize( expectedEntryCount );
+    }
+
+    // Disallow implicit copying
+    Hashtable( const Hashtable& ) = delete;
+    Hashtable& operator =( const Hashtable& ) = delete;
+
+    Hashtable( Hashtable&& rhs )
+        : allocator( rhs.allocator )
+        , flags( rhs.flags )
+    {
+        *this = std::move( rhs );
+    }
+
+
+    bool Empty() const { return count == 0; }
+
+    // TODO 
+#if 0
+    Hashtable& operator =( Hashtable&& rhs )
+    {
+        Destroy();
+
+        // FIXME We need to force a copy (or error out) when the allocators differ?
+        keys     = rhs.keys;
+        value    = rhs.value;
+        hashFunc = rhs.hashFunc;
+        eqFunc   = rhs.eqFunc;
+        count    = rhs.count;
+        capacity = rhs.capacity;
+
+        rhs.Destroy();
+
+        return *this;
+    }
+#else
+    Hashtable& operator =( Hashtable&& ) = delete;
+#endif
+
+    void Resize( int expectedEntryCount )
+    {
+        ASSERT( !(flags & FixedSize) || !capacity );
+        ASSERT( allocator );
+
+        int newCapacity = Max( NextPowerOf2( expectedEntryCount * 2 ), 16 );
+
+        int oldCapacity = capacity;
+        K* oldKeys = keys;
+        V* oldValues = values;
+        u64* oldOccupancy = occupancy;
+
+        count = 0;
+        capacity = newCapacity;
+
+        // TODO Check that generated code for instances with different allocator types is still being inlined
+        sz occupancySize = Bits::WordCount( capacity ) * SIZEOF(u64);
+        void* newMemory = ALLOC( allocator, capacity * (SIZEOF(K) + SIZEOF(V)) + occupancySize, Memory::NoClear() );
+        keys      = (K*)newMemory;
+        values    = (V*)((u8*)newMemory + capacity * SIZEOF(K));
+        occupancy = (u64*)((u8*)values + capacity * SIZEOF(V));
+        memset( occupancy, 0, occupancySize );
+
+        for( int i = Bits::FindNext( oldOccupancy, oldCapacity, 0 ); i >= 0; i = Bits::FindNext( oldOccupancy, oldCapacity, i + 1 ) )
+        {
+            // All keys are unique, so just look for the first free slot
+            u32 slot = HomeSlot( oldKeys[i] );
+            while( IsOccupied( slot ) )
+                slot = (slot + 1) & (capacity - 1);
+
+            INIT( keys[slot] )( MOVE( oldKeys[i] ) );
+            INIT( values[slot] )( MOVE( oldValues[i] ) );
+            Bits::Set( occupancy, slot );
+            oldKeys[i].~K();
+            oldValues[i].~V();
+            ++count;
+        }
+
+        FREE( allocator, oldKeys ); // Handles all
+    }
+
+    // Make sure we can hold the given number of entries without rehashing
+    void Reserve( int expectedEntryCount )
+    {
+        // Same load limit FindSlot grows at
+        if( 2 * expectedEntryCount <= capacity )
+            return;
+
+        Resize( expectedEntryCount );
+    }
+
+    // Remove all entries, but keep the allocated memory
+    void Clear()
+    {
+        for( int i = Bits::FindNext( occupancy, capacity, 0 ); i >= 0; i = Bits::FindNext( occupancy, capacity, i + 1 ) )
+        {
+            keys[i].~K();
+            values[i].~V();
+        }
+        if( capacity )
+            memset( occupancy, 0, Bits::WordCount( capacity ) * sizeof(u64) );
+        count = 0;
+    }
+
+    // Uses backward shift deletion, so there's no tombstones and lookups stay as fast as if the key was never inserted
+    // NOTE This moves other entries around, so it can't be used on FixedSize tables
+    bool Remove( K const& key )
+    {
+        ASSERT( !(flags & FixedSize), "Removing would break pointer stability" );
+        if( count == 0 )
+            return false;
+
+        u32 mask = U32( capacity - 1 );
+        u32 i = HomeSlot( key );
+        for( ;; )
+        {
+            if( !IsOccupied( i ) )
+                return false;
+            else if( eqFunc( keys[i], key ) )
+                break;
+
+            i = (i + 1) & mask;
+        }
+
+        values[i].~V();
+
+        // Shift back any following entries in the same cluster which would be unreachable otherwise
+        u32 hole = i;
+        for( u32 j = (hole + 1) & mask; IsOccupied( j ); j = (j + 1) & mask )
+        {
+            // Entries can only move towards their home slot, so leave it if the hole is before that
+            u32 home = HomeSlot( keys[j] );
+            if( ((j - home) & mask) < ((j - hole) & mask) )
+                continue;
+
+            keys[hole] = MOVE( keys[j] );
+            INIT( values[hole] )( MOVE( values[j] ) );
+            values[j].~V();
+            hole = j;
+        }
+
+        keys[hole].~K();
+        Bits::Clear( occupancy, hole );
+        --count;
+        return true;
+    }
+
+    // TODO This is all now equivalent to FindSlot?
+    V* Get( K const& key )
+    {
+        if( count == 0 )
+            return nullptr;
+
+        ASSERT( count < capacity );
+
+        u32 i = HomeSlot( key );
+
+        u32 startIdx = i;
+        for( ;; )
+        {
+            if( !IsOccupied( i ) )
+                return nullptr;
+            else if( eqFunc( keys[i], key ) )
+                return &values[i];
+
+            i++;
+            if( i == U32( capacity ) )
+                i = 0;
+            if( i == startIdx )
+            {
+                // Something went horribly wrong
+                ASSERT( false );
+                return nullptr;
+            }
+        }
+    }
+
+    V const* Get( K const& key ) const
+    {
+        return ((Hashtable<K, V, AllocType>*)this)->Get( key );
+    }
+
+private:
+    INLINE u32 HomeSlot( K const& key ) const
+    {
+        u64 hash = hashFunc( key );
+        return hash & (capacity - 1);
+    }
+
+    INLINE bool IsOccupied( u32 slot ) const
+    {
+        return Bits::Test( occupancy, (int)slot );
+    }
+
+    INLINE V* FindSlot( K const& key, bool* occupiedOut )
+    {
+        // Super conservative but easy to work with
+        // TODO Put resize check in a FindSlotForPut wrapper or something
+        if( 2 * count >= capacity )
+            Resize( 2 * count );
+
+        u32 i = HomeSlot( key );
+
+        u32 startIdx = i;
+        for( ;; )
+        {
+            if( !IsOccupied( i ) )
+            {
+                INIT( keys[i] )( key );
+                Bits::Set( occupancy, (int)i );
+                ++count;
+                *occupiedOut = false;
+                return &values[i];
+            }
+            else if( eqFunc( keys[i], key ) )
+            {
+                *occupiedOut = true;
+                return &values[i];
+            }
+
+            i++;
+            if( i == U32( capacity ) )
+                i = 0;
+            if( i == startIdx )
+            {
+                // Something went horribly wrong
+                ASSERT( false );
+                return nullptr;
+            }
+        }
+    }
+
+public:
+    V* Put( K const& key )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+        INIT( *slot )();
+        return slot;
+    }
+
+    V* Put( K const& key, V const& value )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+        INIT( *slot )( value );
+        return slot;
+    }
+
+    V* Put( K const& key, V&& value )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+        INIT( *slot )( MOVE( value ) );
+        return slot;
+    }
+
+    V* GetOrPut( K const& key, bool* occupiedOut = nullptr )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+
+        if( !occupied )
+            INIT( *slot )();
+
+        if( occupiedOut )
+            *occupiedOut = occupied;
+        return slot;
+    }
+
+    V* GetOrPut( K const& key, V const& value, bool* occupiedOut = nullptr )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+
+        if( !occupied )
+            INIT( *slot )( value );
+
+        if( occupiedOut )
+            *occupiedOut = occupied;
+        return slot;
+    }
+
+    template <typename E>
+    struct BaseIterator
+    {
+        BaseIterator( Hashtable const& table_ )
+            : table( table_ )
+        {
+            int first = Bits::FindNext( table.occupancy, table.capacity, 0 );
+            current = first >= 0 ? table.keys + first : nullptr;
+        }
+        virtual ~BaseIterator() {}
+
+        explicit operator bool() const { return current != nullptr; }
+
+        virtual E Get() const = 0;
+        E operator * () const { return Get(); }
+
+        BaseIterator& operator ++()
+        {
+            Next();
+            return *this;
+        }
+
+    protected:
+        Hashtable const& table;
+        K* current;
+
+    private:
+        void Next()
+        {
+            // Skips over whole words of empty slots at once
+            int next = Bits::FindNext( table.occupancy, table.capacity, int( current - table.keys ) + 1 );
+            current = next >= 0 ? table.keys + next : nullptr;
+        }
+    };
+
+    struct ItemIterator : public BaseIterator<Item>
+    {
+        ItemIterator( Hashtable const& table_ )
+            : BaseIterator<Item>( table_ )
+        {}
 
-        bucketBuffer[ --bucketBufferCount ] = {};
-    }
+        Item Get() const override
+        {
+            ASSERT( this->current );
+            V& currentValue = this->table.values[ this->current - this->table.keys ];
+            Hashtable::Item result = { *this->current, currentValue };
+            return result;
+        }
+    };
 
-    void GrowBucketBuffer( int new_bucket_capacity = 0 )
+    struct KeyIterator : public BaseIterator<K const&>
     {
-        new_bucket_capacity = Max( 4, new_bucket_capacity
-            ? new_bucket_capacity : bucketBufferCapacity * 2 );
+        KeyIterator( Hashtable const& table_ )
+            : BaseIterator<K const&>( table_ )
+        {}
 
-        Bucket* new_buffer = ALLOC_ARRAY( allocator, Bucket, new_bucket_capacity, memParams );
-        COPYP( bucketBuffer, new_buffer, bucketBufferCount * SIZEOF(Bucket) );
+        K const& Get() const override
+        {
+            ASSERT( this->current );
+            return *this->current;
+        }
+    };
 
-        FREE( allocator, bucketBuffer, memParams );
-        bucketBuffer = new_buffer;
-        bucketBufferCapacity = new_bucket_capacity;
-    }
-};
+    struct ValueIterator : public BaseIterator<V&>
+    {
+        ValueIterator( Hashtable const& table_ )
+            : BaseIterator<V&>( table_ )
+        {}
 
+        V& Get() const override
+        {
+            ASSERT( this->current );
+            V& currentValue = this->table.values[ this->current - this->table.keys ];
+            return currentValue;
+        }
+    };
 
+    struct ConstValueIterator : public BaseIterator<V const&>
+    {
+        ConstValueIterator( Hashtable const& table_ )
+            : BaseIterator<V const&>( table_ )
+        {}
 
+        V const& Get() const override
+        {
+            ASSERT( this->current );
+            V& currentValue = this->table.values[ this->current - this->table.keys ];
+            return currentValue;
+        }
+    };
 
+    ItemIterator Items() { return ItemIterator( *this ); }
+    KeyIterator Keys() const { return KeyIterator( *this ); }
+    ValueIterator Values() { return ValueIterator( *this ); }
+    ConstValueIterator ConstValues() const { return ConstValueIterator( *this ); }
+};
 
 
-// TODO There's two conflicting views on this datatype rn:
-// 1 One would be that we want to keep it fast (both to iterate and to compact into an array), so we want to keep buckets compacted
-//   at all times, where any item removed is swapped with the last one (or subsequent items are moved down) so that we can iterate
-//   each bucket fast with just the pointer to the start of the bucket and its count.
-// 2 The second view is that this is a datatype used mainly for storage, and so we want items to keep a stable address, and be able
-//   to return an Idx/Handle to them. For that we'd need to keep items in place always, and keep something like an occupancy bitfield.
-//
-// Now, Part Pools in KoM have this same exact duality, and I think the concept of a roster used there can help, but used in the
-// opposite sense it's currently being used there.. Instead of the roster being a way to iterate consecutively even in the presence
-// of gaps in the pool, we'd much rather have the buckets be consecutive always (option 1) and use the roster as the thing that
-// a Handle points to (for option 2).
-//
-// The smart thing to do is probably separate these two objectives in two separate datatypes: BucketArray tries to be as simple as
-// possible and just compacts its items down inside each bucket, while PagedPool is composed of a BucketArray plus a roster that it
-// uses to hand out Handles to any added items (complete with generation numbers etc.)
+/////     FLAT HASHTABLE     /////
 
-// TODO Rewrite more in the style of PagedPool in KoM (where pages are just a linear array of pointers) to make it faster to 
-// iterate & access in line with the first objective above .. BUT compacting means we can never have an index
-// Once you remove elements inside a bucket..
-//   · How does that bucket get filled up again? (insertion)
-//   · What happens when it's fully empty? (the array of page pointers gets rewritten)
-//   · BUT if we can never ref. items directly why do we need/want a linear array of pages? (easier for the page array to stay hot, easier to multithread..)
-//   · Will also need a RemoveOrdered for usage as a i.e. StringBuilder
+/*
+Open addressing in the style of Abseil's "Swiss tables". Each slot gets a 1-byte control word in a separate array, holding
+either Empty or the low 7 bits of the key's hash (H2), while the remaining bits (H1) select where probing starts.
+Probing loads a whole group of control bytes at once and compares them all against H2, so we only touch the keys array
+for what are very likely real matches, and we don't need any sentinel key (keys are only ever constructed for full slots).
 
+Groups are aligned to their width and probed quadratically (triangular numbers), which visits every group for a
+power-of-2 group count. Occupancy is kept under 7/8, so there's always an empty slot somewhere to end an unsuccessful probe.
 
-// TODO It seems really that the stable referencing is the true differentiating factor, and hence there's two things here:
-// - BucketArray that iterates fast by compacting but doesnt provide any means of referencing individual items
-// - PagedPool that has an occupancy mask and provides Handles (a composed index to the page + index inside the page) with gen. numbers and even naked pointers but is slower to iterate
-// We could then add:
-// - CompactPool composed of a BucketArray + roster that both iterates fast and provides storable Handles in exchange for complexity
-template <typename T, typename AllocType = Allocator>
-struct OldBucketArray
+Removed entries leave a Deleted marker behind only when their group is full (otherwise no probe could have gone past it).
+Tombstones count against the load factor, and are cleaned up when the table is next rehashed.
+*/
+
+namespace HashCtrl
 {
-    struct Bucket
+    enum : i8
     {
-        Bucket *next;
-        Bucket *prev;               // TODO Do we really use this?
-        AllocType* allocator;
+        Empty = -128,       // 0b10000000
+        Deleted = -2,       // 0b11111110
+        // Full slots store H2 as 0b0xxxxxxx
+    };
+}
 
-        T* data;
-        i32 count;
-        i32 capacity;
-        MemoryParams memParams;
+// A group of control bytes that can be matched in one go
+struct HashGroup
+{
+#if defined(__AVX2__)
+    static constexpr int Width = 32;
 
-        Bucket()
-            : next( nullptr )
-            , prev( nullptr )
-            , allocator( nullptr )
-            , data( nullptr )
-            , count( 0 )
-            , capacity( 0 )
-        {}
+    __m256i ctrl;
 
-        Bucket( i32 capacity_, AllocType* alloc, MemoryParams memParams_ )
-            : next( nullptr )
-            , prev( nullptr )
-            , allocator( alloc )
-            , count( 0 )
-            , capacity( capacity_ )
-            , memParams( memParams_ )
-        {
-            ASSERT( capacity > 0 );
-            ASSERT( allocator );
-            data = ALLOC_ARRAY( allocator, T, capacity, memParams );
-        }
+    explicit HashGroup( i8 const* p )
+        : ctrl( _mm256_loadu_si256( (__m256i const*)p ) )
+    {}
 
-        ~Bucket()
-        {
-            Clear();
-            FREE( allocator, data, memParams );
-        }
+    INLINE u32 Match( i8 h2 ) const
+    {
+        return (u32)_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_set1_epi8( h2 ), ctrl ) );
+    }
 
-        bool Empty() const { return count == 0; }
+    // Only non-full slots have the sign bit set
+    INLINE u32 MatchEmptyOrDeleted() const
+    {
+        return (u32)_mm256_movemask_epi8( ctrl );
+    }
 
-        void Clear()
-        {
-            count = 0;
-            next = prev = nullptr;
-        }
-    };
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    static constexpr int Width = 16;
 
-    template <typename V, typename B>
-    struct IdxBase
+    __m128i ctrl;
+
+    explicit HashGroup( i8 const* p )
+        : ctrl( _mm_loadu_si128( (__m128i const*)p ) )
+    {}
+
+    INLINE u32 Match( i8 h2 ) const
     {
-        B base;
-        i32 index;
+        return (u32)_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_set1_epi8( h2 ), ctrl ) );
+    }
 
-        IdxBase( B base_ = nullptr, i32 index_ = 0 )
-            : base( base_ )
-            , index( index_ )
-        {}
+    // Only non-full slots have the sign bit set
+    INLINE u32 MatchEmptyOrDeleted() const
+    {
+        return (u32)_mm_movemask_epi8( ctrl );
+    }
 
-        // FIXME Additionally check that base is not in the free list
-        bool IsValid() const { return base && index >= 0 && index < base->count; }
-        explicit operator bool() const { return IsValid(); }
+#else
+    static constexpr int Width = 16;
 
-        operator   V() const { ASSERT( IsValid() ); return base->data[index]; }
-        V operator *() const { return (V)*this; }
+    i8 const* ctrl;
 
-        bool operator ==( IdxBase<V, B> const& other ) const { return base == other.base && index == other.index; }
-        bool operator !=( IdxBase<V, B> const& other ) const { return !(*this == other); }
+    explicit HashGroup( i8 const* p )
+        : ctrl( p )
+    {}
 
+    INLINE u32 Match( i8 h2 ) const
+    {
+        u32 result = 0;
+        for( int i = 0; i < Width; ++i )
+            result |= (u32)(ctrl[i] == h2) << i;
+        return result;
+    }
 
-        void Next()
-        {
-            if( index < base->count )
-                index++;
-            // If there's no next bucket, stay at end()
-            if( index == base->count && base->next )
-            {
-                base = base->next;
-                index = 0;
-            }
-        }
+    INLINE u32 MatchEmptyOrDeleted() const
+    {
+        u32 result = 0;
+        for( int i = 0; i < Width; ++i )
+            result |= (u32)(ctrl[i] < 0) << i;
+        return result;
+    }
+#endif
 
-        IdxBase& operator ++()      { Next(); return *this; }
-        IdxBase  operator ++( int ) { IdxBase result(*this); Next(); return result; }
+    INLINE u32 MatchEmpty() const { return Match( HashCtrl::Empty ); }
+};
 
-        void Prev()
-        {
-            if( index > 0 )
-                index--;
-            // If there's no previous bucket, stay at begin()
-            if( index == 0 && base->prev )
-            {
-                base = base->prev;
-                index = base->count - 1;
-            }
-        }
+// Functor versions of the default hash & equality functions, so they can be inlined
+template <typename K>
+struct DefaultHasher
+{
+    INLINE u64 operator()( K const& key ) const { return DefaultHashFunc<K>( key ); }
+};
 
-        IdxBase& operator --() { Prev(); return *this; }
-        IdxBase operator --( int ) { IdxBase result(*this); Prev(); return result; }
+template <typename K>
+struct DefaultKeyEq
+{
+    INLINE bool operator()( K const& a, K const& b ) const { return DefaultEqFunc<K>( a, b ); }
+};
+
+
+template <typename K, typename V, typename HashType = DefaultHasher<K>, typename EqType = DefaultKeyEq<K>,
+          typename AllocType = Allocator>
+struct FlatHashtable
+{
+    struct Item
+    {
+        K const& key;
+        V& value;
     };
 
-    using Idx = IdxBase<T&, Bucket*>;
-    using ConstIdx = IdxBase<T const&, Bucket const*>;
+    static constexpr int GroupWidth = HashGroup::Width;
 
 
-    Bucket first;
-    Bucket* last;
-    Bucket* firstFree;
+    i8* ctrl;
+    K* keys;
+    V* values;
 
     AllocType* allocator;
-    MemoryParams memParams;
     i32 count;
+    i32 capacity;
+    i32 growthLeft;
+    HashType hasher;
+    EqType keysEqual;
 
 
-#if 0
-    static const OldBucketArray<T> Empty;
-#endif
-
-    OldBucketArray()
-        : last( nullptr )
-        , firstFree( nullptr )
-        , allocator( nullptr )
-        , memParams{}
-        , count( 0 )
-    {}
-
-    explicit OldBucketArray( i32 bucketSize, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
-        : first( bucketSize, alloc, params )
-        , last( &first )
-        , firstFree( nullptr )
+    explicit FlatHashtable( int expectedEntryCount = 0, AllocType* alloc = CTX_ALLOC )
+        : ctrl( nullptr )
+        , keys( nullptr )
+        , values( nullptr )
         , allocator( alloc )
-        , memParams( params )
         , count( 0 )
+        , capacity( 0 )
+        , growthLeft( 0 )
     {
         ASSERT( allocator );
-    }
 
-    OldBucketArray( OldBucketArray<T>&& other )
-        : first( other.first )
-        , last( other.last )
-        , firstFree( other.firstFree )
-        , memParams( other.memoryParams )
-        , count( other.count )
-    {
-        other.first = {};
-        other.last = nullptr;
-        other.firstFree = nullptr;
-        other.memoryParams = {};
-        other.count = 0;
+        if( expectedEntryCount )
+            Resize( expectedEntryCount );
     }
-
-    ~OldBucketArray()
-    {
-        Clear();
-        
-        while( firstFree )
-        {
-            Bucket* b = firstFree;
-            DELETE( allocator, b, Bucket, memParams );
-
-            firstFree = firstFree->next;
-        }
+
+    ~FlatHashtable()
+    {
+        Destroy();
     }
 
     // Disallow implicit copying
-    OldBucketArray( const OldBucketArray& ) = delete;
-    OldBucketArray& operator =( const OldBucketArray& ) = delete;
+    FlatHashtable( const FlatHashtable& ) = delete;
+    FlatHashtable& operator =( const FlatHashtable& ) = delete;
 
-    bool        Empty() const { return count == 0; }
+    FlatHashtable( FlatHashtable&& rhs )
+        : ctrl( rhs.ctrl )
+        , keys( rhs.keys )
+        , values( rhs.values )
+        , allocator( rhs.allocator )
+        , count( rhs.count )
+        , capacity( rhs.capacity )
+        , growthLeft( rhs.growthLeft )
+        , hasher( rhs.hasher )
+        , keysEqual( rhs.keysEqual )
+    {
+        rhs.ctrl = nullptr;
+        rhs.keys = nullptr;
+        rhs.values = nullptr;
+        rhs.count = rhs.capacity = rhs.growthLeft = 0;
+    }
 
-    Idx         begin()       { return { &first, 0 }; }
-    ConstIdx    begin() const { return { &first, 0 }; }
-    Idx         end()         { return { last, last->count }; }
-    ConstIdx    end()   const { return { last, last->count }; }
+    FlatHashtable& operator =( FlatHashtable&& ) = delete;
 
-    Idx         Begin()       { return { &first, 0 }; }
-    ConstIdx    Begin() const { return { &first, 0 }; }
-    Idx         End()         { return { last, last->count }; }
-    ConstIdx    End()   const { return { last, last->count }; }
-    Idx         First()       { return { &first, 0 }; }
-    ConstIdx    First() const { return { &first, 0 }; }
-    Idx         Last()        { return { last, last->count - 1 }; }
-    ConstIdx    Last()  const { return { last, last->count - 1 }; }
 
-    T& operator[]( const Idx& idx ) { ASSERT( idx.IsValid() ); return (T&)idx; }
-    const T& operator[]( const ConstIdx& idx ) const { ASSERT( idx.IsValid() ); return (T const&)idx; }
+    bool Empty() const { return count == 0; }
 
-    template <typename AllocType2 = Allocator>
-    bool operator ==( Array<T, AllocType2> const& other ) const
+    void Resize( int expectedEntryCount )
     {
-        if( count != other.count)
-            return false;
+        ASSERT( expectedEntryCount >= count );
 
-        int i = 0;
-        auto idx = First(); 
-        while( idx )
+        // Keep occupancy under 7/8
+        int newCapacity = Max( NextPowerOf2( expectedEntryCount + expectedEntryCount / 7 + 1 ), GroupWidth );
+
+        i8* oldCtrl = ctrl;
+        K* oldKeys = keys;
+        V* oldValues = values;
+        int oldCapacity = capacity;
+
+        sz keysOffset = AlignUp( (sz)newCapacity, alignof(K) );
+        sz valuesOffset = AlignUp( keysOffset + newCapacity * SIZEOF(K), alignof(V) );
+        u8* newMemory = (u8*)ALLOC( allocator, valuesOffset + newCapacity * SIZEOF(V), Memory::NoClear() );
+
+        ctrl   = (i8*)newMemory;
+        keys   = (K*)(newMemory + keysOffset);
+        values = (V*)(newMemory + valuesOffset);
+        capacity = newCapacity;
+        growthLeft = MaxLoad( capacity ) - count;
+        memset( ctrl, HashCtrl::Empty, (size_t)capacity );
+
+        // No need to compare keys, we know they're all unique
+        for( int i = 0; i < oldCapacity; ++i )
         {
-            T const& e = *idx;
-            if( e != other[i++] )
-                return false;
+            if( !IsFull( oldCtrl[i] ) )
+                continue;
 
-            idx.Next();
+            u64 hash = hasher( oldKeys[i] );
+            int slot = FindEmptySlot( hash );
+            ctrl[slot] = H2( hash );
+            INIT( keys[slot] )( MOVE( oldKeys[i] ) );
+            INIT( values[slot] )( MOVE( oldValues[i] ) );
+
+            oldKeys[i].~K();
+            oldValues[i].~V();
         }
 
-        return true;
+        FREE( allocator, oldCtrl ); // Handles all arrays
+    }
+
+    // Make sure we can hold the given number of entries without rehashing
+    void Reserve( int expectedEntryCount )
+    {
+        if( expectedEntryCount - count <= growthLeft )
+            return;
+
+        Resize( expectedEntryCount );
     }
 
+    // Remove all entries, but keep the allocated memory
     void Clear()
     {
-        if( last != &first )
+        for( int i = 0; i < capacity; ++i )
         {
-            // Place all chained buckets in the free list
-            last->next = firstFree;
-            firstFree = first.next;
+            if( IsFull( ctrl[i] ) )
+            {
+                keys[i].~K();
+                values[i].~V();
+            }
         }
+        if( capacity )
+            memset( ctrl, HashCtrl::Empty, (size_t)capacity );
 
-        first.Clear();
         count = 0;
-        last = &first;
+        growthLeft = MaxLoad( capacity );
     }
 
-    T* PushEmpty( bool clear = true )
+    bool Remove( K const& key )
     {
-        if( last->count == last->capacity )
-            AddEmptyBucket();
+        if( count == 0 )
+            return false;
 
-        count++;
-        T* slot = &last->data[last->count++];
-        if( clear )
-            // TODO Call constructor or clear to zero depending on std::is_trivially_copyable(T)
-            INIT( *slot );
+        int slot = FindKey( key, hasher( key ) );
+        if( slot < 0 )
+            return false;
 
-        return slot;
+        keys[slot].~K();
+        values[slot].~V();
+        --count;
+
+        // If the group still has empty slots, any probe reaching it would have stopped here anyway
+        int base = slot & ~(GroupWidth - 1);
+        if( HashGroup( ctrl + base ).MatchEmpty() )
+        {
+            ctrl[slot] = HashCtrl::Empty;
+            ++growthLeft;
+        }
+        else
+            ctrl[slot] = HashCtrl::Deleted;
+
+        return true;
     }
 
-    T* Push( const T& item )
+    V* Get( K const& key )
     {
-        T* slot = PushEmpty( false );
-        // TODO Call constructor or clear to zero depending on std::is_trivially_copyable(T)
-        INIT( *slot )( item );
-        return slot;
+        if( count == 0 )
+            return nullptr;
+
+        int slot = FindKey( key, hasher( key ) );
+        return slot >= 0 ? &values[slot] : nullptr;
     }
 
-    // TODO Test
-    // FIXME This is totally incompatible with the Idx idea
-    void Remove( const Idx& index, T* itemOut = nullptr )
+    V const* Get( K const& key ) const
     {
-        ASSERT( index.IsValid() );
+        return ((FlatHashtable*)this)->Get( key );
+    }
 
-        T* item = &(*index);
-        if( itemOut )
-            *itemOut = *item;
+    V* Put( K const& key )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+        if( occupied )
+            slot->~V();
+        INIT( *slot )();
+        return slot;
+    }
 
-        Bucket* b = index.base;
-        // If index is not pointing to last item in the bucket, swap it
-        // FIXME This is totally incompatible with the Idx idea
-        T* lastItem = &b->data[ b->count - 1 ];
-        if( item != lastItem )
-            *item = *lastItem;
+    V* Put( K const& key, V const& value )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+        if( occupied )
+            slot->~V();
+        INIT( *slot )( value );
+        return slot;
+    }
 
-        lastItem->~T();
-        b->count--;
+    V* Put( K const& key, V&& value )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+        if( occupied )
+            slot->~V();
+        INIT( *slot )( MOVE( value ) );
+        return slot;
+    }
 
-        if( b->count == 0 && b != &first )
-        {
-            // Empty now, so unlink it and place it at the beginning of the free list
-            b->prev->next = b->next;
-            b->next->prev = b->prev;
+    V* GetOrPut( K const& key, bool* occupiedOut = nullptr )
+    {
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
 
-            // NOTE We don't maintain the prev pointer for stuff in the freelist as it seems pointless?
-            b->prev = nullptr;
-            b->next = firstFree;
-            firstFree = b;
-        }
+        if( !occupied )
+            INIT( *slot )();
 
-        count--;
+        if( occupiedOut )
+            *occupiedOut = occupied;
+        return slot;
     }
 
-    T Pop()
+    V* GetOrPut( K const& key, V const& value, bool* occupiedOut = nullptr )
     {
-        T result;
-        Remove( Last(), &result );
-        return result;
+        bool occupied;
+        V* slot = FindSlot( key, &occupied );
+
+        if( !occupied )
+            INIT( *slot )( value );
+
+        if( occupiedOut )
+            *occupiedOut = occupied;
+        return slot;
     }
 
-    // Inclusive
-    void PopUntil( const Idx& index )
+    void Destroy()
     {
-        while( index.IsValid() )
-            Pop();
+        for( int i = 0; i < capacity; ++i )
+        {
+            if( IsFull( ctrl[i] ) )
+            {
+                keys[i].~K();
+                values[i].~V();
+            }
+        }
+        FREE( allocator, ctrl );
+
+        ctrl = nullptr;
+        keys = nullptr;
+        values = nullptr;
+        count = capacity = growthLeft = 0;
     }
 
-    // TODO Untested
-#if 0
-    // Not particularly fast
-    T const& At( int index ) const
+
+    template <typename E>
+    struct BaseIterator
     {
-        ASSERT( index >= 0 && index < count );
+        BaseIterator( FlatHashtable const& table_ )
+            : table( table_ )
+            , current( -1 )
+        {
+            Next();
+        }
 
-        Bucket const* base = &first;
-        const int bucketSize = first.count;
+        explicit operator bool() const { return current < table.capacity; }
 
-        while( index >= bucketSize )
+        BaseIterator& operator ++()
         {
-            index -= bucketSize;
-            base = base->next;
+            Next();
+            return *this;
         }
 
-        return base->data[index];
-    }
-    T& At( int index )
-    {
-        return const_cast<OldBucketArray const*>(this)->At( index );
-    }
+    protected:
+        FlatHashtable const& table;
+        int current;
 
-    void Grow( int newCount )
-    {
-        // TODO This can be used to create gaps, which might be a problem in other situations?
-        if( newCount > count )
+    private:
+        void Next()
         {
-            Bucket const* base = &first;
-            const int bucketSize = first.count;
-
-            int index = newCount;
-            while( index >= bucketSize )
+            do
             {
-                index -= bucketSize;
-                if( base == last )
-                    AddEmptyBucket();
-                base = base->next;
+                current++;
             }
+            while( current < table.capacity && !IsFull( table.ctrl[current] ) );
         }
-    }
+    };
 
-    void Resize( int newCount )
+    struct ItemIterator : public BaseIterator<Item>
     {
-        if( newCount > count )
-            Grow( newCount );
-        //else
-            // TODO Add invalidated buckets to freelist?
+        ItemIterator( FlatHashtable const& table_ )
+            : BaseIterator<Item>( table_ )
+        {}
 
-        count = newCount;
-    }
-#endif
+        Item operator * () const
+        {
+            ASSERT( *this );
+            Item result = { this->table.keys[this->current], this->table.values[this->current] };
+            return result;
+        }
+    };
+
+    struct KeyIterator : public BaseIterator<K const&>
+    {
+        KeyIterator( FlatHashtable const& table_ )
+            : BaseIterator<K const&>( table_ )
+        {}
+
+        K const& operator * () const
+        {
+            ASSERT( *this );
+            return this->table.keys[this->current];
+        }
+    };
+
+    struct ValueIterator : public BaseIterator<V&>
+    {
+        ValueIterator( FlatHashtable const& table_ )
+            : BaseIterator<V&>( table_ )
+        {}
+
+        V& operator * () const
+        {
+            ASSERT( *this );
+            return this->table.values[this->current];
+        }
+    };
+
+    ItemIterator Items() { return ItemIterator( *this ); }
+    KeyIterator Keys() const { return KeyIterator( *this ); }
+    ValueIterator Values() { return ValueIterator( *this ); }
+
+private:
+    static INLINE bool IsFull( i8 c )           { return c >= 0; }
+    static INLINE int MaxLoad( int capacity_ )  { return capacity_ - capacity_ / 8; }
+    static INLINE u64 H1( u64 hash )            { return hash >> 7; }
+    static INLINE i8 H2( u64 hash )             { return (i8)(hash & 0x7F); }
 
-    T* Find( T const& item )
+    INLINE int GroupMask() const                { return capacity / GroupWidth - 1; }
+
+    INLINE int FindKey( K const& key, u64 hash ) const
     {
-        T* result = nullptr;
+        i8 h2 = H2( hash );
+        int mask = GroupMask();
+        int g = (int)(H1( hash ) & (u64)mask);
 
-        auto idx = First();
-        while( idx )
+        for( int step = 1; ; ++step )
         {
-            if( cmp( item, *idx ) )
-                break;
-
-            idx.Next();
-        }
+            int base = g * GroupWidth;
+            HashGroup group( ctrl + base );
 
-        if( idx )
-            result = &*idx;
+            for( u32 m = group.Match( h2 ); m; m &= m - 1 )
+            {
+                int slot = base + LowestSetBit( m );
+                if( keysEqual( keys[slot], key ) )
+                    return slot;
+            }
+            if( group.MatchEmpty() )
+                return -1;
 
-        return result;
+            ASSERT( step <= mask + 1 );
+            g = (g + step) & mask;
+        }
     }
 
-    T const* Find( T const& item ) const
+    // Returns the first slot available for insertion, which may be a tombstone
+    INLINE int FindEmptySlot( u64 hash ) const
     {
-        T* result = ((OldBucketArray<T, AllocType>*)this)->Find( item );
-        return result;
-    }
+        int mask = GroupMask();
+        int g = (int)(H1( hash ) & (u64)mask);
 
-    bool Contains( T const& item ) const
-    {
-        T const* result = Find( item );
-        return result != nullptr;
+        for( int step = 1; ; ++step )
+        {
+            int base = g * GroupWidth;
+            u32 empty = HashGroup( ctrl + base ).MatchEmptyOrDeleted();
+            if( empty )
+                return base + LowestSetBit( empty );
+
+            ASSERT( step <= mask + 1 );
+            g = (g + step) & mask;
+        }
     }
 
-    template <class Predicate>
-    T* Find( Predicate&& p )
+    INLINE V* FindSlot( K const& key, bool* occupiedOut )
     {
-        T* result = nullptr;
+        u64 hash = hasher( key );
 
-        auto idx = First();
-        while( idx )
+        if( count )
         {
-            if( p( *idx ) )
-                break;
-
-            idx.Next();
+            int slot = FindKey( key, hash );
+            if( slot >= 0 )
+            {
+                *occupiedOut = true;
+                return &values[slot];
+            }
         }
 
-        if( idx )
-            result = &*idx;
-
-        return result;
-    }
+        int slot = capacity ? FindEmptySlot( hash ) : -1;
+        if( slot < 0 || (growthLeft == 0 && ctrl[slot] == HashCtrl::Empty) )
+        {
+            // Either grow, or just get rid of tombstones if there's enough of them
+            Resize( 2 * count + 1 );
+            slot = FindEmptySlot( hash );
+        }
 
-    template <class Predicate>
-    T const* Find( Predicate&& p ) const
-    {
-        T* slot = ((OldBucketArray<T, AllocType>*)this)->Find( p );
-        return slot;
-    }
+        if( ctrl[slot] == HashCtrl::Empty )
+            --growthLeft;
+        ctrl[slot] = H2( hash );
+        INIT( keys[slot] )( key );
+        ++count;
 
-    template <class Predicate>
-    bool Contains( Predicate&& p ) const
-    {
-        T const* slot = Find( p );
-        return slot != nullptr;
+        *occupiedOut = false;
+        return &values[slot];
     }
+};
 
 
-    void Push( T const* buffer, int bufferLen )
-    {
-        int totalCopied = 0;
-        Bucket*& bucket = last;
+/////     CONCURRENT HASHTABLE     /////
 
-        while( totalCopied < bufferLen )
-        {
-            int remaining = bufferLen - totalCopied;
-            int available = bucket->capacity - bucket->count;
+/*
+Hashtable split into a fixed number of shards (selected by the high bits of the hash), each with its own reader-writer lock,
+so threads working on different keys rarely contend.
 
-            int copied = Min( remaining, available );
-            COPYP( buffer + totalCopied, bucket->data + bucket->count, copied * SIZEOF(T) );
-            totalCopied += copied;
+When keys are compared bitwise (integers, enums & non-string pointers) and values are small PODs, reads don't take the
+lock at all, and instead go through a per-shard seqlock:
+writers bump the version to odd before touching the shard and back to even once done, and readers retry (or fall back
+to the read lock) if the version changed while they were looking. For that to be safe, a shard never frees the memory
+of a table it has outgrown (see RetainingAllocator), so memory use can be up to twice the final size of the table.
 
-            bucket->count += copied;
-            if( bucket->count == bucket->capacity )
-                AddEmptyBucket();
-        }
+Values can move around on resize, so the interface is all copies in and out instead of pointers.
 
-        count += totalCopied;
-    }
+NOTE Any thread that writes to the table may allocate from it, so the allocator has to be thread-safe
+(i.e. not the usual arena-based CTX_ALLOC unless the table is only ever written from the thread that owns it)
+*/
+template <typename K, typename V, typename AllocType = Allocator, int ShardCount = 16>
+struct ConcurrentHashtable
+{
+    static_assert( ShardCount > 0 && (ShardCount & (ShardCount - 1)) == 0, "ShardCount must be a power of 2" );
+
+    // Optimistic readers may see keys that are half-written or not even initialized yet, so they can only ever compare
+    // them bitwise, and never follow them (DefaultEqFunc for strings would)
+    static constexpr bool BitwiseKeys = std::is_integral<K>::value
+                                     || std::is_enum<K>::value
+                                     || (std::is_pointer<K>::value && !std::is_same<K, char const*>::value);
+    static constexpr bool OptimisticReads = BitwiseKeys
+                                         && std::is_trivially_copyable<V>::value
+                                         && sizeof(V) <= 64;
+    static constexpr int MaxOptimisticAttempts = 4;
+
+    // Only optimistic readers need outgrown tables to stay around
+    using TableAllocType = std::conditional_t<OptimisticReads, RetainingAllocator<AllocType>, AllocType>;
+    using TableType = Hashtable<K, V, TableAllocType>;
+
+    // Table geometry as published for optimistic readers, so they never see keys & capacity from different tables
+    struct View
+    {
+        K* keys;
+        V* values;
+        u64* occupancy;
+        i32 capacity;
+    };
 
-    template <typename AllocType2 = Allocator>
-    void Append( Array<T, AllocType2> const& array )
+    struct alignas(64) Shard
     {
-        Push( array.data, array.count );
-    }
+        RWLock<PreshingSemaphore> lock;
+        atomic_u32 version;
+        std::atomic<View const*> view;
+        // Only used with OptimisticReads (views are allocated from it too)
+        RetainingAllocator<AllocType> allocator;
+        TableType table;
 
-    void CopyTo( T* buffer, sz bufferLen ) const
-    {
-        ASSERT( count <= bufferLen );
+        Shard()
+            : version( 0 )
+            , view( &EmptyView )
+            , table( 0, TableAllocator() )
+        {}
 
-        const Bucket* bucket = &first;
-        while( bucket )
+        TableAllocType* TableAllocator()
         {
-            COPYP( bucket->data, buffer, bucket->count * SIZEOF(T) );
-            buffer += bucket->count;
-            bucket = bucket->next;
+            IF( OptimisticReads )
+                return &allocator;
+            else
+                // Set once we know the real one
+                return nullptr;
         }
-    }
+    };
 
-    template <typename AllocType2 = Allocator>
-    void CopyTo( Array<T, AllocType2>* array ) const
-    {
-        ASSERT( count <= array->capacity );
-        array->Resize( count );
 
-        T* buffer = array->data;
-        const Bucket* bucket = &first;
-        while( bucket )
-        {
-            COPYP( bucket->data, buffer, bucket->count * SIZEOF(T) );
-            buffer += bucket->count;
-            bucket = bucket->next;
-        }
-    }
+    // Readers still need to take the locks
+    mutable Shard shards[ShardCount];
 
-    template <typename AllocType2 = Allocator>
-    Array<T, AllocType2> ToArray( AllocType2* alloc = nullptr ) const
+
+    // NOTE No default allocator, see above (null is only allowed so it can be default-constructed and INIT'd later)
+    explicit ConcurrentHashtable( int expectedEntryCount = 0, AllocType* alloc = nullptr )
     {
-        Array<T, AllocType2> result( count, alloc ? alloc : CTX_ALLOC );
-        result.ResizeToCapacity();
-        CopyTo( &result );
+        ASSERT( alloc || !expectedEntryCount );
 
-        return result;
+        for( Shard& shard : shards )
+        {
+            shard.allocator.base = alloc;
+            IF( !OptimisticReads )
+                shard.table.allocator = alloc;
+            if( expectedEntryCount )
+            {
+                shard.table.Reserve( expectedEntryCount / ShardCount + 1 );
+                PublishView( shard );
+            }
+        }
     }
 
-private:
-
-    void AddEmptyBucket()
+    ~ConcurrentHashtable()
     {
-        Bucket* newBucket;
-        if( firstFree )
-        {
-            newBucket = firstFree;
-            firstFree = firstFree->next;
-            newBucket->Clear();
-        }
-        else
+        for( Shard& shard : shards )
         {
-            // TODO Inline this with the actual contents
-            newBucket = NEW( allocator, Bucket, memParams )( first.capacity, allocator, memParams );
+            shard.table.Clear();
+            IF( OptimisticReads )
+                shard.allocator.ReleaseAll();
+            else if( shard.table.keys )
+                FREE( shard.table.allocator, shard.table.keys );
         }
-        newBucket->prev = last;
-        last->next = newBucket;
-
-        last = newBucket;
     }
-};
 
-#if 0
-template <typename T, typename AllocType>
-const OldBucketArray<T, AllocType> OldBucketArray<T, AllocType>::Empty = {};
-#endif
+    // Disallow implicit copying
+    ConcurrentHashtable( const ConcurrentHashtable& ) = delete;
+    ConcurrentHashtable& operator =( const ConcurrentHashtable& ) = delete;
 
 
-/////     STRING BUILDER     /////
+    bool Get( K const& key, V* valueOut ) const
+    {
+        u64 hash = DefaultHashFunc<K>( key );
+        Shard& shard = ShardFor( hash );
 
-// String builder to help compose Strings piece by piece
-// NOTE This uses temporary memory by default!
-struct StringBuilder
-{
-    BucketArray<char> buckets;
+        IF( OptimisticReads )
+        {
+            for( int attempt = 0; attempt < MaxOptimisticAttempts; ++attempt )
+            {
+                u32 version = shard.version.LOAD_ACQUIRE();
+                if( version & 1 )
+                {
+                    // Writer in progress
+                    Yield();
+                    continue;
+                }
 
-    explicit StringBuilder( Allocator* allocator = CTX_TMPALLOC )
-        : buckets( 32, allocator )
-    {}
+                V value;
+                bool found = FindOptimistic( shard, key, hash, &value );
 
-    bool Empty() const { return buckets.count == 0; }
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if( shard.version.LOAD_RELAXED() == version )
+                {
+                    if( found )
+                        *valueOut = value;
+                    return found;
+                }
+            }
+        }
 
-    void Clear()
-    {
-        buckets.Clear();
+        typename RWLock<PreshingSemaphore>::ReadScope scope( shard.lock );
+
+        V const* value = shard.table.Get( key );
+        if( value )
+            *valueOut = *value;
+        return value != nullptr;
     }
 
-    void Append( char const* str, int length = 0 )
+    bool Contains( K const& key ) const
     {
-        if( !length )
-            length = StringLength( str );
-
-        // Not including null terminator
-        buckets.Push( str, length );
+        V value;
+        return Get( key, &value );
     }
 
-    // TODO No way to use this as it will always prefer the above!
-    template <size_t N>
-    void Append( char (&&str)[N] )
+    void Put( K const& key, V const& value )
     {
-        // Not including null terminator
-        buckets.Push( str, N - 1 );
+        Shard& shard = ShardFor( DefaultHashFunc<K>( key ) );
+
+        BeginWrite( shard );
+        shard.table.Put( key, value );
+        EndWrite( shard );
     }
 
-    void AppendFormat( char const* fmt, ... )
+    // Returns a copy of the existing value for the key, or inserts and returns the given one
+    V GetOrPut( K const& key, V const& value = V(), bool* occupiedOut = nullptr )
     {
-        va_list args;
-        va_start( args, fmt );
+        // Try without taking the write lock first, as this is usually called on keys that already exist
+        V result;
+        if( Get( key, &result ) )
+        {
+            if( occupiedOut )
+                *occupiedOut = true;
+            return result;
+        }
 
-        int n = 1 + vsnprintf( nullptr, 0, fmt, args );
-        char* buf = ALLOC_ARRAY( CTX_TMPALLOC, char, n, Memory::NoClear() );
+        Shard& shard = ShardFor( DefaultHashFunc<K>( key ) );
 
-        // TODO Does this work??
-        vsnprintf( buf, SizeT( n ), fmt, args );
-        va_end( args );
+        BeginWrite( shard );
+        result = *shard.table.GetOrPut( key, value, occupiedOut );
+        EndWrite( shard );
 
-        // TODO We probably want this struct to be made out of irregular buckets that are allocated exactly of the
-        // length needed for each append (n above) so we don't need this extra copy
-        buckets.Push( buf, n - 1 );
+        return result;
     }
 
-    String ToString()
+    // Apply the given function to the value for the key (inserting a default one if needed) while holding the write lock
+    template <typename F>
+    void Update( K const& key, F&& func )
     {
-        buckets.Push( '\0' );
-        return String::Clone( buckets );
+        Shard& shard = ShardFor( DefaultHashFunc<K>( key ) );
+
+        BeginWrite( shard );
+        func( *shard.table.GetOrPut( key ) );
+        EndWrite( shard );
     }
-    String ToStringTmp()
+
+    bool Remove( K const& key )
     {
-        buckets.Push( '\0' );
-        return String::CloneTmp( buckets );
+        Shard& shard = ShardFor( DefaultHashFunc<K>( key ) );
+
+        BeginWrite( shard );
+        bool result = shard.table.Remove( key );
+        EndWrite( shard );
+
+        return result;
     }
-    char const* ToCStringTmp()
+
+    void Clear()
     {
-        return ToStringTmp().c();
+        for( Shard& shard : shards )
+        {
+            BeginWrite( shard );
+            shard.table.Clear();
+            EndWrite( shard );
+        }
     }
-};
-
 
-/////     HASHTABLE     /////
+    // NOTE Only a snapshot, as other threads may be modifying the table while we count
+    int Count() const
+    {
+        int result = 0;
+        for( Shard& shard : shards )
+        {
+            typename RWLock<PreshingSemaphore>::ReadScope scope( shard.lock );
+            result += shard.table.count;
+        }
+        return result;
+    }
 
-/*
-After watching how Bitwise handles open addressing for pointer hashtables, I think I want to keep separate data structures
-for pointer-sized data vs. the rest, when generalizing this data structure to hold any type of data.
+    bool Empty() const { return Count() == 0; }
 
-So, for pointers we'd have something like:
-*/
+private:
+    static constexpr View EmptyView = { nullptr, nullptr, nullptr, 0 };
 
-struct PtrHashtable
-{
-    struct Item
+    INLINE Shard& ShardFor( u64 hash ) const
     {
-        void* key;
-        void* value;
-    };
-
-    Item* items;
-    i32 count;
-    i32 capacity;
-};
-
-/*
-We're trying to optimize for the "hole-in-1" approach here, assuming a sufficiently good hash function, and we'll also keep the
-occupancy quite low by doing an ASSERT( count * 2 < capacity ) before each insertion, so for the few times that we don't hit
-the correct entry on the first try, it makes sense to keep the values inlined with the keys, as the correct result will be hopefully
-just a couple entries away and hence will still be in the same cache line, so we'll _hopefully_ still only have one cache miss even if
-we fail the first hit.
+        // Tables use the low bits to find the slot, so use the high ones here
+        return shards[ (hash >> 32) & (ShardCount - 1) ];
+    }
 
-Now, for generic keys & values, that picture changes significantly, and having both keys & values inlined is now quite probably bad
-for cache efficiency. Here then, we'd have them separate, which means a minimum of _two_ cache misses per lookup: */
+    INLINE void BeginWrite( Shard& shard )
+    {
+        shard.lock.LockWrite();
 
-template <typename T>
-struct ItemHashtable
-{
-    u64* keys;
-    T* values;
+        IF( OptimisticReads )
+        {
+            shard.version.STORE_RELAXED( shard.version.LOAD_RELAXED() + 1 );
+            std::atomic_thread_fence( std::memory_order_release );
+        }
+    }
 
-    i32 count;
-    i32 capacity;
-};
+    INLINE void EndWrite( Shard& shard )
+    {
+        IF( OptimisticReads )
+        {
+            PublishView( shard );
+            shard.version.STORE_RELEASE( shard.version.LOAD_RELAXED() + 1 );
+        }
 
-/*
-So, for the generic case (and to be able to validate these assumptions through proper testing) we're going to want
-to be able to have either keys + values as separate or as interleaved.
+        shard.lock.UnlockWrite();
+    }
 
-The problem is how to do this without having to write the code twice and without affecting performance.
-We could somehow templatize an internal structure that dictates the layout, based on the size of K and V types, but then all access
-would be through pass-through methods in that structure, which I guess is fine as long as they're inlined?
-*/
+    void PublishView( Shard& shard )
+    {
+        IF( OptimisticReads )
+        {
+            TableType const& table = shard.table;
+            View const* current = shard.view.LOAD_RELAXED();
+            if( current->keys != table.keys )
+            {
+                // Views are kept alive by the shard's allocator too
+                View* view = ALLOC_STRUCT( &shard.allocator, View );
+                *view = { table.keys, table.values, table.occupancy, table.capacity };
+                shard.view.STORE_RELEASE( view );
+            }
+        }
+    }
 
-template <typename K> INLINE u64  DefaultHashFunc( K const& key )           { return Hash64( &key, I32( SIZEOF(K) ) ); }
-template <typename K> INLINE bool DefaultEqFunc( K const& a, K const& b )   { return a == b; }
+    // Mirrors Hashtable::Get, but any of the memory we look at may be changing under us, so it can't ever
+    // trust what it reads or assert on it (the result will be discarded by the caller if there were any changes)
+    bool FindOptimistic( Shard& shard, K const& key, u64 hash, V* valueOut ) const
+    {
+        static_assert( BitwiseKeys, "Keys must be compared bitwise in optimistic reads" );
 
-// Some specializations
-template <> INLINE u64  DefaultHashFunc< char const* >( char const* const& key )                    { return Hash64( key, StringLength( key ) ); }
-template <> INLINE bool DefaultEqFunc< const char* >( char const* const& a, char const* const& b )  { return StringEquals( a, b ); }
-template <> INLINE u64  DefaultHashFunc< String >( String const& key )      { return key.Hash(); }
+        View const* view = shard.view.LOAD_ACQUIRE();
+        if( view->capacity == 0 )
+            return false;
 
+        u32 mask = U32( view->capacity - 1 );
+        u32 i = hash & mask;
 
-// TODO This forces us to clear all keys on every resize which is stupid
-// TODO This is probably not a good idea anyway for the general case and we should replace this with an occupancy bitmap
-template <typename K>
-const K ZeroKey{};
+        for( int n = 0; n < view->capacity; ++n )
+        {
+            u64 word;
+            memcpy( &word, &view->occupancy[i >> 6], sizeof(u64) );
+            if( !((word >> (i & 63)) & 1) )
+                return false;
 
-// NOTE Type K must have a default constructor, and all keys must be different to the default-constructed value
-template <typename K, typename V, typename AllocType = Allocator>
-struct Hashtable
-{
-    struct Item
-    {
-        K const& key;
-        V& value;
-    };
+            // Same as DefaultEqFunc for these keys, but never looks past the bits we read
+            K k;
+            memcpy( &k, &view->keys[i], sizeof(K) );
+            if( memcmp( &k, &key, sizeof(K) ) == 0 )
+            {
+                memcpy( valueOut, &view->values[i], sizeof(V) );
+                return true;
+            }
 
-    using HashFunc = u64 (*)( K const& key );
-    using KeysEqFunc = bool (*)( K const& a, K const& b );
+            i = (i + 1) & mask;
+        }
+        return false;
+    }
+};
 
-    enum Flags
-    {
-        None = 0,
-        FixedSize = 0x1,    // For stable pointers to content, must provide expectedSize as appropriate
-    };
 
+/////     RING BUFFER    /////
+// Circular buffer backed by an array with a stable maximum size (no allocations after init).
+// Default behaviour is similar to a FIFO queue where new items are Push()ed onto a virtual "head" cursor,
+// while Pop() returns the item at the "tail" (oldest). Can also remove newest item with PopHead() for a LIFO stack behaviour.
+// Head and tail will wrap around when needed and can never overlap.
+// Can be iterated both from tail to head (oldest to newest) or the other way around.
 
-    K* keys;
-    V* values;
+// FIXME 'Head' & 'Tail' here have the exact opposite meaning you would expect for a queue, hence are super confusing!
+// NOTE See MirroredRingBuffer for variable-length reads & writes that go beyond the end of the buffer
 
-    AllocType* allocator;
-    HashFunc hashFunc;
-    KeysEqFunc eqFunc;
+template <typename T, typename AllocType = Allocator>
+struct RingBuffer
+{
+    Array<T, AllocType> buffer;
+    i32 onePastHeadIndex;       // Points to next slot to write
     i32 count;
-    i32 capacity;
-    u32 flags;
 
 
-    explicit Hashtable( int expectedEntryCount = 0, AllocType* alloc = CTX_ALLOC, 
-                        HashFunc hashFunc_ = DefaultHashFunc<K>, KeysEqFunc eqFunc_ = DefaultEqFunc<K>, u32 flags_ = 0 )
-        : keys( nullptr )
-        , values( nullptr )
-        , allocator( alloc )
-        , hashFunc( hashFunc_ )
-        , eqFunc( eqFunc_ )
+    RingBuffer()
+    {}
+
+    RingBuffer( i32 capacity, AllocType* allocator = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : buffer( capacity, allocator, params )
+        , onePastHeadIndex( 0 )
         , count( 0 )
-        , capacity( 0 )
-        , flags( flags_ )
     {
-        ASSERT( expectedEntryCount || !(flags & FixedSize) );
-        ASSERT( allocator );
-
-        if( expectedEntryCount )
-            Resize( expectedEntryCount );
+        ASSERT( IsPowerOf2( capacity ) );
+        buffer.ResizeToCapacity();
     }
 
-    // Disallow implicit copying
-    Hashtable( const Hashtable& ) = delete;
-    Hashtable& operator =( const Hashtable& ) = delete;
+    int Count() const { return count; }
+    int Capacity() const { return buffer.capacity; }
+    bool Available() const { return count < buffer.capacity; }
 
-    Hashtable( Hashtable&& rhs )
-        : allocator( rhs.allocator )
-        , flags( rhs.flags )
+    void Clear()
     {
-        *this = std::move( rhs );
+        onePastHeadIndex = 0;
+        count = 0;
     }
 
+    void ClearToZero()
+    {
+        Clear();
+        PZERO( buffer.data, buffer.count * sizeof(T) );
+    }
 
-    bool Empty() const { return count == 0; }
+    T* PushEmpty( bool clear = true )
+    {
+        T* slot = buffer.data + onePastHeadIndex;
+        onePastHeadIndex = (onePastHeadIndex + 1) & (buffer.capacity - 1);
+        if( Available() )
+            count++;
 
-    // TODO 
-#if 0
-    Hashtable& operator =( Hashtable&& rhs )
+        if( clear )
+            ZEROP( slot, sizeof(T) );
+        return slot;
+    }
+
+    T* Push( const T& item )
     {
-        Destroy();
+        T* slot = PushEmpty( false );
+        *slot = item;
+        return slot;
+    }
 
-        // FIXME We need to force a copy (or error out) when the allocators differ?
-        keys     = rhs.keys;
-        value    = rhs.value;
-        hashFunc = rhs.hashFunc;
-        eqFunc   = rhs.eqFunc;
-        count    = rhs.count;
-        capacity = rhs.capacity;
+    T Pop()
+    {
+        ASSERT( count > 0 );
+        int tailIndex = TailIndex();
+        count--;
 
-        rhs.Destroy();
+        return buffer.data[tailIndex];
+    }
+    bool TryPop( T* out )
+    {
+        bool canPop = count > 0; 
+        if( canPop )
+            *out = Pop();
 
-        return *this;
+        return canPop;
     }
-#else
-    Hashtable& operator =( Hashtable&& ) = delete;
-#endif
 
-    void Resize( int expectedEntryCount )
+    T PopHead()
     {
-        ASSERT( !(flags & FixedSize) || !capacity );
-
-        int newCapacity = Max( NextPowerOf2( expectedEntryCount * 2 ), 16 );
+        ASSERT( count > 0 );
+        onePastHeadIndex = (onePastHeadIndex - 1) & (buffer.capacity - 1);
+        count--;
 
-        int oldCapacity = capacity;
-        K* oldKeys = keys;
-        V* oldValues = values;
+        return buffer.data[onePastHeadIndex];
+    }
+    bool TryPopHead( T* out )
+    {
+        bool canPop = count > 0; 
+        if( canPop )
+            *out = PopHead();
 
-        count = 0;
-        capacity = newCapacity;
+        return canPop;
+    }
 
-        // TODO Check that generated code for instances with different allocator types is still being inlined
-        void* newMemory = ALLOC( allocator, capacity * (SIZEOF(K) + SIZEOF(V)), Memory::NoClear() );
-        keys   = (K*)newMemory;
-        values = (V*)((u8*)newMemory + capacity * SIZEOF(K));
+    bool Contains( const T& item ) const
+    {
+        return buffer.Contains( item );
+    }
 
-        for( int i = 0; i < capacity; ++i )
-            // TODO Call constructor or clear to zero depending on std::is_trivially_copyable(T)
-            INIT( keys[i] )();
-        for( int i = 0; i < oldCapacity; ++i )
-        {
-            if( !eqFunc( oldKeys[i], ZeroKey<K> ) )
-                // FIXME Move keys too!
-                Put( oldKeys[i], MOVE( oldValues[i] ) );
-        }
+    T& Head( int offset = 0 )
+    {
+        ASSERT( offset >= 0, "Only positive offsets" );
+        ASSERT( count > offset, "Not enough items in buffer" );
+        int index = IndexFromHeadOffset( -offset );
+        return buffer.data[index];
+    }
+    T const& Head( int offset = 0 ) const
+    {
+        return ((RingBuffer<T>*)this)->Head( offset );
+    }
 
-        FREE( allocator, oldKeys ); // Handles both
+    T& Tail( int offset = 0 )
+    {
+        ASSERT( offset >= 0, "Only positive offsets" );
+        ASSERT( count > offset, "Not enough items in buffer" );
+        int head_offset = count - 1 - offset;
+        int idx = IndexFromHeadOffset( -head_offset );
+        return buffer.data[idx];
+    }
+    T const& Tail( int offset = 0 ) const
+    {
+        return ((RingBuffer<T>*)this)->Tail( offset );
     }
 
-    // TODO This is all now equivalent to FindSlot?
-    V* Get( K const& key )
+    int TailIndex() const
     {
-        ASSERT( !eqFunc( key, ZeroKey<K> ) );
+        return (int)(&Tail() - buffer.data);
+    }
 
-        if( count == 0 )
-            return nullptr;
 
-        ASSERT( count < capacity );
+    struct Iterator
+    {
+    protected:
+        RingBuffer<T>& b;
+        T* current;
+        i32 currentIndex;
+        bool forward;
 
-        u64 hash = hashFunc( key );
-        u32 i = hash & (capacity - 1);
+    public:
+        Iterator( RingBuffer& buffer_, bool forward_ = true )
+            : b( buffer_ )
+            , current( nullptr )
+            , currentIndex( 0 )
+            , forward( forward_ )
+        {
+            if( b.Count() )
+            {
+                currentIndex = forward ? b.TailIndex() : b.IndexFromHeadOffset( 0 );
+                current = &b.buffer.data[currentIndex];
+            }
+        }
 
-        u32 startIdx = i;
-        for( ;; )
+        operator  bool() { return current != nullptr; }
+        T& operator * () { return *current; }
+        T* operator ->() { return current; }
+
+        // Prefix
+        inline Iterator& operator ++()
         {
-            if( eqFunc( keys[i], key ) )
-                return &values[i];
-            else if( eqFunc( keys[i], ZeroKey<K> ) )
-                return nullptr;
+            if( current )
+            {
+                if( forward )
+                {
+                    currentIndex = (currentIndex + 1) & (b.buffer.capacity - 1);
+                    current = (currentIndex == b.onePastHeadIndex) ? nullptr : &b.buffer.data[currentIndex];
+                }
+                else
+                {
+                    int tailIndex = b.TailIndex();
 
-            i++;
-            if( i == U32( capacity ) )
-                i = 0;
-            if( i == startIdx )
-            {
-                // Something went horribly wrong
-                ASSERT( false );
-                return nullptr;
+                    currentIndex--;
+                    bool wrapped = b.onePastHeadIndex < tailIndex;
+                    bool finished = wrapped ? (currentIndex >= b.onePastHeadIndex && currentIndex < tailIndex)
+                                            : (currentIndex < tailIndex);
+
+                    currentIndex &= (b.buffer.capacity - 1);
+                    current = finished ? nullptr : &b.buffer.data[currentIndex];
+                }
             }
+
+            return *this;
         }
+    };
+    Iterator MakeIterator( bool forward = true )
+    {
+        return Iterator( *this, forward );
     }
 
-    V const* Get( K const& key ) const
+private:
+    int IndexFromHeadOffset( int offset ) const
     {
-        return ((Hashtable<K, V, AllocType>*)this)->Get( key );
+        int result = onePastHeadIndex + offset - 1;
+        result &= (buffer.capacity - 1);
+
+        return result;
     }
+};
 
-private:
-    INLINE V* FindSlot( K const& key, bool* occupiedOut )
+
+// A bounded, lock-free multi-producer multi-consumer queue with the same FIFO behaviour as RingBuffer.
+// Every slot carries a sequence number that says whose turn it is to access it, so consumers never see an item
+// before it has been completely written, and producers never overwrite an item before it has been completely read.
+// Unlike RingBuffer, pushing onto a full buffer fails instead of overwriting the oldest item.
+// (see https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue)
+template <typename T, typename AllocType = Allocator>
+struct SyncRingBuffer
+{
+    struct Cell
     {
-        ASSERT( !eqFunc( key, ZeroKey<K> ) );
+        atomic_u64 sequence;
+        T data;
+    };
 
-        // Super conservative but easy to work with
-        // TODO Put resize check in a FindSlotForPut wrapper or something
-        if( 2 * count >= capacity )
-            Resize( 2 * count );
+    Cell* cells;
+    i32 capacity;
+    AllocType* allocator;
+    MemoryParams memParams;
 
-        u64 hash = hashFunc( key );
-        u32 i = hash & (capacity - 1);
+    // Keep producers & consumers on separate cache lines so they don't keep invalidating each other
+    alignas(64) atomic_u64 enqueuePos;
+    alignas(64) atomic_u64 dequeuePos;
 
-        u32 startIdx = i;
-        for( ;; )
-        {
-            if( eqFunc( keys[i], key ) )
-            {
-                *occupiedOut = true;
-                return &values[i];
-            }
-            else if( eqFunc( keys[i], ZeroKey<K> ) )
-            {
-                keys[i] = key;
-                ++count;
-                *occupiedOut = false;
-                return &values[i];
-            }
 
-            i++;
-            if( i == U32( capacity ) )
-                i = 0;
-            if( i == startIdx )
-            {
-                // Something went horribly wrong
-                ASSERT( false );
-                return nullptr;
-            }
-        }
-    }
+    SyncRingBuffer()
+        : cells( nullptr )
+        , capacity( 0 )
+        , allocator( nullptr )
+        , enqueuePos( 0 )
+        , dequeuePos( 0 )
+    {}
 
-public:
-    V* Put( K const& key )
+    SyncRingBuffer( i32 capacity_, AllocType* allocator_ = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : capacity( capacity_ )
+        , allocator( allocator_ )
+        , memParams( params )
+        , enqueuePos( 0 )
+        , dequeuePos( 0 )
     {
-        bool occupied;
-        V* slot = FindSlot( key, &occupied );
-        INIT( *slot )();
-        return slot;
+        ASSERT( IsPowerOf2( capacity ) );
+        ASSERT( enqueuePos.is_lock_free(), "'enqueuePos' attribute is not lock-free (check alignment?)" );
+
+        cells = ALLOC_ARRAY( allocator, Cell, capacity, memParams );
+        for( i32 i = 0; i < capacity; ++i )
+        {
+            INIT( cells[i] )();
+            cells[i].sequence.STORE_RELAXED( (u64)i );
+        }
     }
 
-    V* Put( K const& key, V const& value )
+    ~SyncRingBuffer()
     {
-        bool occupied;
-        V* slot = FindSlot( key, &occupied );
-        INIT( *slot )( value );
-        return slot;
+        if( cells )
+        {
+            for( i32 i = 0; i < capacity; ++i )
+                cells[i].~Cell();
+            FREE( allocator, cells, memParams );
+        }
     }
 
-    V* Put( K const& key, V&& value )
+    SyncRingBuffer( SyncRingBuffer const& ) = delete;
+    SyncRingBuffer& operator =( SyncRingBuffer const& ) = delete;
+
+    // NOTE Only a snapshot, as other threads may be pushing / popping concurrently
+    int Count() const
     {
-        bool occupied;
-        V* slot = FindSlot( key, &occupied );
-        INIT( *slot )( MOVE( value ) );
-        return slot;
+        i64 count = (i64)(enqueuePos.LOAD_ACQUIRE() - dequeuePos.LOAD_ACQUIRE());
+        return (int)Clamp( count, (i64)0, (i64)capacity );
     }
+    int Capacity() const { return capacity; }
+    bool Empty() const { return Count() == 0; }
+    bool Available() const { return Count() < capacity; }
 
-    V* GetOrPut( K const& key, bool* occupiedOut = nullptr )
+    // Returns false if the buffer is full
+    bool Push( T const& item )
     {
-        bool occupied;
-        V* slot = FindSlot( key, &occupied );
-
-        if( !occupied )
-            INIT( *slot )();
-
-        if( occupiedOut )
-            *occupiedOut = occupied;
-        return slot;
+        return PushInternal( item );
     }
-
-    V* GetOrPut( K const& key, V const& value, bool* occupiedOut = nullptr )
+    bool Push( T&& item )
     {
-        bool occupied;
-        V* slot = FindSlot( key, &occupied );
-
-        if( !occupied )
-            INIT( *slot )( value );
-
-        if( occupiedOut )
-            *occupiedOut = occupied;
-        return slot;
+        return PushInternal( std::move( item ) );
     }
 
-    // TODO Deleting based on Robid Hood or similar
-
-    template <typename E>
-    struct BaseIterator
+    // Returns false if the buffer is empty
+    bool TryPop( T* out )
     {
-        BaseIterator( Hashtable const& table_ )
-            : table( table_ )
-        {
-            current = table.keys - 1;
-            Next();
-        }
-        virtual ~BaseIterator() {}
-
-        explicit operator bool() const { return current != nullptr; }
-
-        virtual E Get() const = 0;
-        E operator * () const { return Get(); }
-
-        BaseIterator& operator ++()
+        Cell* cell;
+        u64 pos = dequeuePos.LOAD_RELAXED();
+        while( true )
         {
-            Next();
-            return *this;
-        }
-
-    protected:
-        Hashtable const& table;
-        K* current;
+            cell = &cells[pos & (capacity - 1)];
+            u64 seq = cell->sequence.LOAD_ACQUIRE();
+            i64 diff = (i64)seq - (i64)(pos + 1);
 
-    private:
-        void Next()
-        {
-            do
+            if( diff == 0 )
             {
-                current++;
+                if( dequeuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                    break;
             }
-            while( current < table.keys + table.capacity && 
-                table.eqFunc( *current, ZeroKey<K> ) );
-
-            if( current >= table.keys + table.capacity )
-                current = nullptr;
+            else if( diff < 0 )
+                // Nothing has been written to this slot yet
+                return false;
+            else
+                pos = dequeuePos.LOAD_RELAXED();
         }
-    };
 
-    struct ItemIterator : public BaseIterator<Item>
-    {
-        ItemIterator( Hashtable const& table_ )
-            : BaseIterator<Item>( table_ )
-        {}
-
-        Item Get() const override
-        {
-            ASSERT( current );
-            V& currentValue = table.values[ current - table.keys ];
-            Hashtable::Item result = { *current, currentValue };
-            return result;
-        }
-    };
+        *out = std::move( cell->data );
+        // Mark the slot as free for the next lap
+        cell->sequence.STORE_RELEASE( pos + capacity );
+        return true;
+    }
 
-    struct KeyIterator : public BaseIterator<K const&>
+    // NOTE This is inherently NOT threadsafe, as items can be popped (and their slots reused) while we look at them
+    template <typename Predicate>
+    T* Find( Predicate&& pred )
     {
-        KeyIterator( Hashtable const& table_ )
-            : BaseIterator<K const&>( table_ )
-        {}
-
-        K const& Get() const override
+        u64 end = enqueuePos.LOAD_ACQUIRE();
+        for( u64 pos = dequeuePos.LOAD_ACQUIRE(); pos < end; ++pos )
         {
-            ASSERT( current );
-            return *current;
+            Cell* cell = &cells[pos & (capacity - 1)];
+            // Skip slots that are still being written
+            if( cell->sequence.LOAD_ACQUIRE() == pos + 1 && pred( (T const&)cell->data ) )
+                return &cell->data;
         }
-    };
+        return nullptr;
+    }
 
-    struct ValueIterator : public BaseIterator<V&>
+private:
+    template <typename U>
+    bool PushInternal( U&& item )
     {
-        ValueIterator( Hashtable const& table_ )
-            : BaseIterator<V&>( table_ )
-        {}
-
-        V& Get() const override
+        Cell* cell;
+        u64 pos = enqueuePos.LOAD_RELAXED();
+        while( true )
         {
-            ASSERT( current );
-            V& currentValue = table.values[ current - table.keys ];
-            return currentValue;
-        }
-    };
-
-    struct ConstValueIterator : public BaseIterator<V const&>
-    {
-        ConstValueIterator( Hashtable const& table_ )
-            : BaseIterator<V const&>( table_ )
-        {}
+            cell = &cells[pos & (capacity - 1)];
+            u64 seq = cell->sequence.LOAD_ACQUIRE();
+            i64 diff = (i64)seq - (i64)pos;
 
-        V const& Get() const override
-        {
-            ASSERT( current );
-            V& currentValue = table.values[ current - table.keys ];
-            return currentValue;
+            if( diff == 0 )
+            {
+                // Slot is free for this position, try to claim it
+                if( enqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                    break;
+            }
+            else if( diff < 0 )
+                // Slot still holds an item from the previous lap
+                return false;
+            else
+                // Someone else claimed it already
+                pos = enqueuePos.LOAD_RELAXED();
         }
-    };
 
-    ItemIterator Items() { return ItemIterator( *this ); }
-    KeyIterator Keys() const { return KeyIterator( *this ); }
-    ValueIterator Values() { return ValueIterator( *this ); }
-    ConstValueIterator ConstValues() const { return ConstValueIterator( *this ); }
+        cell->data = std::forward<U>( item );
+        cell->sequence.STORE_RELEASE( pos + 1 );
+        return true;
+    }
 };
 
 
-/////     RING BUFFER    /////
-// Circular buffer backed by an array with a stable maximum size (no allocations after init).
-// Default behaviour is similar to a FIFO queue where new items are Push()ed onto a virtual "head" cursor,
-// while Pop() returns the item at the "tail" (oldest). Can also remove newest item with PopHead() for a LIFO stack behaviour.
-// Head and tail will wrap around when needed and can never overlap.
-// Can be iterated both from tail to head (oldest to newest) or the other way around.
-
-// FIXME 'Head' & 'Tail' here have the exact opposite meaning you would expect for a queue, hence are super confusing!
-// TODO Look at the code inside #ifdef MEM_REPLACE_PLACEHOLDER in https://github.com/cmuratori/refterm/blob/main/refterm_example_source_buffer.c
-// for an example of how to speed up linear reads & writes that go beyond the end of the buffer,
-// by just mapping the same block of memory twice back to back!
 
+/////     SPSC QUEUE    /////
+// Bounded queue for exactly one producer thread and one consumer thread.
+// Both sides keep a cached copy of the other side's index, so they only need to touch the other side's cache line
+// when the queue looks full (producer) or empty (consumer).
+// The consumer can also block until there's something to pop, in which case the producer wakes it up through a semaphore,
+// but only when it's actually asleep.
+// (see https://rigtorp.se/ringbuffer/)
 template <typename T, typename AllocType = Allocator>
-struct RingBuffer
+struct SpscQueue
 {
-    Array<T, AllocType> buffer;
-    i32 onePastHeadIndex;       // Points to next slot to write
-    i32 count;
+    T* data;
+    i32 capacity;
+    AllocType* allocator;
+    MemoryParams memParams;
 
+    // Producer side
+    alignas(64) atomic_u64 writePos;
+    u64 cachedReadPos;
 
-    RingBuffer()
+    // Consumer side
+    alignas(64) atomic_u64 readPos;
+    u64 cachedWritePos;
+    atomic_bool consumerWaiting;
+    PreshingSemaphore itemsAvailable;
+
+
+    SpscQueue()
+        : data( nullptr )
+        , capacity( 0 )
+        , allocator( nullptr )
+        , writePos( 0 )
+        , cachedReadPos( 0 )
+        , readPos( 0 )
+        , cachedWritePos( 0 )
+        , consumerWaiting( false )
     {}
 
-    RingBuffer( i32 capacity, AllocType* allocator = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
-        : buffer( capacity, allocator, params )
-        , onePastHeadIndex( 0 )
-        , count( 0 )
+    SpscQueue( i32 capacity_, AllocType* allocator_ = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : capacity( capacity_ )
+        , allocator( allocator_ )
+        , memParams( params )
+        , writePos( 0 )
+        , cachedReadPos( 0 )
+        , readPos( 0 )
+        , cachedWritePos( 0 )
+        , consumerWaiting( false )
     {
         ASSERT( IsPowerOf2( capacity ) );
-        buffer.ResizeToCapacity();
+
+        data = ALLOC_ARRAY( allocator, T, capacity, memParams );
+        for( i32 i = 0; i < capacity; ++i )
+            INIT( data[i] )();
     }
 
-    int Count() const { return count; }
-    int Capacity() const { return buffer.capacity; }
-    bool Available() const { return count < buffer.capacity; }
+    ~SpscQueue()
+    {
+        if( data )
+        {
+            for( i32 i = 0; i < capacity; ++i )
+                data[i].~T();
+            FREE( allocator, data, memParams );
+        }
+    }
 
-    void Clear()
+    SpscQueue( SpscQueue const& ) = delete;
+    SpscQueue& operator =( SpscQueue const& ) = delete;
+
+    // NOTE Only a snapshot, as the other thread may be pushing / popping concurrently
+    int Count() const { return (int)(writePos.LOAD_ACQUIRE() - readPos.LOAD_ACQUIRE()); }
+    int Capacity() const { return capacity; }
+    bool Empty() const { return Count() == 0; }
+
+    // Producer only
+    // Returns false if the queue is full
+    bool Push( T const& item )
     {
-        onePastHeadIndex = 0;
-        count = 0;
+        u64 pos = writePos.LOAD_RELAXED();
+        if( !HasRoomFor( pos, 1 ) )
+            return false;
+
+        data[pos & (capacity - 1)] = item;
+        Publish( pos + 1 );
+        return true;
     }
 
-    void ClearToZero()
+    bool Push( T&& item )
     {
-        Clear();
-        PZERO( buffer.data, buffer.count * sizeof(T) );
+        u64 pos = writePos.LOAD_RELAXED();
+        if( !HasRoomFor( pos, 1 ) )
+            return false;
+
+        data[pos & (capacity - 1)] = std::move( item );
+        Publish( pos + 1 );
+        return true;
     }
 
-    T* PushEmpty( bool clear = true )
+    // Push as many items as will fit, and return how many that was
+    int PushN( T const* items, int count )
     {
-        T* slot = buffer.data + onePastHeadIndex;
-        onePastHeadIndex = (onePastHeadIndex + 1) & (buffer.capacity - 1);
-        if( Available() )
-            count++;
+        u64 pos = writePos.LOAD_RELAXED();
+        if( !HasRoomFor( pos, count ) )
+            count = (int)(cachedReadPos + capacity - pos);
+        if( count <= 0 )
+            return 0;
 
-        if( clear )
-            ZEROP( slot, sizeof(T) );
-        return slot;
+        for( int i = 0; i < count; ++i )
+            data[(pos + i) & (capacity - 1)] = items[i];
+        Publish( pos + count );
+        return count;
     }
 
-    T* Push( const T& item )
+    // Consumer only
+    // Returns false if the queue is empty
+    bool TryPop( T* out )
     {
-        T* slot = PushEmpty( false );
-        *slot = item;
-        return slot;
+        return PopN( out, 1 ) == 1;
     }
 
-    T Pop()
+    // Pop as many items as are available (up to maxCount), and return how many that was
+    int PopN( T* out, int maxCount )
     {
-        ASSERT( count > 0 );
-        int tailIndex = TailIndex();
-        count--;
+        u64 pos = readPos.LOAD_RELAXED();
+        int count = Min( maxCount, (int)(cachedWritePos - pos) );
+        if( count < maxCount )
+        {
+            cachedWritePos = writePos.LOAD_ACQUIRE();
+            count = Min( maxCount, (int)(cachedWritePos - pos) );
+        }
+        if( count <= 0 )
+            return 0;
 
-        return buffer.data[tailIndex];
+        for( int i = 0; i < count; ++i )
+            out[i] = std::move( data[(pos + i) & (capacity - 1)] );
+        readPos.STORE_RELEASE( pos + count );
+        return count;
     }
-    bool TryPop( T* out )
-    {
-        bool canPop = count > 0; 
-        if( canPop )
-            *out = Pop();
 
-        return canPop;
+    // Block until there's at least one item, then pop it
+    void PopWait( T* out )
+    {
+        PopNWait( out, 1 );
     }
 
-    T PopHead()
+    // Block until there's at least one item, then pop as many as are available (up to maxCount)
+    int PopNWait( T* out, int maxCount )
     {
-        ASSERT( count > 0 );
-        onePastHeadIndex = (onePastHeadIndex - 1) & (buffer.capacity - 1);
-        count--;
+        while( true )
+        {
+            int count = PopN( out, maxCount );
+            if( count )
+                return count;
+
+            // Announce we're going to sleep, then check again in case something was pushed just before that
+            consumerWaiting.store( true, std::memory_order_seq_cst );
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+            count = PopN( out, maxCount );
+            if( count )
+            {
+                // If the producer already saw the flag, it will have signalled, so consume that
+                if( !consumerWaiting.exchange( false, std::memory_order_seq_cst ) )
+                    itemsAvailable.Wait();
+                return count;
+            }
 
-        return buffer.data[onePastHeadIndex];
+            itemsAvailable.Wait();
+        }
     }
-    bool TryPopHead( T* out )
+
+private:
+    bool HasRoomFor( u64 pos, int count )
     {
-        bool canPop = count > 0; 
-        if( canPop )
-            *out = PopHead();
+        if( pos + count - cachedReadPos <= (u64)capacity )
+            return true;
 
-        return canPop;
+        cachedReadPos = readPos.LOAD_ACQUIRE();
+        return pos + count - cachedReadPos <= (u64)capacity;
     }
 
-    bool Contains( const T& item ) const
+    void Publish( u64 newWritePos )
     {
-        return buffer.Contains( item );
+        writePos.STORE_RELEASE( newWritePos );
+
+        // Wake the consumer if it's (about to be) asleep
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        if( consumerWaiting.LOAD_RELAXED() && consumerWaiting.exchange( false, std::memory_order_seq_cst ) )
+            itemsAvailable.Signal();
     }
+};
 
-    T& Head( int offset = 0 )
+
+
+/////     WORK STEALING DEQUE    /////
+// Bounded Chase-Lev deque, where a single owner thread pushes & pops at the bottom (LIFO, so it keeps working on what's
+// hot in its cache) while any number of other threads steal from the top (FIFO, so they take the oldest, and hopefully
+// biggest, pieces of work).
+// The owner only needs to synchronize with thieves when there's a single item left.
+// Items must be trivially copyable and small enough for their atomics to be lock free (i.e. pointers or indices).
+// (see https://fzn.fr/readings/ppopp13.pdf)
+template <typename T, typename AllocType = Allocator>
+struct WorkStealingDeque
+{
+    static_assert( std::is_trivially_copyable<T>::value, "Items must be trivially copyable" );
+
+    std::atomic<T>* data;
+    i64 capacity;
+    AllocType* allocator;
+    MemoryParams memParams;
+
+    // Thieves
+    alignas(64) atomic_i64 top;
+    // Owner
+    alignas(64) atomic_i64 bottom;
+
+
+    WorkStealingDeque()
+        : data( nullptr )
+        , capacity( 0 )
+        , allocator( nullptr )
+        , top( 0 )
+        , bottom( 0 )
+    {}
+
+    WorkStealingDeque( i32 capacity_, AllocType* allocator_ = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : data( nullptr )
+        , capacity( capacity_ )
+        , allocator( allocator_ )
+        , memParams( params )
+        , top( 0 )
+        , bottom( 0 )
     {
-        ASSERT( offset >= 0, "Only positive offsets" );
-        ASSERT( count > offset, "Not enough items in buffer" );
-        int index = IndexFromHeadOffset( -offset );
-        return buffer.data[index];
+        AllocData();
     }
-    T const& Head( int offset = 0 ) const
+
+    ~WorkStealingDeque()
     {
-        return ((RingBuffer<T>*)this)->Head( offset );
+        if( data )
+            FREE( allocator, data, memParams );
     }
 
-    T& Tail( int offset = 0 )
+    WorkStealingDeque( WorkStealingDeque const& ) = delete;
+    WorkStealingDeque& operator =( WorkStealingDeque const& ) = delete;
+
+    // For default-constructed deques
+    void Init( i32 capacity_, AllocType* allocator_ = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
     {
-        ASSERT( offset >= 0, "Only positive offsets" );
-        ASSERT( count > offset, "Not enough items in buffer" );
-        int head_offset = count - 1 - offset;
-        int idx = IndexFromHeadOffset( -head_offset );
-        return buffer.data[idx];
+        ASSERT( !data );
+        capacity = capacity_;
+        allocator = allocator_;
+        memParams = params;
+        AllocData();
     }
-    T const& Tail( int offset = 0 ) const
+
+    // NOTE Only a snapshot, unless called from the owner with no thieves around
+    int Count() const
     {
-        return ((RingBuffer<T>*)this)->Tail( offset );
+        i64 b = bottom.LOAD_RELAXED();
+        i64 t = top.LOAD_RELAXED();
+        return b > t ? (int)(b - t) : 0;
     }
+    bool Empty() const { return Count() == 0; }
 
-    int TailIndex() const
+    // Owner only
+    // Returns false if the deque is full
+    bool Push( T item )
     {
-        return (int)(&Tail() - buffer.data);
-    }
+        i64 b = bottom.LOAD_RELAXED();
+        i64 t = top.LOAD_ACQUIRE();
+        if( b - t >= capacity )
+            return false;
 
+        data[b & (capacity - 1)].STORE_RELAXED( item );
+        std::atomic_thread_fence( std::memory_order_release );
+        bottom.STORE_RELAXED( b + 1 );
+        return true;
+    }
 
-    struct Iterator
+    // Owner only
+    bool Pop( T* itemOut )
     {
-    protected:
-        RingBuffer<T>& b;
-        T* current;
-        i32 currentIndex;
-        bool forward;
+        i64 b = bottom.LOAD_RELAXED() - 1;
+        bottom.STORE_RELAXED( b );
+        // Make sure thieves see the reservation before we look at top
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        i64 t = top.LOAD_RELAXED();
 
-    public:
-        Iterator( RingBuffer& buffer_, bool forward_ = true )
-            : b( buffer_ )
-            , current( nullptr )
-            , currentIndex( 0 )
-            , forward( forward_ )
+        if( t > b )
         {
-            if( b.Count() )
-            {
-                currentIndex = forward ? b.TailIndex() : b.IndexFromHeadOffset( 0 );
-                current = &b.buffer.data[currentIndex];
-            }
+            // Empty
+            bottom.STORE_RELAXED( b + 1 );
+            return false;
         }
 
-        operator  bool() { return current != nullptr; }
-        T& operator * () { return *current; }
-        T* operator ->() { return current; }
-
-        // Prefix
-        inline Iterator& operator ++()
+        T item = data[b & (capacity - 1)].LOAD_RELAXED();
+        if( t == b )
         {
-            if( current )
-            {
-                if( forward )
-                {
-                    currentIndex = (currentIndex + 1) & (b.buffer.capacity - 1);
-                    current = (currentIndex == b.onePastHeadIndex) ? nullptr : &b.buffer.data[currentIndex];
-                }
-                else
-                {
-                    int tailIndex = b.TailIndex();
-
-                    currentIndex--;
-                    bool wrapped = b.onePastHeadIndex < tailIndex;
-                    bool finished = wrapped ? (currentIndex >= b.onePastHeadIndex && currentIndex < tailIndex)
-                                            : (currentIndex < tailIndex);
+            // Last item, so race any thieves for it
+            bool won = top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed );
+            bottom.STORE_RELAXED( b + 1 );
+            if( !won )
+                return false;
+        }
 
-                    currentIndex &= (b.buffer.capacity - 1);
-                    current = finished ? nullptr : &b.buffer.data[currentIndex];
-                }
-            }
+        *itemOut = item;
+        return true;
+    }
 
-            return *this;
-        }
-    };
-    Iterator MakeIterator( bool forward = true )
+    // Any thread
+    // Can fail spuriously when racing other thieves (or the owner) for the same item
+    bool Steal( T* itemOut )
     {
-        return Iterator( *this, forward );
+        i64 t = top.LOAD_ACQUIRE();
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        i64 b = bottom.LOAD_ACQUIRE();
+
+        if( t >= b )
+            return false;
+
+        T item = data[t & (capacity - 1)].LOAD_RELAXED();
+        if( !top.compare_exchange_strong( t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+            return false;
+
+        *itemOut = item;
+        return true;
     }
 
 private:
-    int IndexFromHeadOffset( int offset ) const
+    void AllocData()
     {
-        int result = onePastHeadIndex + offset - 1;
-        result &= (buffer.capacity - 1);
-
-        return result;
+        ASSERT( IsPowerOf2( capacity ) );
+        data = ALLOC_ARRAY( allocator, std::atomic<T>, capacity, memParams );
+        for( i64 i = 0; i < capacity; ++i )
+            INIT( data[i] )( T() );
     }
 };
 
 
-// A Version of RingBuffer that is thread-safe and lock-free (multi-producer, multi-consumer).
-// Any operations that would require locking the full buffer have been removed.
-// Can be used as a fixed-capacity thread-safe queue.
-
-// FIXME This type is very broken! Review all ops agains!
-// TODO Simplify and rethink all this by using the repeated page mapping technique Casey uses
-// explained in https://youtu.be/H8THRznXxpQ?si=9IQLXNsvHnEbw6xo&t=702
-template <typename T, typename AllocType = Allocator>
-struct SyncRingBuffer
+/////     MIRRORED RING BUFFER    /////
+// Circular buffer of variable-length records, backed by memory that is mapped twice back to back, so that any record
+// is always contiguous in memory, even when it goes past the end of the buffer (no need to split or skip anything).
+// Records can be pushed concurrently from any thread, but must all be released from a single (consumer) thread.
+// They can be released in any order, but their space is only reused once all older records have been released too.
+template <typename T>
+struct MirroredRingBuffer
 {
-    Array<T, AllocType> buffer;
-    // 32 bits for 'count' | 32 bits for 'onePastHeadIndex'
-    atomic_u64 indexData;
+    static_assert( (sizeof(T) & (sizeof(T) - 1)) == 0, "Item size must be a power of 2" );
 
-
-    SyncRingBuffer()
+    // Precedes every record
+    struct RecordHeader
     {
-        _CheckLayout();
-    }
+        // Including the header itself
+        i32 count;
+        atomic_i32 released;
+    };
+    // Records are also a multiple of this, so headers are always aligned
+    static constexpr i32 HeaderCount = (i32)((sizeof(RecordHeader) + sizeof(T) - 1) / sizeof(T));
 
-    SyncRingBuffer( i32 capacity, AllocType* allocator = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
-        : buffer( capacity, allocator, params )
-        , indexData( 0 )
+    T* data;
+    i32 capacity;
+    sz mappedSize;
+
+    // Keep producers & the consumer on separate cache lines so they don't keep invalidating each other
+    alignas(64) atomic_u64 writePos;
+    alignas(64) atomic_u64 readPos;
+
+
+    MirroredRingBuffer()
+        : data( nullptr )
+        , capacity( 0 )
+        , mappedSize( 0 )
+        , writePos( 0 )
+        , readPos( 0 )
+    {}
+
+    // Capacity will be rounded up to the platform's allocation granularity
+    explicit MirroredRingBuffer( i32 minCapacity )
+        : writePos( 0 )
+        , readPos( 0 )
     {
-        _CheckLayout();
+        sz sizeBytes = NextPowerOf2( minCapacity ) * SIZEOF(T);
+        data = (T*)globalPlatform.AllocMirrored( sizeBytes, &mappedSize );
+        ASSERT( data, "Failed to map mirrored memory" );
+
+        capacity = data ? I32( mappedSize / SIZEOF(T) ) : 0;
         ASSERT( IsPowerOf2( capacity ) );
-        buffer.ResizeToCapacity();
     }
 
-    void _CheckLayout()
+    ~MirroredRingBuffer()
     {
-        ASSERT( indexData.is_lock_free(), "'indexData' attribute is not lock-free (check alignment?)" );
-    };
+        if( data )
+            globalPlatform.FreeMirrored( data, mappedSize );
+    }
 
-    int Count() const { return (int)(indexData.LOAD_ACQUIRE() >> 32); }
-    int Capacity() const { return buffer.capacity; }
-    bool Empty() const { return Count() > 0; }
-    bool Available() const { return Count() < buffer.capacity; }
+    MirroredRingBuffer( MirroredRingBuffer const& ) = delete;
+    MirroredRingBuffer& operator =( MirroredRingBuffer const& ) = delete;
 
-    void Clear()
-    {
-        indexData.STORE_RELEASE( 0 );
-    }
+    // Total items currently in use, including record headers
+    // NOTE Only a snapshot, as other threads may be pushing / releasing concurrently
+    int Count() const { return (int)(writePos.LOAD_ACQUIRE() - readPos.LOAD_ACQUIRE()); }
+    int Capacity() const { return capacity; }
+    bool Empty() const { return Count() == 0; }
+    // Largest record that could ever fit
+    int MaxRecordCount() const { return capacity - HeaderCount; }
 
-    T* PushEmpty( bool clear = true )
+    // Reserve a contiguous record of 'count' items, or return nullptr if there's not enough space right now
+    T* PushEmpty( int count )
     {
-        u32 headIndex;
-        u64 newData, curData = indexData.LOAD_RELAXED();
+        ASSERT( count > 0 && count <= MaxRecordCount() );
+        u64 total = (u64)AlignUp( (sz)(HeaderCount + count), (sz)HeaderCount );
+
+        u64 pos = writePos.LOAD_RELAXED();
         do
         {
-            headIndex = curData & 0xFFFFFFFF;
-            u64 count = curData >> 32;
-
-            u64 onePastHeadIndex = (headIndex + 1) & (buffer.capacity - 1);
-            if( count < (u64)buffer.capacity )
-                count++;
-
-            newData = (count << 32) | onePastHeadIndex;
-        } while( !indexData.COMPARE_EXCHANGE_ACQREL( curData, newData ) );
-
-        T* slot = buffer.data + headIndex;
-        // FIXME This is wrong. Consumer can observe slot pointer not cleared
-        if( clear )
-            ZEROP( slot, sizeof(T) );
+            if( pos + total - readPos.LOAD_ACQUIRE() > (u64)capacity )
+                return nullptr;
+        } while( !writePos.compare_exchange_weak( pos, pos + total, std::memory_order_relaxed ) );
 
-        return slot;
+        RecordHeader* header = (RecordHeader*)(data + (pos & (capacity - 1)));
+        header->count = (i32)total;
+        return (T*)header + HeaderCount;
     }
 
-    T* Push( const T& item )
+    T* Push( T const* items, int count )
     {
-        T* slot = PushEmpty( false );
-        // FIXME Consumer can observe slot pointer being empty
-        *slot = item;
-        return slot;
+        T* result = PushEmpty( count );
+        if( result )
+            COPYP( items, result, count * SIZEOF(T) );
+        return result;
     }
 
-    // TODO Remove
-    T* PushEmptyRangeAdjacent( int rangeLen, bool clear = true )
+    // Give back a record returned by Push / PushEmpty
+    // NOTE Must always be called from the same thread
+    void Release( T* record )
     {
-        u32 len = U32(rangeLen);
+        RecordHeader* header = (RecordHeader*)(record - HeaderCount);
+        header->released.STORE_RELAXED( 1 );
 
-        u32 headIndex;
-        u64 newData, curData = indexData.LOAD_RELAXED();
-        do
+        // Free up as many consecutive released records as we can
+        // Any records that were reserved but are still being written read back as zero, since memory is cleared on release
+        u64 pos = readPos.LOAD_RELAXED();
+        u64 end = writePos.LOAD_ACQUIRE();
+        while( pos < end )
         {
-            headIndex = curData & 0xFFFFFFFF;
-            u64 count = curData >> 32;
+            RecordHeader* h = (RecordHeader*)(data + (pos & (capacity - 1)));
+            if( !h->released.LOAD_ACQUIRE() )
+                break;
+
+            i32 count = h->count;
+            ZEROP( h, count * SIZEOF(T) );
+            pos += (u64)count;
+        }
+        readPos.STORE_RELEASE( pos );
+    }
+
+    // Give back a record returned by Push / PushEmpty from any thread
+    // NOTE Its space is only actually freed by the next call to Release
+    void Discard( T* record )
+    {
+        RecordHeader* header = (RecordHeader*)(record - HeaderCount);
+        header->released.STORE_RELEASE( 1 );
+    }
+};
 
-            u32 remaining = buffer.capacity - headIndex;
-            bool adjacent = remaining >= len;
 
-            // If we're close to the end of the buffer and the range doesn't fit, skip the remaining bytes and place it at the front
-            u64 onePastHeadIndex = adjacent ? (headIndex + len) & (buffer.capacity - 1) : len;
-            if( !adjacent )
-                headIndex = 0;
-            count += (adjacent ? len : remaining + len);
-            count = Min( count, (u64)buffer.capacity );
 
-            newData = (count << 32) | onePastHeadIndex;
-        } while( !indexData.COMPARE_EXCHANGE_ACQREL( curData, newData ) );
+/////     SYNC QUEUE    /////
+// Thread safe, lock-free, unbounded queue (multi-producer, multi-consumer).
+// Every producer thread gets its own sub-queue, made out of a linked list of fixed-size SyncRingBuffer blocks, so producers
+// never contend with each other. Consumers go round all sub-queues looking for items.
+// Items pushed by any single producer are popped in the same order, but there's no ordering between different producers.
+// Blocks that have been emptied are recycled back into their sub-queue once no consumer is looking at them anymore.
+// https://moodycamel.com/blog/2013/a-fast-lock-free-queue-for-c++.htm
+// https://moodycamel.com/blog/2014/a-fast-general-purpose-lock-free-queue-for-c++.htm
 
-        T* slot = buffer.data + headIndex;
-        if( clear )
-            // TODO Clear the skipped end of the buffer too?
-            ZEROP( slot, rangeLen * SIZEOF(T) );
+// TODO Also consider switching all datatypes of this kind to a 'virtual stream' model .. https://fgiesen.wordpress.com/2010/12/14/ring-buffers-and-queues/
+// TODO Consider a huge circular buffer that is mapped using the "sparse memory" technique Casey explains in
+// https://youtu.be/H8THRznXxpQ?si=poiWfwaWYP0dmQhD&t=1887, i.e. essentially keeping a page table and mapping / unmapping pages
+// as the data is produced / consumed. This is only valid if we can live with our queues being bounded (which, given that the
+// max size can be as huge as we want is probably really really worth it!)
+template <typename T, typename AllocType = Allocator>
+struct SyncQueue
+{
+    struct Block
+    {
+        SyncRingBuffer<T, AllocType> ring;
+        std::atomic<Block*> next;
+        // Number of consumers currently looking at this block, plus a flag set once it's been unlinked from its sub-queue
+        atomic_u32 state;
+        Block* nextFree;
+        // What we actually got from the allocator
+        void* memoryBlock;
+
+        Block( i32 capacity, AllocType* allocator )
+            : ring( capacity, allocator )
+            , next( nullptr )
+            , state( 0 )
+            , nextFree( nullptr )
+            , memoryBlock( nullptr )
+        {}
+    };
+    static constexpr u32 Retired = 0x80000000;
+
+    struct ProducerQueue
+    {
+        // Oldest block, where consumers pop from
+        std::atomic<Block*> head;
+        // Newest block, only touched by the producer
+        Block* tail;
+        // Blocks recycled by consumers, waiting to be picked up by the producer
+        std::atomic<Block*> recycledBlocks;
+        // Blocks already picked up by the producer
+        Block* freeBlocks;
+        // Never changes once the sub-queue has been published
+        ProducerQueue* next;
+        u32 threadId;
+    };
 
-        return slot;
-    }
+    AllocType* allocator;
+    std::atomic<ProducerQueue*> producers;
+    i32 blockCapacity;
+    // Used by threads to remember the last queue they used
+    u64 queueId;
+
+    SyncQueue()
+        : allocator( nullptr )
+        , producers( nullptr )
+        , blockCapacity( 0 )
+        , queueId( 0 )
+    {}
 
-    // TODO Remove
-    T* PushRangeAdjacent( T const* item, int rangeLen )
+    SyncQueue( int pageCapacity, AllocType* alloc = CTX_ALLOC )
+        : allocator( alloc )
+        , producers( nullptr )
+        , blockCapacity( pageCapacity )
     {
-        T* slot = PushEmptyRangeAdjacent( rangeLen, false );
-        COPYP( item, slot, rangeLen * sizeof(T) );
-        return slot;
+        ASSERT( IsPowerOf2( pageCapacity ) );
+
+        persistent std::atomic<u64> nextQueueId( 1 );
+        queueId = nextQueueId.fetch_add( 1, std::memory_order_relaxed );
     }
 
-    bool TryPop( T* out )
+    ~SyncQueue()
     {
-        u64 count, onePastHeadIndex;
-        u64 newData, curData = indexData.LOAD_ACQUIRE();
-        do
+        ProducerQueue* p = producers.LOAD_ACQUIRE();
+        while( p )
         {
-            onePastHeadIndex = curData & 0xFFFFFFFF;
-            count = curData >> 32;
+            Block* b = p->head.LOAD_RELAXED();
+            while( b )
+            {
+                Block* next = b->next.LOAD_RELAXED();
+                FreeBlock( b );
+                b = next;
+            }
+            FreeBlockList( p->recycledBlocks.LOAD_RELAXED() );
+            FreeBlockList( p->freeBlocks );
+
+            ProducerQueue* next = p->next;
+            DELETE( allocator, p, ProducerQueue );
+            p = next;
+        }
+    }
 
-            // Try to do the whole #! and just return whether we did anything at the end
-            u64 newCount = (count > 0) ? count - 1 : count;
-            newData = (newCount << 32) | onePastHeadIndex;
+    SyncQueue( SyncQueue const& ) = delete;
+    SyncQueue& operator =( SyncQueue const& ) = delete;
 
-        } while( !indexData.COMPARE_EXCHANGE_ACQREL( curData, newData ) );
+    void Push( const T& item )
+    {
+        PushInternal( item );
+    }
 
-        bool success = count > 0;
-        if( success )
-        {
-            u64 tailIndex = onePastHeadIndex - count;
-            tailIndex &= (buffer.capacity - 1);
-            // FIXME By the time we do the copy someone could have pushed at this index
-            *out = buffer.data[tailIndex];
-        }
-        return success;
+    void Push( T&& item )
+    {
+        PushInternal( std::move( item ) );
     }
 
-    bool TryPopHead( T* out )
+    bool TryPop( T* out )
     {
-        u64 count, onePastHeadIndex;
-        u64 newData, curData = indexData.LOAD_ACQUIRE();
-        do
-        {
-            onePastHeadIndex = curData & 0xFFFFFFFF;
-            count = curData >> 32;
+        ProducerQueue* first = producers.LOAD_ACQUIRE();
+        if( !first )
+            return false;
 
-            // Try to do the whole #! and just return whether we did anything at the end
-            onePastHeadIndex = count > 0 ? ((onePastHeadIndex - 1) & (buffer.capacity - 1)) : onePastHeadIndex;
-            u64 newCount     = count > 0 ? (count - 1) : count;
-            newData = (newCount << 32) | onePastHeadIndex;
+        // Keep popping from the same sub-queue while it has items
+        Memo& memo = GetMemo();
+        ProducerQueue* start = memo.lastPopped ? memo.lastPopped : first;
 
-        } while( !indexData.COMPARE_EXCHANGE_ACQREL( curData, newData ) );
+        ProducerQueue* p = start;
+        do
+        {
+            if( TryPopFrom( p, out ) )
+            {
+                memo.lastPopped = p;
+                return true;
+            }
+            p = p->next ? p->next : first;
+        } while( p != start );
 
-        bool success = count > 0;
-        if( success )
-            // FIXME By the time we do the copy someone could have pushed again
-            *out = buffer.data[onePastHeadIndex];
+        return false;
+    }
 
-        return success;
+    // NOTE Only a snapshot, as other threads may be pushing / popping concurrently
+    int Count() const
+    {
+        int result = 0;
+        for( ProducerQueue* p = producers.LOAD_ACQUIRE(); p; p = p->next )
+            for( Block* b = p->head.LOAD_ACQUIRE(); b; b = b->next.LOAD_ACQUIRE() )
+                result += b->ring.Count();
+        return result;
     }
 
-    // TODO PeekHead & PeekTail
+    bool Empty() const { return Count() == 0; }
 
-    T& Head( int offset = 0 )
+    // NOTE Like the old mutex-based version, the returned pointer is only valid until the item is popped,
+    // and this is NOT safe to use while other threads are popping concurrently
+    T* Find( T const& item )
     {
-        ASSERT( offset >= 0, "Only positive offsets" );
-        int count = 0;
-        int index = IndexFromHeadOffset( -offset, &count );
-        ASSERT( count > offset, "Not enough items in buffer" );
+        return Find( [&item]( T const& it ) { return it == item; } );
+    }
 
-        return buffer.data[index];
+    T const* Find( T const& item ) const
+    {
+        return ((SyncQueue<T, AllocType>*)this)->Find( item );
     }
-    T const& Head( int offset = 0 ) const
+
+    bool Contains( T const& item ) const
     {
-        return ((SyncRingBuffer<T>*)this)->Head( offset );
+        return Find( item ) != nullptr;
     }
 
-    T& Tail( int offset = 0 )
+    template<typename Predicate>
+    T* Find( Predicate&& pred )
     {
-        ASSERT( offset >= 0, "Only positive offsets" );
-        int count = 0;
-        int idx = IndexFromTailOffset( offset, &count );
-        ASSERT( count > offset, "Not enough items in buffer" );
+        for( ProducerQueue* p = producers.LOAD_ACQUIRE(); p; p = p->next )
+            for( Block* b = p->head.LOAD_ACQUIRE(); b; b = b->next.LOAD_ACQUIRE() )
+                if( T* it = b->ring.Find( pred ) )
+                    return it;
 
-        return buffer.data[idx];
+        return nullptr;
     }
-    T const& Tail( int offset = 0 ) const
+
+    template<typename Predicate>
+    T const* Find( Predicate&& pred ) const
     {
-        return ((SyncRingBuffer<T>*)this)->Tail( offset );
+        return ((SyncQueue<T, AllocType>*)this)->Find( pred );
     }
 
-private:
-    int TailIndex() const
+    template<typename Predicate>
+    bool Contains( Predicate&& pred ) const
     {
-        return IndexFromTailOffset( 0, nullptr );
+        return Find( pred ) != nullptr;
     }
 
-    int IndexFromHeadOffset( int offset, int* countOut = nullptr ) const
+private:
+    struct Memo
     {
-        u64 curData = indexData.LOAD_ACQUIRE();
-        u32 onePastHeadIndex = curData & 0xFFFFFFFF;
-        if( countOut )
-            *countOut = (int)(curData >> 32);
-
-        int result = (int)(onePastHeadIndex + offset - 1);
-        result &= (buffer.capacity - 1);
+        u64 queueId;
+        ProducerQueue* producer;
+        ProducerQueue* lastPopped;
+    };
 
-        return result;
+    Memo& GetMemo()
+    {
+        static thread_local Memo memo = {};
+        if( memo.queueId != queueId )
+            memo = { queueId, nullptr, nullptr };
+        return memo;
     }
 
-    int IndexFromTailOffset( int offset, int* countOut = nullptr ) const
+    template <typename U>
+    void PushInternal( U&& item )
     {
-        u64 curData = indexData.LOAD_ACQUIRE();
-        u32 onePastHeadIndex = curData & 0xFFFFFFFF;
-        u32 count = curData >> 32;
+        ProducerQueue* p = GetProducerQueue();
 
-        int result = (int)(onePastHeadIndex - count + offset);
-        result &= (buffer.capacity - 1);
+        if( !p->tail->ring.Push( std::forward<U>( item ) ) )
+        {
+            // Fill up a new block before making it visible to consumers
+            Block* block = AllocBlock( p );
+            bool pushed = block->ring.Push( std::forward<U>( item ) );
+            ASSERT( pushed );
 
-        if( countOut )
-            *countOut = (int)count;
-        return result;
+            p->tail->next.STORE_RELEASE( block );
+            p->tail = block;
+        }
     }
 
-
-public:
-    // NOTE Consider this just an "imprecise view" of the buffer contents
-    // NOTE This is inherently NOT threadsafe, hence made read-only
-    struct Iterator
+    ProducerQueue* GetProducerQueue()
     {
-    protected:
-        SyncRingBuffer<T>& b;
-        T const* current;
-        i32 currentIndex;
-        bool forward;
+        Memo& memo = GetMemo();
+        if( memo.producer )
+            return memo.producer;
 
-    public:
-        Iterator( SyncRingBuffer& buffer_, bool forward_ = true )
-            : b( buffer_ )
-                , current( nullptr )
-                , currentIndex( 0 )
-                , forward( forward_ )
+        u32 threadId = Core::GetThreadId();
+        ProducerQueue* first = producers.LOAD_ACQUIRE();
+        for( ProducerQueue* p = first; p; p = p->next )
         {
-            if( b.Count() )
+            if( p->threadId == threadId )
             {
-                currentIndex = forward ? b.TailIndex() : b.IndexFromHeadOffset( 0 );
-                current = &b.buffer.data[currentIndex];
+                memo.producer = p;
+                return p;
             }
         }
 
-        operator bool() { return current != nullptr; }
-        T const& operator * () { return *current; }
-        T const* operator ->() { return current; }
+        ProducerQueue* result = NEW( allocator, ProducerQueue );
+        result->threadId = threadId;
+        result->recycledBlocks.STORE_RELAXED( nullptr );
+        result->freeBlocks = nullptr;
+        result->tail = AllocBlock( result );
+        result->head.STORE_RELAXED( result->tail );
 
-        // Prefix
-        inline Iterator& operator ++()
+        // Only this thread ever adds a sub-queue with this id, so there's no need to look again if this fails
+        result->next = first;
+        while( !producers.compare_exchange_weak( result->next, result, std::memory_order_release, std::memory_order_relaxed ) )
+            ;
+
+        memo.producer = result;
+        return result;
+    }
+
+    bool TryPopFrom( ProducerQueue* p, T* out )
+    {
+        while( true )
         {
-            if( current )
-            {
-                int onePastHeadIndex = b.IndexFromHeadOffset( 1 );
-                int tailIndex = b.TailIndex();
+            Block* block = p->head.LOAD_ACQUIRE();
+            if( !EnterBlock( p, block ) )
+                continue;
 
-                if( forward )
-                {
-                    currentIndex = (currentIndex + 1) & (b.buffer.capacity - 1);
-                    current = (currentIndex == onePastHeadIndex) ? nullptr : &b.buffer.data[currentIndex];
-                }
-                else
+            bool popped = block->ring.TryPop( out );
+            if( !popped )
+            {
+                Block* next = block->next.LOAD_ACQUIRE();
+                if( next )
                 {
-                    currentIndex--;
-                    bool wrapped = onePastHeadIndex < tailIndex;
-                    bool finished = wrapped ? (currentIndex >= onePastHeadIndex && currentIndex < tailIndex)
-                                            : (currentIndex < tailIndex);
-
-                    currentIndex &= (b.buffer.capacity - 1);
-                    current = finished ? nullptr : &b.buffer.data[currentIndex];
+                    // The producer doesn't touch a block once it has linked the next one,
+                    // so if this is still empty now it will stay empty
+                    popped = block->ring.TryPop( out );
+                    if( !popped )
+                    {
+                        if( p->head.compare_exchange_strong( block, next, std::memory_order_acq_rel ) )
+                            block->state.fetch_or( Retired, std::memory_order_acq_rel );
+                        LeaveBlock( p, block );
+                        continue;
+                    }
                 }
             }
 
-            return *this;
+            LeaveBlock( p, block );
+            return popped;
         }
-    };
-    Iterator MakeIterator( bool forward = true )
-    {
-        return Iterator( *this, forward );
     }
-};
-
-
-
-/////     SYNC QUEUE    /////
-// Thread safe queue.
-// TODO Lock-free
-// https://moodycamel.com/blog/2013/a-fast-lock-free-queue-for-c++.htm
-// https://moodycamel.com/blog/2014/a-fast-general-purpose-lock-free-queue-for-c++.htm
-
-// TODO Also consider switching all datatypes of this kind to a 'virtual stream' model .. https://fgiesen.wordpress.com/2010/12/14/ring-buffers-and-queues/
 
-// TODO Simplify and rethink the circular buffer used in each Page by using the repeated page mapping technique Casey uses
-// explained in https://youtu.be/H8THRznXxpQ?si=9IQLXNsvHnEbw6xo&t=702
-// TODO Actually, it's probably much simpler to just get rid of using circular buffers in each page, and instead switch to huge circular buffer that is
-// mapped using the "sparse memory" technique Casey explains in https://youtu.be/H8THRznXxpQ?si=poiWfwaWYP0dmQhD&t=1887, i.e. essentially keeping a page table
-// and mapping / unmapping pages as the data is produced / consumed.
-// (TOGETHER with the "mirrored-pages" circular buffer technique above, so that we can actually get to the end of it and auto-wrap around)
-// This is only valid if we can live with our queues being bounded (which, given that the max size can be as huge as we want is probably really really worth it!)
-// Also, this would in principle make it a multi-producer multi-consumer queue, which is really cool.
-template <typename T, typename AllocType = Allocator>
-struct SyncQueue
-{
-    struct Page
+    bool EnterBlock( ProducerQueue* p, Block* block )
     {
-        Page* next;
-        i32 capacity;
-        i32 count;
-        i32 onePastTailIndex;
+        block->state.fetch_add( 1, std::memory_order_acq_rel );
+        // Make sure it wasn't unlinked (and maybe recycled) before we got here
+        if( p->head.LOAD_ACQUIRE() != block )
+        {
+            LeaveBlock( p, block );
+            return false;
+        }
+        return true;
+    }
 
-        int HeadIndex() const
+    void LeaveBlock( ProducerQueue* p, Block* block )
+    {
+        u32 prev = block->state.fetch_sub( 1, std::memory_order_acq_rel );
+        if( prev == (Retired | 1) )
         {
-            int result = onePastTailIndex - count;
-            result &= (capacity - 1 );
-            return result;
+            // Last one out recycles it (making sure nobody else does)
+            u32 expected = Retired;
+            if( block->state.compare_exchange_strong( expected, 0, std::memory_order_acq_rel ) )
+            {
+                block->nextFree = p->recycledBlocks.LOAD_RELAXED();
+                while( !p->recycledBlocks.compare_exchange_weak( block->nextFree, block, std::memory_order_release,
+                                                                std::memory_order_relaxed ) )
+                    ;
+            }
         }
-    };
+    }
 
-    Mutex mutex;
-    AllocType* allocator;
+    Block* AllocBlock( ProducerQueue* p )
+    {
+        if( !p->freeBlocks )
+            p->freeBlocks = p->recycledBlocks.exchange( nullptr, std::memory_order_acquire );
 
-    Page* head;
-    Page* tail;
-    Page* firstFree;
-    i32 count;
+        Block* result = p->freeBlocks;
+        if( result )
+        {
+            p->freeBlocks = result->nextFree;
+            result->next.STORE_RELAXED( nullptr );
+        }
+        else
+        {
+            // Not every allocator can give us the cache line alignment the ring needs, so leave room to align it ourselves
+            void* memoryBlock = ALLOC( allocator, SIZEOF(Block) + alignof(Block) - 1 );
+            ASSERT( memoryBlock );
 
-    SyncQueue()
-        : allocator( nullptr )
-        , head( nullptr )
-        , tail( nullptr )
-        , firstFree( nullptr )
-        , count( 0 )
-    {}
+            result = (Block*)AlignUp( memoryBlock, alignof(Block) );
+            INIT( *result )( blockCapacity, allocator );
+            result->memoryBlock = memoryBlock;
+        }
 
-    SyncQueue( int pageCapacity, AllocType* alloc = CTX_ALLOC )
-        : allocator( alloc )
-        , head( nullptr )
-        , tail( nullptr )
-        , firstFree( nullptr )
-        , count( 0 )
-    {
-        ASSERT( IsPowerOf2( pageCapacity ) );
-        head = tail = AllocPage( pageCapacity );
+        return result;
     }
 
-private:
-    T* PageItemUnsafe( Page* p, int index )
+    void FreeBlock( Block* b )
     {
-        // Skip Page header
-        return (T*)((u8*)p + sizeof(Page) + index * sizeof(T));
+        void* memoryBlock = b->memoryBlock;
+        b->~Block();
+        FREE( allocator, memoryBlock );
     }
 
-    T* PushEmptyUnsafe( bool clear = true )
+    void FreeBlockList( Block* b )
     {
-        if( tail->count >= tail->capacity )
+        while( b )
         {
-            tail->next = AllocPage( tail->capacity );
-            tail = tail->next;
+            Block* next = b->nextFree;
+            FreeBlock( b );
+            b = next;
         }
+    }
+};
 
-        T* slot = PageItemUnsafe( tail, tail->onePastTailIndex );
-        tail->onePastTailIndex = (tail->onePastTailIndex + 1) & (tail->capacity - 1);
-        tail->count++;
 
-        count++;
+/////     SORTING     /////
 
-        if( clear )
-            ZEROP( slot, sizeof(T) );
-        return slot;
-    }
+// LSD radix sort for any integer or float type, optionally carrying along a parallel array of values (i.e. indices),
+// and MSD radix sort for Strings. Both are stable. Really small inputs go through a sorting network instead.
+// Scratch memory comes from the given allocator (temporary memory by default), and is always freed before returning.
 
-public:
-    T* PushEmpty( bool clear = true )
-    {
-        Mutex::Scope lock( mutex );
-        return PushEmptyUnsafe( clear );
+namespace Sort
+{
+    // Map keys to unsigned integers that sort in the same order
+    INLINE u32 RadixKey( u8 v )     { return v; }
+    INLINE u32 RadixKey( u16 v )    { return v; }
+    INLINE u32 RadixKey( u32 v )    { return v; }
+    INLINE u64 RadixKey( u64 v )    { return v; }
+    INLINE u32 RadixKey( i8 v )     { return (u8)v ^ 0x80u; }
+    INLINE u32 RadixKey( i16 v )    { return (u16)v ^ 0x8000u; }
+    INLINE u32 RadixKey( i32 v )    { return (u32)v ^ 0x80000000u; }
+    INLINE u64 RadixKey( i64 v )    { return (u64)v ^ 0x8000000000000000ull; }
+    // Negative floats need all their bits flipped so they sort backwards, positive ones just go above them
+    INLINE u32 RadixKey( f32 v )
+    {
+        u32 bits;
+        memcpy( &bits, &v, sizeof(bits) );
+        return bits ^ ((u32)-(i32)(bits >> 31) | 0x80000000u);
+    }
+    INLINE u64 RadixKey( f64 v )
+    {
+        u64 bits;
+        memcpy( &bits, &v, sizeof(bits) );
+        return bits ^ ((u64)-(i64)(bits >> 63) | 0x8000000000000000ull);
+    }
+    // Make long & co. work on platforms where they're not one of the above
+    template <typename T>
+    INLINE auto RadixKey( T v ) -> decltype( RadixKey( (typename std::conditional<sizeof(T) == 8, i64, i32>::type)v ) )
+    {
+        static_assert( std::is_integral<T>::value, "Unsupported radix key type" );
+        IF( std::is_signed<T>::value )
+            return RadixKey( (typename std::conditional<sizeof(T) == 8, i64, i32>::type)v );
+        else
+            return RadixKey( (typename std::conditional<sizeof(T) == 8, u64, u32>::type)v );
     }
 
-    T* Push( const T& item )
+    // Below this, the overhead of the histograms is not worth it
+    static constexpr sz RadixMinCount = 64;
+
+
+    template <typename K, typename V>
+    INLINE void InsertionSort( K* keys, V* values, sz count )
     {
-        Mutex::Scope lock( mutex );
-        T* slot = PushEmptyUnsafe( false );
-        *slot = item;
+        for( sz i = 1; i < count; ++i )
+        {
+            K key = keys[i];
+            auto rk = RadixKey( key );
+            sz j = i;
 
-        return slot;
+            IF( std::is_same<V, void>::value )
+            {
+                for( ; j > 0 && RadixKey( keys[j - 1] ) > rk; --j )
+                    keys[j] = keys[j - 1];
+                keys[j] = key;
+            }
+            else
+            {
+                auto value = values[i];
+                for( ; j > 0 && RadixKey( keys[j - 1] ) > rk; --j )
+                {
+                    keys[j] = keys[j - 1];
+                    values[j] = values[j - 1];
+                }
+                keys[j] = key;
+                values[j] = value;
+            }
+        }
     }
 
-    T* Push( T&& item )
+#if defined(__AVX2__)
+    // Bitonic sorting network for up to 16 32-bit keys, held in a pair of AVX2 registers
+    // Every step compares each lane with a partner lane, given by the permutation, and the mask selects the lanes keeping the max
+    template <typename K> struct NetworkOps;
+
+    template <> struct NetworkOps<i32>
+    {
+        using Vec = __m256i;
+        static constexpr i32 Pad = I32MAX;
+        static INLINE Vec Load( i32 const* p )                  { return _mm256_loadu_si256( (Vec const*)p ); }
+        static INLINE void Store( i32* p, Vec v )               { _mm256_storeu_si256( (Vec*)p, v ); }
+        static INLINE Vec Min( Vec a, Vec b )                   { return _mm256_min_epi32( a, b ); }
+        static INLINE Vec Max( Vec a, Vec b )                   { return _mm256_max_epi32( a, b ); }
+        static INLINE Vec Permute( Vec v, __m256i perm )        { return _mm256_permutevar8x32_epi32( v, perm ); }
+        template <int Mask> static INLINE Vec Blend( Vec a, Vec b ) { return _mm256_blend_epi32( a, b, Mask ); }
+    };
+    template <> struct NetworkOps<u32> : public NetworkOps<i32>
     {
-        Mutex::Scope lock( mutex );
-        T* slot = PushEmptyUnsafe( false );
-        *slot = std::move( item );
+        static constexpr u32 Pad = U32MAX;
+        static INLINE Vec Load( u32 const* p )                  { return _mm256_loadu_si256( (Vec const*)p ); }
+        static INLINE void Store( u32* p, Vec v )               { _mm256_storeu_si256( (Vec*)p, v ); }
+        static INLINE Vec Min( Vec a, Vec b )                   { return _mm256_min_epu32( a, b ); }
+        static INLINE Vec Max( Vec a, Vec b )                   { return _mm256_max_epu32( a, b ); }
+    };
+    // NOTE NaNs are not ordered
+    template <> struct NetworkOps<f32>
+    {
+        using Vec = __m256;
+        static constexpr f32 Pad = INFINITY;
+        static INLINE Vec Load( f32 const* p )                  { return _mm256_loadu_ps( p ); }
+        static INLINE void Store( f32* p, Vec v )               { _mm256_storeu_ps( p, v ); }
+        static INLINE Vec Min( Vec a, Vec b )                   { return _mm256_min_ps( a, b ); }
+        static INLINE Vec Max( Vec a, Vec b )                   { return _mm256_max_ps( a, b ); }
+        static INLINE Vec Permute( Vec v, __m256i perm )        { return _mm256_permutevar8x32_ps( v, perm ); }
+        template <int Mask> static INLINE Vec Blend( Vec a, Vec b ) { return _mm256_blend_ps( a, b, Mask ); }
+    };
 
-        return slot;
+    template <typename Ops, int Mask>
+    INLINE typename Ops::Vec CompareExchange( typename Ops::Vec v, __m256i perm )
+    {
+        typename Ops::Vec p = Ops::Permute( v, perm );
+        return Ops::template Blend<Mask>( Ops::Min( v, p ), Ops::Max( v, p ) );
     }
 
-    bool TryPop( T* out )
+    template <typename Ops>
+    INLINE typename Ops::Vec BitonicClean8( typename Ops::Vec v )
     {
-        bool canPop = count > 0;
-        if( canPop )
-        {
-            Mutex::Scope lock( mutex );
+        v = CompareExchange<Ops, 0xF0>( v, _mm256_setr_epi32( 4, 5, 6, 7, 0, 1, 2, 3 ) );
+        v = CompareExchange<Ops, 0xCC>( v, _mm256_setr_epi32( 2, 3, 0, 1, 6, 7, 4, 5 ) );
+        v = CompareExchange<Ops, 0xAA>( v, _mm256_setr_epi32( 1, 0, 3, 2, 5, 4, 7, 6 ) );
+        return v;
+    }
 
-            canPop = count > 0;
-            if( canPop )
-            {
-                T* slot = PageItemUnsafe( head, head->HeadIndex() );
-                *out = std::move( *slot );
-                head->count--;
+    template <typename Ops>
+    INLINE typename Ops::Vec Sort8( typename Ops::Vec v )
+    {
+        __m256i swap1 = _mm256_setr_epi32( 1, 0, 3, 2, 5, 4, 7, 6 );
+        v = CompareExchange<Ops, 0x66>( v, swap1 );
+        v = CompareExchange<Ops, 0x3C>( v, _mm256_setr_epi32( 2, 3, 0, 1, 6, 7, 4, 5 ) );
+        v = CompareExchange<Ops, 0x5A>( v, swap1 );
+        return BitonicClean8<Ops>( v );
+    }
 
-                if( head->count == 0 && head != tail )
-                {
-                    Page* oldHead = head;
-                    head = head->next;
+    template <typename K>
+    INLINE void SortNetwork( K* keys, sz count )
+    {
+        using Ops = NetworkOps<K>;
+        ASSERT( count <= 16 );
 
-                    oldHead->next = firstFree;
-                    firstFree = oldHead;
-                }
+        K padded[16];
+        for( sz i = 0; i < 16; ++i )
+            padded[i] = i < count ? keys[i] : (K)Ops::Pad;
 
-                count--;
-            }
+        typename Ops::Vec a = Sort8<Ops>( Ops::Load( padded ) );
+        if( count > 8 )
+        {
+            typename Ops::Vec b = Sort8<Ops>( Ops::Load( padded + 8 ) );
+            // Reversing one half makes the whole thing bitonic, so one round of min/max splits it into the lower & upper halves
+            b = Ops::Permute( b, _mm256_setr_epi32( 7, 6, 5, 4, 3, 2, 1, 0 ) );
+            typename Ops::Vec lo = Ops::Min( a, b );
+            typename Ops::Vec hi = Ops::Max( a, b );
+            a = BitonicClean8<Ops>( lo );
+            Ops::Store( padded + 8, BitonicClean8<Ops>( hi ) );
         }
+        Ops::Store( padded, a );
 
-        return canPop;
+        COPYP( padded, keys, count * SIZEOF(K) );
     }
 
-    T* Find( T const& item )
+    template <typename K>
+    constexpr bool HasSortNetwork = std::is_same<K, i32>::value || std::is_same<K, u32>::value || std::is_same<K, f32>::value;
+#else
+    template <typename K>
+    INLINE void SortNetwork( K* keys, sz count )
+    {}
+
+    template <typename K>
+    constexpr bool HasSortNetwork = false;
+#endif
+
+    // Keys are moved between the original array and the scratch buffer on every pass, and values follow along
+    template <typename K, typename V, typename AllocType>
+    void RadixSort( K* keys, V* values, sz count, AllocType* scratchAlloc )
     {
-        Mutex::Scope lock( mutex );
+        using KeyType = decltype( RadixKey( *keys ) );
+        static constexpr int PassCount = (int)sizeof(K);
+        static constexpr bool HasValues = !std::is_same<V, void>::value;
+        using ValueType = typename std::conditional<HasValues, V, u8>::type;
 
-        Page* p = head;
-        while( p )
+        if( count < 2 )
+            return;
+        IF( !HasValues && HasSortNetwork<K> )
         {
-            for( int i = 0; i < p->count; ++i )
+            // Tiny inputs are better served by plain insertion sort
+            if( count > 4 && count <= 16 )
             {
-                int index = (p->HeadIndex() + i) & (p->capacity - 1);
-                T* it = PageItemUnsafe( p, index );
-                if( *it == item )
-                    return it;
+                SortNetwork( keys, count );
+                return;
             }
-            p = p->next;
+        }
+        if( count < RadixMinCount )
+        {
+            InsertionSort( keys, values, count );
+            return;
         }
 
-        return nullptr;
-    }
-
-    T const* Find( T const& item ) const
-    {
-        return ((SyncQueue<T, AllocType>*)this)->Find( item );
-    }
+        // Build histograms for all digits in one go
+        sz counts[PassCount][256] = {};
+        for( sz i = 0; i < count; ++i )
+        {
+            KeyType k = RadixKey( keys[i] );
+            for( int p = 0; p < PassCount; ++p )
+                counts[p][(k >> (p * 8)) & 0xFF]++;
+        }
 
-    bool Contains( T const& item ) const
-    {
-        return Find( item ) != nullptr;
-    }
+        K* scratchKeys = ALLOC_ARRAY( scratchAlloc, K, count, Memory::NoClear() );
+        ValueType* scratchValues = nullptr;
+        IF( HasValues )
+            scratchValues = ALLOC_ARRAY( scratchAlloc, ValueType, count, Memory::NoClear() );
 
-    template<typename Predicate>
-    T* Find( Predicate&& pred )
-    {
-        Mutex::Scope lock( mutex );
+        K* keysIn = keys;
+        K* keysOut = scratchKeys;
+        ValueType* valuesIn = (ValueType*)values;
+        ValueType* valuesOut = scratchValues;
 
-        Page* p = head;
-        while( p )
+        for( int p = 0; p < PassCount; ++p )
         {
-            for( int i = 0; i < p->count; ++i )
+            sz* c = counts[p];
+            int shift = p * 8;
+
+            // Skip digits where all keys are the same
+            KeyType first = RadixKey( keysIn[0] );
+            if( c[(first >> shift) & 0xFF] == count )
+                continue;
+
+            sz offsets[256];
+            sz sum = 0;
+            for( int b = 0; b < 256; ++b )
             {
-                int index = (p->HeadIndex() + i) & (p->capacity - 1);
-                T* it = PageItemUnsafe( p, index );
-                if( pred( *(T const*)it ) )
-                    return it;
+                offsets[b] = sum;
+                sum += c[b];
             }
-            p = p->next;
+
+            for( sz i = 0; i < count; ++i )
+            {
+                K key = keysIn[i];
+                sz dst = offsets[(RadixKey( key ) >> shift) & 0xFF]++;
+                keysOut[dst] = key;
+                IF( HasValues )
+                    valuesOut[dst] = valuesIn[i];
+            }
+
+            std::swap( keysIn, keysOut );
+            IF( HasValues )
+                std::swap( valuesIn, valuesOut );
         }
 
-        return nullptr;
-    }
+        // Make sure we end up in the original arrays
+        if( keysIn != keys )
+        {
+            COPYP( keysIn, keys, count * SIZEOF(K) );
+            IF( HasValues )
+                COPYP( valuesIn, values, count * SIZEOF(ValueType) );
+        }
 
-    template<typename Predicate>
-    T const* Find( Predicate&& pred ) const
-    {
-        return ((SyncQueue<T, AllocType>*)this)->Find( pred );
+        IF( HasValues )
+            FREE( scratchAlloc, scratchValues );
+        FREE( scratchAlloc, scratchKeys );
     }
 
-    template<typename Predicate>
-    bool Contains( Predicate&& pred ) const
+
+    // Compare what's left of two strings after skipping the first 'depth' chars
+    INLINE bool StringLess( String const& a, String const& b, int depth )
     {
-        return Find( pred ) != nullptr;
+        int len = Min( a.length, b.length ) - depth;
+        int cmp = len > 0 ? memcmp( a.data + depth, b.data + depth, SizeT( len ) ) : 0;
+        return cmp < 0 || (cmp == 0 && a.length < b.length);
     }
 
-private:
-
-    Page* AllocPage( int pageCapacity )
+    // Distribute by the char at 'depth' (strings ending there go first), then sort each bucket by the next char
+    // NOTE Strings are relocated bitwise, so owned ones are never cloned or freed, and scratch can be uninitialized memory
+    internal void StringRadixSort( String* strings, String* scratch, sz count, int depth )
     {
-        Page* result = nullptr;
+        if( count < 32 )
+        {
+            alignas(String) u8 tmp[sizeof(String)];
+            String const& s = *(String*)tmp;
+            for( sz i = 1; i < count; ++i )
+            {
+                COPYP( &strings[i], tmp, SIZEOF(String) );
+                sz j = i;
+                for( ; j > 0 && StringLess( s, strings[j - 1], depth ); --j )
+                    COPYP( &strings[j - 1], &strings[j], SIZEOF(String) );
+                COPYP( tmp, &strings[j], SIZEOF(String) );
+            }
+            return;
+        }
 
-        if( firstFree )
+        sz counts[257] = {};
+        for( sz i = 0; i < count; ++i )
         {
-            result = firstFree;
-            firstFree = firstFree->next;
+            String const& s = strings[i];
+            counts[depth < s.length ? (u8)s.data[depth] + 1 : 0]++;
         }
-        else
+
+        sz offsets[257];
+        sz sum = 0;
+        for( int b = 0; b < 257; ++b )
         {
-            result = (Page*)ALLOC( allocator, Sz(sizeof(Page) + pageCapacity * sizeof(T)) );
+            offsets[b] = sum;
+            sum += counts[b];
         }
 
-        *result = {};
-        result->capacity = pageCapacity;
+        for( sz i = 0; i < count; ++i )
+        {
+            String const& s = strings[i];
+            COPYP( &s, &scratch[offsets[depth < s.length ? (u8)s.data[depth] + 1 : 0]++], SIZEOF(String) );
+        }
+        COPYP( scratch, strings, count * SIZEOF(String) );
 
-        return result;
+        sz start = counts[0];
+        for( int b = 1; b < 257; ++b )
+        {
+            if( counts[b] > 1 )
+                StringRadixSort( strings + start, scratch, counts[b], depth + 1 );
+            start += counts[b];
+        }
     }
-};
+} // namespace Sort
+
+
+// Sort keys in ascending order
+template <typename K, typename AllocType = Allocator>
+INLINE void RadixSort( K* keys, sz count, AllocType* scratchAlloc = CTX_TMPALLOC )
+{
+    Sort::RadixSort<K, void>( keys, nullptr, count, scratchAlloc );
+}
+
+// Sort keys in ascending order, reordering values along with them
+template <typename K, typename V, typename AllocType = Allocator>
+INLINE void RadixSort( K* keys, V* values, sz count, AllocType* scratchAlloc = CTX_TMPALLOC )
+{
+    Sort::RadixSort<K, V>( keys, values, count, scratchAlloc );
+}
+
+// Sort Strings in lexicographic (byte) order
+template <typename AllocType = Allocator>
+INLINE void RadixSort( String* strings, sz count, AllocType* scratchAlloc = CTX_TMPALLOC )
+{
+    if( count < 2 )
+        return;
+
+    String* scratch = ALLOC_ARRAY( scratchAlloc, String, count, Memory::NoClear() );
+    Sort::StringRadixSort( strings, scratch, count, 0 );
+    FREE( scratchAlloc, scratch );
+}
+
+template <typename T, typename AllocType = Allocator>
+INLINE void RadixSort( Buffer<T> items, AllocType* scratchAlloc = CTX_TMPALLOC )
+{
+    RadixSort( items.data, items.length, scratchAlloc );
+}
+
+template <typename T, typename AllocType = Allocator, typename ArrayAllocType = Allocator>
+INLINE void RadixSort( Array<T, ArrayAllocType>& items, AllocType* scratchAlloc = CTX_TMPALLOC )
+{
+    RadixSort( items.data, items.count, scratchAlloc );
+}
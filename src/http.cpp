@@ -872,4 +872,67 @@ namespace Http
             }
         }
     }
+
+
+    internal void ResumeAsyncRequest( const Response& response, void* userdata )
+    {
+        AsyncRequest* request = (AsyncRequest*)userdata;
+
+        // The response passed in is just a temporary, so steal its contents
+        request->response = std::move( const_cast<Response&>( response ) );
+
+        if( request->executor )
+            request->executor->Post( request->handle );
+        else
+            request->handle.resume();
+    }
+
+    void AsyncRequest::await_suspend( std::coroutine_handle<> handle_ )
+    {
+        handle = handle_;
+        // NOTE We live inside the suspended frame, so it's safe to point to us until the response arrives
+        if( method == Method::Post )
+            Post( state, url, headers, bodyData, ResumeAsyncRequest, this, flags );
+        else
+            Get( state, url, headers, ResumeAsyncRequest, this, flags );
+    }
+
+    internal AsyncRequest MakeAsyncRequest( State* state, char const* url, Buffer<Header> headers, char const* bodyData,
+                                            Method method, Tasks::Executor* resumeOn, u32 flags )
+    {
+        AsyncRequest result = {};
+        result.state = state;
+        result.url = url;
+        result.headers = headers;
+        result.bodyData = bodyData;
+        result.executor = resumeOn;
+        result.method = method;
+        result.flags = flags;
+        return result;
+    }
+
+    AsyncRequest GetAsync( State* state, char const* url, Buffer<Header> headers, Tasks::Executor* resumeOn /*= nullptr*/,
+                           u32 flags /*= 0*/ )
+    {
+        return MakeAsyncRequest( state, url, headers, nullptr, Method::Get, resumeOn, flags );
+    }
+
+    AsyncRequest GetAsync( State* state, char const* url, Tasks::Executor* resumeOn /*= nullptr*/, u32 flags /*= 0*/ )
+    {
+        Buffer<Header> headers;
+        return GetAsync( state, url, headers, resumeOn, flags );
+    }
+
+    AsyncRequest PostAsync( State* state, char const* url, Buffer<Header> headers, char const* bodyData,
+                            Tasks::Executor* resumeOn /*= nullptr*/, u32 flags /*= 0*/ )
+    {
+        return MakeAsyncRequest( state, url, headers, bodyData, Method::Post, resumeOn, flags );
+    }
+
+    AsyncRequest PostAsync( State* state, char const* url, char const* bodyData, Tasks::Executor* resumeOn /*= nullptr*/,
+                            u32 flags /*= 0*/ )
+    {
+        Buffer<Header> headers;
+        return PostAsync( state, url, headers, bodyData, resumeOn, flags );
+    }
 } // namespace Http
@@ -93,4 +93,33 @@ namespace Http
 
     void ProcessResponses( State* state );
 
+
+    // Awaitable versions of Get & Post, so tasks can simply do 'Response response = co_await GetAsync( state, url );'
+    // The request is only sent once awaited, and the awaiting task resumes from inside ProcessResponses (so on the main
+    // thread), unless an executor is given to post it to instead
+    // NOTE Url, headers & body need only be valid until the request is awaited
+    struct AsyncRequest
+    {
+        State* state;
+        char const* url;
+        Buffer<Header> headers;
+        char const* bodyData;
+        Tasks::Executor* executor;
+        std::coroutine_handle<> handle;
+        Response response;
+        Method method;
+        u32 flags;
+
+        bool await_ready() { return false; }
+        void await_suspend( std::coroutine_handle<> handle_ );
+        Response await_resume() { return std::move( response ); }
+    };
+
+    AsyncRequest GetAsync( State* state, char const* url, Buffer<Header> headers, Tasks::Executor* resumeOn = nullptr, u32 flags = 0 );
+    AsyncRequest GetAsync( State* state, char const* url, Tasks::Executor* resumeOn = nullptr, u32 flags = 0 );
+
+    AsyncRequest PostAsync( State* state, char const* url, Buffer<Header> headers, char const* bodyData,
+                            Tasks::Executor* resumeOn = nullptr, u32 flags = 0 );
+    AsyncRequest PostAsync( State* state, char const* url, char const* bodyData, Tasks::Executor* resumeOn = nullptr, u32 flags = 0 );
+
 } // namespace Http
@@ -42,7 +42,7 @@ INLINE u32 NextPowerOf2( u32 value )
         result = 1u << (msbPosition + 1);
     }
 #else
-    u32 leadingZeros = _lzcnt_u32( value );
+    u32 leadingZeros = value ? (u32)__builtin_clz( value ) : 32;
     if( leadingZeros < 32 )
     {
         result = 1u << (32 - leadingZeros);
@@ -69,7 +69,7 @@ INLINE int Log2( i32 n )
     unsigned long result;
     _BitScanReverse( &result, (u32)n );
 #elif COMPILER_LLVM
-    NOT_IMPLEMENTED
+    u32 result = 31 - (u32)__builtin_clz( (u32)n );
 #else
     u32 result = 0;
     CountShift(16);
@@ -91,7 +91,7 @@ INLINE int Log2( i64 n )
     unsigned long result;
     _BitScanReverse64( &result, (u64)n );
 #elif COMPILER_LLVM
-    NOT_IMPLEMENTED
+    u32 result = 63 - (u32)__builtin_clzll( (u64)n );
 #else
     u32 result = 0;
     CountShift(32);
@@ -106,6 +106,115 @@ INLINE int Log2( i64 n )
 }
 #undef CountShift
 
+// Index of the least significant set bit, or -1 if there's none
+INLINE int LowestSetBit( u32 n )
+{
+    if( n == 0 )
+        return -1;
+
+#if COMPILER_MSVC
+    unsigned long result;
+    _BitScanForward( &result, n );
+#else
+    u32 result = (u32)__builtin_ctz( n );
+#endif
+
+    return (int)result;
+}
+
+INLINE int PopCount( u32 n )
+{
+#if COMPILER_MSVC
+    return (int)__popcnt( n );
+#else
+    return __builtin_popcount( n );
+#endif
+}
+
+INLINE int PopCount( u64 n )
+{
+#if COMPILER_MSVC
+    return (int)__popcnt64( n );
+#else
+    return __builtin_popcountll( n );
+#endif
+}
+
+// Both return the bit width for a zero input (like lzcnt & tzcnt do)
+// NOTE Not using __lzcnt / _tzcnt on MSVC, as those silently turn into bsr / bsf on older CPUs
+INLINE int CountLeadingZeros( u32 n )
+{
+#if COMPILER_MSVC
+    unsigned long result;
+    return _BitScanReverse( &result, n ) ? 31 - (int)result : 32;
+#else
+    return n ? __builtin_clz( n ) : 32;
+#endif
+}
+
+INLINE int CountLeadingZeros( u64 n )
+{
+#if COMPILER_MSVC
+    unsigned long result;
+    return _BitScanReverse64( &result, n ) ? 63 - (int)result : 64;
+#else
+    return n ? __builtin_clzll( n ) : 64;
+#endif
+}
+
+INLINE int CountTrailingZeros( u32 n )
+{
+#if COMPILER_MSVC
+    unsigned long result;
+    return _BitScanForward( &result, n ) ? (int)result : 32;
+#else
+    return n ? __builtin_ctz( n ) : 32;
+#endif
+}
+
+INLINE int CountTrailingZeros( u64 n )
+{
+#if COMPILER_MSVC
+    unsigned long result;
+    return _BitScanForward64( &result, n ) ? (int)result : 64;
+#else
+    return n ? __builtin_ctzll( n ) : 64;
+#endif
+}
+
+// Scatter the low bits of value into the positions of the set bits in mask, from lowest to highest (pdep)
+INLINE u64 DepositBits( u64 value, u64 mask )
+{
+#if defined(__BMI2__) || (COMPILER_MSVC && defined(__AVX2__))
+    return _pdep_u64( value, mask );
+#else
+    u64 result = 0;
+    for( u64 bit = 1; mask; bit += bit )
+    {
+        if( value & bit )
+            result |= mask & (~mask + 1);
+        mask &= mask - 1;
+    }
+    return result;
+#endif
+}
+
+INLINE u32 DepositBits( u32 value, u32 mask )
+{
+#if defined(__BMI2__) || (COMPILER_MSVC && defined(__AVX2__))
+    return _pdep_u32( value, mask );
+#else
+    return (u32)DepositBits( (u64)value, (u64)mask );
+#endif
+}
+
+// Index of the k-th (0-based) set bit, or the bit width if there's not that many
+INLINE int SelectBit( u64 n, int k )
+{
+    ASSERT( k >= 0 && k < 64 );
+    return CountTrailingZeros( DepositBits( (u64)1 << k, n ) );
+}
+
 INLINE f32 Abs( f32 x )
 {
     return (f32)fabs( x );
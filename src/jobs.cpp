@@ -0,0 +1,742 @@
+
+#if !_WIN32 && ARCH_X64
+// Save callee-saved registers & FP control words on the current stack, store its pointer in *fromStackPointer, then
+// restore everything from toStackPointer and return to wherever that fiber was switched out (System V ABI)
+extern "C" void BricksSwitchFiber( void** fromStackPointer, void* toStackPointer );
+asm( R"(
+    .text
+    .globl BricksSwitchFiber
+    .type BricksSwitchFiber, @function
+BricksSwitchFiber:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size BricksSwitchFiber, .-BricksSwitchFiber
+)" );
+#endif
+
+namespace Jobs
+{
+    internal thread_local i32 globalWorkerIndex = -1;
+
+    // NOTE Jobs can come back from a wait on a different thread, so we never want the compiler to reuse a thread-local
+    // address across one
+    internal NOINLINE i32 GetWorkerIndex()
+    {
+        return globalWorkerIndex;
+    }
+
+    INLINE State* GetState()
+    {
+        State* state = CTX.jobState;
+        ASSERT( state, "No job state.. have you called Jobs::Init?" );
+        return state;
+    }
+
+    internal Worker* CurrentWorker( State* state )
+    {
+        i32 index = GetWorkerIndex();
+        ASSERT( index >= 0 && index < state->workerCount, "Jobs can only be started from a worker thread" );
+        return &state->workers[index];
+    }
+
+
+    // Fibers
+
+    static constexpr sz FiberGuardSize = KILOBYTES(64);
+
+    internal void FiberMain();
+
+#if _WIN32
+    internal void WINAPI FiberProc( void* )
+    {
+        FiberMain();
+    }
+#endif
+
+    internal bool InitFiber( Fiber* fiber, State* state, Logging::State* logState )
+    {
+        INIT( *fiber )();
+
+#if _WIN32
+        // Windows sets up the guard page for us
+        fiber->handle = CreateFiberEx( FiberStackSize, FiberStackSize, FIBER_FLAG_FLOAT_SWITCH, FiberProc, fiber );
+        if( !fiber->handle )
+            return false;
+#else
+        // Leave the bottom of the range inaccessible, so overflowing the stack faults right away instead of trashing memory
+        fiber->stackMemorySize = FiberGuardSize + FiberStackSize;
+        fiber->stackMemory = (u8*)globalPlatform.Reserve( fiber->stackMemorySize );
+        if( !fiber->stackMemory )
+            return false;
+        if( !globalPlatform.Commit( fiber->stackMemory + FiberGuardSize, FiberStackSize ) )
+        {
+            globalPlatform.Release( fiber->stackMemory, fiber->stackMemorySize );
+            return false;
+        }
+
+    #if ARCH_X64
+        // Initial frame as BricksSwitchFiber expects it, 'returning' into FiberMain with the stack aligned as after a call
+        u64* sp = (u64*)(fiber->stackMemory + fiber->stackMemorySize);
+        *--sp = 0;
+        *--sp = (u64)&FiberMain;
+        for( int i = 0; i < 6; ++i )
+            *--sp = 0;
+        // Default MXCSR & x87 control word
+        *--sp = 0x1F80ull | (0x037Full << 32);
+        fiber->stackPointer = sp;
+    #else
+        getcontext( &fiber->ucontext );
+        fiber->ucontext.uc_stack.ss_sp = fiber->stackMemory + FiberGuardSize;
+        fiber->ucontext.uc_stack.ss_size = FiberStackSize;
+        fiber->ucontext.uc_link = nullptr;
+        makecontext( &fiber->ucontext, FiberMain, 0 );
+    #endif
+#endif
+
+        // Too many of these to track
+        InitArena( &fiber->arena );
+        InitVirtualArena( &fiber->tmpArena, FiberScratchSize );
+
+        fiber->contexts = &fiber->contextStack;
+        fiber->contextStack.top = fiber->contextStack.entries;
+        fiber->contextStack.entries[0] = InitContext( &fiber->arena, &fiber->tmpArena, logState );
+        fiber->contextStack.entries[0].jobState = state;
+        fiber->resumeJob.func = nullptr;
+        fiber->resumeJob.userdata = nullptr;
+        fiber->resumeJob.counter = nullptr;
+        fiber->resumeJob.next = nullptr;
+        fiber->resumeJob.fiber = fiber;
+        return true;
+    }
+
+    internal void DestroyFiber( Fiber* fiber )
+    {
+#if _WIN32
+        if( fiber->handle )
+            DeleteFiber( fiber->handle );
+#else
+        if( fiber->stackMemory )
+            globalPlatform.Release( fiber->stackMemory, fiber->stackMemorySize );
+#endif
+        ReleaseArena( &fiber->arena );
+        ReleaseArena( &fiber->tmpArena );
+        fiber->~Fiber();
+    }
+
+    // Let the thread's own stack be switched to & from
+    internal void BindThreadFiber( Fiber* fiber )
+    {
+#if _WIN32
+        fiber->handle = ConvertThreadToFiberEx( nullptr, FIBER_FLAG_FLOAT_SWITCH );
+        ASSERT( fiber->handle, "Thread is already a fiber" );
+#endif
+    }
+
+    internal void UnbindThreadFiber( Fiber* fiber )
+    {
+#if _WIN32
+        ConvertFiberToThread();
+        fiber->handle = nullptr;
+#endif
+    }
+
+    internal void SwitchFiber( Fiber* from, Fiber* to )
+    {
+#if _WIN32
+        SwitchToFiber( to->handle );
+#elif ARCH_X64
+        BricksSwitchFiber( &from->stackPointer, to->stackPointer );
+#else
+        swapcontext( &from->ucontext, &to->ucontext );
+#endif
+    }
+
+    internal Fiber* AllocFiber( State* state )
+    {
+        Mutex::Scope lock( state->fiberMutex );
+
+        Fiber* fiber = state->freeFibers;
+        if( fiber )
+            state->freeFibers = fiber->next;
+        return fiber;
+    }
+
+    internal void FreeFiber( State* state, Fiber* fiber )
+    {
+        Mutex::Scope lock( state->fiberMutex );
+
+        fiber->next = state->freeFibers;
+        state->freeFibers = fiber;
+    }
+
+    internal void PushReady( State* state, Fiber* fiber )
+    {
+        Fiber* head = state->readyFibers.LOAD_RELAXED();
+        do
+            fiber->next = head;
+        while( !state->readyFibers.compare_exchange_weak( head, fiber, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+
+    internal Fiber* PopReady( State* state )
+    {
+        if( !state->readyFibers.LOAD_RELAXED() )
+            return nullptr;
+
+        // Grab the whole list so there's no ABA problem, then put back everything but the first one
+        Fiber* fiber = state->readyFibers.exchange( nullptr, std::memory_order_acquire );
+        if( fiber && fiber->next )
+        {
+            Fiber* rest = fiber->next;
+            Fiber* tail = rest;
+            while( tail->next )
+                tail = tail->next;
+
+            Fiber* head = state->readyFibers.LOAD_RELAXED();
+            do
+                tail->next = head;
+            while( !state->readyFibers.compare_exchange_weak( head, rest, std::memory_order_release, std::memory_order_relaxed ) );
+        }
+        return fiber;
+    }
+
+    // Returns null if all slots are still taken
+    internal Job* AllocJob( Worker* worker, JobFunc* func, void* userdata, Counter* counter )
+    {
+        // Slots are freed when their jobs start, which can happen in any order (and RunAfter ones may wait for long)
+        for( int n = 0; n < MaxPendingJobs; ++n )
+        {
+            Job* job = &worker->jobs[worker->nextJob++ & (MaxPendingJobs - 1)];
+            if( !job->pending.LOAD_ACQUIRE() )
+            {
+                job->func = func;
+                job->userdata = userdata;
+                job->counter = counter;
+                job->next = nullptr;
+                job->fiber = nullptr;
+                job->pending.STORE_RELAXED( true );
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    internal void Wake( State* state, int count )
+    {
+        // Pairs with the fence in Sleep, so either we see the sleeper or it sees our jobs
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        int sleeping = state->sleepingCount.LOAD_RELAXED();
+        int n;
+        do
+        {
+            n = Min( sleeping, count );
+            if( n <= 0 )
+                return;
+        }
+        while( !state->sleepingCount.compare_exchange_weak( sleeping, sleeping - n, std::memory_order_relaxed ) );
+
+        state->wakeSemaphore.Signal( n );
+    }
+
+    internal void Execute( State* state, Worker* worker, Job* job );
+
+    // Job queues only ever contain actual jobs
+    internal void Push( State* state, Worker* worker, Job* job )
+    {
+        // Just run it if we're swamped
+        if( !worker->queue.Push( job ) )
+            Execute( state, worker, job );
+    }
+
+    // Start all jobs that were waiting on a counter
+    internal void Release( State* state, Worker* worker, Job* waiters )
+    {
+        int count = 0;
+        while( waiters )
+        {
+            Job* next = waiters->next;
+            if( waiters->fiber )
+                PushReady( state, waiters->fiber );
+            else
+                Push( state, worker, waiters );
+            waiters = next;
+            count++;
+        }
+        if( count )
+            Wake( state, count );
+    }
+
+    internal void Finish( State* state, Worker* worker, Counter* counter )
+    {
+        counter->busy.fetch_add( 1, std::memory_order_seq_cst );
+        if( counter->value.fetch_sub( 1, std::memory_order_seq_cst ) == 1 )
+            Release( state, worker, counter->waiters.exchange( nullptr, std::memory_order_seq_cst ) );
+        // Can't touch the counter after this
+        counter->busy.fetch_sub( 1, std::memory_order_release );
+    }
+
+    // Add job to the list of waiters for the dependency, or start it right away if it's already done
+    internal void AddWaiter( State* state, Worker* worker, Counter* dependency, Job* job )
+    {
+        dependency->busy.fetch_add( 1, std::memory_order_seq_cst );
+        if( dependency->value.load( std::memory_order_seq_cst ) == 0 )
+        {
+            job->next = nullptr;
+            Release( state, worker, job );
+        }
+        else
+        {
+            job->next = dependency->waiters.LOAD_RELAXED();
+            while( !dependency->waiters.compare_exchange_weak( job->next, job, std::memory_order_seq_cst, std::memory_order_relaxed ) )
+                ;
+
+            // The last job could have finished just before we were added to the list, in which case we start
+            // whatever is in there ourselves
+            if( dependency->value.load( std::memory_order_seq_cst ) == 0 )
+                Release( state, worker, dependency->waiters.exchange( nullptr, std::memory_order_seq_cst ) );
+        }
+        dependency->busy.fetch_sub( 1, std::memory_order_release );
+    }
+
+    internal void Execute( State* state, Worker* worker, JobFunc* func, void* userdata, Counter* counter )
+    {
+        // Nested jobs (run while waiting) just open a new scope on top
+        ScopedTmpMemory tmp( &worker->currentFiber->tmpArena );
+
+        func( userdata );
+
+        // We may have been suspended & resumed somewhere else
+        if( counter )
+            Finish( state, CurrentWorker( state ), counter );
+    }
+
+    internal void Execute( State* state, Worker* worker, Job* job )
+    {
+        JobFunc* func = job->func;
+        void* userdata = job->userdata;
+        Counter* counter = job->counter;
+        // Give the slot back right away, as the job could take a long time (or wait on others started from the same worker)
+        job->pending.STORE_RELEASE( false );
+
+        Execute( state, worker, func, userdata, counter );
+    }
+
+    internal void RunPendingAction()
+    {
+        State* state = GetState();
+        Worker* worker = CurrentWorker( state );
+
+        FiberAction action = worker->pendingAction;
+        worker->pendingAction = {};
+
+        switch( action.type )
+        {
+            case FiberAction::None:
+                break;
+            case FiberAction::Release:
+                FreeFiber( state, action.fiber );
+                break;
+            case FiberAction::Wait:
+                state->suspendedCount.fetch_add( 1, std::memory_order_relaxed );
+                AddWaiter( state, worker, action.counter, &action.fiber->resumeJob );
+                break;
+        }
+    }
+
+    // Leave the current fiber and continue running the given one on this thread, then do whatever action says once
+    // we're off the current stack. Returns once somebody switches back to us, possibly from a different thread
+    internal void SwitchTo( Worker* worker, Fiber* to, FiberAction action )
+    {
+        Fiber* from = worker->currentFiber;
+        worker->currentFiber = to;
+        worker->pendingAction = action;
+
+        from->contexts = globalPlatform.SwapContextStack( to->contexts );
+        SwitchFiber( from, to );
+
+        RunPendingAction();
+    }
+
+    // Switch to another fiber until the counter is done
+    internal void SwitchAndWait( Worker* worker, Fiber* to, Counter* counter )
+    {
+        if( worker->currentFiber == &worker->threadFiber )
+        {
+            // The thread's own stack can't go anywhere else, so the fibers running on this worker will come back to it
+            worker->threadWaitCounter = counter;
+            SwitchTo( worker, to, {} );
+            worker->threadWaitCounter = nullptr;
+        }
+        else
+            SwitchTo( worker, to, { FiberAction::Wait, worker->currentFiber, counter } );
+
+        // The last job to finish may still be touching the counter
+        while( !counter->Done() )
+            Yield();
+    }
+
+    internal Job* FindJob( State* state, Worker* worker )
+    {
+        Job* job = nullptr;
+        if( worker->queue.Pop( &job ) )
+            return job;
+
+        // Suspended jobs that can continue go before stealing anything new
+        if( Fiber* fiber = PopReady( state ) )
+        {
+            state->suspendedCount.fetch_sub( 1, std::memory_order_relaxed );
+            return &fiber->resumeJob;
+        }
+
+        int count = state->workerCount;
+        if( count < 2 )
+            return nullptr;
+
+        // Try everybody else once, starting from a random victim (xorshift)
+        u64 x = worker->rngState;
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        worker->rngState = x;
+
+        int start = (int)(x % (u64)count);
+        for( int i = 0; i < count; ++i )
+        {
+            int victim = (start + i) % count;
+            if( victim != worker->index && state->workers[victim].queue.Steal( &job ) )
+                return job;
+        }
+        return nullptr;
+    }
+
+    internal bool AnyWork( State* state )
+    {
+        if( state->readyFibers.LOAD_RELAXED() )
+            return true;
+        for( int i = 0; i < state->workerCount; ++i )
+            if( !state->workers[i].queue.Empty() )
+                return true;
+        return false;
+    }
+
+    internal void Sleep( State* state )
+    {
+        state->sleepingCount.fetch_add( 1, std::memory_order_seq_cst );
+
+        if( AnyWork( state ) || !state->running.LOAD_ACQUIRE() )
+        {
+            // Take a wake-up token back, unless somebody already used it to signal the semaphore, in which case
+            // we need to consume that signal instead
+            int sleeping = state->sleepingCount.LOAD_RELAXED();
+            while( sleeping > 0 && !state->sleepingCount.compare_exchange_weak( sleeping, sleeping - 1, std::memory_order_relaxed ) )
+                ;
+            if( sleeping > 0 )
+                return;
+        }
+
+        state->wakeSemaphore.Wait();
+    }
+
+    // Every pool fiber runs this, picking up jobs on whatever worker it finds itself on
+    internal void FiberMain()
+    {
+        RunPendingAction();
+
+        const int spinCount = 64;
+        int idleCount = 0;
+        for( ;; )
+        {
+            State* state = GetState();
+            Worker* worker = CurrentWorker( state );
+
+            // Give the thread back its own stack once it's done waiting (or shutting down)
+            Counter* threadWaitCounter = worker->threadWaitCounter;
+            if( threadWaitCounter ? threadWaitCounter->Done() : !state->running.LOAD_ACQUIRE() )
+            {
+                SwitchTo( worker, &worker->threadFiber, { FiberAction::Release, worker->currentFiber } );
+                idleCount = 0;
+                continue;
+            }
+
+            if( Job* job = FindJob( state, worker ) )
+            {
+                if( job->fiber )
+                    SwitchTo( worker, job->fiber, { FiberAction::Release, worker->currentFiber } );
+                else
+                    Execute( state, worker, job );
+                idleCount = 0;
+            }
+            else if( ++idleCount < spinCount )
+                Yield();
+            else if( threadWaitCounter )
+                // Nobody would wake us up when it's done
+                std::this_thread::yield();
+            else
+            {
+                Sleep( state );
+                idleCount = 0;
+            }
+        }
+    }
+
+    internal PLATFORM_THREAD_FUNC(WorkerMain)
+    {
+        Worker* worker = (Worker*)userdata;
+        State* state = worker->state;
+        globalWorkerIndex = worker->index;
+
+        // The thread's own stack just waits here until shutdown
+        BindThreadFiber( &worker->threadFiber );
+        SwitchTo( worker, worker->firstFiber, {} );
+        UnbindThreadFiber( &worker->threadFiber );
+
+        return 0;
+    }
+
+
+    void Init( State* state, int workerCount /*= 0*/, int fiberCount /*= DefaultFiberCount*/ )
+    {
+        if( workerCount <= 0 )
+            workerCount = Core::GetCoreCount();
+        workerCount = Clamp( workerCount, 1, MaxWorkers );
+        // One for each worker plus at least one to switch to when waiting
+        fiberCount = Max( fiberCount, workerCount + 1 );
+
+        state->sleepingCount.STORE_RELAXED( 0 );
+        state->suspendedCount.STORE_RELAXED( 0 );
+        state->running.STORE_RELAXED( true );
+        Logging::State* logState = CTX.logState;
+
+        state->fiberCount = fiberCount;
+        state->fibers = (Fiber*)globalPlatform.Alloc( fiberCount * SIZEOF(Fiber), 0 );
+        state->freeFibers = nullptr;
+        state->readyFibers.STORE_RELAXED( nullptr );
+        for( int i = fiberCount - 1; i >= 0; --i )
+        {
+            Fiber* fiber = &state->fibers[i];
+            bool ok = InitFiber( fiber, state, logState );
+            ASSERT( ok, "Failed creating job fiber" );
+            if( ok )
+                FreeFiber( state, fiber );
+        }
+
+        state->workerCount = workerCount;
+        // Already zeroed (and cache line aligned)
+        state->workers = (Worker*)globalPlatform.Alloc( workerCount * SIZEOF(Worker), 0 );
+        for( int i = 0; i < workerCount; ++i )
+        {
+            Worker& w = state->workers[i];
+            INIT( w )();
+            w.queue.Init( MaxPendingJobs * 2, &state->allocator );
+            w.rngState = 0x9E3779B97F4A7C15ull * (u64)(i + 1);
+            w.currentFiber = &w.threadFiber;
+            w.state = state;
+            w.index = i;
+        }
+
+        // The calling thread is worker 0
+        CTX.jobState = state;
+        globalWorkerIndex = 0;
+
+        BindThreadFiber( &state->workers[0].threadFiber );
+        for( int i = 0; i < workerCount; ++i )
+        {
+            // Only used by whatever runs straight on the thread's own stack
+            Fiber& f = state->workers[i].threadFiber;
+            InitArena( &f.arena );
+            InitVirtualArena( &f.tmpArena );
+#if MEMORY_TRACKING
+            Memory::TrackArena( &f.arena, "JobWorker" );
+            Memory::TrackArena( &f.tmpArena, "JobWorkerTmp" );
+#endif
+
+            f.contextStack.entries[0] = InitContext( &f.arena, &f.tmpArena, logState );
+            f.contextStack.entries[0].jobState = state;
+            if( i > 0 )
+            {
+                Worker& w = state->workers[i];
+                w.firstFiber = AllocFiber( state );
+                ASSERT( w.firstFiber, "Not enough fibers for all workers" );
+                w.thread = Core::CreateThread( "JobWorker", WorkerMain, &w, f.contextStack.entries[0] );
+            }
+        }
+    }
+
+    void Shutdown( State* state )
+    {
+        state->running.STORE_RELEASE( false );
+        // More than enough for everybody
+        state->wakeSemaphore.Signal( state->workerCount );
+
+        for( int i = 0; i < state->workerCount; ++i )
+        {
+            Worker& w = state->workers[i];
+            if( i > 0 )
+                Core::JoinThread( w.thread );
+            ReleaseArena( &w.threadFiber.arena );
+            ReleaseArena( &w.threadFiber.tmpArena );
+        }
+        UnbindThreadFiber( &state->workers[0].threadFiber );
+        for( int i = 0; i < state->workerCount; ++i )
+            state->workers[i].~Worker();
+        globalPlatform.Free( state->workers );
+
+        // Anything still suspended in there is just dropped
+        for( int i = 0; i < state->fiberCount; ++i )
+            DestroyFiber( &state->fibers[i] );
+        globalPlatform.Free( state->fibers );
+        state->fibers = nullptr;
+        state->fiberCount = 0;
+        state->freeFibers = nullptr;
+
+        state->workers = nullptr;
+        state->workerCount = 0;
+        if( CTX.jobState == state )
+            CTX.jobState = nullptr;
+        globalWorkerIndex = -1;
+    }
+
+    void Run( JobDecl const* jobs, int count, Counter* counter /*= nullptr*/ )
+    {
+        State* state = GetState();
+        Worker* worker = CurrentWorker( state );
+
+        // Has to be done before any of the jobs can possibly finish
+        if( counter )
+            counter->value.fetch_add( count, std::memory_order_relaxed );
+
+        for( int i = 0; i < count; ++i )
+        {
+            if( Job* job = AllocJob( worker, jobs[i].func, jobs[i].userdata, counter ) )
+                Push( state, worker, job );
+            else
+            {
+                // Too many jobs from this worker waiting to run already, so just run it here
+                Execute( state, worker, jobs[i].func, jobs[i].userdata, counter );
+                worker = CurrentWorker( state );
+            }
+        }
+        Wake( state, count );
+    }
+
+    void Run( JobFunc* func, void* userdata, Counter* counter /*= nullptr*/ )
+    {
+        JobDecl job = { func, userdata };
+        Run( &job, 1, counter );
+    }
+
+    void RunAfter( Counter* dependency, JobFunc* func, void* userdata, Counter* counter /*= nullptr*/ )
+    {
+        State* state = GetState();
+        Worker* worker = CurrentWorker( state );
+
+        if( counter )
+            counter->value.fetch_add( 1, std::memory_order_relaxed );
+
+        if( Job* job = AllocJob( worker, func, userdata, counter ) )
+            AddWaiter( state, worker, dependency, job );
+        else
+        {
+            // Too many jobs from this worker waiting to run already, so wait for the dependency and run it here
+            WaitForCounter( dependency );
+            Execute( state, CurrentWorker( state ), func, userdata, counter );
+        }
+    }
+
+    void WaitForCounter( Counter* counter )
+    {
+        if( counter->Done() )
+            return;
+
+        State* state = CTX.jobState;
+        i32 index = GetWorkerIndex();
+        Worker* worker = state && index >= 0 && index < state->workerCount ? &state->workers[index] : nullptr;
+
+        // Go run other jobs on a fresh fiber, or if we're out of them, right here on top of this one
+        int idleCount = 0;
+        while( !counter->Done() )
+        {
+            if( worker )
+            {
+                if( Fiber* fiber = AllocFiber( state ) )
+                {
+                    SwitchAndWait( worker, fiber, counter );
+                    return;
+                }
+
+                if( Job* job = FindJob( state, worker ) )
+                {
+                    // Doesn't need a new fiber
+                    if( job->fiber )
+                    {
+                        SwitchAndWait( worker, job->fiber, counter );
+                        return;
+                    }
+
+                    if( worker->currentFiber == &worker->threadFiber )
+                    {
+                        ScopedContext ctx( worker->threadFiber.contextStack.entries[0] );
+                        Execute( state, worker, job );
+                    }
+                    else
+                    {
+                        Execute( state, worker, job );
+                        // Could have been suspended in there
+                        worker = CurrentWorker( state );
+                    }
+                    idleCount = 0;
+                    continue;
+                }
+            }
+
+            if( ++idleCount < 64 )
+                Yield();
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    int WorkerIndex()
+    {
+        return GetWorkerIndex();
+    }
+
+    int WorkerCount()
+    {
+        State* state = CTX.jobState;
+        return state ? state->workerCount : 0;
+    }
+
+    MemoryArena* ScratchArena()
+    {
+        State* state = GetState();
+        return &CurrentWorker( state )->currentFiber->tmpArena;
+    }
+
+    Allocator ScratchAllocator( sz sizeBytes )
+    {
+        MemoryArena* arena = ScratchArena();
+        // Pooled fibers only reserve FiberScratchSize
+        if( !IsVirtual( *arena ) || arena->reservedSize - arena->used >= sizeBytes )
+            return Allocator::CreateFrom( arena );
+        return Allocator( CTX_ALLOC );
+    }
+} // namespace Jobs
@@ -0,0 +1,463 @@
+#pragma once
+
+/////     JOB SYSTEM     /////
+// Small work-stealing scheduler: every worker owns a Chase-Lev deque where it pushes the jobs it spawns and pops them back
+// in LIFO order, while idle workers steal the oldest jobs from the top of somebody else's.
+// The thread calling Init becomes worker 0 and only runs jobs while it's waiting on a Counter, and there's one background
+// thread for each of the rest.
+// Jobs signal completion through Counters, which can also gate the start of other jobs (RunAfter).
+//
+// Jobs run on fibers taken from a fixed pool, each with its own guard-paged stack, Context stack & arenas.
+// A job waiting on a Counter suspends its whole fiber and the worker just moves on to a fresh one, until the Counter gets
+// to zero and the fiber is pushed back as a job that any worker can pick up (so it may well resume on a different thread).
+// Anything allocated from CTX_TMPALLOC is gone once the job returns, while CTX_ALLOC memory lives until Shutdown.
+// If the pool runs dry, waiting falls back to running other jobs right on top of the waiting one.
+//
+// NOTE Don't keep pointers to thread-local data across a wait inside a job (CTX is fine, as it moves with the fiber)
+// NOTE Jobs can only be started from inside workers, but any thread can wait for them
+// NOTE Job descriptors are recycled from a fixed-size ring per worker, so each worker can have at most MaxPendingJobs
+// jobs that it started waiting to run at any one time (RunAfter jobs count until their dependency is done). Past that,
+// Run just runs the job right away, and RunAfter waits for the dependency first.
+
+namespace Jobs
+{
+#define JOB_FUNC(x) void x( void* userdata )
+    typedef JOB_FUNC(JobFunc);
+
+    static constexpr int MaxPendingJobs     = 4096;
+    static constexpr int MaxWorkers         = 32;
+    static constexpr int DefaultFiberCount  = 256;
+    static constexpr sz  FiberStackSize     = KILOBYTES(256);
+    // Scratch memory reserved for each pooled fiber (only committed as needed), so all of them together
+    // take about as much address space as a single default virtual arena
+    static constexpr sz  FiberScratchSize   = MEGABYTES(64);
+
+    struct Job;
+    struct Fiber;
+    struct State;
+
+    // Counts jobs that haven't finished yet
+    // Can be reused once it gets back to zero, but must outlive any jobs that use it and any waits on it
+    struct Counter
+    {
+        atomic_i32          value;
+        // Threads still touching the counter after a job has finished, so waiters don't return (and destroy it) too early
+        atomic_i32          busy;
+        // Lock-free stack of jobs to start once the value gets to zero
+        std::atomic<Job*>   waiters;
+
+        Counter()
+            : value( 0 )
+            , busy( 0 )
+            , waiters( nullptr )
+        {}
+
+        Counter( Counter const& ) = delete;
+        Counter& operator =( Counter const& ) = delete;
+
+        bool Done() const { return value.LOAD_ACQUIRE() == 0 && busy.LOAD_ACQUIRE() == 0; }
+    };
+
+    struct Job
+    {
+        JobFunc*            func;
+        void*               userdata;
+        Counter*            counter;
+        // Next job waiting on the same dependency
+        Job*                next;
+        // Not really a job, but a suspended fiber to resume
+        Fiber*              fiber;
+        // Slot can't be reused until the job starts running
+        atomic_bool         pending;
+    };
+
+    struct JobDecl
+    {
+        JobFunc*            func;
+        void*               userdata;
+    };
+
+    struct Fiber
+    {
+#if _WIN32
+        void*                       handle;
+#elif ARCH_X64
+        void*                       stackPointer;
+#else
+        ucontext_t                  ucontext;
+#endif
+        // Whole reserved range, including the guard page at the bottom
+        u8*                         stackMemory;
+        sz                          stackMemorySize;
+
+        // Points to our own contextStack, except for fibers representing the thread's own stack
+        ContextStack*               contexts;
+        ContextStack                contextStack;
+        MemoryArena                 arena;
+        MemoryArena                 tmpArena;
+
+        // Pushed once we can be resumed
+        Job                         resumeJob;
+        // Next in the free or ready list
+        Fiber*                      next;
+    };
+
+    // What to do right after switching fibers, once we're off the previous one's stack
+    struct FiberAction
+    {
+        enum Type
+        {
+            None,
+            // Return fiber to the pool
+            Release,
+            // Resume fiber once counter gets to zero
+            Wait,
+        };
+
+        Type                        type;
+        Fiber*                      fiber;
+        Counter*                    counter;
+    };
+
+    struct alignas(64) Worker
+    {
+        WorkStealingDeque<Job*, LazyAllocator> queue;
+        Job                         jobs[MaxPendingJobs];
+        u32                         nextJob;
+        u64                         rngState;
+
+        // The thread's own stack (only ever resumed on this same thread)
+        Fiber                       threadFiber;
+        Fiber*                      currentFiber;
+        FiberAction                 pendingAction;
+        // Worker 0 runs jobs on pool fibers while its own stack waits for this
+        Counter*                    threadWaitCounter;
+        // Reserved upfront for background workers, so they can always start
+        Fiber*                      firstFiber;
+
+        Platform::ThreadHandle      thread;
+        State*                      state;
+        i32                         index;
+    };
+
+    struct State
+    {
+        Worker*                     workers;
+        i32                         workerCount;        // Including the main thread
+        LazyAllocator               allocator;
+
+        Fiber*                      fibers;
+        i32                         fiberCount;
+        Fiber*                      freeFibers;
+        Mutex                       fiberMutex;
+        // Suspended fibers that can continue
+        std::atomic<Fiber*>         readyFibers;
+        // Fibers currently parked waiting on some Counter
+        atomic_i32                  suspendedCount;
+
+        // Idle workers sleep here
+        PreshingSemaphore           wakeSemaphore;
+        alignas(64) atomic_i32      sleepingCount;
+        atomic_bool                 running;
+    };
+
+
+    // Zero workers means one per core
+    void Init( State* state, int workerCount = 0, int fiberCount = DefaultFiberCount );
+    // Waits for all background workers to exit, but doesn't wait for pending jobs
+    void Shutdown( State* state );
+
+    void Run( JobFunc* func, void* userdata, Counter* counter = nullptr );
+    void Run( JobDecl const* jobs, int count, Counter* counter = nullptr );
+    // Start a job only once the dependency counter gets to zero
+    void RunAfter( Counter* dependency, JobFunc* func, void* userdata, Counter* counter = nullptr );
+
+    // Jobs get suspended until it's done, worker 0 runs other jobs meanwhile, and other threads just spin & yield
+    void WaitForCounter( Counter* counter );
+
+    // -1 for threads that aren't workers
+    int WorkerIndex();
+    int WorkerCount();
+    // Temporary arena of the calling job's fiber (same as CTX_TMPALLOC while running jobs)
+    // NOTE Jobs running on pooled fibers can only use up to FiberScratchSize of it
+    MemoryArena* ScratchArena();
+    // ScratchArena if it still has room for the given size, or the context allocator otherwise (so always FREE from it)
+    // Used by the parallel algorithms, so they can take inputs of any size from any job
+    Allocator ScratchAllocator( sz sizeBytes );
+} // namespace Jobs
+
+
+/////     PARALLEL ALGORITHMS     /////
+// Data-parallel loops on top of the job system.
+// Work is split into chunks of (at least) grainSize items, and one job per worker keeps claiming the next chunk from a shared
+// cursor until there's none left, so uneven chunks balance out without flooding the queues with tiny jobs.
+// Inside the callbacks, CTX_TMPALLOC is the worker's scratch arena, and it's rolled back after each chunk.
+// All of them block until the whole range is done, and run everything on the calling thread if it isn't a job worker.
+
+namespace Jobs
+{
+    template <typename F>
+    struct ParallelForTask
+    {
+        F* fn;
+        sz count;
+        sz grainSize;
+        alignas(64) std::atomic<sz> next;
+    };
+
+    template <typename F>
+    JOB_FUNC(ParallelForJob)
+    {
+        ParallelForTask<F>* task = (ParallelForTask<F>*)userdata;
+        MemoryArena* scratch = ScratchArena();
+
+        for( ;; )
+        {
+            sz begin = task->next.fetch_add( task->grainSize, std::memory_order_relaxed );
+            if( begin >= task->count )
+                break;
+
+            ScopedTmpMemory tmp( scratch );
+            (*task->fn)( begin, Min( begin + task->grainSize, task->count ) );
+        }
+    }
+
+    // Calls fn( begin, end ) for consecutive subranges of [0, count)
+    template <typename F>
+    void ParallelForRange( sz count, sz grainSize, F&& fn )
+    {
+        if( count <= 0 )
+            return;
+        grainSize = Max( grainSize, (sz)1 );
+
+        sz chunkCount = (count + grainSize - 1) / grainSize;
+        int jobCount = (int)Min( (sz)WorkerCount(), chunkCount );
+        if( jobCount <= 1 || WorkerIndex() < 0 )
+        {
+            for( sz begin = 0; begin < count; begin += grainSize )
+                fn( begin, Min( begin + grainSize, count ) );
+            return;
+        }
+
+        using FuncType = typename std::remove_reference<F>::type;
+        ParallelForTask<FuncType> task;
+        task.fn = &fn;
+        task.count = count;
+        task.grainSize = grainSize;
+        task.next.STORE_RELAXED( 0 );
+
+        JobDecl jobs[MaxWorkers];
+        for( int i = 0; i < jobCount; ++i )
+            jobs[i] = { ParallelForJob<FuncType>, &task };
+
+        Counter counter;
+        Run( jobs, jobCount, &counter );
+        WaitForCounter( &counter );
+    }
+} // namespace Jobs
+
+// Calls fn( Buffer<T> chunk, sz firstIndex ) for consecutive chunks of the given items
+template <typename T, typename F>
+INLINE void ParallelFor( Buffer<T> items, sz grainSize, F&& fn )
+{
+    Jobs::ParallelForRange( items.length, grainSize, [&]( sz begin, sz end )
+    {
+        fn( Buffer<T>( items.data + begin, end - begin ), begin );
+    } );
+}
+
+template <typename T, typename AllocType, typename F>
+INLINE void ParallelFor( Array<T, AllocType>& array, sz grainSize, F&& fn )
+{
+    ParallelFor( Buffer<T>( array.data, array.count ), grainSize, fn );
+}
+
+// Every bucket is a chunk
+template <typename T, typename AllocType, typename F>
+void ParallelFor( BucketArray<T, AllocType>& array, F&& fn )
+{
+    int bucketCount = array.bucketBufferCount;
+    if( !bucketCount )
+        return;
+
+    // Index of the first item in each bucket
+    sz* offsets = ALLOC_ARRAY( CTX_TMPALLOC, sz, bucketCount, Memory::NoClear() );
+    sz offset = 0;
+    for( int i = 0; i < bucketCount; ++i )
+    {
+        offsets[i] = offset;
+        offset += array.bucketBuffer[i].count;
+    }
+
+    Jobs::ParallelForRange( bucketCount, 1, [&]( sz begin, sz end )
+    {
+        for( sz i = begin; i < end; ++i )
+        {
+            auto const& bucket = array.bucketBuffer[i];
+            if( bucket.count )
+                fn( Buffer<T>( bucket.data, bucket.count ), offsets[i] );
+        }
+    } );
+    FREE( CTX_TMPALLOC, offsets );
+}
+
+// Maps each chunk to a partial result with chunkFn( Buffer<T> chunk ) -> R, then folds all partials together in order
+// (so the result is deterministic even for non-associative ops, like float sums) with combineFn( R, R ) -> R
+template <typename R, typename T, typename F, typename C>
+R ParallelReduce( Buffer<T> items, sz grainSize, R identity, F&& chunkFn, C&& combineFn )
+{
+    grainSize = Max( grainSize, (sz)1 );
+    sz chunkCount = (items.length + grainSize - 1) / grainSize;
+    if( chunkCount <= 1 || Jobs::WorkerIndex() < 0 )
+    {
+        R result = identity;
+        for( sz begin = 0; begin < items.length; begin += grainSize )
+            result = combineFn( result, chunkFn( Buffer<T>( items.data + begin, Min( grainSize, items.length - begin ) ) ) );
+        return result;
+    }
+
+    ScopedTmpMemory tmp( Jobs::ScratchArena() );
+    Allocator scratch = Jobs::ScratchAllocator( chunkCount * SIZEOF(R) + alignof(R) );
+    R* partials = ALLOC_ARRAY( &scratch, R, chunkCount, Memory::NoClear() );
+
+    Jobs::ParallelForRange( chunkCount, 1, [&]( sz begin, sz end )
+    {
+        for( sz c = begin; c < end; ++c )
+        {
+            sz first = c * grainSize;
+            INIT( partials[c] )( chunkFn( Buffer<T>( items.data + first, Min( grainSize, items.length - first ) ) ) );
+        }
+    } );
+
+    R result = identity;
+    for( sz c = 0; c < chunkCount; ++c )
+    {
+        result = combineFn( result, partials[c] );
+        partials[c].~R();
+    }
+    FREE( &scratch, partials );
+    return result;
+}
+
+template <typename R, typename T, typename AllocType, typename F, typename C>
+INLINE R ParallelReduce( Array<T, AllocType>& array, sz grainSize, R identity, F&& chunkFn, C&& combineFn )
+{
+    return ParallelReduce( Buffer<T>( array.data, array.count ), grainSize, identity, chunkFn, combineFn );
+}
+
+// Parallel version of Sort::RadixSort: every pass builds a digit histogram for each chunk, turns them all into output
+// offsets (chunk order within each digit keeps it stable), then has each chunk scatter its own keys
+// Needs scratch memory as big as the input, which comes from the context allocator when the ScratchArena can't fit it
+template <typename K>
+void ParallelSort( K* keys, sz count, sz grainSize = 64 * 1024 )
+{
+    using KeyType = decltype( Sort::RadixKey( *keys ) );
+    static constexpr int PassCount = (int)sizeof(K);
+
+    if( count < 2 )
+        return;
+
+    int workerCount = Jobs::WorkerCount();
+    if( workerCount < 2 || Jobs::WorkerIndex() < 0 || count < 2 * grainSize )
+    {
+        if( Jobs::WorkerIndex() >= 0 )
+        {
+            ScopedTmpMemory tmp( Jobs::ScratchArena() );
+            Allocator scratch = Jobs::ScratchAllocator( count * SIZEOF(K) + alignof(K) );
+            RadixSort( keys, count, &scratch );
+        }
+        else
+            RadixSort( keys, count );
+        return;
+    }
+
+    // A few chunks per worker is enough to even out the load
+    sz chunkCount = Min( (count + grainSize - 1) / grainSize, (sz)workerCount * 4 );
+    sz chunkSize = (count + chunkCount - 1) / chunkCount;
+    chunkCount = (count + chunkSize - 1) / chunkSize;
+
+    ScopedTmpMemory tmp( Jobs::ScratchArena() );
+    Allocator scratch = Jobs::ScratchAllocator( count * SIZEOF(K) + chunkCount * 256 * SIZEOF(sz) + 64 );
+    K* buffer = ALLOC_ARRAY( &scratch, K, count, Memory::NoClear() );
+    sz* offsets = ALLOC_ARRAY( &scratch, sz, chunkCount * 256, Memory::NoClear() );
+
+    K* src = keys;
+    K* dst = buffer;
+    for( int p = 0; p < PassCount; ++p )
+    {
+        int shift = p * 8;
+
+        Jobs::ParallelForRange( chunkCount, 1, [&]( sz begin, sz end )
+        {
+            for( sz c = begin; c < end; ++c )
+            {
+                sz* counts = offsets + c * 256;
+                memset( counts, 0, 256 * sizeof(sz) );
+
+                K const* chunk = src + c * chunkSize;
+                sz n = Min( chunkSize, count - c * chunkSize );
+                for( sz i = 0; i < n; ++i )
+                    counts[(Sort::RadixKey( chunk[i] ) >> shift) & 0xFF]++;
+            }
+        } );
+
+        // Skip digits where all keys are the same
+        KeyType first = Sort::RadixKey( src[0] );
+        sz firstDigitCount = 0;
+        for( sz c = 0; c < chunkCount; ++c )
+            firstDigitCount += offsets[c * 256 + ((first >> shift) & 0xFF)];
+        if( firstDigitCount == count )
+            continue;
+
+        sz sum = 0;
+        for( int d = 0; d < 256; ++d )
+        {
+            for( sz c = 0; c < chunkCount; ++c )
+            {
+                sz n = offsets[c * 256 + d];
+                offsets[c * 256 + d] = sum;
+                sum += n;
+            }
+        }
+
+        Jobs::ParallelForRange( chunkCount, 1, [&]( sz begin, sz end )
+        {
+            for( sz c = begin; c < end; ++c )
+            {
+                sz* chunkOffsets = offsets + c * 256;
+                K const* chunk = src + c * chunkSize;
+                sz n = Min( chunkSize, count - c * chunkSize );
+                for( sz i = 0; i < n; ++i )
+                {
+                    K key = chunk[i];
+                    dst[chunkOffsets[(Sort::RadixKey( key ) >> shift) & 0xFF]++] = key;
+                }
+            }
+        } );
+
+        std::swap( src, dst );
+    }
+
+    if( src != keys )
+    {
+        ParallelFor( Buffer<K>( src, count ), grainSize, [&]( Buffer<K> chunk, sz first )
+        {
+            COPYP( chunk.data, keys + first, chunk.length * SIZEOF(K) );
+        } );
+    }
+
+    FREE( &scratch, offsets );
+    FREE( &scratch, buffer );
+}
+
+template <typename K>
+INLINE void ParallelSort( Buffer<K> keys, sz grainSize = 64 * 1024 )
+{
+    ParallelSort( keys.data, keys.length, grainSize );
+}
+
+template <typename K, typename AllocType>
+INLINE void ParallelSort( Array<K, AllocType>& keys, sz grainSize = 64 * 1024 )
+{
+    ParallelSort( keys.data, keys.count, grainSize );
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// Everything the Linux platform layer needs from the system (counterpart to win32.h)
+
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <fnmatch.h>
+#include <execinfo.h>
+#include <ifaddrs.h>
+#include <poll.h>
+#include <dirent.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/futex.h>
+#include <ucontext.h>
+
+#include <immintrin.h>
+
+// Pulled in transitively by the Windows headers
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <coroutine>
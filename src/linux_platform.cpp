@@ -0,0 +1,817 @@
+/*
+The MIT License
+
+Copyright (c) 2021 Oscar Peñas Pariente <n00bmindr0b0t@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#if NON_UNITY_BUILD
+#include "linux.h"
+#endif
+
+
+// Same as the Win32 version, so code can poll for it without caring about the platform
+bool IsDebuggerPresent()
+{
+    char buffer[4096];
+
+    int fd = open( "/proc/self/status", O_RDONLY | O_CLOEXEC );
+    if( fd == -1 )
+        return false;
+
+    ssize_t bytesRead = read( fd, buffer, sizeof(buffer) - 1 );
+    close( fd );
+    if( bytesRead <= 0 )
+        return false;
+    buffer[bytesRead] = 0;
+
+    char const* tracer = strstr( buffer, "TracerPid:" );
+    if( !tracer )
+        return false;
+
+    // Any non-zero pid means someone is attached
+    return atoi( tracer + sizeof("TracerPid:") - 1 ) != 0;
+}
+
+
+namespace Linux
+{
+    struct ThreadInfo
+    {
+        Context context;
+
+        char const* name;
+        pthread_t pthread;
+        Platform::ThreadFunc* func;
+        void* userData;
+        u32 id;
+        bool live;
+    };
+
+    struct State
+    {
+        // Slots are never moved around, so each thread can hang on to its own ThreadInfo for as long as it lives
+        ThreadInfo threads[64];
+        Mutex threadsMutex;
+        // Backing memory for semaphore & mutex handles
+        LazyAllocator handleAllocator;
+        f64 appStartTimeMillis;
+    };
+    internal State platformState = {};
+
+    static void InitState( State* state )
+    {
+        state->appStartTimeMillis = globalPlatform.ElapsedTimeMillis();
+    }
+
+
+    // We need to know the size of each mapping when unmapping it, so stash it in a header that's the size of
+    // a cache line, so the memory we return keeps the same alignment guarantees we'd get on Win32
+    struct AllocHeader
+    {
+        sz sizeBytes;
+        u8 _pad[56];
+    };
+
+    PLATFORM_ALLOC(Alloc)
+    {
+        sz totalSize = sizeBytes + SIZEOF(AllocHeader);
+        void* block = mmap( nullptr, SizeT( totalSize ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if( block == MAP_FAILED )
+            return nullptr;
+
+        AllocHeader* header = (AllocHeader*)block;
+        header->sizeBytes = totalSize;
+
+        return header + 1;
+    }
+
+    PLATFORM_FREE(Free)
+    {
+        if( !memoryBlock )
+            return;
+
+        AllocHeader* header = (AllocHeader*)memoryBlock - 1;
+        munmap( header, SizeT( header->sizeBytes ) );
+    }
+
+    PLATFORM_RESERVE(Reserve)
+    {
+        void* result = mmap( nullptr, SizeT( sizeBytes ), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+        return result != MAP_FAILED ? result : nullptr;
+    }
+
+    PLATFORM_COMMIT(Commit)
+    {
+        // Pages will actually be backed by memory on first touch
+        return mprotect( address, SizeT( sizeBytes ), PROT_READ | PROT_WRITE ) == 0;
+    }
+
+    PLATFORM_DECOMMIT(Decommit)
+    {
+        // Drop the pages (they'll read back as zeroes if ever committed again) and make the range inaccessible
+        madvise( address, SizeT( sizeBytes ), MADV_DONTNEED );
+        mprotect( address, SizeT( sizeBytes ), PROT_NONE );
+    }
+
+    PLATFORM_RELEASE(Release)
+    {
+        munmap( address, SizeT( sizeBytes ) );
+    }
+
+    PLATFORM_ALLOC_MIRRORED(AllocMirrored)
+    {
+        sz size = AlignUp( sizeBytes, (sz)sysconf( _SC_PAGESIZE ) );
+
+        // Anonymous file backing the memory, so we can map it more than once
+        int fd = memfd_create( "MirroredMemory", MFD_CLOEXEC );
+        if( fd == -1 )
+            return nullptr;
+
+        u8* result = nullptr;
+        if( ftruncate( fd, (off_t)size ) == 0 )
+        {
+            // Grab a range big enough for both copies, then map the file over each half
+            void* range = mmap( nullptr, SizeT( 2 * size ), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+            if( range != MAP_FAILED )
+            {
+                u8* base = (u8*)range;
+                void* first = mmap( base, SizeT( size ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0 );
+                void* second = mmap( base + size, SizeT( size ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0 );
+
+                if( first != MAP_FAILED && second != MAP_FAILED )
+                    result = base;
+                else
+                    munmap( range, SizeT( 2 * size ) );
+            }
+        }
+        // The mappings keep the memory alive
+        close( fd );
+
+        if( result && sizeOut )
+            *sizeOut = size;
+        return result;
+    }
+
+    PLATFORM_FREE_MIRRORED(FreeMirrored)
+    {
+        munmap( address, SizeT( 2 * sizeBytes ) );
+    }
+
+    PLATFORM_GET_FILE_ATTRIBUTES(GetFileAttributes)
+    {
+        *out = {};
+
+        struct stat data;
+        if( stat( filename, &data ) != 0 )
+            return false;
+
+        out->sizeBytes = (size_t)data.st_size;
+        out->modifiedTimePosix = (u64)data.st_mtim.tv_sec;
+
+        return true;
+    }
+
+    PLATFORM_READ_ENTIRE_FILE(ReadEntireFile)
+    {
+        u8* resultData = nullptr;
+        sz resultLength = 0;
+
+        int fd = open( filename, O_RDONLY | O_CLOEXEC );
+        if( fd != -1 )
+        {
+            struct stat data;
+            if( fstat( fd, &data ) == 0 )
+            {
+                sz fileSize = (sz)data.st_size;
+                resultLength = nullTerminate ? fileSize + 1 : fileSize;
+                resultData = (u8*)ALLOC( allocator, resultLength );
+
+                if( resultData )
+                {
+                    sz totalRead = 0;
+                    while( totalRead < fileSize )
+                    {
+                        ssize_t bytesRead = read( fd, resultData + totalRead, SizeT( fileSize - totalRead ) );
+                        if( bytesRead < 0 && errno == EINTR )
+                            continue;
+                        if( bytesRead <= 0 )
+                            break;
+                        totalRead += bytesRead;
+                    }
+
+                    if( totalRead == fileSize )
+                    {
+                        // Null-terminate to help when handling text files
+                        if( nullTerminate )
+                            *(resultData + fileSize) = '\0';
+                    }
+                    else
+                    {
+                        LogE( "Platform", "read failed for '%s' (%s)", filename, strerror( errno ) );
+                        FREE( allocator, resultData );
+                        resultData = nullptr;
+                        resultLength = 0;
+                    }
+                }
+                else
+                {
+                    LogE( "Platform", "Couldn't allocate buffer for file contents" );
+                }
+            }
+            else
+            {
+                LogE( "Platform", "Failed querying file size for '%s' (%s)", filename, strerror( errno ) );
+            }
+
+            close( fd );
+        }
+        else
+        {
+            LogE( "Platform", "Failed opening file '%s' for reading (%s)", filename, strerror( errno ) );
+        }
+
+        return Buffer<u8>( resultData, resultLength );
+    }
+
+    PLATFORM_WRITE_FILE_CHUNKS(WriteFileChunks)
+    {
+        int creationMode = O_CREAT | O_EXCL;
+        if( overwrite )
+            creationMode = O_CREAT | O_TRUNC;
+
+        int outFile = open( filename, O_WRONLY | O_APPEND | O_CLOEXEC | creationMode, 0644 );
+        if( outFile == -1 )
+        {
+            LogE( "Platform", "Could not open '%s' for writing (%s)", filename, strerror( errno ) );
+            return false;
+        }
+
+        bool error = false;
+        for( int i = 0; i < chunks.count && !error; ++i )
+        {
+            Buffer<> const& chunk = chunks[i];
+
+            sz totalWritten = 0;
+            while( totalWritten < chunk.length )
+            {
+                ssize_t bytesWritten = write( outFile, chunk.data + totalWritten, SizeT( chunk.length - totalWritten ) );
+                if( bytesWritten < 0 && errno == EINTR )
+                    continue;
+                if( bytesWritten <= 0 )
+                {
+                    LogE( "Platform", "Failed writing %d bytes to '%s' (%s)", chunk.length, filename, strerror( errno ) );
+                    error = true;
+                    break;
+                }
+                totalWritten += bytesWritten;
+            }
+        }
+
+        close( outFile );
+
+        return !error;
+    }
+
+    // Not exposed by glibc (at least not on older versions), so just declare it ourselves
+    struct LinuxDirent64
+    {
+        u64            d_ino;
+        i64            d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[];
+    };
+
+    bool FindFilesInternal( int parentFd, char const* path, char const* filenamePattern, bool recursive,
+                            BucketArray<Platform::DirEntry>* entriesOut )
+    {
+        int dirFd = openat( parentFd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+        if( dirFd == -1 )
+            // Same as Win32, a missing path is not an error, it just doesn't contain anything
+            return errno == ENOENT;
+
+        bool needsSep = !StringEndsWithAny( path, "/" );
+        // Only recurse once we're done with this dir, to avoid keeping too many fds open
+        BucketArray<String> subdirs( 16, CTX_TMPALLOC );
+
+        bool result = true;
+        alignas(LinuxDirent64) u8 direntBuffer[8192];
+        for( ;; )
+        {
+            long bytesRead = syscall( SYS_getdents64, dirFd, direntBuffer, sizeof(direntBuffer) );
+            if( bytesRead == 0 )
+                break;
+            if( bytesRead < 0 )
+            {
+                result = false;
+                break;
+            }
+
+            for( long offset = 0; offset < bytesRead; )
+            {
+                LinuxDirent64* dirent = (LinuxDirent64*)(direntBuffer + offset);
+                offset += dirent->d_reclen;
+
+                char const* filename = dirent->d_name;
+                if( StringEquals( filename, "." ) || StringEquals( filename, ".." ) )
+                    continue;
+
+                unsigned char type = dirent->d_type;
+                if( type == DT_UNKNOWN )
+                {
+                    // Not all filesystems fill this in
+                    struct stat data;
+                    if( fstatat( dirFd, filename, &data, AT_SYMLINK_NOFOLLOW ) == 0 )
+                        type = S_ISDIR( data.st_mode ) ? DT_DIR : S_ISREG( data.st_mode ) ? DT_REG : DT_UNKNOWN;
+                }
+
+                if( type == DT_DIR )
+                {
+                    if( recursive )
+                        subdirs.Push( String::FromFormatTmp( "%s%s%s", path, needsSep ? "/" : "", filename ) );
+                }
+                else if( fnmatch( filenamePattern, filename, 0 ) == 0 )
+                {
+                    Platform::DirEntry* newEntry = entriesOut->PushEmpty();
+                    // TODO These Strings *cannot* honour the allocator parameter passed to FindFiles below!
+                    newEntry->path = String::FromFormat( "%s%s%s", path, needsSep ? "/" : "", filename );
+                    newEntry->type = Platform::Regular;
+                    // TODO Add more info
+                }
+            }
+        }
+
+        close( dirFd );
+
+        for( String const& subPath : subdirs )
+            result = FindFilesInternal( parentFd, subPath.c(), filenamePattern, true, entriesOut ) && result;
+
+        return result;
+    }
+    PLATFORM_FIND_FILES(FindFiles)
+    {
+        using namespace Platform;
+
+        BucketArray<DirEntry> entries( 64, CTX_TMPALLOC );
+        bool result = FindFilesInternal( AT_FDCWD, path, filenamePattern, recursive, &entries );
+
+        DirEntry* resultData = nullptr;
+        if( result )
+        {
+            resultData = (DirEntry*)ALLOC( allocator, entries.count * SIZEOF(DirEntry) );
+            // Move so we dont copy each filename string
+            entries.MoveTo( resultData, entries.count );
+        }
+
+        return Buffer<DirEntry>( resultData, result ? entries.count : 0 );
+    }
+
+
+    PLATFORM_GET_THREAD_ID(GetThreadId)
+    {
+        return (u32)syscall( SYS_gettid );
+    }
+
+    internal void* WorkerThreadProc( void* param )
+    {
+        ThreadInfo* info = (ThreadInfo*)param;
+        info->id = GetThreadId();
+
+        // Set up base Context
+        // TODO We're gonna need to do this again upon hot reloading for any long-running threads
+        Platform::InitContextStack( info->context );
+
+        int exitCode = info->func( info->userData );
+        return (void*)(intptr_t)exitCode;
+    }
+
+    PLATFORM_CREATE_THREAD(CreateThread)
+    {
+        ThreadInfo* info = nullptr;
+        {
+            Mutex::Scope lock( platformState.threadsMutex );
+            for( ThreadInfo& ti : platformState.threads )
+                if( !ti.live )
+                {
+                    info = &ti;
+                    break;
+                }
+            ASSERT( info, "Too many threads" );
+            if( !info )
+                return nullptr;
+
+            info->live = true;
+        }
+
+        info->name = name;
+        info->func = threadFunc;
+        info->userData = userdata;
+        info->context = threadContext;
+
+        pthread_attr_t attr;
+        pthread_attr_init( &attr );
+        pthread_attr_setstacksize( &attr, MEGABYTES(1) );
+
+        int ret = pthread_create( &info->pthread, &attr, WorkerThreadProc, info );
+        pthread_attr_destroy( &attr );
+
+        if( ret != 0 )
+        {
+            LogE( "Platform", "pthread_create failed (%s)", strerror( ret ) );
+            info->live = false;
+            return nullptr;
+        }
+
+        // Names are limited to 16 chars including the terminator
+        char shortName[16] = {};
+        StringCopy( name, shortName, ARRAYCOUNT(shortName) );
+        pthread_setname_np( info->pthread, shortName );
+
+        return (Platform::ThreadHandle)info;
+    }
+
+    PLATFORM_JOIN_THREAD(JoinThread)
+    {
+        ThreadInfo* info = (ThreadInfo*)handle;
+        if( !info || !info->live )
+        {
+            LogE( "Platform", "Thread with handle %p not found!", handle );
+            return -1;
+        }
+
+        void* exitCode = nullptr;
+        pthread_join( info->pthread, &exitCode );
+
+        Mutex::Scope lock( platformState.threadsMutex );
+        *info = {};
+
+        return (int)(intptr_t)exitCode;
+    }
+
+    // NOTE This file should be compiled only in the platform layer,
+    // so this id will by definition be stable across hot reloads
+    static u32 globalMainThreadId = GetThreadId();
+    static thread_local u32 globalThreadId = GetThreadId();
+    PLATFORM_IS_MAIN_THREAD(IsMainThread)
+    {
+        return globalThreadId == globalMainThreadId;
+    }
+
+    PLATFORM_GET_CORE_COUNT(GetCoreCount)
+    {
+        long count = sysconf( _SC_NPROCESSORS_ONLN );
+        return count > 0 ? (int)count : 1;
+    }
+
+
+    internal INLINE long Futex( atomic_i32* addr, int op, i32 value )
+    {
+        // std::atomic<i32> is guaranteed to have the same representation as an i32 when it's lock free
+        return syscall( SYS_futex, (i32*)addr, op, value, nullptr, nullptr, 0 );
+    }
+
+    PLATFORM_FUTEX_WAIT(FutexWait)
+    {
+        Futex( address, FUTEX_WAIT_PRIVATE, expected );
+    }
+
+    PLATFORM_FUTEX_WAKE(FutexWake)
+    {
+        Futex( address, FUTEX_WAKE_PRIVATE, count );
+    }
+
+    // Same futex-based primitives user code can use directly, just behind a handle
+    PLATFORM_CREATE_SEMAPHORE(CreateSemaphore)
+    {
+        FutexSemaphore* s = ALLOC_STRUCT( &platformState.handleAllocator, FutexSemaphore );
+        INIT( *s )( initialCount );
+        return s;
+    }
+
+    PLATFORM_DESTROY_SEMAPHORE(DestroySemaphore)
+    {
+        ((FutexSemaphore*)handle)->~FutexSemaphore();
+        FREE( &platformState.handleAllocator, handle );
+    }
+
+    PLATFORM_WAIT_SEMAPHORE(WaitSemaphore)
+    {
+        ((FutexSemaphore*)handle)->Wait();
+    }
+
+    PLATFORM_SIGNAL_SEMAPHORE(SignalSemaphore)
+    {
+        ((FutexSemaphore*)handle)->Signal( count );
+    }
+
+    PLATFORM_CREATE_MUTEX(CreateMutex)
+    {
+        FutexMutex* m = ALLOC_STRUCT( &platformState.handleAllocator, FutexMutex );
+        INIT( *m )();
+        return m;
+    }
+
+    PLATFORM_DESTROY_MUTEX(DestroyMutex)
+    {
+        ((FutexMutex*)handle)->~FutexMutex();
+        FREE( &platformState.handleAllocator, handle );
+    }
+
+    PLATFORM_LOCK_MUTEX(LockMutex)
+    {
+        ((FutexMutex*)handle)->Lock();
+    }
+
+    PLATFORM_UNLOCK_MUTEX(UnlockMutex)
+    {
+        ((FutexMutex*)handle)->Unlock();
+    }
+
+
+    PLATFORM_ELAPSED_TIME_MILLIS(ElapsedTimeMillis)
+    {
+        timespec now;
+        clock_gettime( CLOCK_MONOTONIC, &now );
+
+        f64 result = (f64)now.tv_sec * 1000 + (f64)now.tv_nsec / 1000000
+            - platformState.appStartTimeMillis;
+
+        return result;
+    }
+
+    PLATFORM_SHELL_EXECUTE(ShellExecute)
+    {
+        int exitCode = -1;
+        char outBuffer[2048] = {};
+
+        FILE* pipe = popen( cmdLine, "r" );
+        if( pipe == NULL )
+        {
+            LogE( "Platform", "Error executing command (%s)\n", strerror( errno ) );
+        }
+        else
+        {
+            while( fgets( outBuffer, I32( ARRAYCOUNT(outBuffer) ), pipe ) )
+                globalPlatform.Print( outBuffer );
+
+            if( feof( pipe ) )
+            {
+                int status = pclose( pipe );
+                exitCode = WIFEXITED( status ) ? WEXITSTATUS( status ) : -1;
+            }
+            else
+            {
+                LogE( "Platform", "Failed reading command pipe to the end\n" );
+                pclose( pipe );
+            }
+        }
+
+        return exitCode;
+    }
+
+    PLATFORM_TEST_CONNECTIVITY(TestConnectivity)
+    {
+        // Check there's at least one interface up other than loopback
+        bool anyInterface = false;
+
+        ifaddrs* addrs = nullptr;
+        if( getifaddrs( &addrs ) == 0 )
+        {
+            for( ifaddrs* a = addrs; a; a = a->ifa_next )
+            {
+                if( a->ifa_addr && (a->ifa_flags & IFF_UP) && !(a->ifa_flags & IFF_LOOPBACK)
+                    && (a->ifa_addr->sa_family == AF_INET || a->ifa_addr->sa_family == AF_INET6) )
+                {
+                    anyInterface = true;
+                    break;
+                }
+            }
+            freeifaddrs( addrs );
+        }
+
+        if( !anyInterface )
+            return false;
+
+        // Having an interface doesn't mean we can get anywhere though, so (like Windows does under the hood)
+        // actually try reaching a well known public host, without waiting on it for too long
+        int sock = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+        if( sock == -1 )
+            return false;
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons( 53 );
+        inet_pton( AF_INET, "1.1.1.1", &addr.sin_addr );
+
+        bool result = false;
+        if( connect( sock, (sockaddr*)&addr, sizeof(addr) ) == 0 )
+            result = true;
+        else if( errno == EINPROGRESS )
+        {
+            pollfd pfd = { sock, POLLOUT, 0 };
+            if( poll( &pfd, 1, 2000 ) == 1 )
+            {
+                int error = 0;
+                socklen_t len = sizeof(error);
+                getsockopt( sock, SOL_SOCKET, SO_ERROR, &error, &len );
+                result = (error == 0);
+            }
+        }
+
+        close( sock );
+        return result;
+    }
+
+
+    PLATFORM_PRINT(Print)
+    {
+        va_list args;
+        va_start( args, fmt );
+        vfprintf( stdout, fmt, args );
+        va_end( args );
+    }
+
+    PLATFORM_PRINT(Error)
+    {
+        va_list args;
+        va_start( args, fmt );
+        vfprintf( stderr, fmt, args );
+        va_end( args );
+    }
+
+    PLATFORM_PRINT_VA(PrintVA)
+    {
+        vfprintf( stdout, fmt, args );
+    }
+
+    PLATFORM_PRINT_VA(ErrorVA)
+    {
+        vfprintf( stderr, fmt, args );
+    }
+
+    int CaptureCallstack( void* framesOut[], sz framesOutLen, int framesIgnoredCount = 0 )
+    {
+        int frameCount = backtrace( framesOut, (int)framesOutLen );
+        // Shift down so we drop the ignored frames
+        framesIgnoredCount = Min( framesIgnoredCount, frameCount );
+        memmove( framesOut, framesOut + framesIgnoredCount, SizeT( (frameCount - framesIgnoredCount) * SIZEOF(void*) ) );
+
+        return frameCount - framesIgnoredCount;
+    }
+
+    sz ResolveCallstack( void* const frames[], int framesLen, char* bufferOut, sz bufferOutLen, char const* lineSeparator = nullptr )
+    {
+        if( !lineSeparator )
+            lineSeparator = "\n";
+
+        char const* const bufferStart = bufferOut;
+        char const* const bufferEnd = bufferOut + bufferOutLen;
+
+        // NOTE Needs -rdynamic for anything other than raw addresses
+        char** symbols = backtrace_symbols( frames, framesLen );
+        for( int frameIdx = 0; frameIdx < framesLen; ++frameIdx )
+        {
+            char const* symName = symbols ? symbols[frameIdx] : "[backtrace_symbols failed]";
+            bool appended = StringAppendToBuffer( bufferOut, bufferEnd, "[%2d] %s%s" "\t0x%016llx%s", frameIdx, symName, lineSeparator,
+                                                  (u64)frames[frameIdx], lineSeparator );
+
+            // bail when we hit the application entry-point, don't care much about beyond this level
+            if( !appended || strstr( symName, "(main+" ) != nullptr )
+                break;
+        }
+        free( symbols );
+
+        *bufferOut++ = 0;
+        return bufferOut - bufferStart;
+    }
+
+    int DumpCallstackToBuffer( char* bufferOut, sz bufferLen, int framesIgnoredCount = 0, char const* lineSeparator = nullptr )
+    {
+        void* addresses[64]{};
+        int frameCount = CaptureCallstack( addresses, ARRAYCOUNT(addresses), framesIgnoredCount );
+
+        ResolveCallstack( addresses, frameCount, bufferOut, bufferLen, lineSeparator );
+        return frameCount;
+    }
+
+
+    internal void ExceptionHandler( int signal, siginfo_t* info, void* context )
+    {
+        char callstack[16384];
+        DumpCallstackToBuffer( callstack, ARRAYCOUNT(callstack), 2 );
+
+        // Print directly, as the logging thread won't get a chance to flush anything before we go down
+        globalPlatform.Error( "### UNHANDLED SIGNAL %d (%s) at address %p ###\n%s", signal, strsignal( signal ), info->si_addr, callstack );
+
+        // Handler has been reset to the default one, so just let it run its course (core dump etc.)
+        raise( signal );
+    }
+
+    ASSERT_HANDLER(DefaultAssertHandler)
+    {
+        char buffer[256] = {};
+
+        va_list args;
+        va_start( args, msg );
+        vsnprintf( buffer, ARRAYCOUNT(buffer), msg, args );
+        va_end( args );
+
+        LogE( "Platform", "ASSERTION FAILED! :: \"%s\" (%s@%d)\n", buffer, file, line );
+        // Don't dump a callstack, as we're either in the debugger, or the TRAP will cause an unhandled signal
+    }
+
+
+    void InstallDefaultCrashHandler()
+    {
+        // Use a separate stack so we can still report stack overflows
+        persistent u8 signalStack[64 * 1024];
+        stack_t ss = {};
+        ss.ss_sp = signalStack;
+        ss.ss_size = sizeof(signalStack);
+        sigaltstack( &ss, nullptr );
+
+        struct sigaction sa = {};
+        sa.sa_sigaction = ExceptionHandler;
+        sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESETHAND;
+        sigemptyset( &sa.sa_mask );
+
+        int signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGTRAP, SIGABRT };
+        for( int s : signals )
+            sigaction( s, &sa, nullptr );
+    }
+
+    internal void ShutdownLogging()
+    {
+        // Unlike on Windows, other threads keep running while static destructors execute on exit, and destroying a
+        // condition variable some thread is still waiting on blocks forever, so make sure the logging thread is gone by then
+        Logging::Shutdown( Platform::GetGlobalLoggingState() );
+    }
+
+    void InitGlobalPlatform( Buffer<Logging::ChannelDecl> const& logChannels )
+    {
+        Platform::API linuxAPI = {};
+        linuxAPI.Alloc                = Alloc;
+        linuxAPI.Free                 = Free;
+        linuxAPI.Reserve              = Reserve;
+        linuxAPI.Commit               = Commit;
+        linuxAPI.Decommit             = Decommit;
+        linuxAPI.Release              = Release;
+        linuxAPI.AllocMirrored        = AllocMirrored;
+        linuxAPI.FreeMirrored         = FreeMirrored;
+        linuxAPI.GetContext           = Platform::GetContext;
+        linuxAPI.PushContext          = Platform::PushContext;
+        linuxAPI.PopContext           = Platform::PopContext;
+        linuxAPI.SwapContextStack     = Platform::SwapContextStack;
+        linuxAPI.GetFileAttributes    = GetFileAttributes;
+        linuxAPI.ReadEntireFile       = ReadEntireFile;
+        linuxAPI.WriteFileChunks      = WriteFileChunks;
+        linuxAPI.FindFiles            = FindFiles;
+        linuxAPI.CreateThread         = CreateThread;
+        linuxAPI.JoinThread           = JoinThread;
+        linuxAPI.GetThreadId          = GetThreadId;
+        linuxAPI.IsMainThread         = IsMainThread;
+        linuxAPI.GetCoreCount         = GetCoreCount;
+        linuxAPI.CreateSemaphore      = CreateSemaphore;
+        linuxAPI.DestroySemaphore     = DestroySemaphore;
+        linuxAPI.WaitSemaphore        = WaitSemaphore;
+        linuxAPI.SignalSemaphore      = SignalSemaphore;
+        linuxAPI.FutexWait            = FutexWait;
+        linuxAPI.FutexWake            = FutexWake;
+        linuxAPI.CreateMutex          = CreateMutex;
+        linuxAPI.DestroyMutex         = DestroyMutex;
+        linuxAPI.LockMutex            = LockMutex;
+        linuxAPI.UnlockMutex          = UnlockMutex;
+        linuxAPI.ElapsedTimeMillis    = ElapsedTimeMillis;
+        linuxAPI.ShellExecute         = ShellExecute;
+        linuxAPI.TestConnectivity     = TestConnectivity;
+        linuxAPI.Print                = Print;
+        linuxAPI.Error                = Error;
+        linuxAPI.PrintVA              = PrintVA;
+        linuxAPI.ErrorVA              = ErrorVA;
+        linuxAPI.DefaultAssertHandler = DefaultAssertHandler;
+
+        Platform::InitGlobalPlatform( linuxAPI, logChannels );
+        // Registered after the logging state has been constructed, so it runs before its destructor
+        atexit( ShutdownLogging );
+
+        // TODO Same ordering problem as the Win32 version
+        InitState( &platformState );
+    }
+}
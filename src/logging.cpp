@@ -1,43 +1,79 @@
 
 namespace Logging
 {
+    // How long to wait for the logging thread to make room for a new message before dropping it
+    static constexpr int MaxPushRetries = 1000000;
+
+    // The logging thread can't wait for itself, so it just drops anything that doesn't fit
+    internal bool WaitForRoom( State* state, int retries )
+    {
+        if( retries >= MaxPushRetries || Core::GetThreadId() == state->threadId.LOAD_RELAXED() )
+        {
+            state->droppedCount.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+
+        Yield();
+        return true;
+    }
 
     void LogInternalVA( char const* channelName, Volume volume, char const* file, int line, char const* msg, va_list args )
     {
         State* state = CTX.logState;
 
-        // TODO We probably won't need this. Just check we're initialized?
-        ASSERT( !state->channels.Empty(), "No channels.. have you called Logging::Init?" );
+        ASSERT( state, "No log state.. have you called Logging::Init?" );
 
-        // If we don't find the Channel just add one with default attrs on the spot
-        Channel const* channel = state->channels.GetOrPut( channelName );
-        ASSERT( channelName && channel, "Invalid log channel" );
-        if( !channel )
+        ASSERT( channelName, "Invalid log channel" );
+        if( !channelName )
             return;
 
-        if( volume < channel->minVolume )
+        // If we don't find the Channel just add one with default attrs on the spot
+        Channel channel = state->channels.GetOrPut( channelName );
+        if( volume < channel.minVolume )
             return;
 
-        // Figure out total length of the msg + entry header
+        // We need to go over the args twice
+        va_list argsCopy;
+        va_copy( argsCopy, args );
+
+        // Figure out total length of the msg (truncating anything that would never fit)
         int len         = vsnprintf( nullptr, 0, msg, args );
-        // TODO Formalize what we're trying to do here using a BipBuffer instead .. https://www.codeproject.com/Articles/3479/The-Bip-Buffer-The-Circular-Buffer-with-a-Twist
-        // AND remove all 'Adjacent' variations from RingBuffer(s) cause they're quirky
-        char* msgBuffer = state->msgBuffer.PushEmptyRangeAdjacent( len + 1, false );
-
-        Entry* newEntry = state->entryQueue.PushEmpty();
-        newEntry->channelName = channelName;
-        newEntry->sourceFile  = file;
-        newEntry->sourceLine  = line;
-        newEntry->timeSeconds = Clock::AppTimeSeconds();
-        newEntry->threadId    = Core::GetThreadId();
-        newEntry->volume      = volume;
-        newEntry->msgLen      = len;
-        newEntry->msg         = msgBuffer;
-        
-        // Actually write the msg string
-        vsnprintf( msgBuffer, (size_t)(len + 1), msg, args );
-        // May not be necessary
-        msgBuffer[len] = 0;
+        len             = Min( len, state->msgBuffer.MaxRecordCount() / 4 );
+
+        // Released by the logging thread once all endpoints have seen it
+        // If the logging thread can't keep up, wait for it for a while before dropping messages
+        char* msgBuffer;
+        for( int retries = 0; !(msgBuffer = state->msgBuffer.PushEmpty( len + 1 )); ++retries )
+        {
+            if( !WaitForRoom( state, retries ) )
+            {
+                va_end( argsCopy );
+                return;
+            }
+        }
+
+        // Write the msg string directly into the buffer
+        vsnprintf( msgBuffer, (size_t)(len + 1), msg, argsCopy );
+        va_end( argsCopy );
+
+        Entry newEntry;
+        newEntry.channelName = channelName;
+        newEntry.sourceFile  = file;
+        newEntry.sourceLine  = line;
+        newEntry.timeSeconds = Clock::AppTimeSeconds();
+        newEntry.threadId    = Core::GetThreadId();
+        newEntry.volume      = volume;
+        newEntry.msgLen      = len;
+        newEntry.msg         = msgBuffer;
+
+        for( int retries = 0; !state->entryQueue.Push( newEntry ); ++retries )
+        {
+            if( !WaitForRoom( state, retries ) )
+            {
+                state->msgBuffer.Discard( msgBuffer );
+                return;
+            }
+        }
 
         state->entrySemaphore.Signal();
     }
@@ -88,8 +124,9 @@ namespace Logging
     PLATFORM_THREAD_FUNC(LoggingThread)
     {
         State* state = (State*)userdata;
+        state->threadId.STORE_RELAXED( Core::GetThreadId() );
 
-        while( state->thread.LOAD_RELAXED() )
+        while( state->threadRunning.LOAD_RELAXED() )
         {
             state->entrySemaphore.Wait();
 
@@ -101,19 +138,7 @@ namespace Logging
                 for( EndpointInfo const& tgt : state->endpoints )
                     tgt.func( entry, tgt.userdata );
 
-                // Clear out the range in the msg buffer, and advance it as much as we can
-                ZEROP( (void*)entry.msg, entry.msgLen );
-
-                // Remove any zero'd out chars currently present in the msgBuffer, to account for the fact that entries and msg strings
-                // have been pushed in two stages and hence could be out of order with respect to each other
-                // (Since we're the only thread consuming stuff, we're safe doing whatever at the tail end of the buffer)
-                while( !state->msgBuffer.Empty() )
-                {
-                    char* c = &state->msgBuffer.Tail();
-                    if( *c )
-                        break;
-                    state->msgBuffer.TryPop( c );
-                }
+                state->msgBuffer.Release( (char*)entry.msg );
             }
         }
 
@@ -124,22 +149,26 @@ namespace Logging
     void Init( State* state, Buffer<ChannelDecl> channels )
     {
         // Init everything from the main thread's arena
-        INIT( state->channels )( I32(channels.length) + 1 );
-        INIT( state->endpoints )( 8 );
-        INIT( state->msgBuffer )( 64 * 1024 );
+        INIT( state->channels )( I32(channels.length) + 1, &state->channelsAllocator );
+        INIT( state->endpoints )();
+        INIT( state->msgBuffer )( 1024 * 1024 );
         INIT( state->entryQueue )( 1024 );
         INIT( state->entrySemaphore );
         INIT( state->thread )( nullptr );
+        INIT( state->threadRunning )( true );
+        INIT( state->threadId )( 0 );
+        INIT( state->droppedCount )( 0 );
 
         InitArena( &state->threadArena );
         InitArena( &state->threadTmpArena );
 
         // Always add a 'Platform' channel
-        /*Channel* c = */state->channels.Put( "Platform" );
+        state->channels.Put( "Platform", Channel() );
         for( ChannelDecl const& cd : channels )
         {
-            Channel* c = state->channels.Put( cd.name );
-            c->minVolume = cd.minVolume;
+            Channel c;
+            c.minVolume = cd.minVolume;
+            state->channels.Put( cd.name, c );
         }
 
         // Once ready, set the state in this thread's Context so it's ready to use
@@ -160,6 +189,7 @@ namespace Logging
     {
         Platform::ThreadHandle thread = state->thread.LOAD_RELAXED();
         state->thread.STORE_RELAXED( nullptr );
+        state->threadRunning.STORE_RELAXED( false );
         state->entrySemaphore.Signal();
 
         Core::JoinThread( thread );
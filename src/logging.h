@@ -47,15 +47,22 @@ ENUM_STRUCT_WITH_NAMES(Volume, VOLUME_ITEMS);
 
     struct State
     {
-        Hashtable<char const*, Channel>     channels;
-        Array<EndpointInfo>                 endpoints;
-        SyncRingBuffer<char>                msgBuffer;
-        // TODO Assert when full
+        // Unknown channels are added on the fly by whichever thread logs to them
+        ConcurrentHashtable<char const*, Channel, LazyAllocator> channels;
+        LazyAllocator                       channelsAllocator;
+        SmallArray<EndpointInfo, 8>         endpoints;
+        // Message strings are pushed by whichever thread logs and released by the logging thread
+        MirroredRingBuffer<char>            msgBuffer;
         SyncRingBuffer<Entry>               entryQueue;
         Semaphore                           entrySemaphore;
         MemoryArena                         threadArena;
         MemoryArena                         threadTmpArena;
         std::atomic<Platform::ThreadHandle> thread;
+        // Set before the thread is created, since it may start running before we even get its handle
+        atomic_bool                         threadRunning;
+        atomic_u32                          threadId;
+        // Messages that couldn't be queued because the logging thread wasn't keeping up (or was logging itself)
+        atomic_u32                          droppedCount;
     };
 
 
@@ -0,0 +1,387 @@
+//
+// NOTE NOTE NOTE Include this only on platform exe, not the application dll
+//
+
+#if MEMORY_TRACKING
+
+namespace Memory
+{
+
+// NOTE All internal storage comes straight from malloc, so the tracker never goes through (and recurses into) itself
+struct TrackedBlock
+{
+    void* memoryBlock;
+    sz size;
+    i32 siteIndex;
+};
+
+struct TrackedArena
+{
+    MemoryArena* arena;
+    char const* name;
+};
+
+struct TrackingState
+{
+    Mutex mutex;
+
+    // Open addressing with linear probing, keyed on the block address
+    TrackedBlock* blocks;
+    i32 blockCapacity;
+    i32 blockCount;
+
+    SiteStats* sites;
+    i32 siteCount;
+    i32 siteCapacity;
+    // Maps (filename, line, tag) to 1 + index into sites
+    i32* siteSlots;
+    i32 siteSlotCapacity;
+
+    TrackingStats total;
+    TrackingStats tags[256];
+
+    TrackedArena arenas[64];
+    i32 arenaCount;
+};
+
+internal TrackingState& GetTrackingState()
+{
+    persistent TrackingState state = {};
+    return state;
+}
+
+// Set while a thread is inside the tracker, so we can ignore anything allocated from there (i.e. snapshots)
+internal thread_local bool threadInTracker;
+
+
+internal INLINE u32 HashPointer( void const* p )
+{
+    u64 h = ((u64)(uintptr_t)p >> 4) * 0x9E3779B97F4A7C15ull;
+    return (u32)(h >> 32);
+}
+
+internal INLINE u32 HashSite( char const* filename, int line, u8 tag )
+{
+    u64 h = ((u64)(uintptr_t)filename ^ ((u64)line << 8) ^ tag) * 0x9E3779B97F4A7C15ull;
+    return (u32)(h >> 32);
+}
+
+internal void AddStats( TrackingStats* stats, sz sizeBytes )
+{
+    stats->liveBytes += sizeBytes;
+    stats->peakBytes = Max( stats->peakBytes, stats->liveBytes );
+    stats->liveCount++;
+    stats->allocCount++;
+}
+
+internal void RemoveStats( TrackingStats* stats, sz sizeBytes )
+{
+    stats->liveBytes -= sizeBytes;
+    stats->liveCount--;
+}
+
+internal void InsertSiteSlot( TrackingState& state, i32 siteIndex )
+{
+    SiteStats const& site = state.sites[siteIndex];
+    u32 mask = (u32)state.siteSlotCapacity - 1;
+    u32 i = HashSite( site.filename, site.line, site.tag ) & mask;
+    while( state.siteSlots[i] )
+        i = (i + 1) & mask;
+    state.siteSlots[i] = siteIndex + 1;
+}
+
+internal i32 FindOrAddSite( TrackingState& state, char const* filename, int line, u8 tag )
+{
+    if( state.siteSlotCapacity )
+    {
+        u32 mask = (u32)state.siteSlotCapacity - 1;
+        u32 i = HashSite( filename, line, tag ) & mask;
+        while( i32 slot = state.siteSlots[i] )
+        {
+            SiteStats const& site = state.sites[slot - 1];
+            if( site.filename == filename && site.line == line && site.tag == tag )
+                return slot - 1;
+            i = (i + 1) & mask;
+        }
+    }
+
+    if( state.siteCount == state.siteCapacity )
+    {
+        state.siteCapacity = Max( 256, state.siteCapacity * 2 );
+        state.sites = (SiteStats*)realloc( state.sites, SizeT( state.siteCapacity * SIZEOF(SiteStats) ) );
+    }
+    i32 result = state.siteCount++;
+    state.sites[result] = { filename, line, tag, {} };
+
+    // Keep the slots at most half full
+    if( state.siteCount * 2 > state.siteSlotCapacity )
+    {
+        free( state.siteSlots );
+        state.siteSlotCapacity = Max( 512, state.siteSlotCapacity * 2 );
+        state.siteSlots = (i32*)calloc( SizeT( state.siteSlotCapacity ), sizeof(i32) );
+        for( i32 i = 0; i < state.siteCount; ++i )
+            InsertSiteSlot( state, i );
+    }
+    else
+        InsertSiteSlot( state, result );
+
+    return result;
+}
+
+internal i32 FindBlockSlot( TrackingState const& state, void const* memoryBlock )
+{
+    if( !state.blockCapacity )
+        return -1;
+
+    u32 mask = (u32)state.blockCapacity - 1;
+    u32 i = HashPointer( memoryBlock ) & mask;
+    while( state.blocks[i].memoryBlock )
+    {
+        if( state.blocks[i].memoryBlock == memoryBlock )
+            return (i32)i;
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+internal void InsertBlock( TrackingState& state, TrackedBlock const& block )
+{
+    u32 mask = (u32)state.blockCapacity - 1;
+    u32 i = HashPointer( block.memoryBlock ) & mask;
+    while( state.blocks[i].memoryBlock )
+        i = (i + 1) & mask;
+    state.blocks[i] = block;
+    state.blockCount++;
+}
+
+internal void RemoveBlockAt( TrackingState& state, i32 slot )
+{
+    // Backward shift deletion, so we don't need tombstones
+    u32 mask = (u32)state.blockCapacity - 1;
+    u32 hole = (u32)slot;
+    u32 i = (hole + 1) & mask;
+    while( state.blocks[i].memoryBlock )
+    {
+        u32 home = HashPointer( state.blocks[i].memoryBlock ) & mask;
+        // Move it into the hole if its home slot is not in the (cyclic) range (hole, i]
+        if( ((i - home) & mask) >= ((i - hole) & mask) )
+        {
+            state.blocks[hole] = state.blocks[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    state.blocks[hole] = {};
+    state.blockCount--;
+}
+
+internal void RetireBlock( TrackingState& state, i32 slot )
+{
+    TrackedBlock const& block = state.blocks[slot];
+    SiteStats& site = state.sites[block.siteIndex];
+
+    RemoveStats( &site.stats, block.size );
+    RemoveStats( &state.tags[site.tag], block.size );
+    RemoveStats( &state.total, block.size );
+    RemoveBlockAt( state, slot );
+}
+
+void TrackAlloc( void* memoryBlock, sz sizeBytes, char const* filename, int line, u8 tag )
+{
+    if( !memoryBlock || threadInTracker )
+        return;
+
+    TrackingState& state = GetTrackingState();
+    Mutex::Scope lock( state.mutex );
+
+    // Address handed out again without an intervening FREE (i.e. temporary memory that was just rolled back)
+    i32 existing = FindBlockSlot( state, memoryBlock );
+    if( existing >= 0 )
+        RetireBlock( state, existing );
+
+    // Keep the table at most half full
+    if( (state.blockCount + 1) * 2 > state.blockCapacity )
+    {
+        TrackedBlock* oldBlocks = state.blocks;
+        i32 oldCapacity = state.blockCapacity;
+
+        state.blockCapacity = Max( 1024, oldCapacity * 2 );
+        state.blocks = (TrackedBlock*)calloc( SizeT( state.blockCapacity ), sizeof(TrackedBlock) );
+        state.blockCount = 0;
+        for( i32 i = 0; i < oldCapacity; ++i )
+            if( oldBlocks[i].memoryBlock )
+                InsertBlock( state, oldBlocks[i] );
+        free( oldBlocks );
+    }
+
+    i32 siteIndex = FindOrAddSite( state, filename, line, tag );
+    InsertBlock( state, { memoryBlock, sizeBytes, siteIndex } );
+
+    AddStats( &state.sites[siteIndex].stats, sizeBytes );
+    AddStats( &state.tags[tag], sizeBytes );
+    AddStats( &state.total, sizeBytes );
+}
+
+void TrackFree( void* memoryBlock )
+{
+    if( !memoryBlock || threadInTracker )
+        return;
+
+    TrackingState& state = GetTrackingState();
+    Mutex::Scope lock( state.mutex );
+
+    // Untracked blocks (allocated before tracking was compiled in, or without the ALLOC macros) are just ignored
+    i32 slot = FindBlockSlot( state, memoryBlock );
+    if( slot >= 0 )
+        RetireBlock( state, slot );
+}
+
+void TrackArena( MemoryArena* arena, char const* name )
+{
+    TrackingState& state = GetTrackingState();
+    Mutex::Scope lock( state.mutex );
+
+    for( i32 i = 0; i < state.arenaCount; ++i )
+    {
+        if( state.arenas[i].arena == arena )
+        {
+            state.arenas[i].name = name;
+            return;
+        }
+    }
+
+    ASSERT( state.arenaCount < ARRAYCOUNT(state.arenas), "Too many tracked arenas" );
+    if( state.arenaCount < ARRAYCOUNT(state.arenas) )
+        state.arenas[state.arenaCount++] = { arena, name };
+}
+
+void UntrackArena( MemoryArena* arena )
+{
+    TrackingState& state = GetTrackingState();
+    Mutex::Scope lock( state.mutex );
+
+    for( i32 i = 0; i < state.arenaCount; ++i )
+    {
+        if( state.arenas[i].arena == arena )
+        {
+            state.arenas[i] = state.arenas[--state.arenaCount];
+            return;
+        }
+    }
+}
+
+Snapshot TakeSnapshot( Allocator* allocator )
+{
+    TrackingState& state = GetTrackingState();
+    Snapshot result = {};
+
+    threadInTracker = true;
+    {
+        Mutex::Scope lock( state.mutex );
+
+        result.total = state.total;
+        COPY( state.tags, result.tags );
+
+        result.sites = Buffer<SiteStats>( ALLOC_ARRAY( allocator, SiteStats, state.siteCount, Memory::NoClear() ),
+                                          state.siteCount );
+        COPYP( state.sites, result.sites.data, state.siteCount * SIZEOF(SiteStats) );
+
+        result.arenas = Buffer<ArenaStats>( ALLOC_ARRAY( allocator, ArenaStats, state.arenaCount, Memory::NoClear() ),
+                                            state.arenaCount );
+        for( i32 i = 0; i < state.arenaCount; ++i )
+        {
+            MemoryArena const* arena = state.arenas[i].arena;
+            result.arenas[i] = { state.arenas[i].name, arena->used, arena->peakUsed, arena->size };
+        }
+    }
+    threadInTracker = false;
+
+    return result;
+}
+
+internal TrackingStats DiffStats( TrackingStats const& before, TrackingStats const& after )
+{
+    TrackingStats result;
+    result.liveBytes = after.liveBytes - before.liveBytes;
+    result.peakBytes = after.peakBytes;
+    result.liveCount = after.liveCount - before.liveCount;
+    result.allocCount = after.allocCount - before.allocCount;
+    return result;
+}
+
+Snapshot Diff( Snapshot const& before, Snapshot const& after, Allocator* allocator )
+{
+    ASSERT( before.sites.length <= after.sites.length, "Snapshots given in the wrong order?" );
+
+    Snapshot result = {};
+    threadInTracker = true;
+    result.total = DiffStats( before.total, after.total );
+    for( int i = 0; i < ARRAYCOUNT(result.tags); ++i )
+        result.tags[i] = DiffStats( before.tags[i], after.tags[i] );
+
+    sz changedCount = 0;
+    for( sz i = 0; i < after.sites.length; ++i )
+    {
+        TrackingStats stats = i < before.sites.length ? DiffStats( before.sites[i].stats, after.sites[i].stats )
+                                                      : after.sites[i].stats;
+        if( stats.allocCount || stats.liveCount )
+            changedCount++;
+    }
+
+    result.sites = Buffer<SiteStats>( ALLOC_ARRAY( allocator, SiteStats, changedCount, Memory::NoClear() ), changedCount );
+    sz n = 0;
+    for( sz i = 0; i < after.sites.length; ++i )
+    {
+        SiteStats site = after.sites[i];
+        if( i < before.sites.length )
+            site.stats = DiffStats( before.sites[i].stats, after.sites[i].stats );
+        if( site.stats.allocCount || site.stats.liveCount )
+            result.sites[n++] = site;
+    }
+
+    result.arenas = Buffer<ArenaStats>( ALLOC_ARRAY( allocator, ArenaStats, after.arenas.length, Memory::NoClear() ),
+                                        after.arenas.length );
+    COPYP( after.arenas.data, result.arenas.data, after.arenas.length * SIZEOF(ArenaStats) );
+    threadInTracker = false;
+
+    return result;
+}
+
+void FreeSnapshot( Snapshot* snapshot, Allocator* allocator )
+{
+    FREE( allocator, snapshot->sites.data );
+    FREE( allocator, snapshot->arenas.data );
+    *snapshot = {};
+}
+
+bool WriteCSVReport( Snapshot const& snapshot, char const* filename )
+{
+    StringBuilder sb;
+    sb.Append( "kind,name,line,tag,liveBytes,peakBytes,liveCount,allocCount\n" );
+
+    TrackingStats const& t = snapshot.total;
+    sb.AppendFormat( "total,,,,%lld,%lld,%lld,%lld\n",
+                     (long long)t.liveBytes, (long long)t.peakBytes, (long long)t.liveCount, (long long)t.allocCount );
+    for( int i = 0; i < ARRAYCOUNT(snapshot.tags); ++i )
+    {
+        TrackingStats const& s = snapshot.tags[i];
+        if( s.allocCount || s.liveCount )
+            sb.AppendFormat( "tag,,,%d,%lld,%lld,%lld,%lld\n", i,
+                             (long long)s.liveBytes, (long long)s.peakBytes, (long long)s.liveCount, (long long)s.allocCount );
+    }
+    for( SiteStats const& site : snapshot.sites )
+    {
+        TrackingStats const& s = site.stats;
+        sb.AppendFormat( "site,%s,%d,%d,%lld,%lld,%lld,%lld\n", site.filename, site.line, site.tag,
+                         (long long)s.liveBytes, (long long)s.peakBytes, (long long)s.liveCount, (long long)s.allocCount );
+    }
+    for( ArenaStats const& arena : snapshot.arenas )
+        sb.AppendFormat( "arena,%s,,,%lld,%lld,,%lld\n", arena.name,
+                         (long long)arena.used, (long long)arena.peakUsed, (long long)arena.size );
+
+    return globalPlatform.WriteFileChunks( filename, sb.buckets.ToRawBufferArray(), true );
+}
+
+} // namespace Memory
+
+#endif // MEMORY_TRACKING
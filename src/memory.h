@@ -29,11 +29,25 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #endif
 
 
+// Define this to record live & peak bytes per call site, per tag and per registered arena (see Memory::TakeSnapshot)
+#ifndef MEMORY_TRACKING
+#define MEMORY_TRACKING 0
+#endif
+
 // Free memory functions, passing any kind of allocator implementation as the first param
+#if MEMORY_TRACKING
+#define ALLOC(allocator, size, ...)                 _TrackedAlloc( allocator, size, __FILE__, __LINE__, ##__VA_ARGS__ )
+#define ALLOC_STRUCT(allocator, type, ...)          (type *)_TrackedAlloc( allocator, SIZEOF(type), __FILE__, __LINE__, ##__VA_ARGS__ )
+#define ALLOC_ARRAY(allocator, type, count, ...)    (type *)_TrackedAlloc( allocator, (count)*SIZEOF(type), __FILE__, __LINE__, ##__VA_ARGS__ )
+#define FREE(allocator, mem, ...)                   _TrackedFree( allocator, (void*)(mem), ##__VA_ARGS__ )
+#define REALLOC(allocator, mem, oldSize, newSize, ...)  _TrackedRealloc( allocator, (void*)(mem), oldSize, newSize, __FILE__, __LINE__, ##__VA_ARGS__ )
+#else
 #define ALLOC(allocator, size, ...)                 Alloc( allocator, size, __FILE__, __LINE__, ##__VA_ARGS__ )
 #define ALLOC_STRUCT(allocator, type, ...)          (type *)Alloc( allocator, SIZEOF(type), __FILE__, __LINE__, ##__VA_ARGS__ )
 #define ALLOC_ARRAY(allocator, type, count, ...)    (type *)Alloc( allocator, (count)*SIZEOF(type), __FILE__, __LINE__, ##__VA_ARGS__ )
 #define FREE(allocator, mem, ...)                   Free( allocator, (void*)(mem), ##__VA_ARGS__ )
+#define REALLOC(allocator, mem, oldSize, newSize, ...)  Realloc( allocator, (void*)(mem), oldSize, newSize, __FILE__, __LINE__, ##__VA_ARGS__ )
+#endif
 
 #undef DELETE
 #define NEW(allocator, type, ...)                   new ( ALLOC( allocator, sizeof(type), ##__VA_ARGS__ ) ) type
@@ -76,60 +90,210 @@ namespace Memory
         result.alignment = alignment;
         return result;
     }
+    INLINE Params Tagged( u8 tag )
+    {
+        Params result;
+        result.tag = tag;
+        return result;
+    }
 }
 
 using MemoryParams = Memory::Params;
 
 
+struct MemoryArena;
+struct Allocator;
+template <typename AllocType> struct RetainingAllocator;
+
+#if MEMORY_TRACKING
+namespace Memory
+{
+    struct TrackingStats
+    {
+        sz liveBytes;
+        sz peakBytes;
+        i64 liveCount;
+        // Total number of allocations ever made
+        i64 allocCount;
+    };
+
+    struct SiteStats
+    {
+        char const* filename;
+        int line;
+        u8 tag;
+        TrackingStats stats;
+    };
+
+    struct ArenaStats
+    {
+        char const* name;
+        sz used;
+        // High-water mark for 'used' (within the current page, for paged arenas)
+        sz peakUsed;
+        sz size;
+    };
+
+    struct Snapshot
+    {
+        TrackingStats total;
+        TrackingStats tags[256];
+        // Sites are only ever appended, so they appear in the same order in any later snapshot
+        Buffer<SiteStats> sites;
+        Buffer<ArenaStats> arenas;
+    };
+
+    void TrackAlloc( void* memoryBlock, sz sizeBytes, char const* filename, int line, u8 tag );
+    void TrackFree( void* memoryBlock );
+    // Arenas are not tracked per allocation, but registered arenas are reported with their current & peak usage
+    void TrackArena( MemoryArena* arena, char const* name );
+    void UntrackArena( MemoryArena* arena );
+
+    Snapshot TakeSnapshot( Allocator* allocator );
+    // Returns all stats that changed between the two snapshots (live counts can be negative)
+    // Peak values and arenas are taken from 'after'
+    Snapshot Diff( Snapshot const& before, Snapshot const& after, Allocator* allocator );
+    void FreeSnapshot( Snapshot* snapshot, Allocator* allocator );
+    bool WriteCSVReport( Snapshot const& snapshot, char const* filename );
+
+    // Arena allocations are only tracked through the arena's high-water mark
+    INLINE bool IsTrackedAllocator( void const* ) { return true; }
+    INLINE bool IsTrackedAllocator( MemoryArena const* ) { return false; }
+    // Retained blocks are tracked by the allocator they come from
+    template <typename AllocType>
+    INLINE bool IsTrackedAllocator( RetainingAllocator<AllocType> const* ) { return false; }
+    // Type-erased allocators remember what they wrap
+    INLINE bool IsTrackedAllocator( Allocator const* allocator );
+}
+
+template <typename T>
+INLINE void* _TrackedAlloc( T* allocator, sz sizeBytes, char const* filename, int line, MemoryParams params = {} )
+{
+    void* result = Alloc( allocator, sizeBytes, filename, line, params );
+    if( Memory::IsTrackedAllocator( allocator ) )
+        Memory::TrackAlloc( result, sizeBytes, filename, line, params.tag );
+    return result;
+}
+
+template <typename T>
+INLINE void _TrackedFree( T* allocator, void* memoryBlock, MemoryParams params = {} )
+{
+    if( Memory::IsTrackedAllocator( allocator ) )
+        Memory::TrackFree( memoryBlock );
+    Free( allocator, memoryBlock, params );
+}
+
+template <typename T>
+INLINE void* _TrackedRealloc( T* allocator, void* memoryBlock, sz oldSizeBytes, sz newSizeBytes, char const* filename, int line,
+                              MemoryParams params = {} )
+{
+    bool tracked = Memory::IsTrackedAllocator( allocator );
+    // Untrack the old block first, since another thread could get the same address as soon as it's freed
+    if( tracked && memoryBlock )
+        Memory::TrackFree( memoryBlock );
+
+    void* result = Realloc( allocator, memoryBlock, oldSizeBytes, newSizeBytes, filename, line, params );
+    if( tracked )
+    {
+        // On failure the old block is still there
+        if( result )
+            Memory::TrackAlloc( result, newSizeBytes, filename, line, params.tag );
+        else if( memoryBlock )
+            Memory::TrackAlloc( memoryBlock, oldSizeBytes, filename, line, params.tag );
+    }
+    return result;
+}
+#endif
+
+
 #define ALLOC_FUNC(cls) void* Alloc( cls* data, sz sizeBytes, char const* filename, int line, MemoryParams params = {} )
 #define ALLOC_METHOD void* Alloc( sz sizeBytes, char const* filename, int line, MemoryParams params = {} )
 typedef void* (*AllocFunc)( void* impl, sz sizeBytes, char const* filename, int line, MemoryParams params );
 #define FREE_FUNC(cls)  void Free( cls* data, void* memoryBlock, MemoryParams params = {} )
 #define FREE_METHOD  void Free( void* memoryBlock, MemoryParams params = {} )
 typedef void (*FreeFunc)( void* impl, void* memoryBlock, MemoryParams params );
+// Resize a block previously returned by Alloc, keeping its contents. A null block just allocates a new one.
+// Returns either the same block (when it could be resized in place) or a new one, in which case the old one is freed.
+#define REALLOC_FUNC(cls) void* Realloc( cls* data, void* memoryBlock, sz oldSizeBytes, sz newSizeBytes, char const* filename, int line, \
+                                         MemoryParams params = {} )
+#define REALLOC_METHOD void* Realloc( void* memoryBlock, sz oldSizeBytes, sz newSizeBytes, char const* filename, int line, \
+                                      MemoryParams params = {} )
+typedef void* (*ReallocFunc)( void* impl, void* memoryBlock, sz oldSizeBytes, sz newSizeBytes, char const* filename, int line,
+                              MemoryParams params );
+
+// Fallback for allocators that can't do any better than allocating a new block and copying everything over
+template <typename Class>
+INLINE REALLOC_FUNC( Class )
+{
+    void* result = Alloc( data, newSizeBytes, filename, line, params );
+    if( memoryBlock )
+    {
+        COPYP( memoryBlock, result, Min( oldSizeBytes, newSizeBytes ) );
+        Free( data, memoryBlock, params );
+    }
+    return result;
+}
 
 // This guy casts an opaque data pointer to the appropriate type
 // and relies on overloading to call the correct pair of Alloc & Free functions accepting that as a first argument
+// NOTE The overloads are resolved through ADL at instantiation time, so they can be declared after this
 template <typename Class>
 struct AllocatorImpl
 {
-    static INLINE ALLOC_FUNC( void )
+    static INLINE void* AllocThunk( void* data, sz sizeBytes, char const* filename, int line, MemoryParams params )
     {
         Class* obj = (Class*)data;
-        return ::Alloc( obj, sizeBytes, filename, line, params );
+        return Alloc( obj, sizeBytes, filename, line, params );
     }
 
-    static INLINE FREE_FUNC( void )
+    static INLINE void FreeThunk( void* data, void* memoryBlock, MemoryParams params )
     {
         Class* obj = (Class*)data;
-        ::Free( obj, memoryBlock, params );
+        Free( obj, memoryBlock, params );
+    }
+
+    static INLINE void* ReallocThunk( void* data, void* memoryBlock, sz oldSizeBytes, sz newSizeBytes, char const* filename, int line,
+                                      MemoryParams params )
+    {
+        Class* obj = (Class*)data;
+        return Realloc( obj, memoryBlock, oldSizeBytes, newSizeBytes, filename, line, params );
     }
 };
 // This guy is just a generic non-templated wrapper to any kind of allocator whatsoever
-// and two function pointers to its corresponding pair of free Alloc & Free functions
+// and function pointers to its corresponding free Alloc, Free & Realloc functions
 // TODO Can we do this simpler plz
 struct Allocator
 {
     Allocator()
         : allocPtr( nullptr )
         , freePtr( nullptr )
+        , reallocPtr( nullptr )
         , impl( nullptr )
     {}
 
     template <typename Class>
     Allocator( Class* obj )
-        : allocPtr( &AllocatorImpl<Class>::Alloc )
-        , freePtr( &AllocatorImpl<Class>::Free )
+        : allocPtr( &AllocatorImpl<Class>::AllocThunk )
+        , freePtr( &AllocatorImpl<Class>::FreeThunk )
+        , reallocPtr( &AllocatorImpl<Class>::ReallocThunk )
         , impl( obj )
-    {}
+    {
+#if MEMORY_TRACKING
+        tracked = Memory::IsTrackedAllocator( obj );
+#endif
+    }
 
     // Pass-through for abstract allocators
-    template <>
     Allocator( Allocator* obj )
         : allocPtr( obj->allocPtr )
         , freePtr( obj->freePtr )
+        , reallocPtr( obj->reallocPtr )
         , impl( obj->impl )
-    {}
+    {
+#if MEMORY_TRACKING
+        tracked = obj->tracked;
+#endif
+    }
 
     template <typename Class>
     static INLINE Allocator CreateFrom( Class* obj )
@@ -148,15 +312,37 @@ struct Allocator
         freePtr( impl, memoryBlock, params );
     }
 
+    INLINE REALLOC_METHOD
+    {
+        return reallocPtr( impl, memoryBlock, oldSizeBytes, newSizeBytes, filename, line, params );
+    }
+
     friend void* Alloc( Allocator* data, sz sizeBytes, char const* filename, int line, MemoryParams params );
     friend void Free( Allocator* data, void* memoryBlock, MemoryParams params );
+    friend void* Realloc( Allocator* data, void* memoryBlock, sz oldSizeBytes, sz newSizeBytes, char const* filename, int line,
+                          MemoryParams params );
+#if MEMORY_TRACKING
+    friend bool Memory::IsTrackedAllocator( Allocator const* allocator );
+#endif
 
 private:
     AllocFunc allocPtr;
     FreeFunc freePtr;
+    ReallocFunc reallocPtr;
     void* impl;
+#if MEMORY_TRACKING
+    // Arena blocks are never freed, so only track what the wrapped allocator would
+    bool tracked = true;
+#endif
 };
 
+#if MEMORY_TRACKING
+INLINE bool Memory::IsTrackedAllocator( Allocator const* allocator )
+{
+    return allocator->tracked;
+}
+#endif
+
 INLINE ALLOC_FUNC( Allocator )
 {
     return data->allocPtr( data->impl, sizeBytes, filename, line, params );
@@ -167,6 +353,11 @@ INLINE FREE_FUNC( Allocator )
     data->freePtr( data->impl, memoryBlock, params );
 }
 
+INLINE REALLOC_FUNC( Allocator )
+{
+    return data->reallocPtr( data->impl, memoryBlock, oldSizeBytes, newSizeBytes, filename, line, params );
+}
+
 
 
 struct LazyAllocator
@@ -190,10 +381,80 @@ FREE_FUNC( LazyAllocator )
     free( memoryBlock );
 }
 
+REALLOC_FUNC( LazyAllocator )
+{
+    ASSERT( !params.alignment );
+
+    void* result = realloc( memoryBlock, SizeT( newSizeBytes ) );
+
+    if( newSizeBytes > oldSizeBytes && !params.IsSet( Memory::MF_NoClear ) )
+        ZEROP( (u8*)result + oldSizeBytes, newSizeBytes - oldSizeBytes );
+
+    return result;
+}
+
+
+// Forwards allocations to another allocator, but holds on to every block until ReleaseAll, even after it's been freed.
+// Lets lock-free readers keep looking at a table that's just been resized under their feet.
+template <typename AllocType>
+struct RetainingAllocator
+{
+    struct Block
+    {
+        Block* next;
+        void* memory;
+    };
+
+    AllocType* base;
+    Block* blocks;
+
+    RetainingAllocator( AllocType* base_ = nullptr )
+        : base( base_ )
+        , blocks( nullptr )
+    {}
+
+    void ReleaseAll()
+    {
+        while( blocks )
+        {
+            Block* next = blocks->next;
+            FREE( base, blocks->memory );
+            FREE( base, blocks );
+            blocks = next;
+        }
+    }
+};
+
+template <typename AllocType>
+INLINE ALLOC_FUNC( RetainingAllocator<AllocType> )
+{
+    ASSERT( data->base );
+
+    using Block = typename RetainingAllocator<AllocType>::Block;
+    Block* block = ALLOC_STRUCT( data->base, Block );
+#if MEMORY_TRACKING
+    block->memory = _TrackedAlloc( data->base, sizeBytes, filename, line, params );
+#else
+    block->memory = Alloc( data->base, sizeBytes, filename, line, params );
+#endif
+    block->next = data->blocks;
+    data->blocks = block;
+
+    return block->memory;
+}
+
+template <typename AllocType>
+INLINE FREE_FUNC( RetainingAllocator<AllocType> )
+{
+    // Only released with the allocator itself
+}
+
 
 ///// MEMORY ARENA
 // Linear memory arena that can grow in pages of a certain size
 // Can be partitioned into sub arenas and supports "temporary blocks" (which can be nested, similar to a stack allocator)
+// Virtual arenas instead reserve a big contiguous range of address space upfront and commit memory as they go,
+// so they never need to chain pages, and rolling back temporary blocks is just resetting the used count
 
 #define PUSH_STRUCT(arena, type, ...) (type *)_PushSize( arena, SIZEOF(type), alignof(type), ## __VA_ARGS__ )
 #define PUSH_ARRAY(arena, type, count, ...) (type *)_PushSize( arena, (count)*SIZEOF(type), alignof(type), ## __VA_ARGS__ )
@@ -201,6 +462,9 @@ FREE_FUNC( LazyAllocator )
 #define PUSH_SIZE(arena, size, ...) _PushSize( arena, size, DefaultMemoryAlignment, ## __VA_ARGS__ )
 
 static const sz DefaultArenaPageSize = MEGABYTES( 16 );
+static const sz DefaultArenaReserveSize = GIGABYTES( 16 );
+// Matches the allocation granularity on Win32
+static const sz DefaultArenaCommitSize = KILOBYTES( 64 );
 static const sz DefaultMemoryAlignment = alignof(u64);
 
 struct MemoryArenaHeader
@@ -214,14 +478,24 @@ struct MemoryArenaHeader
 struct MemoryArena
 {
     u8 *base;
+    // For virtual arenas, this is the currently committed size
     sz size;
     sz used;
 
     // This is always zero for static arenas
+    // For virtual arenas, this is the granularity in which memory is committed
     sz pageSize;
+    // This is only non-zero for virtual arenas
+    sz reservedSize;
     i32 pageCount;
 
     i32 tempCount;
+    // Return committed memory to the OS when rolling back temporary blocks or clearing a virtual arena
+    bool decommitUnused;
+
+#if MEMORY_TRACKING
+    sz peakUsed;
+#endif
 };
 
 // Initialize a static (fixed-size) arena on the given block of memory
@@ -243,6 +517,56 @@ InitArena( MemoryArena* arena, sz pageSize = DefaultArenaPageSize )
     arena->pageSize = pageSize;
 }
 
+// Initialize an arena that reserves the given size in address space upfront, and commits memory from it as needed
+inline void
+InitVirtualArena( MemoryArena* arena, sz reserveSize = DefaultArenaReserveSize, bool decommitUnused = false,
+                  sz commitSize = DefaultArenaCommitSize )
+{
+    ASSERT( IsPowerOf2( commitSize ) );
+
+    *arena = {};
+    arena->reservedSize = AlignUp( reserveSize, commitSize );
+    arena->base = (u8*)globalPlatform.Reserve( arena->reservedSize );
+    arena->pageSize = commitSize;
+    arena->decommitUnused = decommitUnused;
+
+    ASSERT( arena->base, "Failed reserving %llu bytes of address space", arena->reservedSize );
+}
+
+inline bool
+IsVirtual( const MemoryArena& arena )
+{
+    return arena.reservedSize != 0;
+}
+
+internal bool
+CommitVirtualArena( MemoryArena* arena, sz neededSize )
+{
+    if( neededSize > arena->reservedSize )
+        return false;
+
+    sz newSize = Min( AlignUp( neededSize, arena->pageSize ), arena->reservedSize );
+    if( !globalPlatform.Commit( arena->base + arena->size, newSize - arena->size ) )
+        return false;
+
+    arena->size = newSize;
+    return true;
+}
+
+// Give back to the OS all committed pages in a virtual arena that are past the currently used size
+inline void
+DecommitUnused( MemoryArena* arena )
+{
+    ASSERT( IsVirtual( *arena ) );
+
+    sz keepSize = AlignUp( arena->used, arena->pageSize );
+    if( keepSize < arena->size )
+    {
+        globalPlatform.Decommit( arena->base + keepSize, arena->size - keepSize );
+        arena->size = keepSize;
+    }
+}
+
 internal MemoryArenaHeader*
 GetArenaHeader( MemoryArena* arena )
 {
@@ -271,6 +595,15 @@ ClearArena( MemoryArena* arena )
     if( arena->base == nullptr )
         return;
 
+    if( IsVirtual( *arena ) )
+    {
+        // Keep the reserved range around
+        arena->used = 0;
+        if( arena->decommitUnused )
+            DecommitUnused( arena );
+        return;
+    }
+
     while( arena->pageCount > 0 )
         FreeLastPage( arena );
 
@@ -279,6 +612,23 @@ ClearArena( MemoryArena* arena )
     InitArena( arena, pageSize );
 }
 
+// Like ClearArena, but virtual arenas also give back their whole address space range
+inline void
+ReleaseArena( MemoryArena* arena )
+{
+#if MEMORY_TRACKING
+    Memory::UntrackArena( arena );
+#endif
+    if( IsVirtual( *arena ) )
+    {
+        if( arena->base )
+            globalPlatform.Release( arena->base, arena->reservedSize );
+        *arena = {};
+    }
+    else
+        ClearArena( arena );
+}
+
 inline sz
 Available( const MemoryArena& arena )
 {
@@ -288,7 +638,7 @@ Available( const MemoryArena& arena )
 inline bool
 IsInitialized( const MemoryArena& arena )
 {
-    return arena.base && arena.size;
+    return arena.base && (arena.size || arena.reservedSize);
 }
 
 inline void *
@@ -314,7 +664,15 @@ _PushSize( MemoryArena *arena, sz size, sz minAlignment, MemoryParams params = {
     }
 
     sz alignedSize = size + waste;
-    if( arena->used + alignedSize > arena->size )
+    if( arena->used + alignedSize > arena->size && IsVirtual( *arena ) )
+    {
+        if( !CommitVirtualArena( arena, arena->used + alignedSize ) )
+        {
+            ASSERT( false, "Virtual arena overflow (reserved %llu)", arena->reservedSize );
+            return nullptr;
+        }
+    }
+    else if( arena->used + alignedSize > arena->size )
     {
         ASSERT( arena->pageSize, "Static arena overflow (size %llu)", arena->size );
 
@@ -345,6 +703,9 @@ _PushSize( MemoryArena *arena, sz size, sz minAlignment, MemoryParams params = {
     }
 
     arena->used += alignedSize;
+#if MEMORY_TRACKING
+    arena->peakUsed = Max( arena->peakUsed, arena->used );
+#endif
 
     // Have already moved up the block's pointer, so just clear the requested size
     if( !(params.flags & Memory::MF_NoClear) )
@@ -383,6 +744,32 @@ FREE_FUNC( MemoryArena )
     // NOTE No-op
 }
 
+// The last block pushed can be grown or shrunk in place, as long as the current page has room for it
+REALLOC_FUNC( MemoryArena )
+{
+    u8* block = (u8*)memoryBlock;
+    if( block && block + oldSizeBytes == data->base + data->used
+        && (!params.alignment || AlignUp( block, params.alignment ) == block) )
+    {
+        sz newUsed = data->used - oldSizeBytes + newSizeBytes;
+        if( newUsed <= data->size || (IsVirtual( *data ) && CommitVirtualArena( data, newUsed )) )
+        {
+            data->used = newUsed;
+#if MEMORY_TRACKING
+            data->peakUsed = Max( data->peakUsed, data->used );
+#endif
+            if( newSizeBytes > oldSizeBytes && !(params.flags & Memory::MF_NoClear) )
+                ZEROP( block + oldSizeBytes, newSizeBytes - oldSizeBytes );
+            return block;
+        }
+    }
+
+    void* result = _PushSize( data, newSizeBytes, DefaultMemoryAlignment, params );
+    if( block )
+        COPYP( block, result, Min( oldSizeBytes, newSizeBytes ) );
+    return result;
+}
+
 struct TemporaryMemory
 {
     MemoryArena *arena;
@@ -417,6 +804,9 @@ EndTemporaryMemory( TemporaryMemory& tempMem )
     ASSERT( arena->used >= tempMem.usedRecord );
     arena->used = tempMem.usedRecord;
 
+    if( arena->decommitUnused )
+        DecommitUnused( arena );
+
     ASSERT( arena->tempCount > 0 );
     --arena->tempCount;
 }
@@ -442,182 +832,639 @@ CheckTemporaryBlocks( MemoryArena *arena )
 
 
 
+///// POOL ALLOCATOR
+// Segregated-fit allocator for lots of small objects, using power-of-two size classes
+// Reserves a contiguous range of address space upfront and carves it into fixed size slabs, committed on demand.
+// Each slab serves a single size class, so the size of any block can be determined just from its address,
+// and freed blocks are kept in an intrusive free list per class.
+// Anything bigger than the biggest class goes straight to the platform.
+//
+// NOT THREAD SAFE atm
+
+struct PoolAllocator
+{
+    static constexpr int MinBlockShift  = 4;            // 16 bytes
+    static constexpr int MaxBlockShift  = 15;           // 32 KB
+    static constexpr int ClassCount     = MaxBlockShift - MinBlockShift + 1;
+    static constexpr int SlabShift      = 16;           // 64 KB
+    static constexpr sz  SlabSize       = 1LL << SlabShift;
+    static constexpr sz  MinBlockSize   = 1LL << MinBlockShift;
+    static constexpr sz  MaxBlockSize   = 1LL << MaxBlockShift;
+    static constexpr sz  DefaultReserveSize = GIGABYTES( 1 );
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct SizeClass
+    {
+        FreeBlock* freeList;
+        // Remaining untouched space in the last slab assigned to this class
+        u8* next;
+        u8* end;
+
+        i32 slabCount;
+        i32 usedCount;
+        i32 peakUsedCount;
+    };
+
+    struct Stats
+    {
+        sz blockSize;
+        i32 slabCount;
+        i32 totalCount;
+        i32 usedCount;
+        i32 peakUsedCount;
+    };
+
+    SizeClass classes[ClassCount];
+    u8* base;
+    sz reservedSize;
+    // Size class index of every slab handed out so far
+    u8* slabClasses;
+    i32 slabCount;
+    i32 maxSlabCount;
+    // Allocations too big for any size class
+    i32 largeCount;
+
+    PoolAllocator( sz reserveSize = DefaultReserveSize )
+        : classes{}
+        , slabCount( 0 )
+        , largeCount( 0 )
+    {
+        reservedSize = AlignUp( reserveSize, SlabSize );
+        base = (u8*)globalPlatform.Reserve( reservedSize );
+        ASSERT( base, "Failed reserving %llu bytes of address space", reservedSize );
+
+        maxSlabCount = I32( reservedSize >> SlabShift );
+        slabClasses = (u8*)globalPlatform.Alloc( maxSlabCount, 0 );
+    }
+
+    ~PoolAllocator()
+    {
+        globalPlatform.Free( slabClasses );
+        globalPlatform.Release( base, reservedSize );
+    }
+
+    PoolAllocator( PoolAllocator const& ) = delete;
+    PoolAllocator& operator =( PoolAllocator const& ) = delete;
+
+    static INLINE int SizeClassFor( sz size )
+    {
+        if( size <= MinBlockSize )
+            return 0;
+        return Log2( size - 1 ) + 1 - MinBlockShift;
+    }
+
+    static INLINE sz BlockSizeFor( int classIndex )
+    {
+        return MinBlockSize << classIndex;
+    }
+
+    INLINE bool Owns( void const* p ) const
+    {
+        return p >= base && p < base + reservedSize;
+    }
+
+    void* Alloc( sz sizeBytes, MemoryParams params = {} )
+    {
+        // Blocks are naturally aligned to their size, so just bump the size if needed
+        sz size = Max( sizeBytes, (sz)params.alignment );
+        if( size > MaxBlockSize )
+            return AllocLarge( sizeBytes, params );
+
+        int c = SizeClassFor( size );
+        SizeClass& cls = classes[c];
+
+        void* result = cls.freeList;
+        if( result )
+            cls.freeList = cls.freeList->next;
+        else
+        {
+            if( cls.next == cls.end && !NewSlab( c ) )
+                return nullptr;
+
+            result = cls.next;
+            cls.next += BlockSizeFor( c );
+        }
+
+        cls.usedCount++;
+        cls.peakUsedCount = Max( cls.peakUsedCount, cls.usedCount );
+
+        if( !params.IsSet( Memory::MF_NoClear ) )
+            ZEROP( result, sizeBytes );
+
+        return result;
+    }
+
+    void Free( void* memoryBlock )
+    {
+        if( !memoryBlock )
+            return;
+
+        if( !Owns( memoryBlock ) )
+        {
+            largeCount--;
+            globalPlatform.Free( memoryBlock );
+            return;
+        }
+
+        sz slabIndex = ((u8*)memoryBlock - base) >> SlabShift;
+        ASSERT( slabIndex < slabCount );
+        SizeClass& cls = classes[slabClasses[slabIndex]];
+        ASSERT( cls.usedCount > 0, "Can't free a free block!" );
+
+        FreeBlock* block = (FreeBlock*)memoryBlock;
+        block->next = cls.freeList;
+        cls.freeList = block;
+        cls.usedCount--;
+    }
+
+    // Stays in place for as long as the new size still fits in the same size class
+    void* Realloc( void* memoryBlock, sz oldSizeBytes, sz newSizeBytes, MemoryParams params = {} )
+    {
+        if( memoryBlock && Owns( memoryBlock ) )
+        {
+            sz slabIndex = ((u8*)memoryBlock - base) >> SlabShift;
+            sz size = Max( newSizeBytes, (sz)params.alignment );
+            if( size <= BlockSizeFor( slabClasses[slabIndex] ) )
+            {
+                if( newSizeBytes > oldSizeBytes && !params.IsSet( Memory::MF_NoClear ) )
+                    ZEROP( (u8*)memoryBlock + oldSizeBytes, newSizeBytes - oldSizeBytes );
+                return memoryBlock;
+            }
+        }
+
+        void* result = Alloc( newSizeBytes, params );
+        if( memoryBlock )
+        {
+            COPYP( memoryBlock, result, Min( oldSizeBytes, newSizeBytes ) );
+            Free( memoryBlock );
+        }
+        return result;
+    }
+
+    Stats GetStats( int classIndex ) const
+    {
+        ASSERT( classIndex >= 0 && classIndex < ClassCount );
+        SizeClass const& cls = classes[classIndex];
+        sz blockSize = BlockSizeFor( classIndex );
+
+        Stats result = {};
+        result.blockSize = blockSize;
+        result.slabCount = cls.slabCount;
+        // Count only the blocks that have been actually handed out at some point
+        result.totalCount = I32( cls.slabCount * (SlabSize / blockSize) - (cls.end - cls.next) / blockSize );
+        result.usedCount = cls.usedCount;
+        result.peakUsedCount = cls.peakUsedCount;
+
+        return result;
+    }
+
+private:
+    bool NewSlab( int classIndex )
+    {
+        // TODO Give completely empty slabs back so they can be reused by other classes
+        if( slabCount == maxSlabCount )
+        {
+            ASSERT( false, "Pool allocator is full (reserved %llu)", reservedSize );
+            return false;
+        }
+
+        u8* slab = base + (slabCount << SlabShift);
+        if( !globalPlatform.Commit( slab, SlabSize ) )
+            return false;
+
+        slabClasses[slabCount++] = (u8)classIndex;
+
+        SizeClass& cls = classes[classIndex];
+        cls.next = slab;
+        cls.end = slab + SlabSize;
+        cls.slabCount++;
+
+        return true;
+    }
+
+    void* AllocLarge( sz sizeBytes, MemoryParams params )
+    {
+        // Platform allocations are always cache aligned
+        ASSERT( params.alignment <= 64 );
+        largeCount++;
+        // Already zeroed
+        return globalPlatform.Alloc( sizeBytes, 0 );
+    }
+};
+
+INLINE ALLOC_FUNC( PoolAllocator )
+{
+    return data->Alloc( sizeBytes, params );
+}
+
+INLINE FREE_FUNC( PoolAllocator )
+{
+    data->Free( memoryBlock );
+}
+
+INLINE REALLOC_FUNC( PoolAllocator )
+{
+    return data->Realloc( memoryBlock, oldSizeBytes, newSizeBytes, params );
+}
+
+
 ///// GENERIC HEAP
-// General memory heap of a fixed initial size, can allocate any object type or size
-// Merges free contiguous blocks and searches for empty blocks linearly, continuing where it last left off
-// in circular buffer fashion, so it's appropriate for continuously allocating transient data with a limited lifetime.
-// Could be easily extended to grow on request, by just allocating new chunks from the OS and adding them to the chain.
+// General memory heap that can allocate any object type or size, using a two-level segregated fit scheme (TLSF)
+// Free blocks are kept in lists binned first by power of two, then linearly subdivided within each power of two,
+// with a bitmap for each level, so finding a suitable block for any size and freeing one are both O(1).
+// Free blocks are always merged with their free neighbours, and the heap grows by chaining new chunks from the OS,
+// so it's appropriate for continuously allocating transient data with a limited lifetime.
+// (see http://www.gii.upv.es/tlsf/files/papers/ecrts04_tlsf.pdf)
 // 
 // NOT THREAD SAFE atm
 
 struct GenericHeap
 {
+    static constexpr sz  DefaultChunkSize = MEGABYTES( 64 );
+
     enum BlockFlags : u32
     {
         None    = 0,
-        Used    = 0x01,
-        Deleted = 0x02,
+        Available   = 0x01,
+        Sentinel    = 0x02,     // Marks the end of each chunk
     };
 
     struct Block
     {
-        Block* prev;
-        Block* next;
+        // Previous block in the same chunk (null for the first one)
+        Block* prevPhysical;
+        // Payload size, lower bits are used for flags
+        sz sizeAndFlags;
+
+        // Only valid while the block is free (the payload starts here otherwise)
+        Block* nextFree;
+        Block* prevFree;
+
+        INLINE sz Size() const { return sizeAndFlags & ~FlagsMask; }
+        INLINE bool IsFree() const { return sizeAndFlags & Available; }
+        INLINE bool IsLast() const { return sizeAndFlags & Sentinel; }
+        INLINE void SetSize( sz size ) { sizeAndFlags = size | (sizeAndFlags & FlagsMask); }
+        INLINE void SetFree( bool free ) { sizeAndFlags = free ? (sizeAndFlags | Available) : (sizeAndFlags & ~(sz)Available); }
+
+        INLINE u8* Payload() { return (u8*)this + BlockOverhead; }
+        INLINE Block* NextPhysical() { return (Block*)(Payload() + Size()); }
+    };
 
-        i32 size;
-        u32 flags;
+    struct alignas(16) Chunk
+    {
+        Chunk* prev;
+        Chunk* next;
+        sz size;
     };
 
-    Block sentinel;
-    Block* lastAllocated;
+    static constexpr int AlignLog2      = 4;
+    static constexpr sz  Alignment      = 1 << AlignLog2;
+    static constexpr sz  FlagsMask      = Alignment - 1;
+    static constexpr sz  BlockOverhead  = offsetof( Block, nextFree );
+    static constexpr sz  MinBlockSize   = sizeof(Block) - BlockOverhead;
+    // Second level subdivisions per power of two
+    static constexpr int SLLog2         = 4;
+    static constexpr int SLCount        = 1 << SLLog2;
+    // Below this all sizes go into the first level, subdivided linearly
+    static constexpr int FLShift        = SLLog2 + AlignLog2;
+    static constexpr sz  SmallBlockSize = 1LL << FLShift;
+    static constexpr int FLCount        = 32;
+    static constexpr sz  MaxBlockSize   = 1LL << (FLCount + FLShift - 2);
+
+    Block* freeLists[FLCount][SLCount];
+    u32 flBitmap;
+    u32 slBitmaps[FLCount];
+
+    Chunk* chunks;
+    sz chunkSize;
+    i32 chunkCount;
     sz allocatedBlocks;
 
-    GenericHeap()
-        : lastAllocated( &sentinel )
+    GenericHeap( sz chunkSize_ = DefaultChunkSize )
+        : freeLists{}
+        , flBitmap( 0 )
+        , slBitmaps{}
+        , chunks( nullptr )
+        , chunkSize( chunkSize_ )
+        , chunkCount( 0 )
         , allocatedBlocks( 0 )
-    {
-        // Initialize empty sentinel
-        sentinel.prev = &sentinel;
-        sentinel.next = &sentinel;
-        sentinel.size = 0;
-        sentinel.flags = 0;
-
-        // Insert empty block with the whole memory chunk
-        static constexpr sz c_initialHeapSize = 256 * 1024 * 1024LL;
-        InsertBlock( &sentinel, (u8*)globalPlatform.Alloc( c_initialHeapSize, 0 ), c_initialHeapSize );
-    }
+    {}
 
-    void* Alloc( sz size_bytes )
+    ~GenericHeap()
     {
-        void* result = nullptr;
-
-        Block* block = FindBlockForSize( size_bytes );
-        if( block )
+        while( chunks )
         {
-            result = UseBlock( block, size_bytes );
-            lastAllocated = block;
-            allocatedBlocks++;
+            Chunk* next = chunks->next;
+            globalPlatform.Free( chunks );
+            chunks = next;
         }
-        else
+    }
+
+    GenericHeap( GenericHeap const& ) = delete;
+    GenericHeap& operator =( GenericHeap const& ) = delete;
+
+    void* Alloc( sz sizeBytes, MemoryParams params = {} )
+    {
+        sz size = Max( AlignUp( sizeBytes, Alignment ), MinBlockSize );
+        sz align = params.alignment > Alignment ? params.alignment : 0;
+        // Leave enough room to trim a free block off the front, if needed
+        sz searchSize = align ? size + align + SIZEOF(Block) : size;
+        ASSERT( searchSize <= MaxBlockSize, "Allocation too big (%llu bytes)", sizeBytes );
+
+        Block* block = FindFreeBlock( searchSize );
+        if( !block )
         {
-            // TODO Allocate a new block with size Max( size_bytes, c_initialHeapSize ) and add it to the chain
-            // (keep track of all blocks in a vector for stats/freeing)
-            ASSERT( false, "FULL" );
+            // Searches round up to the next bin, so the new chunk's block must be big enough to be found that way
+            if( !AddChunk( RoundUpToBin( searchSize ) ) )
+                return nullptr;
+            block = FindFreeBlock( searchSize );
+            ASSERT( block );
         }
+        RemoveFreeBlock( block );
+
+        if( align )
+            block = TrimFront( block, align );
+        TrimBack( block, size );
+
+        block->SetFree( false );
+        allocatedBlocks++;
+
+        void* result = block->Payload();
+        if( !params.IsSet( Memory::MF_NoClear ) )
+            ZEROP( result, sizeBytes );
 
         return result;
     }
 
     void Free( void* memory )
     {
-        Block* block = (Block*)memory - 1;
-        ASSERT( block->flags & BlockFlags::Used, "Can't free a free block!" );
-        block->flags &= ~BlockFlags::Used;
+        if( !memory )
+            return;
+
+        Block* block = (Block*)((u8*)memory - BlockOverhead);
+        ASSERT( !block->IsFree(), "Can't free a free block!" );
+        block->SetFree( true );
+        allocatedBlocks--;
+
+        Block* next = block->NextPhysical();
+        if( next->IsFree() )
+        {
+            RemoveFreeBlock( next );
+            Merge( block, next );
+        }
+        Block* prev = block->prevPhysical;
+        if( prev && prev->IsFree() )
+        {
+            RemoveFreeBlock( prev );
+            Merge( prev, block );
+            block = prev;
+        }
 
-        bool merged_next = MergeIfPossible( block, block->next );
-        bool merged_prev = MergeIfPossible( block->prev, block );
+        // Give back any extra chunks that become completely empty, but always keep one around
+        if( !block->prevPhysical && block->NextPhysical()->IsLast() && chunkCount > 1 )
+            RemoveChunk( (Chunk*)((u8*)block - SIZEOF(Chunk)) );
+        else
+            InsertFreeBlock( block );
+    }
 
-        // In case we merged around the lastAllocated pointer, search backwards for a new used block
-        if( lastAllocated->flags & BlockFlags::Deleted || !(lastAllocated->flags & BlockFlags::Used) )
+    // Resize in place when the block already has enough slack, or can absorb a free neighbour right after it
+    void* Realloc( void* memory, sz oldSizeBytes, sz newSizeBytes, MemoryParams params = {} )
+    {
+        if( memory )
         {
-            lastAllocated = nullptr;
-            Block* start_block = block->prev;
-            for( Block* b = start_block->prev; b != start_block; b = b->prev )
+            Block* block = (Block*)((u8*)memory - BlockOverhead);
+            ASSERT( !block->IsFree(), "Can't realloc a free block!" );
+
+            sz size = Max( AlignUp( newSizeBytes, Alignment ), MinBlockSize );
+            bool fits = block->Size() >= size;
+            if( !fits )
             {
-                if( b->flags & BlockFlags::Used )
+                Block* next = block->NextPhysical();
+                if( next->IsFree() && block->Size() + BlockOverhead + next->Size() >= size )
                 {
-                    lastAllocated = b;
-                    break;
+                    RemoveFreeBlock( next );
+                    Merge( block, next );
+                    // The block after next can't be free, so what's left over can go straight back
+                    TrimBack( block, size );
+                    fits = true;
                 }
             }
-            if( !lastAllocated )
-                lastAllocated = &sentinel;
+
+            if( fits )
+            {
+                if( newSizeBytes > oldSizeBytes && !params.IsSet( Memory::MF_NoClear ) )
+                    ZEROP( (u8*)memory + oldSizeBytes, newSizeBytes - oldSizeBytes );
+                return memory;
+            }
         }
-        allocatedBlocks--;
+
+        void* result = Alloc( newSizeBytes, params );
+        if( memory )
+        {
+            COPYP( memory, result, Min( oldSizeBytes, newSizeBytes ) );
+            Free( memory );
+        }
+        return result;
     }
 
-    private:
-    Block* InsertBlock( Block* prev, void* block_start, sz available_size )
+private:
+    // Map a size to its first & second level bins
+    static INLINE void Mapping( sz size, int* fl, int* sl )
     {
-        ASSERT( available_size > sizeof(Block), "Need more space" );
-        Block* block = (Block*)block_start;
-        block->size = I32(available_size - sizeof(Block));
-        block->flags = 0;
-        block->prev = prev;
-        block->next = prev->next;
-        block->prev->next = block;
-        block->next->prev = block;
+        if( size < SmallBlockSize )
+        {
+            *fl = 0;
+            *sl = I32( size / (SmallBlockSize / SLCount) );
+        }
+        else
+        {
+            int log2 = Log2( size );
+            *sl = I32( (size >> (log2 - SLLog2)) ^ ((sz)1 << SLLog2) );
+            *fl = log2 - FLShift + 1;
+        }
+    }
 
-        return block;
+    // Smallest size for which every block in its bin is guaranteed to be at least as big as the given one
+    static INLINE sz RoundUpToBin( sz size )
+    {
+        if( size >= SmallBlockSize )
+            size += (1LL << (Log2( size ) - SLLog2)) - 1;
+        return size;
     }
 
-    Block* FindBlockForSize( sz size )
+    Block* FindFreeBlock( sz size )
     {
-        Block* result = nullptr;
-        for( Block* block = lastAllocated->next; block != lastAllocated; block = block->next )
+        // Round up to the next bin, so any block we find there is guaranteed to be big enough
+        size = RoundUpToBin( size );
+
+        int fl, sl;
+        Mapping( size, &fl, &sl );
+        if( fl >= FLCount )
+            return nullptr;
+
+        u32 slMap = slBitmaps[fl] & (~0u << sl);
+        if( !slMap )
         {
-            // TODO Keep a separate list of free blocks?
-            if( !(block->flags & BlockFlags::Used) && block->size >= size )
-            {
-                result = block;
-                break;
-            }
+            u32 flMap = fl + 1 < FLCount ? flBitmap & (~0u << (fl + 1)) : 0;
+            if( !flMap )
+                return nullptr;
+
+            fl = LowestSetBit( flMap );
+            slMap = slBitmaps[fl];
         }
+        sl = LowestSetBit( slMap );
 
-        return result;
+        return freeLists[fl][sl];
     }
 
-    void* UseBlock( Block* block, sz useBytes )
+    void InsertFreeBlock( Block* block )
     {
-        ASSERT( useBytes <= block->size, "Block can't hold %llu bytes", useBytes );
+        int fl, sl;
+        Mapping( block->Size(), &fl, &sl );
+
+        Block* head = freeLists[fl][sl];
+        block->nextFree = head;
+        block->prevFree = nullptr;
+        if( head )
+            head->prevFree = block;
+        freeLists[fl][sl] = block;
+
+        flBitmap |= (1u << fl);
+        slBitmaps[fl] |= (1u << sl);
+    }
 
-        block->flags |= BlockFlags::Used;
-        void* result = (block + 1);
+    void RemoveFreeBlock( Block* block )
+    {
+        int fl, sl;
+        Mapping( block->Size(), &fl, &sl );
 
-        sz remainingSize = block->size - useBytes;
-        // TODO Tune this based on the smallest size we will typically have
-        static constexpr sz c_splitThreshold = sizeof(Block) + 16;
-        if( remainingSize > c_splitThreshold )
-        {
-            // Chop given block in two
-            block->size = I32(useBytes);
-            InsertBlock( block, (u8*)result + useBytes, remainingSize );
-        }
+        if( block->prevFree )
+            block->prevFree->nextFree = block->nextFree;
         else
+            freeLists[fl][sl] = block->nextFree;
+        if( block->nextFree )
+            block->nextFree->prevFree = block->prevFree;
+
+        if( !freeLists[fl][sl] )
         {
-            // TODO Record the unused portion so that it can be merged with neighbours
+            slBitmaps[fl] &= ~(1u << sl);
+            if( !slBitmaps[fl] )
+                flBitmap &= ~(1u << fl);
         }
-
-        return result;
     }
 
-    bool MergeIfPossible( Block* first, Block* second )
+    // Absorb next into block (both must be physically adjacent)
+    void Merge( Block* block, Block* next )
     {
-        ASSERT( first->next == second, "Blocks are not linked" );
-        ASSERT( second->prev == first, "Blocks are not linked" );
+        ASSERT( block->NextPhysical() == next, "Blocks are not adjacent" );
+        block->SetSize( block->Size() + BlockOverhead + next->Size() );
+        block->NextPhysical()->prevPhysical = block;
+    }
 
-        bool result = false;
+    // Split block in two at the given payload size, returning the second half
+    Block* Split( Block* block, sz size )
+    {
+        Block* rest = (Block*)(block->Payload() + size);
+        rest->prevPhysical = block;
+        rest->sizeAndFlags = 0;
+        rest->SetSize( block->Size() - size - BlockOverhead );
+        block->SetSize( size );
+        rest->NextPhysical()->prevPhysical = rest;
+
+        return rest;
+    }
 
-        if( first != &sentinel && second != &sentinel &&
-            !(first->flags & BlockFlags::Used) &&
-            !(second->flags & BlockFlags::Used) )
+    // Put back any space left over at the end that's big enough to be a block on its own
+    void TrimBack( Block* block, sz size )
+    {
+        if( block->Size() - size >= SIZEOF(Block) )
         {
-            // This check only needed so we can support discontiguous memory pools if needed
-            void* expectedOffset = (u8*)first + sizeof(Block) + first->size;
-            ASSERT( second == expectedOffset, "Block is not at the expected location" );
-            if( second == expectedOffset )
-            {
-                second->next->prev = first;
-                first->next = second->next;
-                first->size += sizeof(Block) + second->size;
-                // Mark the merged block as deleted so we can correctly reposition lastAllocated pointer
-                // (and to help with debugging)
-                second->flags |= BlockFlags::Deleted;
-
-                result = true;
-            }
+            Block* rest = Split( block, size );
+            rest->SetFree( true );
+            InsertFreeBlock( rest );
         }
+    }
+
+    // Trim as much off the front as needed for the payload to have the given alignment
+    Block* TrimFront( Block* block, sz align )
+    {
+        u8* payload = block->Payload();
+        u8* aligned = (u8*)AlignUp( payload, align );
+        if( aligned == payload )
+            return block;
+
+        // The space left in front needs to be big enough to be a block on its own
+        while( aligned - payload < SIZEOF(Block) )
+            aligned += align;
+
+        Block* result = Split( block, aligned - payload - BlockOverhead );
+        block->SetFree( true );
+        InsertFreeBlock( block );
 
         return result;
     }
+
+    bool AddChunk( sz minSize )
+    {
+        // Chunk header, one block and the end sentinel
+        sz size = AlignUp( Max( chunkSize, minSize + SIZEOF(Chunk) + 2 * BlockOverhead ), KILOBYTES(64) );
+        Chunk* chunk = (Chunk*)globalPlatform.Alloc( size, 0 );
+        if( !chunk )
+        {
+            ASSERT( false, "Failed allocating a new heap chunk (%llu bytes)", size );
+            return false;
+        }
+
+        chunk->prev = nullptr;
+        chunk->next = chunks;
+        chunk->size = size;
+        if( chunks )
+            chunks->prev = chunk;
+        chunks = chunk;
+        chunkCount++;
+
+        Block* block = (Block*)(chunk + 1);
+        block->prevPhysical = nullptr;
+        block->sizeAndFlags = Available;
+        block->SetSize( size - SIZEOF(Chunk) - 2 * BlockOverhead );
+
+        Block* sentinel = block->NextPhysical();
+        sentinel->prevPhysical = block;
+        sentinel->sizeAndFlags = Sentinel;
+
+        InsertFreeBlock( block );
+        return true;
+    }
+
+    void RemoveChunk( Chunk* chunk )
+    {
+        if( chunk->prev )
+            chunk->prev->next = chunk->next;
+        else
+            chunks = chunk->next;
+        if( chunk->next )
+            chunk->next->prev = chunk->prev;
+
+        chunkCount--;
+        globalPlatform.Free( chunk );
+    }
 };
+
+INLINE ALLOC_FUNC( GenericHeap )
+{
+    return data->Alloc( sizeBytes, params );
+}
+
+INLINE FREE_FUNC( GenericHeap )
+{
+    data->Free( memoryBlock );
+}
+
+INLINE REALLOC_FUNC( GenericHeap )
+{
+    return data->Realloc( memoryBlock, oldSizeBytes, newSizeBytes, params );
+}
@@ -6,13 +6,16 @@ namespace Platform
 {
 
 // Global stack of Contexts
-thread_local Context   globalContextStack[64];
-thread_local Context*  globalContextPtr;
+// The thread's own stack is the one in use unless a job fiber has swapped in its own
+thread_local ContextStack   globalThreadContextStack;
+thread_local ContextStack*  globalContextStack;
+thread_local Context*       globalContextPtr;
 
 void InitContextStack( Context const& baseContext )
 {
-    globalContextPtr  = globalContextStack;
-    *globalContextPtr = baseContext;
+    globalContextStack = &globalThreadContextStack;
+    globalContextPtr   = globalContextStack->entries;
+    *globalContextPtr  = baseContext;
 }
 
 
@@ -24,16 +27,26 @@ PLATFORM_GET_CONTEXT( GetContext )
 PLATFORM_PUSH_CONTEXT( PushContext )
 {
     globalContextPtr++;
-    ASSERT( globalContextPtr < globalContextStack + ARRAYCOUNT(globalContextStack) );
+    ASSERT( globalContextPtr < globalContextStack->entries + ARRAYCOUNT(globalContextStack->entries) );
     *globalContextPtr = newContext;
 }
 
 PLATFORM_POP_CONTEXT( PopContext )
 {
-    if( globalContextPtr > globalContextStack )
+    if( globalContextPtr > globalContextStack->entries )
         globalContextPtr--;
 }
 
+PLATFORM_SWAP_CONTEXT_STACK( SwapContextStack )
+{
+    ContextStack* oldStack = globalContextStack;
+    oldStack->top = globalContextPtr;
+
+    globalContextStack = newStack;
+    globalContextPtr   = newStack->top;
+    return oldStack;
+}
+
 
 // Global platform
 
@@ -54,7 +67,12 @@ void InitGlobalPlatform( Platform::API const& platformAPI, Buffer<Logging::Chann
     globalPlatform = platformAPI;
 
     InitArena( &globalPlatformArena );
-    InitArena( &globalTmpArena );
+    // Cleared every tick, so just keep reusing the same committed range
+    InitVirtualArena( &globalTmpArena );
+#if MEMORY_TRACKING
+    Memory::TrackArena( &globalPlatformArena, "Platform" );
+    Memory::TrackArena( &globalTmpArena, "Tmp" );
+#endif
 
     // Set up Context for the main thread
     Context threadContext =
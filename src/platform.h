@@ -30,6 +30,26 @@ namespace Platform
 typedef PLATFORM_ALLOC(AllocFunc);
 #define PLATFORM_FREE(x)                void x( void* memoryBlock )
 typedef PLATFORM_FREE(FreeFunc);
+// Reserve a range of address space, without backing it with any actual memory yet
+#define PLATFORM_RESERVE(x)             void* x( sz sizeBytes )
+typedef PLATFORM_RESERVE(ReserveFunc);
+// Back (part of) a reserved range with zero-initialized memory
+#define PLATFORM_COMMIT(x)              bool x( void* address, sz sizeBytes )
+typedef PLATFORM_COMMIT(CommitFunc);
+// Return the memory backing (part of) a reserved range to the OS, but keep the range reserved
+#define PLATFORM_DECOMMIT(x)            void x( void* address, sz sizeBytes )
+typedef PLATFORM_DECOMMIT(DecommitFunc);
+// Release a whole reserved range (sizeBytes must be the same that was originally reserved)
+#define PLATFORM_RELEASE(x)             void x( void* address, sz sizeBytes )
+typedef PLATFORM_RELEASE(ReleaseFunc);
+// Map the same zero-initialized memory twice back to back, so that accesses going past the end of the first copy
+// land at the start of the original memory. sizeBytes is rounded up to the allocation granularity and returned in sizeOut
+// (the total range returned spans twice that)
+#define PLATFORM_ALLOC_MIRRORED(x)      void* x( sz sizeBytes, sz* sizeOut )
+typedef PLATFORM_ALLOC_MIRRORED(AllocMirroredFunc);
+// Unmap a mirrored range (sizeBytes must be the rounded size returned by AllocMirrored)
+#define PLATFORM_FREE_MIRRORED(x)       void x( void* address, sz sizeBytes )
+typedef PLATFORM_FREE_MIRRORED(FreeMirroredFunc);
 
 
 #define PLATFORM_GET_CONTEXT(x)         Context** x()
@@ -38,6 +58,9 @@ typedef PLATFORM_GET_CONTEXT(GetContextFunc);
 typedef PLATFORM_PUSH_CONTEXT(PushContextFunc);
 #define PLATFORM_POP_CONTEXT(x)         void x()
 typedef PLATFORM_POP_CONTEXT(PopContextFunc);
+// Install a different stack of Contexts for the calling thread, and return the previous one
+#define PLATFORM_SWAP_CONTEXT_STACK(x)  ContextStack* x( ContextStack* newStack )
+typedef PLATFORM_SWAP_CONTEXT_STACK(SwapContextStackFunc);
 
 
 // TODO Do something better for paths
@@ -91,6 +114,9 @@ typedef PLATFORM_JOIN_THREAD(JoinThreadFunc);
 typedef PLATFORM_GET_THREAD_ID(GetThreadIdFunc);
 #define PLATFORM_IS_MAIN_THREAD(x)      bool x()
 typedef PLATFORM_IS_MAIN_THREAD(IsMainThreadFunc);
+// Number of logical processors available to the process
+#define PLATFORM_GET_CORE_COUNT(x)      int x()
+typedef PLATFORM_GET_CORE_COUNT(GetCoreCountFunc);
 
 #define PLATFORM_CREATE_SEMAPHORE(x)    void* x( int initialCount )
 typedef PLATFORM_CREATE_SEMAPHORE(CreateSemaphoreFunc);
@@ -101,6 +127,13 @@ typedef PLATFORM_WAIT_SEMAPHORE(WaitSemaphoreFunc);
 #define PLATFORM_SIGNAL_SEMAPHORE(x)    void x( void* handle, int count )
 typedef PLATFORM_SIGNAL_SEMAPHORE(SignalSemaphoreFunc);
 
+// Sleep for as long as the value at the address is still the expected one (may also return spuriously)
+#define PLATFORM_FUTEX_WAIT(x)          void x( atomic_i32* address, i32 expected )
+typedef PLATFORM_FUTEX_WAIT(FutexWaitFunc);
+// Wake up to count threads sleeping on the address
+#define PLATFORM_FUTEX_WAKE(x)          void x( atomic_i32* address, i32 count )
+typedef PLATFORM_FUTEX_WAKE(FutexWakeFunc);
+
 #define PLATFORM_CREATE_MUTEX(x)        void* x()
 typedef PLATFORM_CREATE_MUTEX(CreateMutexFunc);
 #define PLATFORM_DESTROY_MUTEX(x)       void x( void* handle )
@@ -132,11 +165,18 @@ struct API
     // Memory
     AllocFunc*                        Alloc;
     FreeFunc*                         Free;
+    ReserveFunc*                      Reserve;
+    CommitFunc*                       Commit;
+    DecommitFunc*                     Decommit;
+    ReleaseFunc*                      Release;
+    AllocMirroredFunc*                AllocMirrored;
+    FreeMirroredFunc*                 FreeMirrored;
 
     // Context
     GetContextFunc*                   GetContext;
     PushContextFunc*                  PushContext;
     PopContextFunc*                   PopContext;
+    SwapContextStackFunc*             SwapContextStack;
 
     // Filesystem
     GetFileAttributesFunc*            GetFileAttributes;
@@ -153,11 +193,14 @@ struct API
     JoinThreadFunc*                   JoinThread;
     GetThreadIdFunc*                  GetThreadId;
     IsMainThreadFunc*                 IsMainThread;
+    GetCoreCountFunc*                 GetCoreCount;
 
     CreateSemaphoreFunc*              CreateSemaphore;
     DestroySemaphoreFunc*             DestroySemaphore;
     WaitSemaphoreFunc*                WaitSemaphore;
     SignalSemaphoreFunc*              SignalSemaphore;
+    FutexWaitFunc*                    FutexWait;
+    FutexWakeFunc*                    FutexWake;
     CreateMutexFunc*                  CreateMutex;
     DestroyMutexFunc*                 DestroyMutex;
     LockMutexFunc*                    LockMutex;
@@ -186,8 +186,8 @@ REFLECT_T( EnumStruct<T> )
 {
     T& e = *(T*)&d;
 
-    using ValueType = T::ValueType;
-    static_assert( !std::is_same< ValueType, EnumStruct<T>::InvalidValueType >(), "EnumStruct has no declared values to serialize" );
+    using ValueType = typename T::ValueType;
+    static_assert( !std::is_same< ValueType, typename EnumStruct<T>::InvalidValueType >(), "EnumStruct has no declared values to serialize" );
 
     ValueType v;
     IF( r.IsWriting )
@@ -209,3 +209,299 @@ REFLECT_T( EnumStruct<T> )
     return ReflectOk;
 }
 
+
+
+/////     STRUCT OF ARRAYS     /////
+
+// Reflector that doesn't serialize anything, just records where each (top level) reflected field lives inside its struct
+struct SoALayoutReflector : public Reflector<false>
+{
+    static constexpr int MaxFields = 32;
+
+    struct Field
+    {
+        char const* name;
+        u32 id;
+        sz offset;
+        sz size;
+    };
+
+    u8 const* base;
+    sz baseSize;
+    Field fields[MaxFields];
+    int fieldCount;
+
+    template <typename T>
+    SoALayoutReflector( T const& d )
+        : Reflector<false>( nullptr )
+        , base( (u8 const*)&d )
+        , baseSize( SIZEOF(T) )
+        , fields{}
+        , fieldCount( 0 )
+    {}
+};
+
+// Don't recurse, each field becomes a column no matter its type
+template <typename F>
+INLINE ReflectResult ReflectFieldBody( SoALayoutReflector& r, ReflectedTypeInfo<SoALayoutReflector>& info, u32 fieldId, F& f,
+                                       StaticString const& name, FieldAttributes const& attribs )
+{
+    sz offset = (u8 const*)&f - r.base;
+    ASSERT( offset >= 0 && offset + SIZEOF(F) <= r.baseSize, "Field '%s' is not a member, can't be laid out as a column", name.data );
+    ASSERT( r.fieldCount < SoALayoutReflector::MaxFields, "Too many fields" );
+
+    r.fields[r.fieldCount++] = { name.data, fieldId, offset, SIZEOF(F) };
+    return ReflectOk;
+}
+template <typename F>
+INLINE ReflectResult ReflectFieldBody( SoALayoutReflector& r, ReflectedTypeInfo<SoALayoutReflector>& info, u32 fieldId, F& f,
+                                       StaticString const& name )
+{
+    return ReflectFieldBody( r, info, fieldId, f, name, {} );
+}
+
+
+// Stores each reflected field of T in its own contiguous column, so loops touching just a few fields only pull those into cache
+// (and can be easily vectorized). Columns are laid out from the FIELD list in the type's REFLECT function.
+// Whole records can still be pushed, removed and read back, and converted to and from plain Arrays.
+// Grows automatically, all columns share a single allocation.
+// NOTE Only reflected fields are stored! Anything else comes back default-initialized from Get()
+// NOTE Records are copied around field by field, so T must be trivially copyable
+template <typename T, typename AllocType = Allocator>
+struct SoAArray
+{
+    static_assert( std::is_trivially_copyable<T>::value, "SoAArray records must be trivially copyable" );
+
+    static constexpr sz ColumnAlignment = 64;
+
+    // Each column's start, followed by the columns themselves
+    u8** columns;
+    i32 count;
+    i32 capacity;
+
+    AllocType* allocator;
+    MemoryParams memParams;
+
+
+    static SoALayoutReflector const& Layout()
+    {
+        // Reflect a dummy instance just once
+        static SoALayoutReflector const layout = []()
+        {
+            T dummy = {};
+            SoALayoutReflector r( dummy );
+            Reflect( r, dummy );
+            ASSERT( r.fieldCount > 0, "Type has no reflected fields" );
+            return r;
+        }();
+        return layout;
+    }
+
+    explicit SoAArray( i32 capacity_ = 0, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : columns( nullptr )
+        , count( 0 )
+        , capacity( 0 )
+        , allocator( alloc )
+        , memParams( params )
+    {
+        Reserve( capacity_ );
+    }
+
+    // Copy all records from a plain array
+    explicit SoAArray( Buffer<T> const& items, AllocType* alloc = CTX_ALLOC, MemoryParams params = Memory::NoClear() )
+        : SoAArray( I32( items.length ), alloc, params )
+    {
+        for( T const& item : items )
+            Push( item );
+    }
+
+    // NOTE Move only (copy implicitly deleted)
+    SoAArray( SoAArray&& other )
+        : SoAArray( 0, other.allocator, other.memParams )
+    {
+        *this = std::move( other );
+    }
+
+    ~SoAArray()
+    {
+        Destroy();
+    }
+
+    void operator =( SoAArray&& other )
+    {
+        Destroy();
+
+        columns   = other.columns;
+        count     = other.count;
+        capacity  = other.capacity;
+        allocator = other.allocator;
+        memParams = other.memParams;
+
+        ZERO( other );
+    }
+
+    void Destroy()
+    {
+        if( columns )
+            FREE( allocator, columns, memParams );
+
+        columns = nullptr;
+        count = 0;
+        capacity = 0;
+    }
+
+    INLINE int  FieldCount() const  { return Layout().fieldCount; }
+    INLINE bool Empty() const       { return count == 0; }
+    INLINE i32  Available() const   { return capacity - count; }
+
+    // Typed access to a whole column, given the field in the original struct, as in: array.Column( &Particle::pos )
+    template <typename F>
+    Buffer<F> Column( F T::* member )
+    {
+        int index = FieldIndex( member );
+        ASSERT( index >= 0, "Field is not reflected" );
+        return Buffer<F>( (F*)columns[index], count );
+    }
+
+    template <typename F>
+    Buffer<F const> Column( F T::* member ) const
+    {
+        int index = FieldIndex( member );
+        ASSERT( index >= 0, "Field is not reflected" );
+        return Buffer<F const>( (F const*)columns[index], count );
+    }
+
+    // Same, but given the field's index in the reflected field list
+    template <typename F>
+    Buffer<F> Column( int index )
+    {
+        ASSERT( index >= 0 && index < FieldCount() );
+        ASSERT( Layout().fields[index].size == SIZEOF(F), "Wrong type for column '%s'", Layout().fields[index].name );
+        return Buffer<F>( (F*)columns[index], count );
+    }
+
+    void Reserve( i32 newCapacity )
+    {
+        if( newCapacity <= capacity )
+            return;
+
+        ASSERT( allocator );
+        SoALayoutReflector const& layout = Layout();
+
+        // Room for the column pointers, enough slack to align the first column, and each column rounded up
+        sz totalSize = layout.fieldCount * SIZEOF(u8*) + ColumnAlignment;
+        for( int f = 0; f < layout.fieldCount; ++f )
+            totalSize += AlignUp( layout.fields[f].size * newCapacity, ColumnAlignment );
+
+        u8** newColumns = (u8**)ALLOC( allocator, totalSize, memParams );
+        u8* next = (u8*)AlignUp( (u8*)(newColumns + layout.fieldCount), ColumnAlignment );
+        for( int f = 0; f < layout.fieldCount; ++f )
+        {
+            sz columnSize = layout.fields[f].size;
+            newColumns[f] = next;
+            if( columns )
+                COPYP( columns[f], newColumns[f], count * columnSize );
+
+            next += AlignUp( columnSize * newCapacity, ColumnAlignment );
+        }
+
+        if( columns )
+            FREE( allocator, columns, memParams );
+        columns = newColumns;
+        capacity = newCapacity;
+    }
+
+    void Clear()
+    {
+        count = 0;
+    }
+
+    void Push( T const& item )
+    {
+        if( count == capacity )
+            Reserve( Max( capacity * 2, 16 ) );
+
+        Set( count++, item );
+    }
+
+    void Push( Buffer<T> const& items )
+    {
+        if( Available() < items.length )
+            Reserve( Max( capacity * 2, count + I32( items.length ) ) );
+
+        for( T const& item : items )
+            Set( count++, item );
+    }
+
+    // Swaps the last record in
+    void Remove( i32 index )
+    {
+        ASSERT( index >= 0 && index < count );
+        --count;
+
+        if( index != count )
+        {
+            SoALayoutReflector const& layout = Layout();
+            for( int f = 0; f < layout.fieldCount; ++f )
+            {
+                sz size = layout.fields[f].size;
+                COPYP( columns[f] + count * size, columns[f] + index * size, size );
+            }
+        }
+    }
+
+    T Get( i32 index ) const
+    {
+        ASSERT( index >= 0 && index < count );
+
+        T result = {};
+        SoALayoutReflector const& layout = Layout();
+        for( int f = 0; f < layout.fieldCount; ++f )
+        {
+            SoALayoutReflector::Field const& field = layout.fields[f];
+            COPYP( columns[f] + index * field.size, (u8*)&result + field.offset, field.size );
+        }
+        return result;
+    }
+
+    void Set( i32 index, T const& item )
+    {
+        ASSERT( index >= 0 && index < count );
+
+        SoALayoutReflector const& layout = Layout();
+        for( int f = 0; f < layout.fieldCount; ++f )
+        {
+            SoALayoutReflector::Field const& field = layout.fields[f];
+            COPYP( (u8 const*)&item + field.offset, columns[f] + index * field.size, field.size );
+        }
+    }
+
+    template <typename AllocType2 = Allocator>
+    Array<T, AllocType2> ToArray( AllocType2* alloc = nullptr ) const
+    {
+        Array<T, AllocType2> result( count, alloc ? alloc : CTX_ALLOC );
+        for( int i = 0; i < count; ++i )
+            result.Push( Get( i ) );
+        return result;
+    }
+
+private:
+    template <typename F>
+    static int FieldIndex( F T::* member )
+    {
+        // Find the column by the member's offset
+        alignas(T) static u8 dummy[sizeof(T)];
+        sz offset = (u8 const*)&(((T const*)dummy)->*member) - dummy;
+
+        SoALayoutReflector const& layout = Layout();
+        for( int f = 0; f < layout.fieldCount; ++f )
+        {
+            if( layout.fields[f].offset == offset )
+            {
+                ASSERT( layout.fields[f].size == SIZEOF(F) );
+                return f;
+            }
+        }
+        return -1;
+    }
+};
@@ -18,23 +18,48 @@ struct BinaryReflector : public Reflector<RW>
 {
     BufferType<u8>* buffer;
     sz bufferHead;
+    // Contiguous chunk of the buffer we last read from, so most reads are just a straight copy out of it
+    Buffer<u8> readSpan;
+    sz readSpanStart;
 
     BinaryReflector( BufferType<u8>* b, Allocator* allocator = CTX_TMPALLOC )
         : Reflector<RW>( allocator )
         , buffer( b )
         , bufferHead( 0 )
+        , readSpanStart( 0 )
     {}
 
+    INLINE sz Read( u8* out, sz size, sz offset )
+    {
+        if( offset < readSpanStart || offset + size > readSpanStart + readSpan.length )
+        {
+            if( offset >= buffer->Size() )
+                return 0;
+
+            readSpan = buffer->SpanAt( offset );
+            readSpanStart = offset;
+        }
+
+        if( offset + size <= readSpanStart + readSpan.length )
+        {
+            COPYP( readSpan.data + (offset - readSpanStart), out, size );
+            return size;
+        }
+
+        // Straddles more than one span
+        return buffer->CopyTo( out, size, offset );
+    }
+
     INLINE void ReadAndAdvance( u8* out, sz size )
     {
-        sz copied = buffer->CopyTo( out, size, bufferHead );
+        sz copied = Read( out, size, bufferHead );
         ASSERT( copied == size );
         bufferHead += size;
     }
 
     INLINE void ReadField( sz offset, BinaryField* fieldOut )
     {
-        sz copied = buffer->CopyTo( (u8*)fieldOut, BinaryFieldSize, offset );
+        sz copied = Read( (u8*)fieldOut, BinaryFieldSize, offset );
         ASSERT( copied == BinaryFieldSize );
     }
 
@@ -385,6 +410,28 @@ REFLECT_T( Array<T> )
     return result;
 }
 
+template <typename R, typename T, int N>
+ReflectResult Reflect( R& r, SmallArray<T, N>& d )
+{
+    i32 count = d.count;
+    Reflect( r, count );
+
+    IF( r.IsReading )
+    {
+        d.Clear();
+        d.Resize( count );
+    }
+
+    ReflectResult result = ReflectOk;
+    for( int i = 0; i < count; ++i )
+    {
+        result = Reflect( r, d[i] );
+        if( !result )
+            break;
+    }
+    return result;
+}
+
 template <typename R, typename T>
 ReflectResult ReflectArrayPOD( R& r, T& d )
 {
@@ -315,7 +315,9 @@ REFLECT_SPECIAL_RW( JsonReflector, String )
     return ReflectOk;
 }
 
-REFLECT_SPECIAL_RWT( JsonReflector, Array<T> )
+// Shared by all array-like containers. The resize func must leave the container with exactly 'count' (reflectable) items
+template <bool RW, typename ArrayType, typename ResizeFunc>
+ReflectResult ReflectJsonArray( JsonReflector<RW>& r, ArrayType& d, ResizeFunc&& resize )
 {
     IF( r.IsWriting )
     {
@@ -357,8 +359,7 @@ REFLECT_SPECIAL_RWT( JsonReflector, Array<T> )
             return { ReflectResult::BadData };
 
         int count = (int)array->length;
-        d.Reset( count );
-        d.ResizeToCapacity();
+        resize( count );
 
         json_array_element_s* el = array->start;
         for( int i = 0; i < count; ++i, el = el->next )
@@ -378,4 +379,23 @@ REFLECT_SPECIAL_RWT( JsonReflector, Array<T> )
     return ReflectOk;
 }
 
+REFLECT_SPECIAL_RWT( JsonReflector, Array<T> )
+{
+    return ReflectJsonArray( r, d, [&d]( int count )
+    {
+        d.Reset( count );
+        d.ResizeToCapacity();
+    } );
+}
+
+template <bool RW, typename T, int N>
+ReflectResult Reflect( JsonReflector<RW>& r, SmallArray<T, N>& d )
+{
+    return ReflectJsonArray( r, d, [&d]( int count )
+    {
+        d.Clear();
+        d.Resize( count );
+    } );
+}
+
 
@@ -89,11 +89,17 @@ void String::InternalClone( char const* src, int len /*= 0*/ )
 
 String String::Clone( BucketArray<char> const& src, bool temporary /*= false*/ )
 {
-    bool terminated = src.Last() == 0;
+    bool terminated = !src.Empty() && src.Last() == 0;
 
     // Constructor already accounts for the terminator space
-    String result( (int)(terminated ? src.count - 1 : src.count) );
-    src.CopyTo( (char*)result.data, result.length + 1 );
+    String result( (int)(terminated ? src.count - 1 : src.count), temporary ? Temporary : None );
+
+    char* dst = result.InPlaceModify();
+    src.ForEachSpan( [&dst]( Buffer<char> const& span )
+    {
+        COPYP( span.data, dst, span.length );
+        dst += span.length;
+    } );
 
     result.InPlaceModify()[result.length] = 0;
     return result;
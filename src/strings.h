@@ -263,7 +263,7 @@ INLINE bool StringEndsWith( char const* str, char const* find, int len = 0 )
 INLINE bool StringEndsWithAny( char const* str, char const* charList, int len = 0 )
 {
     if( !str || !charList )
-        return nullptr;
+        return false;
 
     size_t strLen = len ? len : strlen( str );
 
@@ -585,8 +585,9 @@ struct String
 
 private:
     explicit String( int len, u32 flags_ = 0 )
+        : flags( 0 )
     {
-        Reset( len, flags );
+        Reset( len, flags_ );
     }
 
     // Will copy len chars and append an extra null-terminator at the end
@@ -632,7 +633,8 @@ public:
     {
         if( !len )
             len = str ? StringLength( str ) : 0;
-        return length == len && (data == str || StringEquals( data, str, length, caseSensitive ));
+        // Empty strings are equal regardless of whether they point to a null or an empty buffer
+        return length == len && (length == 0 || data == str || StringEquals( data, str, length, caseSensitive ));
     }
     bool IsEqualIgnoreCase( const char* str, sz len = 0 ) const
     {
@@ -703,20 +705,16 @@ public:
 private:
     static String FromFormat( char const* fmt, va_list args, bool temporary )
     {
-        // TODO I read somewhere that apparently these need to be copied to correctly use them twice?
-#if 0
+        // A va_list can't be consumed twice on every platform (it happens to work on Win32, but not on x64 SysV)
         va_list argsCopy;
         va_copy( argsCopy, args );
-#endif
         // String constructor below already accounts for the null terminator
         int len = vsnprintf( nullptr, 0, fmt, args );
 
         String result( len, temporary ? Temporary : None );
         // Actual string buffer above has one extra character for the null terminator
-        vsnprintf( (char*)result.data, (size_t)result.length + 1, fmt, args/*Copy*/ );
-#if 0
+        vsnprintf( (char*)result.data, (size_t)result.length + 1, fmt, argsCopy );
         va_end( argsCopy );
-#endif
 
         ASSERT( result.ValidCString() );
         return result;
@@ -0,0 +1,120 @@
+namespace Tasks
+{
+    // Precedes every coroutine frame, so it can always be freed from wherever it came from
+    struct FrameHeader
+    {
+        Allocator* allocator;
+        void* block;
+    };
+    static_assert( sizeof(FrameHeader) == 16, "Frame payload must stay 16-byte aligned" );
+
+    internal std::atomic<Allocator*> globalFrameAllocator( nullptr );
+
+
+    // Shared by frames & main loop queues, created on first use since it needs the platform to be initialized
+    internal SyncHeap* SharedHeap()
+    {
+        persistent SyncHeap heap;
+        return &heap;
+    }
+
+    internal Allocator* DefaultFrameAllocator()
+    {
+        persistent Allocator allocator = Allocator::CreateFrom( SharedHeap() );
+        return &allocator;
+    }
+
+    Allocator* FrameAllocator()
+    {
+        Allocator* result = globalFrameAllocator.LOAD_ACQUIRE();
+        return result ? result : DefaultFrameAllocator();
+    }
+
+    void SetFrameAllocator( Allocator* allocator )
+    {
+        globalFrameAllocator.STORE_RELEASE( allocator );
+    }
+
+    void* AllocFrame( sz sizeBytes )
+    {
+        Allocator* allocator = FrameAllocator();
+
+        // Not every allocator guarantees the alignment frames need, so leave room to align it ourselves
+        void* block = ALLOC( allocator, sizeBytes + SIZEOF(FrameHeader) + 15, Memory::NoClear() );
+        ASSERT( block );
+
+        u8* result = (u8*)AlignUp( (u8*)block + SIZEOF(FrameHeader), 16 );
+        FrameHeader* header = (FrameHeader*)result - 1;
+        header->allocator = allocator;
+        header->block = block;
+
+        return result;
+    }
+
+    void FreeFrame( void* frame )
+    {
+        FrameHeader* header = (FrameHeader*)frame - 1;
+        FREE( header->allocator, header->block );
+    }
+
+
+    internal void PostToMainLoop( void* impl, std::coroutine_handle<> handle )
+    {
+        MainLoop* loop = (MainLoop*)impl;
+        loop->queue.Push( handle.address() );
+    }
+
+    MainLoop::MainLoop()
+        : queue( 64, SharedHeap() )
+    {
+        executor.postFunc = PostToMainLoop;
+        executor.impl = this;
+    }
+
+    int MainLoop::RunPending()
+    {
+        int result = 0;
+
+        void* address;
+        while( queue.TryPop( &address ) )
+        {
+            std::coroutine_handle<>::from_address( address ).resume();
+            result++;
+        }
+        return result;
+    }
+
+
+    internal JOB_FUNC(ResumeTaskJob)
+    {
+        std::coroutine_handle<>::from_address( userdata ).resume();
+    }
+
+    internal void PostToJobs( void* impl, std::coroutine_handle<> handle )
+    {
+        Jobs::Run( ResumeTaskJob, handle.address() );
+    }
+
+    Executor* JobExecutor()
+    {
+        persistent Executor executor = { PostToJobs, nullptr };
+        return &executor;
+    }
+
+
+    internal JOB_FUNC(CounterDoneJob)
+    {
+        WaitForCounter* awaiter = (WaitForCounter*)userdata;
+        if( awaiter->executor )
+            awaiter->executor->Post( awaiter->handle );
+        else
+            awaiter->handle.resume();
+    }
+
+    void WaitForCounter::await_suspend( std::coroutine_handle<> handle_ )
+    {
+        handle = handle_;
+        // NOTE The awaiter lives in the suspended frame, so it's safe to point to it until we're resumed
+        Jobs::RunAfter( counter, CounterDoneJob, this );
+    }
+} // namespace Tasks
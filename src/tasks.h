@@ -0,0 +1,274 @@
+#pragma once
+
+/////     TASKS     /////
+// C++20 coroutines that can suspend on asynchronous work (jobs, http requests..) without blocking any thread, as in:
+//
+//     Task<int> CountWords( Http::State* http, Executor* workers )
+//     {
+//         Http::Response response = co_await Http::GetAsync( http, "https://example.com" );
+//         co_await Tasks::ResumeOn( workers );
+//         co_return ParseWords( response.body );
+//     }
+//
+// Tasks are lazy: they don't start until they're awaited by another task, or explicitly Start()ed (or Spawn()ed).
+// Once a task finishes, whoever was awaiting it continues right away on the same thread.
+// Every time a task suspends on something, it's resumed by whatever completed it, unless told otherwise through
+// an Executor, which decides where it will run next: the main loop (through MainLoop::RunPending) or the job workers.
+//
+// Coroutine frames never touch the global heap. They come from Tasks::FrameAllocator(), which by default is a pooled
+// thread-safe heap (SyncHeap), but can be anything else (even an arena) as long as it's safe to free from any thread
+// tasks may end up running on.
+//
+// NOTE Tasks use no exceptions, so any unhandled error inside a coroutine is just a failed assertion
+
+template <typename T = void>
+struct Task;
+
+namespace Tasks
+{
+    // Where frames for all new coroutines are allocated from
+    Allocator* FrameAllocator();
+    // Pass null to go back to the default one
+    void SetFrameAllocator( Allocator* allocator );
+
+    void* AllocFrame( sz sizeBytes );
+    void FreeFrame( void* frame );
+
+
+    // Something that decides where to resume suspended tasks
+    struct Executor
+    {
+        typedef void PostFunc( void* impl, std::coroutine_handle<> handle );
+
+        PostFunc*       postFunc;
+        void*           impl;
+
+        void Post( std::coroutine_handle<> handle ) { postFunc( impl, handle ); }
+    };
+
+    // Queue of tasks to resume whenever the owner calls RunPending (usually once per frame, from the main loop)
+    // Tasks can be posted from any thread
+    struct MainLoop
+    {
+        SyncQueue<void*, SyncHeap>  queue;
+        Executor                    executor;
+
+        MainLoop();
+
+        // Resume all tasks posted so far, and return how many there were
+        int RunPending();
+    };
+
+    // Resumes tasks as jobs, so they can continue on any worker
+    // NOTE Tasks can only be posted to it from a job worker (like the main thread after calling Jobs::Init)
+    Executor* JobExecutor();
+
+
+    struct PromiseBase
+    {
+        // Whoever is awaiting this task, if anyone
+        std::coroutine_handle<> continuation;
+        bool                    detached = false;
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            void await_resume() noexcept {}
+
+            template <typename P>
+            std::coroutine_handle<> await_suspend( std::coroutine_handle<P> handle ) noexcept
+            {
+                PromiseBase& promise = handle.promise();
+                if( promise.continuation )
+                    return promise.continuation;
+
+                // Nobody will ever look at the result
+                if( promise.detached )
+                    handle.destroy();
+                return std::noop_coroutine();
+            }
+        };
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { ASSERT( false, "Unhandled exception in task" ); }
+
+        void* operator new( size_t sizeBytes ) { return AllocFrame( (sz)sizeBytes ); }
+        void operator delete( void* frame ) { FreeFrame( frame ); }
+    };
+
+    template <typename T>
+    struct Promise : public PromiseBase
+    {
+        alignas(T) u8   storage[sizeof(T)];
+        bool            hasValue = false;
+
+        ~Promise()
+        {
+            if( hasValue )
+                Value().~T();
+        }
+
+        Task<T> get_return_object();
+
+        template <typename V>
+        void return_value( V&& value )
+        {
+            INIT( Value() )( std::forward<V>( value ) );
+            hasValue = true;
+        }
+
+        T& Value() { return *(T*)storage; }
+    };
+
+    template <>
+    struct Promise<void> : public PromiseBase
+    {
+        Task<void> get_return_object();
+        void return_void() {}
+    };
+} // namespace Tasks
+
+template <typename T>
+struct Task
+{
+    using promise_type = Tasks::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Handle handle;
+
+    Task()
+        : handle( nullptr )
+    {}
+
+    explicit Task( Handle handle_ )
+        : handle( handle_ )
+    {}
+
+    Task( Task&& other )
+        : handle( other.handle )
+    {
+        other.handle = nullptr;
+    }
+
+    Task& operator =( Task&& other )
+    {
+        if( this != &other )
+        {
+            Destroy();
+            handle = other.handle;
+            other.handle = nullptr;
+        }
+        return *this;
+    }
+
+    Task( Task const& ) = delete;
+    Task& operator =( Task const& ) = delete;
+
+    ~Task()
+    {
+        Destroy();
+    }
+
+    void Destroy()
+    {
+        if( handle )
+            handle.destroy();
+        handle = nullptr;
+    }
+
+    // Run until the first suspension point (only for tasks nobody is awaiting)
+    void Start()
+    {
+        ASSERT( handle && !handle.done() );
+        handle.resume();
+    }
+
+    bool Done() const { return !handle || handle.done(); }
+
+    // Only valid once Done
+    decltype(auto) Result()
+    {
+        ASSERT( handle && handle.done() );
+        IF( !std::is_void<T>::value )
+            return handle.promise().Value();
+    }
+
+    // Awaiting a task starts it, and continues the awaiting one as soon as it's done
+    bool await_ready() const { return Done(); }
+
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting )
+    {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    decltype(auto) await_resume()
+    {
+        IF( !std::is_void<T>::value )
+            return std::move( handle.promise().Value() );
+    }
+};
+
+namespace Tasks
+{
+    template <typename T>
+    INLINE Task<T> Promise<T>::get_return_object()
+    {
+        return Task<T>( std::coroutine_handle<Promise<T>>::from_promise( *this ) );
+    }
+
+    INLINE Task<void> Promise<void>::get_return_object()
+    {
+        return Task<void>( std::coroutine_handle<Promise<void>>::from_promise( *this ) );
+    }
+
+    // Start a task and forget about it, its frame will be freed when it finishes
+    INLINE void Spawn( Task<void>&& task )
+    {
+        auto handle = task.handle;
+        task.handle = nullptr;
+
+        handle.promise().detached = true;
+        handle.resume();
+    }
+
+    // Continue the calling task on the given executor
+    struct ResumeOn
+    {
+        Executor* executor;
+
+        ResumeOn( Executor* executor_ )
+            : executor( executor_ )
+        {}
+
+        bool await_ready() { return false; }
+        void await_suspend( std::coroutine_handle<> handle ) { executor->Post( handle ); }
+        void await_resume() {}
+    };
+
+    // Suspend the calling task until the counter gets to zero, without blocking the worker
+    // By default it's resumed by the job that finishes last, otherwise it's posted to the given executor
+    // NOTE Can only be awaited on a job worker
+    struct WaitForCounter
+    {
+        Jobs::Counter*          counter;
+        Executor*               executor;
+        std::coroutine_handle<> handle;
+
+        WaitForCounter( Jobs::Counter* counter_, Executor* executor_ = nullptr )
+            : counter( counter_ )
+            , executor( executor_ )
+        {}
+
+        bool await_ready() { return counter->Done(); }
+        void await_suspend( std::coroutine_handle<> handle_ );
+
+        void await_resume()
+        {
+            // The last job to finish may still be touching the counter
+            while( !counter->Done() )
+                Yield();
+        }
+    };
+} // namespace Tasks
@@ -26,6 +26,11 @@ namespace Core
     {
         return globalPlatform.IsMainThread();
     }
+
+    inline int GetCoreCount()
+    {
+        return globalPlatform.GetCoreCount();
+    }
 } // namespace Core
 
 
@@ -33,6 +38,68 @@ namespace Core
 // TODO Test & benchmark all this using the "atomic sync" primitives in https://github.com/dr-m/atomic_sync (requires C++20)
 // TODO These should all delete the copy constructor and assignment?
 
+/////     FUTEX     /////
+
+// Sleep on / wake up threads waiting on a 32-bit word (futex on Linux, WaitOnAddress on Win32)
+// Nothing is allocated in the kernel, so primitives built on top are just a few ints and cost nothing until they block
+namespace Futex
+{
+    // Sleep for as long as the value at the address is still the expected one (may also return spuriously)
+    INLINE void Wait( atomic_i32* address, i32 expected )
+    {
+        globalPlatform.FutexWait( address, expected );
+    }
+
+    INLINE void Wake( atomic_i32* address, i32 count = 1 )
+    {
+        globalPlatform.FutexWake( address, count );
+    }
+
+    INLINE void WakeAll( atomic_i32* address )
+    {
+        globalPlatform.FutexWake( address, I32MAX );
+    }
+} // namespace Futex
+
+// Bounded spin before going to sleep, as a syscall round trip is way more expensive than a short wait.
+// Keeps a running average of how long it took to succeed (like glibc's adaptive mutexes), so primitives that are
+// usually released quickly get to spin for longer, but never more than MaxSpinCount pauses.
+struct AdaptiveSpin
+{
+    static constexpr i32 MaxSpinCount = 100;
+
+    // Racy updates are fine, it's just a heuristic
+    atomic_i32 estimate;
+
+    AdaptiveSpin()
+        : estimate( 0 )
+    {}
+
+    template <typename F>
+    INLINE bool Spin( F&& tryAcquire )
+    {
+        i32 current = estimate.LOAD_RELAXED();
+        i32 limit = Min( current * 2 + 10, MaxSpinCount );
+
+        i32 spins = 0;
+        bool result = false;
+        for( ; spins < limit; ++spins )
+        {
+            if( tryAcquire() )
+            {
+                result = true;
+                break;
+            }
+            _mm_pause();
+        }
+
+        estimate.STORE_RELAXED( current + (spins - current) / 8 );
+        return result;
+    }
+};
+
+
+
 /////     SEMAPHORE     /////
 
 // Taken from https://stackoverflow.com/a/19659736/2151254 & https://elweitzel.de/drupal/?q=node/6
@@ -92,7 +159,7 @@ public:
 };
 
 
-// TODO See https://github.com/preshing/cpp11-on-multicore/blob/master/common/sema.h for OSX & linux implementations
+// NOTE Kernel semaphore in Win32, FutexSemaphore in Linux
 struct PlatformSemaphore
 {
 private:
@@ -188,6 +255,64 @@ public:
 };
 
 
+// Counting semaphore that stays in user space unless somebody actually needs to sleep
+struct FutexSemaphore
+{
+private:
+    atomic_i32 count;
+    // Threads (possibly) sleeping in the kernel, so signalling doesn't need a syscall when there's none
+    atomic_i32 waiters;
+    AdaptiveSpin spin;
+
+public:
+    FutexSemaphore( int initialCount = 0 )
+        : count( initialCount )
+        , waiters( 0 )
+    {
+        ASSERT( initialCount >= 0 );
+    }
+
+    FutexSemaphore( FutexSemaphore const& ) = delete;
+    FutexSemaphore& operator =( FutexSemaphore const& ) = delete;
+
+    bool TryWait()
+    {
+        i32 oldCount = count.LOAD_RELAXED();
+        while( oldCount > 0 )
+        {
+            if( count.compare_exchange_weak( oldCount, oldCount - 1, std::memory_order_acquire, std::memory_order_relaxed ) )
+                return true;
+        }
+        return false;
+    }
+
+    void Wait()
+    {
+        if( TryWait() || spin.Spin( [this]() { return TryWait(); } ) )
+            return;
+
+        do
+        {
+            // If a signal sneaks in between the check above and the wait, the kernel will see the count is no longer 0
+            // and return immediately
+            waiters.fetch_add( 1, std::memory_order_seq_cst );
+            Futex::Wait( &count, 0 );
+            waiters.fetch_sub( 1, std::memory_order_relaxed );
+        }
+        while( !TryWait() );
+    }
+
+    void Signal( int signalCount = 1 )
+    {
+        ASSERT( signalCount > 0 );
+        count.fetch_add( signalCount, std::memory_order_seq_cst );
+
+        if( waiters.load( std::memory_order_seq_cst ) > 0 )
+            Futex::Wake( &count, signalCount );
+    }
+};
+
+
 
 /////     MUTEX     /////
 
@@ -257,6 +382,63 @@ struct PlatformMutex
 };
 
 
+// Three-state mutex from "Futexes Are Tricky" (Drepper): 0 unlocked, 1 locked, 2 locked with (possible) waiters
+// Uncontended lock / unlock is a single atomic op each, and unlocking only goes to the kernel when somebody is asleep
+struct FutexMutex
+{
+private:
+    atomic_i32 state;
+    AdaptiveSpin spin;
+
+public:
+    FutexMutex()
+        : state( 0 )
+    {}
+
+    FutexMutex( FutexMutex const& ) = delete;
+    FutexMutex& operator =( FutexMutex const& ) = delete;
+
+    bool TryLock()
+    {
+        i32 c = state.LOAD_RELAXED();
+        return c == 0 && state.compare_exchange_strong( c, 1, std::memory_order_acquire, std::memory_order_relaxed );
+    }
+
+    void Lock()
+    {
+        i32 c = 0;
+        if( state.compare_exchange_strong( c, 1, std::memory_order_acquire, std::memory_order_relaxed ) )
+            return;
+        if( spin.Spin( [this]() { return TryLock(); } ) )
+            return;
+
+        // Flag it as contended, and sleep until we're the ones who find it unlocked
+        // NOTE This leaves it as contended even if we were the last waiter, which just costs one spurious wake
+        while( state.exchange( 2, std::memory_order_acquire ) != 0 )
+            Futex::Wait( &state, 2 );
+    }
+
+    void Unlock()
+    {
+        i32 c = state.exchange( 0, std::memory_order_release );
+        ASSERT( c != 0 );
+        if( c == 2 )
+            Futex::Wake( &state, 1 );
+    }
+
+    struct Scope
+    {
+        FutexMutex& m;
+
+        Scope( FutexMutex& m_ ) : m( m_ )
+        { m.Lock(); }
+
+        ~Scope()
+        { m.Unlock(); }
+    };
+};
+
+
 // From https://github.com/preshing/cpp11-on-multicore/blob/master/common/benaphore.h (NonRecursiveBenaphore)
 template <typename SemaphoreType>
 struct Benaphore
@@ -375,7 +557,516 @@ public:
 };
 
 
-// TODO ? Implement https://github.com/preshing/cpp11-on-multicore/blob/master/common/rwlock.h
-// TODO Implement Event from https://elweitzel.de/drupal/?q=node/6
-// Also check AutoResetEvent in https://preshing.com/20150316/semaphores-are-surprisingly-versatile/
+// From https://github.com/preshing/cpp11-on-multicore/blob/master/common/rwlock.h (NonRecursiveRWLock)
+// All state is packed into a single atomic word, so uncontended lock / unlock is a single RMW op
+template <typename SemaphoreType>
+struct RWLock
+{
+private:
+    // Three 10-bit counters: active readers, readers waiting for a writer to finish, and writers (active + waiting)
+    static constexpr u32 FieldBits      = 10;
+    static constexpr u32 FieldMask      = (1u << FieldBits) - 1;
+    static constexpr u32 ReadersShift   = 0;
+    static constexpr u32 WaitingShift   = FieldBits;
+    static constexpr u32 WritersShift   = 2 * FieldBits;
+
+    static INLINE u32 Readers( u32 status )     { return (status >> ReadersShift) & FieldMask; }
+    static INLINE u32 Waiting( u32 status )     { return (status >> WaitingShift) & FieldMask; }
+    static INLINE u32 Writers( u32 status )     { return (status >> WritersShift) & FieldMask; }
+
+    atomic_u32 status;
+    SemaphoreType readSemaphore;
+    SemaphoreType writeSemaphore;
+
+public:
+    RWLock()
+        : status( 0 )
+    {}
+
+    void LockRead()
+    {
+        u32 oldStatus = status.LOAD_RELAXED();
+        u32 newStatus;
+        do
+        {
+            // Queue up behind any writers, so they can't be starved
+            newStatus = oldStatus + (Writers( oldStatus ) ? (1u << WaitingShift) : (1u << ReadersShift));
+            ASSERT( Readers( newStatus ) < FieldMask && Waiting( newStatus ) < FieldMask );
+        }
+        while( !status.compare_exchange_weak( oldStatus, newStatus, std::memory_order_acquire, std::memory_order_relaxed ) );
+
+        if( Writers( oldStatus ) )
+            readSemaphore.Wait();
+    }
+
+    void UnlockRead()
+    {
+        u32 oldStatus = status.fetch_sub( 1u << ReadersShift, std::memory_order_release );
+        ASSERT( Readers( oldStatus ) > 0 );
+
+        // Last reader out lets the first writer in
+        if( Readers( oldStatus ) == 1 && Writers( oldStatus ) )
+            writeSemaphore.Signal();
+    }
+
+    void LockWrite()
+    {
+        u32 oldStatus = status.fetch_add( 1u << WritersShift, std::memory_order_acquire );
+        ASSERT( Writers( oldStatus ) + 1 < FieldMask );
 
+        if( Readers( oldStatus ) || Writers( oldStatus ) )
+            writeSemaphore.Wait();
+    }
+
+    void UnlockWrite()
+    {
+        u32 oldStatus = status.LOAD_RELAXED();
+        u32 newStatus;
+        u32 waiting;
+        do
+        {
+            ASSERT( Readers( oldStatus ) == 0 );
+
+            // Let all waiting readers in at once, otherwise hand over to the next writer
+            waiting = Waiting( oldStatus );
+            newStatus = oldStatus - (1u << WritersShift);
+            if( waiting )
+                newStatus = (newStatus & ~(FieldMask << WaitingShift)) + (waiting << ReadersShift);
+        }
+        while( !status.compare_exchange_weak( oldStatus, newStatus, std::memory_order_release, std::memory_order_relaxed ) );
+
+        if( waiting )
+            readSemaphore.Signal( I32( waiting ) );
+        else if( Writers( oldStatus ) > 1 )
+            writeSemaphore.Signal();
+    }
+
+    struct ReadScope
+    {
+        RWLock& l;
+
+        ReadScope( RWLock& l_ ) : l( l_ )
+        { l.LockRead(); }
+
+        ~ReadScope()
+        { l.UnlockRead(); }
+    };
+
+    struct WriteScope
+    {
+        RWLock& l;
+
+        WriteScope( RWLock& l_ ) : l( l_ )
+        { l.LockWrite(); }
+
+        ~WriteScope()
+        { l.UnlockWrite(); }
+    };
+};
+
+
+
+/////     EVENT     /////
+
+// Manual-reset event: once set, it lets every waiter through until it's reset again
+// NOTE A Set immediately followed by a Reset may not wake everybody who was waiting
+struct Event
+{
+private:
+    // 0 not set, 1 set, 2 not set with (possible) waiters
+    atomic_i32 state;
+    AdaptiveSpin spin;
+
+public:
+    Event( bool set = false )
+        : state( set ? 1 : 0 )
+    {}
+
+    Event( Event const& ) = delete;
+    Event& operator =( Event const& ) = delete;
+
+    bool IsSet() const
+    {
+        return state.LOAD_ACQUIRE() == 1;
+    }
+
+    void Set()
+    {
+        if( state.exchange( 1, std::memory_order_release ) == 2 )
+            Futex::WakeAll( &state );
+    }
+
+    void Reset()
+    {
+        i32 expected = 1;
+        state.compare_exchange_strong( expected, 0, std::memory_order_relaxed );
+    }
+
+    void Wait()
+    {
+        if( IsSet() || spin.Spin( [this]() { return IsSet(); } ) )
+            return;
+
+        i32 s = state.LOAD_ACQUIRE();
+        while( s != 1 )
+        {
+            // Let Set know it'll have to wake us
+            if( s == 0 && !state.compare_exchange_weak( s, 2, std::memory_order_acquire, std::memory_order_acquire ) )
+                continue;
+
+            Futex::Wait( &state, 2 );
+            s = state.LOAD_ACQUIRE();
+        }
+    }
+};
+
+// Lets a single waiter through for each Set (signals don't accumulate though, setting it twice lets just one through)
+// From https://preshing.com/20150316/semaphores-are-surprisingly-versatile/
+struct AutoResetEvent
+{
+private:
+    // 1 set, 0 not set, -N not set with N waiters
+    atomic_i32 status;
+    FutexSemaphore semaphore;
+
+public:
+    AutoResetEvent( bool set = false )
+        : status( set ? 1 : 0 )
+    {}
+
+    AutoResetEvent( AutoResetEvent const& ) = delete;
+    AutoResetEvent& operator =( AutoResetEvent const& ) = delete;
+
+    void Set()
+    {
+        i32 oldStatus = status.LOAD_RELAXED();
+        for( ;; )
+        {
+            ASSERT( oldStatus <= 1 );
+            i32 newStatus = oldStatus < 1 ? oldStatus + 1 : 1;
+            if( status.compare_exchange_weak( oldStatus, newStatus, std::memory_order_release, std::memory_order_relaxed ) )
+                break;
+        }
+
+        if( oldStatus < 0 )
+            semaphore.Signal();
+    }
+
+    void Wait()
+    {
+        i32 oldStatus = status.fetch_sub( 1, std::memory_order_acquire );
+        ASSERT( oldStatus <= 1 );
+        if( oldStatus < 1 )
+            semaphore.Wait();
+    }
+};
+
+
+
+/////     SYNC HEAP     /////
+
+// Thread-safe front for a GenericHeap
+// Small allocations are served from per-thread caches (one "magazine" of blocks per size class), which are refilled from /
+// returned to the shared central heap in batches, so most operations don't need to touch the central lock at all.
+// Every block remembers the thread cache that handed it out, and blocks freed from any other thread are sent back
+// to their owner through a lock-free list, which the owner collects the next time it runs out of blocks of some class.
+// Anything too big or too aligned goes straight to the central heap, and so does everything from any threads beyond
+// the first MaxThreads.
+// (see https://www.usenix.org/legacy/event/usenix01/full_papers/bonwick/bonwick.pdf)
+
+struct SyncHeap
+{
+    static constexpr int MinClassShift  = 4;            // 16 bytes
+    static constexpr int MaxClassShift  = 11;           // 2 KB
+    static constexpr int ClassCount     = MaxClassShift - MinClassShift + 1;
+    static constexpr sz  MaxCachedSize  = (sz)1 << MaxClassShift;
+    static constexpr int MagazineSize   = 64;
+    static constexpr int MaxThreads     = 64;
+    static constexpr u32 LargeClass     = U32MAX;
+
+    struct ThreadCache;
+
+    // Precedes every block handed out (keeps the payload 16-byte aligned)
+    struct Header
+    {
+        ThreadCache* owner;
+        u32 sizeClass;
+        // Distance from the start of the underlying central heap block to the payload
+        u32 offset;
+    };
+
+    // Overlaps the owner field, so the size class is preserved while in the remote list
+    struct RemoteBlock
+    {
+        RemoteBlock* next;
+    };
+
+    struct Magazine
+    {
+        i32 count;
+        Header* blocks[MagazineSize];
+    };
+
+    struct alignas(64) ThreadCache
+    {
+        // Blocks owned by this cache that have been freed by other threads
+        std::atomic<RemoteBlock*> remoteFrees;
+        // Zero when not claimed by any thread
+        std::atomic<u32> threadId;
+        Magazine magazines[ClassCount];
+    };
+
+    GenericHeap central;
+    Mutex centralMutex;
+
+    ThreadCache* caches;
+    atomic_i32 cacheCount;
+    // Used by threads to remember the last heap they used
+    u64 heapId;
+
+    SyncHeap( sz chunkSize = GenericHeap::DefaultChunkSize )
+        : central( chunkSize )
+        , cacheCount( 0 )
+    {
+        persistent std::atomic<u64> nextHeapId( 1 );
+        heapId = nextHeapId.fetch_add( 1, std::memory_order_relaxed );
+
+        // Already zeroed
+        caches = (ThreadCache*)globalPlatform.Alloc( MaxThreads * SIZEOF(ThreadCache), 0 );
+    }
+
+    ~SyncHeap()
+    {
+        // Any blocks still cached are freed along with the central heap chunks
+        globalPlatform.Free( caches );
+    }
+
+    SyncHeap( SyncHeap const& ) = delete;
+    SyncHeap& operator =( SyncHeap const& ) = delete;
+
+    static INLINE int SizeClassFor( sz size )
+    {
+        if( size <= ((sz)1 << MinClassShift) )
+            return 0;
+        return Log2( size - 1 ) + 1 - MinClassShift;
+    }
+
+    void* Alloc( sz sizeBytes, MemoryParams params = {} )
+    {
+        if( sizeBytes > MaxCachedSize || params.alignment > GenericHeap::Alignment )
+            return AllocLarge( sizeBytes, params );
+
+        ThreadCache* cache = GetThreadCache();
+        // Out of cache slots, so just go through the locked central heap
+        if( !cache )
+            return AllocLarge( sizeBytes, params );
+
+        int c = SizeClassFor( sizeBytes );
+        Magazine& m = cache->magazines[c];
+
+        if( m.count == 0 && !Refill( cache, c ) )
+            return nullptr;
+
+        Header* header = m.blocks[--m.count];
+        header->owner = cache;
+        header->sizeClass = (u32)c;
+        header->offset = SIZEOF(Header);
+
+        void* result = header + 1;
+        if( !params.IsSet( Memory::MF_NoClear ) )
+            ZEROP( result, sizeBytes );
+
+        return result;
+    }
+
+    void Free( void* memoryBlock )
+    {
+        if( !memoryBlock )
+            return;
+
+        Header* header = (Header*)memoryBlock - 1;
+        if( header->sizeClass == LargeClass )
+        {
+            Mutex::Scope lock( centralMutex );
+            central.Free( (u8*)memoryBlock - header->offset );
+            return;
+        }
+
+        ThreadCache* cache = GetThreadCache();
+        ThreadCache* owner = header->owner;
+        if( cache && owner == cache )
+            FreeLocal( cache, header );
+        else
+        {
+            RemoteBlock* block = (RemoteBlock*)header;
+            block->next = owner->remoteFrees.LOAD_RELAXED();
+            while( !owner->remoteFrees.compare_exchange_weak( block->next, block, std::memory_order_release,
+                                                              std::memory_order_relaxed ) )
+                ;
+        }
+    }
+
+    // Give all blocks cached by the calling thread back to the central heap, and release its cache slot
+    // Should be called by any thread using the heap before it exits
+    void FlushThreadCache()
+    {
+        ThreadCache* cache = GetThreadCache();
+        ThreadMemo() = {};
+        if( !cache )
+            return;
+
+        CollectRemoteFrees( cache );
+
+        {
+            Mutex::Scope lock( centralMutex );
+            for( Magazine& m : cache->magazines )
+            {
+                while( m.count )
+                    central.Free( m.blocks[--m.count] );
+            }
+        }
+
+        cache->threadId.STORE_RELEASE( 0 );
+    }
+
+private:
+    struct Memo
+    {
+        u64 heapId;
+        ThreadCache* cache;
+    };
+    static Memo& ThreadMemo()
+    {
+        static thread_local Memo memo = {};
+        return memo;
+    }
+
+    // Returns null when all slots are taken by other threads
+    ThreadCache* GetThreadCache()
+    {
+        // Fast path for the (very) common case where each thread keeps using the same heap
+        Memo& memo = ThreadMemo();
+        if( memo.heapId == heapId )
+            return memo.cache;
+
+        u32 threadId = Core::GetThreadId();
+        ThreadCache* result = nullptr;
+
+        int count = cacheCount.LOAD_ACQUIRE();
+        for( int i = 0; i < count && !result; ++i )
+            if( caches[i].threadId.LOAD_RELAXED() == threadId )
+                result = &caches[i];
+
+        // Reuse any released slot before adding a new one
+        for( int i = 0; i < count && !result; ++i )
+        {
+            u32 expected = 0;
+            if( caches[i].threadId.compare_exchange_strong( expected, threadId, std::memory_order_acq_rel ) )
+                result = &caches[i];
+        }
+
+        while( !result )
+        {
+            // New slots are visible as soon as the count is bumped, so some other thread looking for a released slot
+            // could claim it before us, in which case it's theirs and we just try the next one
+            int index = cacheCount.LOAD_ACQUIRE();
+            if( index >= MaxThreads )
+                break;
+            if( !cacheCount.compare_exchange_weak( index, index + 1, std::memory_order_acq_rel ) )
+                continue;
+
+            u32 expected = 0;
+            if( caches[index].threadId.compare_exchange_strong( expected, threadId, std::memory_order_acq_rel ) )
+                result = &caches[index];
+        }
+
+        // Remember a failure too, so threads over the limit don't rescan on every call. They can get a slot
+        // again after calling FlushThreadCache
+
+        memo = { heapId, result };
+        return result;
+    }
+
+    void FreeLocal( ThreadCache* cache, Header* header )
+    {
+        Magazine& m = cache->magazines[header->sizeClass];
+        if( m.count == MagazineSize )
+        {
+            // Give half back
+            Mutex::Scope lock( centralMutex );
+            while( m.count > MagazineSize / 2 )
+                central.Free( m.blocks[--m.count] );
+        }
+        m.blocks[m.count++] = header;
+    }
+
+    void CollectRemoteFrees( ThreadCache* cache )
+    {
+        RemoteBlock* block = cache->remoteFrees.exchange( nullptr, std::memory_order_acquire );
+        while( block )
+        {
+            RemoteBlock* next = block->next;
+            FreeLocal( cache, (Header*)block );
+            block = next;
+        }
+    }
+
+    bool Refill( ThreadCache* cache, int sizeClass )
+    {
+        Magazine& m = cache->magazines[sizeClass];
+
+        if( cache->remoteFrees.LOAD_RELAXED() )
+        {
+            CollectRemoteFrees( cache );
+            if( m.count )
+                return true;
+        }
+
+        sz blockSize = SIZEOF(Header) + ((sz)1 << (sizeClass + MinClassShift));
+
+        Mutex::Scope lock( centralMutex );
+        while( m.count < MagazineSize / 2 )
+        {
+            Header* block = (Header*)central.Alloc( blockSize, Memory::NoClear() );
+            if( !block )
+                break;
+            m.blocks[m.count++] = block;
+        }
+
+        return m.count > 0;
+    }
+
+    void* AllocLarge( sz sizeBytes, MemoryParams params )
+    {
+        sz align = Max( (sz)params.alignment, GenericHeap::Alignment );
+        // Leave enough room in front for the header while keeping the payload aligned
+        sz offset = AlignUp( SIZEOF(Header), align );
+
+        u8* block = nullptr;
+        {
+            Mutex::Scope lock( centralMutex );
+            MemoryParams centralParams = params;
+            centralParams.alignment = (u16)align;
+            block = (u8*)central.Alloc( sizeBytes + offset, centralParams );
+        }
+        if( !block )
+            return nullptr;
+
+        Header* header = (Header*)(block + offset) - 1;
+        header->owner = nullptr;
+        header->sizeClass = LargeClass;
+        header->offset = (u32)offset;
+
+        return block + offset;
+    }
+};
+
+INLINE ALLOC_FUNC( SyncHeap )
+{
+    return data->Alloc( sizeBytes, params );
+}
+
+INLINE FREE_FUNC( SyncHeap )
+{
+    data->Free( memoryBlock );
+}
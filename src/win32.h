@@ -55,4 +55,5 @@
 #define ANSI_ONLY
 
 #include <windows.h>
+#include <coroutine>
 
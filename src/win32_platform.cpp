@@ -50,7 +50,7 @@ namespace Win32
 
     struct State
     {
-        ThreadInfo liveThreads[16];
+        ThreadInfo liveThreads[64];
         sz threadCount;
         f64 appStartTimeMillis;
     };
@@ -73,6 +73,70 @@ namespace Win32
         VirtualFree( memoryBlock, 0, MEM_RELEASE );
     }
 
+    PLATFORM_RESERVE(Reserve)
+    {
+        return VirtualAlloc( 0, (size_t)sizeBytes, MEM_RESERVE, PAGE_NOACCESS );
+    }
+
+    PLATFORM_COMMIT(Commit)
+    {
+        return VirtualAlloc( address, (size_t)sizeBytes, MEM_COMMIT, PAGE_READWRITE ) != nullptr;
+    }
+
+    PLATFORM_DECOMMIT(Decommit)
+    {
+        VirtualFree( address, (size_t)sizeBytes, MEM_DECOMMIT );
+    }
+
+    PLATFORM_RELEASE(Release)
+    {
+        VirtualFree( address, 0, MEM_RELEASE );
+    }
+
+    PLATFORM_ALLOC_MIRRORED(AllocMirrored)
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo( &info );
+        sz size = AlignUp( sizeBytes, (sz)info.dwAllocationGranularity );
+
+        // Pagefile-backed section, so we can map it more than once
+        HANDLE section = CreateFileMappingA( INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                             (DWORD)((u64)size >> 32), (DWORD)((u64)size & 0xFFFFFFFF), nullptr );
+        if( !section )
+            return nullptr;
+
+        u8* result = nullptr;
+        // Find a free range big enough for both copies, then map the section over each half.
+        // Someone else could grab the range between releasing it and mapping the views, so retry a few times
+        for( int attempt = 0; attempt < 16 && !result; ++attempt )
+        {
+            u8* base = (u8*)VirtualAlloc( nullptr, (size_t)(2 * size), MEM_RESERVE, PAGE_NOACCESS );
+            if( !base )
+                break;
+            VirtualFree( base, 0, MEM_RELEASE );
+
+            void* first = MapViewOfFileEx( section, FILE_MAP_ALL_ACCESS, 0, 0, (size_t)size, base );
+            void* second = first ? MapViewOfFileEx( section, FILE_MAP_ALL_ACCESS, 0, 0, (size_t)size, base + size ) : nullptr;
+
+            if( first && second )
+                result = base;
+            else if( first )
+                UnmapViewOfFile( first );
+        }
+        // The views keep the section alive
+        CloseHandle( section );
+
+        if( result && sizeOut )
+            *sizeOut = size;
+        return result;
+    }
+
+    PLATFORM_FREE_MIRRORED(FreeMirrored)
+    {
+        UnmapViewOfFile( (u8*)address + sizeBytes );
+        UnmapViewOfFile( address );
+    }
+
     internal u64 FiletimeToPOSIX( FILETIME ft )
     {
         LARGE_INTEGER date, adjust;
@@ -129,6 +193,7 @@ namespace Win32
                     else
                     {
                         LogE( "Platform", "ReadFile failed for '%s'", filename );
+                        FREE( allocator, resultData );
                         resultData = nullptr;
                         resultLength = 0;
                     }
@@ -408,6 +473,13 @@ namespace Win32
         return globalThreadId == globalMainThreadId;
     }
 
+    PLATFORM_GET_CORE_COUNT(GetCoreCount)
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo( &info );
+        return (int)info.dwNumberOfProcessors;
+    }
+
     int Utf8ToWideString( const char* in, wchar_t* out, sz outSize )
     {
         return MultiByteToWideChar( CP_UTF8, 0, in, -1, out, (int)(outSize / sizeof(wchar_t)) );
@@ -434,6 +506,22 @@ namespace Win32
         ReleaseSemaphore( (HANDLE)handle, count, NULL );
     }
 
+    PLATFORM_FUTEX_WAIT(FutexWait)
+    {
+        ::WaitOnAddress( (volatile VOID*)address, &expected, sizeof(i32), INFINITE );
+    }
+
+    PLATFORM_FUTEX_WAKE(FutexWake)
+    {
+        if( count == I32MAX )
+            WakeByAddressAll( (PVOID)address );
+        else
+        {
+            for( int i = 0; i < count; ++i )
+                WakeByAddressSingle( (PVOID)address );
+        }
+    }
+
     PLATFORM_CREATE_MUTEX(CreateMutex)
     {
         // FIXME Maintain a list of these on the platform state
@@ -802,9 +890,16 @@ namespace Win32
         Platform::API win32API = {};
         win32API.Alloc                = Alloc;
         win32API.Free                 = Free;
+        win32API.Reserve              = Reserve;
+        win32API.Commit               = Commit;
+        win32API.Decommit             = Decommit;
+        win32API.Release              = Release;
+        win32API.AllocMirrored        = AllocMirrored;
+        win32API.FreeMirrored         = FreeMirrored;
         win32API.GetContext           = Platform::GetContext;
         win32API.PushContext          = Platform::PushContext;
         win32API.PopContext           = Platform::PopContext;
+        win32API.SwapContextStack     = Platform::SwapContextStack;
         win32API.GetFileAttributes    = GetFileAttributes;
         win32API.ReadEntireFile       = ReadEntireFile;
         win32API.WriteFileChunks      = WriteFileChunks;
@@ -813,10 +908,13 @@ namespace Win32
         win32API.JoinThread           = JoinThread;
         win32API.GetThreadId          = GetThreadId;
         win32API.IsMainThread         = IsMainThread;
+        win32API.GetCoreCount         = GetCoreCount;
         win32API.CreateSemaphore      = CreateSemaphore;
         win32API.DestroySemaphore     = DestroySemaphore;
         win32API.WaitSemaphore        = WaitSemaphore;
         win32API.SignalSemaphore      = SignalSemaphore;
+        win32API.FutexWait            = FutexWait;
+        win32API.FutexWake            = FutexWake;
         win32API.CreateMutex          = CreateMutex;
         win32API.DestroyMutex         = DestroyMutex;
         win32API.LockMutex            = LockMutex;
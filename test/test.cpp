@@ -1,16 +1,22 @@
 
+#if _WIN32
 #include "win32.h"
 #include <winsock2.h>
 #include <wininet.h>
 #include <DbgHelp.h>
 
 #pragma comment(lib, "wininet")
+#else
+#include "linux.h"
+#endif
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <atomic>
 #include <mutex>
+#include <algorithm>
+#include <filesystem>
 
 #define MBEDTLS_ALLOW_PRIVATE_ACCESS    // For accessing 'fd'
 #include "mbedtls/net_sockets.h"
@@ -31,6 +37,9 @@
 #pragma warning( pop )
 
 
+// Exercise the allocation tracker in all tests
+#define MEMORY_TRACKING 1
+
 #pragma warning( push )
 #pragma warning( disable : 5262 )
 #include "magic.h"
@@ -45,16 +54,25 @@
 #include "threading.h"
 #include "datatypes.h"
 #include "logging.h"
+#include "jobs.h"
+#include "tasks.h"
 #include "http.h"
 #include "serialization.h"
 #include "serialize_binary.h"
 
 #include "common.cpp"
 #include "strings.cpp"
+#include "memory.cpp"
 #include "logging.cpp"
+#include "jobs.cpp"
+#include "tasks.cpp"
 #include "http.cpp"
 #include "platform.cpp"
+#if _WIN32
 #include "win32_platform.cpp"
+#else
+#include "linux_platform.cpp"
+#endif
 #pragma warning( pop )
 
 #include "test.h"
@@ -130,6 +148,327 @@ TEST( Core, EnumStructs )
 
 // TODO Math tests
 
+//// Memory
+
+TEST( Memory, VirtualArena )
+{
+    MemoryArena arena;
+    InitVirtualArena( &arena, MEGABYTES(64), true );
+    ASSERT_TRUE( IsInitialized( arena ) );
+    ASSERT_EQ( arena.size, 0 );
+
+    u8* first = (u8*)PUSH_SIZE( &arena, 100 );
+    ASSERT_EQ( first, arena.base );
+    ASSERT_EQ( arena.size, DefaultArenaCommitSize );
+
+    {
+        ScopedTmpMemory tmp( &arena );
+
+        // Spans many commit pages, but must stay contiguous
+        u8* big = (u8*)PUSH_SIZE( &arena, MEGABYTES(3) );
+        ASSERT_EQ( big, first + AlignUp( 100, DefaultMemoryAlignment ) );
+        ASSERT_GE( arena.size, MEGABYTES(3) );
+        big[MEGABYTES(3) - 1] = 42;
+    }
+
+    // Rolling back should give back all pages we don't need anymore
+    ASSERT_EQ( arena.used, 100 );
+    ASSERT_EQ( arena.size, DefaultArenaCommitSize );
+    ASSERT_EQ( arena.pageCount, 0 );
+
+    // Memory must be zeroed when recommitted
+    u8* again = (u8*)PUSH_SIZE( &arena, MEGABYTES(3), Memory::NoClear() );
+    ASSERT_EQ( again[MEGABYTES(3) - 1], 0 );
+
+    ClearArena( &arena );
+    ASSERT_EQ( arena.used, 0 );
+    ASSERT_EQ( arena.size, 0 );
+    ASSERT_TRUE( IsInitialized( arena ) );
+
+    ReleaseArena( &arena );
+    ASSERT_FALSE( IsInitialized( arena ) );
+}
+
+TEST( Memory, PoolAllocator )
+{
+    PoolAllocator pool( MEGABYTES(16) );
+
+    ASSERT_EQ( PoolAllocator::SizeClassFor( 1 ), 0 );
+    ASSERT_EQ( PoolAllocator::SizeClassFor( 16 ), 0 );
+    ASSERT_EQ( PoolAllocator::SizeClassFor( 17 ), 1 );
+    ASSERT_EQ( PoolAllocator::SizeClassFor( 32 ), 1 );
+    ASSERT_EQ( PoolAllocator::SizeClassFor( 33 ), 2 );
+    ASSERT_EQ( PoolAllocator::SizeClassFor( PoolAllocator::MaxBlockSize ), PoolAllocator::ClassCount - 1 );
+
+    void* blocks[1000];
+    for( int i = 0; i < ARRAYCOUNT(blocks); ++i )
+    {
+        blocks[i] = ALLOC( &pool, 24 );
+        ASSERT_EQ( (uintptr_t)blocks[i] % 32, 0 );
+    }
+
+    PoolAllocator::Stats stats = pool.GetStats( 1 );
+    ASSERT_EQ( stats.blockSize, 32 );
+    ASSERT_EQ( stats.usedCount, 1000 );
+    ASSERT_EQ( stats.totalCount, 1000 );
+    ASSERT_EQ( stats.slabCount, 1 );
+
+    // Freed blocks must be reused before touching any new memory
+    FREE( &pool, blocks[10] );
+    FREE( &pool, blocks[20] );
+    void* b = ALLOC( &pool, 30 );
+    ASSERT_EQ( b, blocks[20] );
+    stats = pool.GetStats( 1 );
+    ASSERT_EQ( stats.usedCount, 999 );
+    ASSERT_EQ( stats.totalCount, 1000 );
+    ASSERT_EQ( stats.peakUsedCount, 1000 );
+
+    // Aligned requests are served from a big enough class
+    void* aligned = ALLOC( &pool, 8, Memory::Aligned( 256 ) );
+    ASSERT_EQ( (uintptr_t)aligned % 256, 0 );
+    ASSERT_EQ( pool.GetStats( PoolAllocator::SizeClassFor( 256 ) ).usedCount, 1 );
+
+    // Too big for any class
+    void* large = ALLOC( &pool, MEGABYTES(1) );
+    ASSERT_FALSE( pool.Owns( large ) );
+    ASSERT_EQ( pool.largeCount, 1 );
+    FREE( &pool, large );
+    ASSERT_EQ( pool.largeCount, 0 );
+
+    // Drop-in for containers
+    Allocator allocator = Allocator::CreateFrom( &pool );
+    Array<int> array( 100, &allocator );
+    for( int i = 0; i < 100; ++i )
+        array.Push( i );
+    ASSERT_TRUE( pool.Owns( array.data ) );
+    ASSERT_EQ( pool.GetStats( PoolAllocator::SizeClassFor( 100 * SIZEOF(int) ) ).usedCount, 1 );
+}
+
+TEST( Memory, GenericHeap )
+{
+    GenericHeap heap( MEGABYTES(1) );
+
+    // Fill up several chunks with blocks of random sizes, each tagged with its own index
+    static constexpr int blockCount = 4000;
+    u8* blocks[blockCount];
+    sz sizes[blockCount];
+
+    srand( 1234 );
+    for( int i = 0; i < blockCount; ++i )
+    {
+        sizes[i] = 1 + rand() % 2000;
+        blocks[i] = (u8*)ALLOC( &heap, sizes[i] );
+        ASSERT_TRUE( blocks[i] );
+        ASSERT_EQ( (uintptr_t)blocks[i] % GenericHeap::Alignment, 0 );
+        memset( blocks[i], i & 0xFF, SizeT( sizes[i] ) );
+    }
+    ASSERT_GT( heap.chunkCount, 1 );
+    ASSERT_EQ( heap.allocatedBlocks, blockCount );
+
+    // Free every other block and allocate them again (with more demanding alignment)
+    for( int i = 0; i < blockCount; i += 2 )
+        FREE( &heap, blocks[i] );
+    for( int i = 0; i < blockCount; i += 2 )
+    {
+        blocks[i] = (u8*)ALLOC( &heap, sizes[i], Memory::Aligned( 128 ) );
+        ASSERT_EQ( (uintptr_t)blocks[i] % 128, 0 );
+        memset( blocks[i], i & 0xFF, SizeT( sizes[i] ) );
+    }
+
+    // Nobody stepped on anybody else
+    for( int i = 0; i < blockCount; ++i )
+        for( sz j = 0; j < sizes[i]; ++j )
+            ASSERT_EQ( blocks[i][j], i & 0xFF );
+
+    // Bigger than a whole chunk
+    void* big = ALLOC( &heap, MEGABYTES(3) );
+    ASSERT_TRUE( big );
+    FREE( &heap, big );
+    // Not aligned to any bin boundary
+    for( sz size : { MEGABYTES(63) + 1, MEGABYTES(101), MEGABYTES(5) + 12345 } )
+    {
+        big = ALLOC( &heap, size, Memory::NoClear() );
+        ASSERT_TRUE( big );
+        ((u8*)big)[size - 1] = 42;
+        FREE( &heap, big );
+    }
+
+    // Once everything is freed, all but one chunk should have been returned
+    for( int i = 0; i < blockCount; ++i )
+        FREE( &heap, blocks[i] );
+    ASSERT_EQ( heap.allocatedBlocks, 0 );
+    ASSERT_EQ( heap.chunkCount, 1 );
+
+    // Drop-in for containers
+    Allocator allocator = Allocator::CreateFrom( &heap );
+    Array<int> array( 100, &allocator );
+    for( int i = 0; i < 100; ++i )
+        array.Push( i );
+    ASSERT_EQ( heap.allocatedBlocks, 1 );
+}
+
+TEST( Memory, Realloc )
+{
+    // The last block in an arena grows in place
+    MemoryArena arena;
+    InitVirtualArena( &arena, MEGABYTES(64) );
+    PUSH_SIZE( &arena, 100 );
+    u8* top = (u8*)ALLOC( &arena, 64 );
+    memset( top, 42, 64 );
+    u8* grown = (u8*)REALLOC( &arena, top, 64, MEGABYTES(2) );
+    ASSERT_EQ( grown, top );
+    ASSERT_EQ( grown[63], 42 );
+    ASSERT_EQ( grown[64], 0 );
+    ASSERT_EQ( arena.used, (u8*)grown + MEGABYTES(2) - arena.base );
+
+    // ..but anything below the top needs moving
+    u8* other = (u8*)ALLOC( &arena, 16 );
+    u8* moved = (u8*)REALLOC( &arena, grown, MEGABYTES(2), MEGABYTES(2) + 16 );
+    ASSERT_GT( moved, other );
+    ASSERT_EQ( moved[63], 42 );
+    ReleaseArena( &arena );
+
+    // Pool blocks stay put while the size class doesn't change
+    PoolAllocator pool( MEGABYTES(16) );
+    u8* small = (u8*)ALLOC( &pool, 20 );
+    small[19] = 7;
+    ASSERT_EQ( REALLOC( &pool, small, 20, 32 ), small );
+    u8* bigger = (u8*)REALLOC( &pool, small, 32, 33 );
+    ASSERT_NE( bigger, small );
+    ASSERT_EQ( bigger[19], 7 );
+    ASSERT_EQ( pool.GetStats( PoolAllocator::SizeClassFor( 32 ) ).usedCount, 0 );
+
+    // Heap blocks absorb a free neighbour
+    GenericHeap heap( MEGABYTES(1) );
+    u8* a = (u8*)ALLOC( &heap, 256 );
+    u8* b = (u8*)ALLOC( &heap, 256 );
+    u8* c = (u8*)ALLOC( &heap, 256 );
+    memset( a, 1, 256 );
+    FREE( &heap, b );
+    u8* a2 = (u8*)REALLOC( &heap, a, 256, 400 );
+    ASSERT_EQ( a2, a );
+    ASSERT_EQ( a2[255], 1 );
+    ASSERT_EQ( heap.allocatedBlocks, 2 );
+    // No more room before c
+    u8* a3 = (u8*)REALLOC( &heap, a2, 400, 1024 );
+    ASSERT_NE( a3, a2 );
+    ASSERT_EQ( a3[255], 1 );
+    ASSERT_EQ( heap.allocatedBlocks, 2 );
+    FREE( &heap, a3 );
+    FREE( &heap, c );
+    ASSERT_EQ( heap.allocatedBlocks, 0 );
+
+    // Type-erased allocators forward to the right implementation
+    Allocator allocator = Allocator::CreateFrom( &heap );
+    void* p = ALLOC( &allocator, 64 );
+    ASSERT_EQ( REALLOC( &allocator, p, 64, 48 ), p );
+    FREE( &allocator, p );
+}
+
+TEST( Memory, Tracking )
+{
+    GenericHeap heap;
+    Memory::Snapshot before = Memory::TakeSnapshot( CTX_ALLOC );
+
+    void* blocks[10];
+    for( void*& b : blocks )
+        b = ALLOC( &heap, 100, Memory::Tagged( 42 ) );
+    int allocLine = __LINE__ - 1;
+    FREE( &heap, blocks[0] );
+    FREE( &heap, blocks[1] );
+
+    Memory::Snapshot after = Memory::TakeSnapshot( CTX_ALLOC );
+    Memory::Snapshot diff = Memory::Diff( before, after, CTX_ALLOC );
+
+    Memory::TrackingStats const& tag = diff.tags[42];
+    ASSERT_EQ( tag.liveBytes, 800 );
+    ASSERT_EQ( tag.liveCount, 8 );
+    ASSERT_EQ( tag.allocCount, 10 );
+    ASSERT_GE( tag.peakBytes, 1000 );
+
+    Memory::SiteStats const* site = nullptr;
+    for( Memory::SiteStats const& s : diff.sites )
+        if( s.line == allocLine )
+            site = &s;
+    ASSERT_TRUE( site );
+    ASSERT_EQ( site->tag, 42 );
+    ASSERT_EQ( site->stats.liveBytes, 800 );
+    ASSERT_EQ( site->stats.allocCount, 10 );
+
+    // Global arenas are registered on init
+    bool foundTmp = false;
+    for( Memory::ArenaStats const& a : diff.arenas )
+        foundTmp = foundTmp || StringEquals( a.name, "Tmp" );
+    ASSERT_TRUE( foundTmp );
+
+    for( int i = 2; i < ARRAYCOUNT(blocks); ++i )
+        FREE( &heap, blocks[i] );
+
+    // Arena blocks are never tracked, even through a type-erased allocator
+    MemoryArena arena;
+    InitArena( &arena );
+    Allocator arenaAllocator = Allocator::CreateFrom( &arena );
+    for( int i = 0; i < 10; ++i )
+        ALLOC( &arenaAllocator, 100, Memory::Tagged( 42 ) );
+    Allocator passThrough( &arenaAllocator );
+    ALLOC( &passThrough, 100, Memory::Tagged( 42 ) );
+
+    Memory::Snapshot end = Memory::TakeSnapshot( CTX_ALLOC );
+    ASSERT_EQ( end.tags[42].liveBytes, before.tags[42].liveBytes );
+    ASSERT_EQ( end.tags[42].liveCount, before.tags[42].liveCount );
+    ASSERT_EQ( end.tags[42].allocCount, before.tags[42].allocCount + 10 );
+    ReleaseArena( &arena );
+
+    // Snapshots (and diffs) don't count themselves
+    for( Memory::SiteStats const& s : end.sites )
+        ASSERT_FALSE( strstr( s.filename, "memory.cpp" ) && s.stats.liveCount );
+
+    std::string reportPath = (std::filesystem::temp_directory_path() / "memory_report.csv").string();
+    ASSERT_TRUE( Memory::WriteCSVReport( diff, reportPath.c_str() ) );
+    ASSERT_EQ( remove( reportPath.c_str() ), 0 );
+
+    Memory::FreeSnapshot( &before, CTX_ALLOC );
+    Memory::FreeSnapshot( &after, CTX_ALLOC );
+    Memory::FreeSnapshot( &diff, CTX_ALLOC );
+    Memory::FreeSnapshot( &end, CTX_ALLOC );
+}
+
+//// Logging
+
+static LOG_ENDPOINT(FloodingEndpoint)
+{
+    // Log from the logging thread itself, way more than the entry queue can take
+    if( StringEquals( entry.msg, "Flood" ) )
+    {
+        for( int i = 0; i < 5000; ++i )
+            LogI( "Core", "Flooded %d", i );
+    }
+    ((atomic_i32*)userdata)->fetch_add( 1 );
+}
+
+TEST( Logging, FullBuffers )
+{
+    Logging::State* prevState = CTX.logState;
+
+    Logging::ChannelDecl channels[] = { { "Core" } };
+    Logging::State state;
+    Logging::Init( &state, (Buffer<Logging::ChannelDecl>)channels );
+
+    atomic_i32 received( 0 );
+    Logging::AttachEndpoint( "StandardOut", FloodingEndpoint, &received );
+    LogI( "Core", "Flood" );
+
+    // Whatever didn't fit is dropped instead of waiting forever for ourselves
+    f64 start = globalPlatform.ElapsedTimeMillis();
+    while( received.load() < state.entryQueue.capacity && globalPlatform.ElapsedTimeMillis() - start < 10000 )
+        Yield();
+    ASSERT_GE( received.load(), state.entryQueue.capacity );
+    ASSERT_GT( state.droppedCount.load(), 0u );
+
+    Logging::Shutdown( &state );
+    CTX.logState = prevState;
+}
+
 //// Serialization
 
 TEST( Serialization, SerializeSimpleType )
@@ -164,241 +503,2234 @@ TEST( Serialization, SerializeComplexType )
 
     LOG( "Size of serialized SerialTypeComplex: %I64d", buffer.count );
 
-    BinaryReader r( &buffer );
-    SerialTypeComplex after;
-    ret = Reflect( r, after );
-    ASSERT_TRUE( (bool)ret );
+    BinaryReader r( &buffer );
+    SerialTypeComplex after;
+    ret = Reflect( r, after );
+    ASSERT_TRUE( (bool)ret );
+
+    ASSERT_TRUE( before == after );
+}
+
+TEST( Serialization, SerializeReorderedAttribute )
+{
+    BucketArray<u8> buffer( 128, CTX_TMPALLOC );
+    BinaryWriter w( &buffer );
+
+    SerialTypeComplex before = { { 42 }, {}, "Hello sailor" };
+    INIT( before.nums )( { 0, 1, 2, 3, 4, 5, 6, 7 } );
+
+    ReflectResult ret = Reflect( w, before );
+    ASSERT_TRUE( (bool)ret );
+
+    BinaryReader r( &buffer );
+    SerialTypeComplex2 after;
+
+    ret = Reflect( r, after );
+    ASSERT_TRUE( (bool)ret );
+
+    ASSERT_TRUE( after == before );
+}
+
+TEST( Serialization, SerializeRemovedAttribute )
+{
+    BucketArray<u8> buffer( 128, CTX_TMPALLOC );
+    BinaryWriter w( &buffer );
+
+    SerialTypeComplex before = { { 42 }, {}, "Hello sailor" };
+    INIT( before.nums )( { 0, 1, 2, 3, 4, 5, 6, 7 } );
+    ReflectResult ret = Reflect( w, before );
+    ASSERT_TRUE( (bool)ret );
+
+    BinaryReader r( &buffer );
+    SerialTypeComplex3 after;
+    ret = Reflect( r, after );
+    ASSERT_TRUE( (bool)ret );
+
+    ASSERT_TRUE( after == before );
+}
+
+TEST( Serialization, SerializeChunkyType )
+{
+    BucketArray<u8> buffer( 2048, CTX_TMPALLOC );
+    BinaryWriter w( &buffer );
+
+    SerialTypeDeeper deeper =
+    {
+        { // SerialTypeDeep
+            { { 42 }, {}, "Hello sailor" }, // SerialTypeComplex
+            666
+        },
+        "Apartense vacas, que la vida es corta"
+    };
+    INIT( deeper.deep.complexx.nums )( { 0, 1, 2, 3, 4, 5, 6, 7 } );
+
+    SerialTypeChunky before;
+    before.deeper.Reset( 8000 );
+    for( int i = 0; i < before.deeper.capacity; ++i )
+        before.deeper.Push( MOVE( deeper ) );
+    ReflectResult ret = Reflect( w, before );
+    ASSERT_TRUE( (bool)ret );
+
+    LOG( "Size of serialized SerialTypeChunky: %I64d", buffer.count );
+
+    BinaryReader r( &buffer );
+    SerialTypeChunky after;
+    ret = Reflect( r, after );
+    ASSERT_TRUE( (bool)ret );
+
+    ASSERT_TRUE( after == before );
+}
+
+//// Data types
+
+class DatatypesTest : public testing::Test
+{
+protected:
+    // Per-test-suite set-up.
+    // Called before the first test in this test suite.
+    // Can be omitted if not needed.
+    static void SetUpTestCase()
+    {
+    }
+
+    // Per-test-suite tear-down.
+    // Called after the last test in this test suite.
+    // Can be omitted if not needed.
+    static void TearDownTestCase()
+    {
+    }
+
+    // Per-test setup/teardown
+    virtual void SetUp()
+    { }
+    virtual void TearDown()
+    { }
+};
+
+TEST_F( DatatypesTest, ArrayBasics )
+{
+    Array<int> array( 100 );
+
+    // TODO 
+}
+
+TEST_F( DatatypesTest, DynArrayGrowth )
+{
+    MemoryArena arena;
+    InitVirtualArena( &arena, MEGABYTES(64) );
+
+    DynArray<int, MemoryArena> array( 0, &arena );
+    ASSERT_EQ( array.capacity, 0 );
+    for( int i = 0; i < 1000; ++i )
+        array.Push( i );
+    ASSERT_EQ( array.count, 1000 );
+    ASSERT_EQ( array.capacity, 1024 );
+    // Always at the top of the arena, so it never had to move
+    ASSERT_EQ( (u8*)array.data, arena.base );
+    ASSERT_EQ( arena.used, 1024 * SIZEOF(int) );
+    for( int i = 0; i < 1000; ++i )
+        ASSERT_EQ( array[i], i );
+
+    int more[100];
+    for( int i = 0; i < 100; ++i )
+        more[i] = 1000 + i;
+    array.Push( more, 100 );
+    ASSERT_EQ( array.count, 1100 );
+    ASSERT_EQ( array.Last(), 1099 );
+
+    array.ShrinkToFit();
+    ASSERT_EQ( array.capacity, 1100 );
+    ASSERT_EQ( arena.used, 1100 * SIZEOF(int) );
+
+    // Still growable after being moved into a plain Array
+    Array<int, MemoryArena> plain( std::move( array ) );
+    plain.Push( 1100 );
+    ASSERT_EQ( plain.count, 1101 );
+    ASSERT_EQ( plain.Last(), 1100 );
+
+    plain.Clear();
+    plain.ShrinkToFit();
+    ASSERT_EQ( plain.capacity, 0 );
+    ASSERT_EQ( plain.data, nullptr );
+
+    ReleaseArena( &arena );
+
+    // Pushing our own items while full still reads them from the right place after growing
+    LazyAllocator lazy;
+    DynArray<int, LazyAllocator> self( 0, &lazy );
+    for( int i = 0; i < 8; ++i )
+        self.Push( i + 1 );
+    ASSERT_EQ( self.count, self.capacity );
+    self.Push( self[3] );
+    ASSERT_EQ( self.Last(), 4 );
+
+    self.ShrinkToFit();
+    self.Push( self.data, self.count );
+    ASSERT_EQ( self.count, 18 );
+    for( int i = 0; i < 9; ++i )
+        ASSERT_EQ( self[9 + i], self[i] );
+}
+
+TEST_F( DatatypesTest, SmallArrayBasics )
+{
+    SmallArray<int, 4> array;
+    ASSERT_TRUE( array.IsInline() );
+
+    for( int i = 0; i < 4; ++i )
+        array.Push( i );
+    ASSERT_TRUE( array.IsInline() );
+    ASSERT_EQ( array.capacity, 4 );
+
+    // Spill
+    for( int i = 4; i < 20; ++i )
+        array.Push( i );
+    ASSERT_FALSE( array.IsInline() );
+    ASSERT_EQ( array.count, 20 );
+    for( int i = 0; i < 20; ++i )
+        ASSERT_EQ( array[i], i );
+
+    int const seven = 7;
+    ASSERT_TRUE( array.Contains( seven ) );
+    int* found = array.Find( []( int v ) { return v > 18; } );
+    ASSERT_EQ( *found, 19 );
+
+    // Removal swaps the last item in
+    array.Remove( array.Find( seven ) );
+    ASSERT_FALSE( array.Contains( seven ) );
+    ASSERT_EQ( array[7], 19 );
+    ASSERT_EQ( array.Pop(), 18 );
+    ASSERT_EQ( array.count, 18 );
+
+    // Moving a spilled array steals its buffer
+    int* data = array.data;
+    SmallArray<int, 4> moved( std::move( array ) );
+    ASSERT_EQ( moved.data, data );
+    ASSERT_EQ( moved.count, 18 );
+    ASSERT_TRUE( array.IsInline() );
+    ASSERT_TRUE( array.Empty() );
+
+    // Moving an inline array copies its items over
+    SmallArray<int, 4> small;
+    small.Push( 1 );
+    small.Push( 2 );
+    SmallArray<int, 4> smallMoved( std::move( small ) );
+    ASSERT_TRUE( smallMoved.IsInline() );
+    ASSERT_EQ( smallMoved.count, 2 );
+    ASSERT_EQ( smallMoved.Last(), 2 );
+
+    Array<int> other( 3 );
+    other.Push( 10 );
+    other.Push( 11 );
+    other.Push( 12 );
+    smallMoved.Append( other );
+    ASSERT_FALSE( smallMoved.IsInline() );
+    ASSERT_EQ( smallMoved.count, 5 );
+    ASSERT_EQ( smallMoved.Last(), 12 );
+}
+
+TEST_F( DatatypesTest, SmallArrayLifetimes )
+{
+    struct Tracked
+    {
+        int* alive;
+        Tracked( int* a ) : alive( a ) { ++*alive; }
+        Tracked( Tracked&& o ) : alive( o.alive ) { ++*alive; }
+        Tracked& operator =( Tracked&& o ) { alive = o.alive; return *this; }
+        ~Tracked() { --*alive; }
+    };
+
+    int alive = 0;
+    {
+        SmallArray<Tracked, 2> array;
+        for( int i = 0; i < 10; ++i )
+            array.PushInit( &alive );
+        ASSERT_EQ( alive, 10 );
+
+        array.Remove( &array[3] );
+        ASSERT_EQ( alive, 9 );
+        while( array.count > 4 )
+            array.Pop();
+        ASSERT_EQ( alive, 4 );
+    }
+    ASSERT_EQ( alive, 0 );
+
+    // Pushing our own items while full, both when spilling and when growing the spilled buffer
+    SmallArray<std::string, 2> strings;
+    strings.Push( std::string( 40, 'a' ) );
+    strings.Push( std::string( 40, 'b' ) );
+    strings.Push( strings[0] );
+    strings.Push( strings[1] );
+    ASSERT_EQ( strings.count, strings.capacity );
+    strings.Push( std::move( strings[2] ) );
+    ASSERT_EQ( strings[4], std::string( 40, 'a' ) );
+    ASSERT_EQ( strings[3], std::string( 40, 'b' ) );
+    strings.Push( strings.data, strings.count );
+    ASSERT_EQ( strings.count, 10 );
+    ASSERT_EQ( strings[9], std::string( 40, 'a' ) );
+    ASSERT_EQ( strings[8], std::string( 40, 'b' ) );
+
+    // Moving into itself leaves it alone
+    SmallArray<std::string, 2>& same = strings;
+    strings = std::move( same );
+    ASSERT_EQ( strings.count, 10 );
+    ASSERT_EQ( strings[0], std::string( 40, 'a' ) );
+}
+
+TEST_F( DatatypesTest, SmallArraySerialization )
+{
+    BucketArray<u8> buffer( 128, CTX_TMPALLOC );
+    BinaryWriter w( &buffer );
+
+    SmallArray<i32, 4> before;
+    for( int i = 0; i < 10; ++i )
+        before.Push( i * 3 );
+    ASSERT_TRUE( (bool)Reflect( w, before ) );
+
+    BinaryReader r( &buffer );
+    SmallArray<i32, 4> after;
+    after.Push( 666 );
+    ASSERT_TRUE( (bool)Reflect( r, after ) );
+
+    ASSERT_EQ( after.count, before.count );
+    for( int i = 0; i < before.count; ++i )
+        ASSERT_EQ( after[i], before[i] );
+}
+
+TEST_F( DatatypesTest, SoAArray )
+{
+    SoALayoutReflector const& layout = SoAArray<SoATypeParticle>::Layout();
+    ASSERT_EQ( layout.fieldCount, 5 );
+    ASSERT_STREQ( layout.fields[3].name, "simple" );
+    ASSERT_EQ( layout.fields[3].size, SIZEOF(SerialTypeSimple) );
+    ASSERT_EQ( layout.fields[4].offset, offsetof( SoATypeParticle, flags ) );
+
+    Array<SoATypeParticle> particles( 100 );
+    for( int i = 0; i < 100; ++i )
+        particles.Push( { (f32)i, (f32)-i, 1.f + i, { i * 10 }, (u8)i, 666u } );
+
+    SoAArray<SoATypeParticle> soa( (Buffer<SoATypeParticle>)particles );
+    ASSERT_EQ( soa.count, 100 );
+
+    // Columns are contiguous & aligned
+    Buffer<f32> mass = soa.Column( &SoATypeParticle::mass );
+    ASSERT_EQ( mass.length, 100 );
+    ASSERT_EQ( (uintptr_t)mass.data % SoAArray<SoATypeParticle>::ColumnAlignment, 0 );
+    f32 total = 0;
+    for( f32 m : mass )
+        total += m;
+    ASSERT_EQ( total, 100.f + 99 * 100 / 2 );
+
+    Buffer<SerialTypeSimple> simple = soa.Column( &SoATypeParticle::simple );
+    ASSERT_EQ( simple[42].num, 420 );
+    ASSERT_EQ( soa.Column<u8>( 4 )[7], 7 );
+
+    // Records come back whole, except for unreflected fields
+    SoATypeParticle p = soa.Get( 42 );
+    ASSERT_EQ( p.x, 42.f );
+    ASSERT_EQ( p.y, -42.f );
+    ASSERT_EQ( p.simple.num, 420 );
+    ASSERT_EQ( p.scratch, 0u );
+
+    // Remove swaps the last record in
+    soa.Remove( 10 );
+    ASSERT_EQ( soa.count, 99 );
+    ASSERT_EQ( soa.Get( 10 ).x, 99.f );
+    ASSERT_EQ( soa.Column( &SoATypeParticle::flags )[10], 99 );
+
+    // Growing keeps everything in place
+    for( int i = 0; i < 1000; ++i )
+        soa.Push( { 0.f, 0.f, 0.f, { -i }, 0, 0 } );
+    ASSERT_EQ( soa.count, 1099 );
+    ASSERT_EQ( soa.Get( 10 ).simple.num, 990 );
+    ASSERT_EQ( soa.Get( 1098 ).simple.num, -999 );
+
+    Array<SoATypeParticle> back = soa.ToArray();
+    ASSERT_EQ( back.count, 1099 );
+    ASSERT_EQ( back[42].mass, 43.f );
+    ASSERT_EQ( back[10].flags, 99 );
+
+    // Moving into a populated array gives its old columns back
+    {
+        PoolAllocator pool( MEGABYTES(16) );
+        auto usedBlocks = [&pool]()
+        {
+            i32 result = pool.largeCount;
+            for( int c = 0; c < PoolAllocator::ClassCount; ++c )
+                result += pool.GetStats( c ).usedCount;
+            return result;
+        };
+
+        SoAArray<SoATypeParticle, PoolAllocator> target( 10, &pool );
+        target.Push( particles[1] );
+        SoAArray<SoATypeParticle, PoolAllocator> source( 20, &pool );
+        source.Push( particles[2] );
+        ASSERT_EQ( usedBlocks(), 2 );
+
+        target = std::move( source );
+        ASSERT_EQ( usedBlocks(), 1 );
+        ASSERT_EQ( target.count, 1 );
+        ASSERT_EQ( target.Get( 0 ).x, 2.f );
+        ASSERT_EQ( source.columns, nullptr );
+
+        SoAArray<SoATypeParticle, PoolAllocator> moved( std::move( target ) );
+        ASSERT_EQ( usedBlocks(), 1 );
+        ASSERT_EQ( moved.Get( 0 ).simple.num, 20 );
+    }
+}
+
+TEST_F( DatatypesTest, BucketArraySpans )
+{
+    BucketArray<int> array( 16 );
+
+    // Single bucket is just a view
+    for( int i = 0; i < 10; ++i )
+        array.Push( i );
+    Buffer<int> linear = array.Linearize();
+    ASSERT_EQ( linear.data, &array[0] );
+    ASSERT_EQ( linear.length, 10 );
+
+    for( int i = 10; i < 100; ++i )
+        array.Push( i );
+    for( int i = 0; i < 100; ++i )
+        ASSERT_EQ( array[i], i );
+
+    int spanCount = 0, next = 0;
+    for( Buffer<int> span : array.Spans() )
+    {
+        ASSERT_LE( span.length, 16 );
+        for( int i = 0; i < span.length; ++i )
+            ASSERT_EQ( span.data[i], next++ );
+        spanCount++;
+    }
+    ASSERT_EQ( spanCount, 7 );
+    ASSERT_EQ( next, 100 );
+
+    next = 0;
+    array.ForEachSpan( [&next]( Buffer<int> const& span )
+    {
+        for( int i = 0; i < span.length; ++i )
+            next += span.data[i] == next ? 1 : 0;
+    } );
+    ASSERT_EQ( next, 100 );
+
+    Buffer<int> span = array.SpanAt( 40 );
+    ASSERT_EQ( span.data, &array[40] );
+    ASSERT_EQ( span.length, 8 );
+    span = array.SpanAt( 97 );
+    ASSERT_EQ( span.length, 3 );
+
+    // Multiple buckets get copied
+    linear = array.Linearize();
+    ASSERT_EQ( linear.length, 100 );
+    for( int i = 0; i < 100; ++i )
+        ASSERT_EQ( linear.data[i], i );
+
+    BucketArray<char> chars( 8 );
+    chars.Push( "Hello world", 11 );
+    String str = String::CloneTmp( chars );
+    ASSERT_TRUE( str == "Hello world" );
+    ASSERT_TRUE( str.flags & String::Temporary );
+}
+
+TEST_F( DatatypesTest, SlotMap )
+{
+    using Map = SlotMap<int>;
+    Map map;
+
+    Map::Handle h1 = map.Insert( 1 );
+    Map::Handle h2 = map.Insert( 2 );
+    Map::Handle h3 = map.Insert( 3 );
+    ASSERT_TRUE( h1 && h2 && h3 );
+    ASSERT_FALSE( Map::Handle{} );
+    ASSERT_EQ( map.Get( Map::Handle{} ), nullptr );
+    ASSERT_EQ( *map.Get( h2 ), 2 );
+
+    // Removing from the middle keeps the rest packed and reachable
+    ASSERT_TRUE( map.Remove( h1 ) );
+    ASSERT_FALSE( map.Remove( h1 ) );
+    ASSERT_EQ( map.count, 2 );
+    ASSERT_EQ( map.items[0], 3 );
+    ASSERT_EQ( *map.Get( h3 ), 3 );
+    ASSERT_EQ( map.HandleAt( 0 ), h3 );
+
+    // The slot gets reused, but old handles don't resolve to the new item
+    Map::Handle h4 = map.Insert( 4 );
+    ASSERT_EQ( h4.Index(), h1.Index() );
+    ASSERT_NE( h4, h1 );
+    ASSERT_EQ( map.Get( h1 ), nullptr );
+    ASSERT_EQ( *map.Get( h4 ), 4 );
+
+    map.Clear();
+    ASSERT_TRUE( map.Empty() );
+    ASSERT_FALSE( map.Contains( h2 ) );
+    ASSERT_FALSE( map.Contains( h4 ) );
+
+    // Random churn against a reference table
+    SlotMap<u64, u64> big( 0, CTX_TMPALLOC );
+    Hashtable<u64, u64> reference( 0 );
+    Array<SlotMap<u64, u64>::Handle> live( 20000 );
+    Array<SlotMap<u64, u64>::Handle> dead( 20000 );
+
+    srand( 42 );
+    for( int i = 0; i < 20000; ++i )
+    {
+        if( live.count && rand() % 3 == 0 )
+        {
+            int r = rand() % live.count;
+            SlotMap<u64, u64>::Handle h = live[r];
+            ASSERT_TRUE( big.Remove( h ) );
+            live.Remove( &live[r] );
+            dead.Push( h );
+        }
+        else
+        {
+            SlotMap<u64, u64>::Handle h = big.Insert( (u64)i );
+            reference.Put( h.id, (u64)i );
+            live.Push( h );
+        }
+    }
+
+    ASSERT_EQ( big.count, live.count );
+    for( SlotMap<u64, u64>::Handle h : live )
+        ASSERT_EQ( *big.Get( h ), *reference.Get( h.id ) );
+    for( SlotMap<u64, u64>::Handle h : dead )
+        ASSERT_FALSE( big.Contains( h ) );
+
+    // Iterating the dense items matches their handles
+    for( int i = 0; i < big.count; ++i )
+        ASSERT_EQ( big.items[i], *reference.Get( big.HandleAt( i ).id ) );
+
+    // Inserting our own items while full, and moving into a populated map
+    {
+        LazyAllocator lazy;
+        SlotMap<std::string, u32, LazyAllocator> strings( 0, &lazy );
+        for( int i = 0; i < 16; ++i )
+            strings.Insert( std::string( 40, (char)('a' + i) ) );
+        ASSERT_EQ( strings.count, strings.capacity );
+        auto h = strings.Insert( strings.items[3] );
+        ASSERT_EQ( *strings.Get( h ), std::string( 40, 'd' ) );
+
+        SlotMap<std::string, u32, LazyAllocator> other( 0, &lazy );
+        other.Insert( std::string( 40, 'z' ) );
+        other = std::move( strings );
+        ASSERT_EQ( other.count, 17 );
+        ASSERT_EQ( *other.Get( h ), std::string( 40, 'd' ) );
+        ASSERT_EQ( strings.count, 0 );
+
+        SlotMap<std::string, u32, LazyAllocator> moved( std::move( other ) );
+        ASSERT_EQ( moved.count, 17 );
+        ASSERT_EQ( other.items, nullptr );
+    }
+}
+
+template <typename T>
+static void CheckRadixSort( sz count, T (*gen)() )
+{
+    T* keys = ALLOC_ARRAY( CTX_TMPALLOC, T, count );
+    T* expected = ALLOC_ARRAY( CTX_TMPALLOC, T, count );
+    for( sz i = 0; i < count; ++i )
+        keys[i] = expected[i] = gen();
+
+    RadixSort( keys, count );
+    std::sort( expected, expected + count );
+    for( sz i = 0; i < count; ++i )
+        ASSERT_EQ( keys[i], expected[i] ) << "at " << i << " of " << count;
+}
+
+TEST_F( DatatypesTest, RadixSort )
+{
+    // Cover the sorting network, insertion sort and radix paths
+    sz sizes[] = { 0, 1, 2, 7, 8, 9, 16, 17, 63, 64, 1000, 100000 };
+    srand( 1234 );
+    for( sz n : sizes )
+    {
+        CheckRadixSort<i32>( n, []() { return (i32)(rand() - RAND_MAX / 2); } );
+        CheckRadixSort<u32>( n, []() { return (u32)rand() * 7919u; } );
+        CheckRadixSort<i16>( n, []() { return (i16)rand(); } );
+        CheckRadixSort<u64>( n, []() { return ((u64)rand() << 33) ^ (u64)rand(); } );
+        CheckRadixSort<i64>( n, []() { return ((i64)rand() << 20) - ((i64)RAND_MAX << 19); } );
+        CheckRadixSort<f32>( n, []() { return (f32)(rand() - RAND_MAX / 2) / 1000.f; } );
+        CheckRadixSort<f64>( n, []() { return (f64)(rand() - RAND_MAX / 2) * 1e-3; } );
+    }
+
+    // Values follow their keys, and equal keys keep their order
+    Array<u32> keys( 5000 );
+    Array<u32> indices( 5000 );
+    for( u32 i = 0; i < 5000; ++i )
+    {
+        keys.Push( (u32)rand() % 100 );
+        indices.Push( i );
+    }
+    Array<u32> original = keys.Clone();
+    RadixSort( keys.data, indices.data, keys.count );
+    for( int i = 0; i < keys.count; ++i )
+    {
+        ASSERT_EQ( keys[i], original[indices[i]] );
+        if( i > 0 )
+        {
+            ASSERT_LE( keys[i - 1], keys[i] );
+            if( keys[i - 1] == keys[i] )
+            {
+                ASSERT_LT( indices[i - 1], indices[i] );
+            }
+        }
+    }
+
+    // Scratch memory is given back, whatever it came from
+    {
+        PoolAllocator pool( MEGABYTES(16) );
+        RadixSort( original.data, indices.data, original.count, &pool );
+        RadixSort( original.data, original.count, &pool );
+        ASSERT_EQ( pool.largeCount, 0 );
+        for( int c = 0; c < PoolAllocator::ClassCount; ++c )
+            ASSERT_EQ( pool.GetStats( c ).usedCount, 0 );
+    }
+
+    // Strings
+    char const* words[] = { "banana", "apple", "", "app", "apples", "b", "zebra", "apple", "\xff", "ban" };
+    Array<String> strings( 2000 );
+    for( int i = 0; i < 2000; ++i )
+    {
+        if( i < ARRAYCOUNT(words) )
+            strings.Push( String( words[i] ) );
+        else
+        {
+            char* buf = ALLOC_ARRAY( CTX_TMPALLOC, char, 8 );
+            int len = rand() % 8;
+            for( int c = 0; c < len; ++c )
+                buf[c] = 'a' + rand() % 4;
+            buf[len] = 0;
+            strings.Push( String( buf ) );
+        }
+    }
+    RadixSort( strings );
+    for( int i = 1; i < strings.count; ++i )
+    {
+        String const& a = strings[i - 1];
+        String const& b = strings[i];
+        int cmp = memcmp( a.data, b.data, SizeT( Min( a.length, b.length ) ) );
+        ASSERT_TRUE( cmp < 0 || (cmp == 0 && a.length <= b.length) ) << a.data << " > " << b.data;
+    }
+    ASSERT_EQ( strings[0].length, 0 );
+
+    // Owned strings on a real heap (scratch & string memory is reused, so any clone / free would show up)
+    {
+        persistent LazyAllocator lazyAllocator;
+        Context ctx = CTX;
+        ctx.allocator = Allocator::CreateFrom( &lazyAllocator );
+        ctx.tmpAllocator = Allocator::CreateFrom( &lazyAllocator );
+        WITH_CONTEXT( ctx );
+
+        for( int round = 0; round < 4; ++round )
+        {
+            Array<String, LazyAllocator> owned( 200, &lazyAllocator );
+            std::vector<std::string> expected;
+            for( int i = 0; i < 200; ++i )
+            {
+                char buf[16];
+                snprintf( buf, sizeof(buf), "s%d", rand() % 1000 );
+                owned.Push( String( buf ) );
+                expected.push_back( buf );
+            }
+            RadixSort( owned.data, owned.count, &lazyAllocator );
+            std::sort( expected.begin(), expected.end() );
+
+            for( int i = 0; i < owned.count; ++i )
+                ASSERT_TRUE( owned[i] == expected[i].c_str() ) << owned[i].data << " != " << expected[i];
+            for( String& s : owned )
+                s.~String();
+        }
+    }
+}
+
+TEST_F( DatatypesTest, HashtablePutGet )
+{
+    persistent LazyAllocator lazyAllocator;
+    Hashtable<void*, void*, LazyAllocator> table( 0, &lazyAllocator );
+
+    const int N = 128 * 1024;
+    for( int i = 1; i < N; ++i )
+        table.Put( (void*)i, (void*)(i + 1) );
+    for( int i = 1; i < N; ++i )
+        ASSERT_EQ( *table.Get( (void*)i ), (void*)(i + 1) );
+}
+
+TEST_F( DatatypesTest, HashtableRemove )
+{
+    Hashtable<u64, u64> table;
+
+    const int N = 10000;
+    for( int i = 1; i <= N; ++i )
+        table.Put( (u64)i, (u64)i * 2 );
+
+    // Remove every third key
+    for( int i = 1; i <= N; i += 3 )
+        ASSERT_TRUE( table.Remove( (u64)i ) );
+    ASSERT_FALSE( table.Remove( 1 ) );
+    ASSERT_FALSE( table.Remove( N + 1 ) );
+
+    int expectedCount = 0;
+    for( int i = 1; i <= N; ++i )
+    {
+        u64 const* value = table.Get( (u64)i );
+        if( (i - 1) % 3 == 0 )
+            ASSERT_EQ( value, nullptr );
+        else
+        {
+            ASSERT_TRUE( value != nullptr );
+            ASSERT_EQ( *value, (u64)i * 2 );
+            expectedCount++;
+        }
+    }
+    ASSERT_EQ( table.count, expectedCount );
+
+    // Reinsert over the removed slots
+    for( int i = 1; i <= N; i += 3 )
+        table.Put( (u64)i, 0 );
+    ASSERT_EQ( table.count, N );
+    ASSERT_EQ( *table.Get( 1 ), 0u );
+
+    int capacity = table.capacity;
+    table.Clear();
+    ASSERT_TRUE( table.Empty() );
+    ASSERT_EQ( table.capacity, capacity );
+    ASSERT_EQ( table.Get( 2 ), nullptr );
+
+    table.Reserve( N );
+    ASSERT_EQ( table.capacity, capacity );
+    table.Reserve( 4 * N );
+    ASSERT_GT( table.capacity, capacity );
+
+    // Reserving exactly what fits doesn't reallocate, and neither does filling it up
+    Hashtable<u64, u64> small( 8 );
+    ASSERT_EQ( small.capacity, 16 );
+    u64* keys = small.keys;
+    small.Reserve( 8 );
+    ASSERT_EQ( small.keys, keys );
+    for( int i = 1; i <= 8; ++i )
+        small.Put( (u64)i, (u64)i );
+    ASSERT_EQ( small.keys, keys );
+    small.Reserve( 9 );
+    ASSERT_NE( small.keys, keys );
+    ASSERT_EQ( small.capacity, 32 );
+    ASSERT_EQ( *small.Get( 8 ), 8u );
+}
+
+TEST_F( DatatypesTest, HashtableStringKeys )
+{
+    Hashtable<String, int> table;
+
+    char buffer[32];
+    for( int i = 0; i < 1000; ++i )
+    {
+        snprintf( buffer, sizeof(buffer), "key%d", i );
+        table.Put( String( buffer ), i );
+    }
+    for( int i = 0; i < 1000; i += 2 )
+    {
+        snprintf( buffer, sizeof(buffer), "key%d", i );
+        ASSERT_TRUE( table.Remove( String( buffer ) ) );
+    }
+    ASSERT_EQ( table.count, 500 );
+
+    for( int i = 0; i < 1000; ++i )
+    {
+        snprintf( buffer, sizeof(buffer), "key%d", i );
+        int const* value = table.Get( String( buffer ) );
+        if( i & 1 )
+        {
+            ASSERT_TRUE( value != nullptr );
+            ASSERT_EQ( *value, i );
+        }
+        else
+            ASSERT_EQ( value, nullptr );
+    }
+}
+
+TEST_F( DatatypesTest, HashtableSparseIteration )
+{
+    Hashtable<u64, u64> table( 100000 );
+
+    // A few scattered entries, including the default-constructed key
+    u64 keys[] = { 0, 3, 64, 1000, 77777, 123456789 };
+    for( u64 k : keys )
+        table.Put( k, k + 1 );
+    ASSERT_TRUE( table.Get( 0 ) != nullptr );
+    ASSERT_EQ( *table.Get( 0 ), 1u );
+
+    int seen = 0;
+    u64 keySum = 0;
+    for( auto it = table.Items(); it; ++it )
+    {
+        ASSERT_EQ( (*it).value, (*it).key + 1 );
+        keySum += (*it).key;
+        seen++;
+    }
+    ASSERT_EQ( seen, (int)ARRAYCOUNT(keys) );
+    ASSERT_EQ( keySum, 0u + 3 + 64 + 1000 + 77777 + 123456789 );
+
+    ASSERT_TRUE( table.Remove( 0 ) );
+    ASSERT_EQ( table.Get( 0 ), nullptr );
+    table.Clear();
+    ASSERT_FALSE( table.Keys() );
+}
+
+TEST_F( DatatypesTest, BitSet )
+{
+    ASSERT_EQ( PopCount( 0xF0F0u ), 8 );
+    ASSERT_EQ( PopCount( ~(u64)0 ), 64 );
+    ASSERT_EQ( CountLeadingZeros( 1u ), 31 );
+    ASSERT_EQ( CountLeadingZeros( (u64)0 ), 64 );
+    ASSERT_EQ( CountTrailingZeros( 0x80u ), 7 );
+    ASSERT_EQ( CountTrailingZeros( 0u ), 32 );
+    ASSERT_EQ( DepositBits( (u64)0b101, (u64)0xF0 ), (u64)0x50 );
+    ASSERT_EQ( DepositBits( 0b11u, 0x8001u ), 0x8001u );
+    ASSERT_EQ( SelectBit( (u64)0b101100, 2 ), 5 );
+
+    BitSet<200> a;
+    ASSERT_TRUE( a.None() );
+    ASSERT_EQ( a.FindNext(), -1 );
+
+    int indices[] = { 0, 5, 63, 64, 130, 199 };
+    for( int i : indices )
+        a.Set( i );
+    ASSERT_EQ( a.Count(), (int)ARRAYCOUNT(indices) );
+    ASSERT_TRUE( a[63] && a[64] && !a[65] );
+
+    int n = 0;
+    for( int i : a )
+        ASSERT_EQ( i, indices[n++] );
+    ASSERT_EQ( n, (int)ARRAYCOUNT(indices) );
+
+    for( int k = 0; k < (int)ARRAYCOUNT(indices); ++k )
+    {
+        ASSERT_EQ( a.Select( k ), indices[k] );
+        ASSERT_EQ( a.Rank( indices[k] ), k );
+    }
+    ASSERT_EQ( a.Select( (int)ARRAYCOUNT(indices) ), -1 );
+    ASSERT_EQ( a.Rank( 200 ), (int)ARRAYCOUNT(indices) );
+    ASSERT_EQ( a.FindNext( 65 ), 130 );
+    ASSERT_EQ( a.FindNextClear( 63 ), 65 );
+
+    BitSet<200> b;
+    b.SetAll();
+    ASSERT_EQ( b.Count(), 200 );
+    ASSERT_EQ( b.FindNextClear(), -1 );
+    b.Clear( 64 );
+    b.Toggle( 130 );
+
+    BitSet<200> c = a;
+    c &= b;
+    ASSERT_EQ( c.Count(), 4 );
+    ASSERT_FALSE( c[64] || c[130] );
+    c = a;
+    c.AndNot( b );
+    ASSERT_EQ( c.Count(), 2 );
+    ASSERT_TRUE( c[64] && c[130] );
+    c |= b;
+    ASSERT_EQ( c.Count(), 200 );
+    c ^= b;
+    ASSERT_EQ( c.Count(), 2 );
+    ASSERT_TRUE( c != a );
+
+    // Dynamic version
+    BitArray<> bits( 1000 );
+    ASSERT_TRUE( bits.None() );
+    for( int i = 0; i < 1000; i += 7 )
+        bits.Set( i );
+    ASSERT_EQ( bits.Count(), 143 );
+    ASSERT_EQ( bits.Select( 10 ), 70 );
+    ASSERT_EQ( bits.Rank( 71 ), 11 );
+
+    BitArray<> mask( 1000 );
+    mask.SetAll();
+    for( int i = 0; i < 1000; i += 2 )
+        mask.Clear( i );
+    bits &= mask;
+    n = 0;
+    for( int i : bits )
+    {
+        ASSERT_EQ( i % 14, 7 );
+        n++;
+    }
+    ASSERT_EQ( n, bits.Count() );
+
+    // Shrinking clears the tail, so growing again starts with clear bits
+    bits.Resize( 10 );
+    ASSERT_EQ( bits.Count(), 1 );
+    bits.Resize( 2000 );
+    ASSERT_EQ( bits.Count(), 1 );
+    ASSERT_EQ( bits.FindNext( 8 ), -1 );
+
+    // Moving into a populated array gives its old words back
+    {
+        PoolAllocator pool( MEGABYTES(16) );
+        BitArray<PoolAllocator> target( 100, &pool );
+        BitArray<PoolAllocator> source( 300, &pool );
+        source.Set( 299 );
+        int targetClass = PoolAllocator::SizeClassFor( 2 * SIZEOF(u64) );
+        ASSERT_NE( targetClass, PoolAllocator::SizeClassFor( 5 * SIZEOF(u64) ) );
+        ASSERT_EQ( pool.GetStats( targetClass ).usedCount, 1 );
+
+        target = std::move( source );
+        ASSERT_EQ( pool.GetStats( targetClass ).usedCount, 0 );
+        ASSERT_EQ( target.count, 300 );
+        ASSERT_TRUE( target.Test( 299 ) );
+
+        BitArray<PoolAllocator> moved( std::move( target ) );
+        ASSERT_EQ( moved.Count(), 1 );
+        ASSERT_EQ( target.words, nullptr );
+    }
+}
+
+TEST_F( DatatypesTest, FlatHashtablePutGet )
+{
+    FlatHashtable<u64, u64> table;
+
+    // Zero is a valid key here
+    const int N = 128 * 1024;
+    for( int i = 0; i < N; ++i )
+        table.Put( (u64)i, (u64)i + 1 );
+    ASSERT_EQ( table.count, N );
+    for( int i = 0; i < N; ++i )
+        ASSERT_EQ( *table.Get( (u64)i ), (u64)i + 1 );
+    ASSERT_EQ( table.Get( (u64)N ), nullptr );
+
+    bool occupied;
+    u64* value = table.GetOrPut( 42, &occupied );
+    ASSERT_TRUE( occupied );
+    ASSERT_EQ( *value, 43u );
+    table.Put( 42, 0 );
+    ASSERT_EQ( *table.Get( 42 ), 0u );
+    ASSERT_EQ( table.count, N );
+
+    int itemCount = 0;
+    for( auto it = table.Items(); it; ++it )
+    {
+        ASSERT_EQ( (*it).value, (*it).key == 42 ? 0 : (*it).key + 1 );
+        itemCount++;
+    }
+    ASSERT_EQ( itemCount, N );
+}
+
+TEST_F( DatatypesTest, FlatHashtableRemove )
+{
+    FlatHashtable<u64, u64> table;
+    Hashtable<u64, u64> reference;
+
+    // Churn through a lot of inserts & removes so tombstones pile up and get cleaned
+    srand( 1234 );
+    for( int i = 0; i < 200000; ++i )
+    {
+        u64 key = (u64)(rand() % 5000) + 1;
+        if( rand() % 2 )
+        {
+            table.Put( key, (u64)i );
+            reference.Put( key, (u64)i );
+        }
+        else
+            ASSERT_EQ( table.Remove( key ), reference.Remove( key ) );
+    }
+    ASSERT_EQ( table.count, reference.count );
+    ASSERT_LE( table.capacity, 16 * 1024 );
+
+    for( u64 key = 1; key <= 5000; ++key )
+    {
+        u64 const* value = table.Get( key );
+        u64 const* expected = reference.Get( key );
+        if( expected )
+        {
+            ASSERT_TRUE( value != nullptr );
+            ASSERT_EQ( *value, *expected );
+        }
+        else
+            ASSERT_EQ( value, nullptr );
+    }
+
+    int capacity = table.capacity;
+    table.Clear();
+    ASSERT_TRUE( table.Empty() );
+    ASSERT_EQ( table.capacity, capacity );
+    ASSERT_EQ( table.Get( 1 ), nullptr );
+
+    table.Reserve( 100 );
+    ASSERT_EQ( table.capacity, capacity );
+    table.Reserve( 100000 );
+    ASSERT_GT( table.capacity, capacity );
+}
+
+TEST_F( DatatypesTest, FlatHashtableStringKeys )
+{
+    FlatHashtable<String, int> table( 16 );
+
+    char buffer[32];
+    for( int i = 0; i < 1000; ++i )
+    {
+        snprintf( buffer, sizeof(buffer), "key%d", i );
+        table.Put( String( buffer ), i );
+    }
+    ASSERT_EQ( table.count, 1000 );
+
+    for( int i = 0; i < 1000; ++i )
+    {
+        snprintf( buffer, sizeof(buffer), "key%d", i );
+        int const* value = table.Get( String( buffer ) );
+        ASSERT_TRUE( value != nullptr );
+        ASSERT_EQ( *value, i );
+    }
+    ASSERT_EQ( table.Get( "nope" ), nullptr );
+}
+
+TEST_F( DatatypesTest, ConcurrentHashtableBasics )
+{
+    persistent LazyAllocator lazyAllocator;
+    ConcurrentHashtable<u64, u64, LazyAllocator> table( 0, &lazyAllocator );
+    ASSERT_TRUE( table.Empty() );
+
+    const int N = 10000;
+    for( int i = 1; i <= N; ++i )
+        table.Put( (u64)i, (u64)i * 3 );
+    ASSERT_EQ( table.Count(), N );
+
+    u64 value;
+    for( int i = 1; i <= N; ++i )
+    {
+        ASSERT_TRUE( table.Get( (u64)i, &value ) );
+        ASSERT_EQ( value, (u64)i * 3 );
+    }
+    ASSERT_FALSE( table.Get( N + 1, &value ) );
+
+    bool occupied;
+    ASSERT_EQ( table.GetOrPut( 5, 0, &occupied ), 15u );
+    ASSERT_TRUE( occupied );
+    ASSERT_EQ( table.GetOrPut( N + 1, 7, &occupied ), 7u );
+    ASSERT_FALSE( occupied );
+
+    table.Update( 5, []( u64& v ) { v++; } );
+    ASSERT_TRUE( table.Get( 5, &value ) );
+    ASSERT_EQ( value, 16u );
+
+    ASSERT_TRUE( table.Remove( 5 ) );
+    ASSERT_FALSE( table.Contains( 5 ) );
+    ASSERT_EQ( table.Count(), N );
+
+    table.Clear();
+    ASSERT_TRUE( table.Empty() );
+}
+
+template <typename DataType>
+void TestPushPop()
+{
+    DataType buffer( 128 );
+    ASSERT_EQ( buffer.Count(), 0 );
+
+    for( int i = 0; i < buffer.Capacity(); ++i )
+        buffer.Push( i );
+    ASSERT_EQ( buffer.Count(), buffer.Capacity() );
+
+    for( int i = 0; i < buffer.Capacity(); ++i )
+    {
+        int x;
+        bool res = buffer.TryPop( &x );
+        ASSERT_TRUE( res );
+        ASSERT_EQ( x, i );
+    }
+    ASSERT_EQ( buffer.Count(), 0 );
+
+    for( int i = 0; i < buffer.Capacity(); ++i )
+        buffer.Push( i );
+    ASSERT_EQ( buffer.Count(), buffer.Capacity() );
+
+    for( int i = 0; i < buffer.Capacity(); ++i )
+    {
+        int x;
+        bool res = buffer.TryPopHead( &x );
+        ASSERT_TRUE( res );
+        ASSERT_EQ( x, buffer.Capacity() - i - 1 );
+    }
+    ASSERT_EQ( buffer.Count(), 0 );
+}
+
+TEST_F( DatatypesTest, RingBufferBasics )
+{
+    TestPushPop< RingBuffer<int> >();
+}
+
+TEST_F( DatatypesTest, SyncRingBufferBasics )
+{
+    SyncRingBuffer<int> buffer( 128 );
+    ASSERT_TRUE( buffer.Empty() );
+
+    // Go around a few times
+    for( int lap = 0; lap < 3; ++lap )
+    {
+        for( int i = 0; i < buffer.Capacity(); ++i )
+            ASSERT_TRUE( buffer.Push( i ) );
+        ASSERT_EQ( buffer.Count(), buffer.Capacity() );
+        // Full buffers don't overwrite
+        ASSERT_FALSE( buffer.Push( -1 ) );
+
+        for( int i = 0; i < buffer.Capacity(); ++i )
+        {
+            int x;
+            ASSERT_TRUE( buffer.TryPop( &x ) );
+            ASSERT_EQ( x, i );
+        }
+        int x;
+        ASSERT_FALSE( buffer.TryPop( &x ) );
+        ASSERT_TRUE( buffer.Empty() );
+    }
+}
+
+TEST_F( DatatypesTest, SpscQueueBasics )
+{
+    SpscQueue<int> q( 64 );
+
+    // Go around a few times
+    int items[100];
+    for( int i = 0; i < ARRAYCOUNT(items); ++i )
+        items[i] = i;
+    for( int lap = 0; lap < 3; ++lap )
+    {
+        for( int i = 0; i < 10; ++i )
+            ASSERT_TRUE( q.Push( i ) );
+        // Only fits as many as there's room for
+        ASSERT_EQ( q.PushN( items + 10, 90 ), 54 );
+        ASSERT_FALSE( q.Push( -1 ) );
+        ASSERT_EQ( q.Count(), 64 );
+
+        int x;
+        ASSERT_TRUE( q.TryPop( &x ) );
+        ASSERT_EQ( x, 0 );
+
+        int out[100];
+        ASSERT_EQ( q.PopN( out, 100 ), 63 );
+        for( int i = 0; i < 63; ++i )
+            ASSERT_EQ( out[i], i + 1 );
+        ASSERT_FALSE( q.TryPop( &x ) );
+        ASSERT_TRUE( q.Empty() );
+    }
+}
+
+TEST_F( DatatypesTest, MirroredRingBuffer )
+{
+    MirroredRingBuffer<char> buffer( 4096 );
+    int capacity = buffer.Capacity();
+    ASSERT_GE( capacity, 4096 );
+
+    // Both copies see the same memory
+    buffer.data[10] = 'x';
+    ASSERT_EQ( buffer.data[capacity + 10], 'x' );
+    buffer.data[capacity + 20] = 'y';
+    ASSERT_EQ( buffer.data[20], 'y' );
+    buffer.data[10] = buffer.data[20] = 0;
+
+    // Keep pushing records of varying lengths so they wrap around the end many times
+    char const* text = "Apartense vacas, que la vida es corta";
+    int textLen = StringLength( text );
+    char* pending[3] = {};
+    for( int i = 0; i < 1000; ++i )
+    {
+        int len = 1 + i % textLen;
+        char* record = buffer.Push( text, len );
+        ASSERT_TRUE( record );
+
+        // Release them in a different order than they were pushed
+        int slot = i % 3;
+        if( pending[slot] )
+        {
+            int prevLen = 1 + (i - 3) % textLen;
+            ASSERT_EQ( memcmp( pending[slot], text, SizeT( prevLen ) ), 0 );
+            buffer.Release( pending[slot] );
+        }
+        pending[slot] = record;
+    }
+
+    // Space is only reclaimed in order
+    buffer.Release( pending[2] );
+    ASSERT_FALSE( buffer.Empty() );
+    buffer.Release( pending[0] );
+    buffer.Release( pending[1] );
+    ASSERT_TRUE( buffer.Empty() );
+
+    // Fill it up
+    int recordCount = 0;
+    while( buffer.PushEmpty( 100 ) )
+        recordCount++;
+    ASSERT_GT( recordCount, 0 );
+    ASSERT_GT( buffer.Count(), capacity - 120 );
+}
+
+TEST_F( DatatypesTest, SyncQueuePushPop )
+{
+    SyncQueue<int> q( 128 );
+
+    const int N = 128 * 1024;
+    for( int i = 0; i < N; ++i )
+        q.Push( i );
+    ASSERT_EQ( q.Count(), N );
+    int const last = N - 1;
+    ASSERT_TRUE( q.Contains( last ) );
+    int* found = q.Find( []( int const& it ) { return it > 1000; } );
+    ASSERT_TRUE( found );
+    ASSERT_EQ( *found, 1001 );
+
+    for( int i = 0; i < N; ++i )
+    {
+        int it;
+        bool res = q.TryPop( &it );
+        ASSERT_TRUE( res );
+        ASSERT_EQ( it, i );
+    }
+    int it;
+    ASSERT_FALSE( q.TryPop( &it ) );
+    ASSERT_FALSE( q.Contains( last ) );
+}
+
+
+//// Threading
+
+template <typename T>
+PLATFORM_THREAD_FUNC(MutexTesterThread);
+template <typename T>
+struct MutexTester
+{
+    T mutex;
+    const int iterationCount;
+    const int threadCount;
+    i64 value;
+
+    MutexTester( int threadCount_, int iterationCount_ )
+        : iterationCount( iterationCount_ )
+        , threadCount( threadCount_ )
+        , value( 0 )
+    {}
+
+    void Test()
+    {
+        value = 0;
+
+        Array<Platform::ThreadHandle> threads( threadCount );
+        for (int i = 0; i < threadCount; i++)
+            threads.Push( Core::CreateThread( "Test thread", MutexTesterThread<T>, this, {} ) );
+        for( Platform::ThreadHandle& t : threads )
+            Core::JoinThread( t );
+
+        ASSERT_EQ( value, threadCount * iterationCount );
+    }
+};
+template <typename T>
+PLATFORM_THREAD_FUNC(MutexTesterThread)
+{
+    MutexTester<T>* tester = (MutexTester<T>*)userdata;
+
+    for( int i = 0; i < tester->iterationCount; i++ )
+    {
+        tester->mutex.Lock();
+        tester->value++;
+        tester->mutex.Unlock();
+    }
+    return 0;
+}
+
+TEST( Threading, MutexTest )
+{
+    MutexTester<Mutex>( 4, 100000 ).Test();
+    MutexTester<FutexMutex>( 4, 100000 ).Test();
+    MutexTester<PlatformMutex>( 4, 100000 ).Test();
+
+    //MutexTester<Benaphore<PlatformSemaphore>>( 4, 10000 ).Test();
+    MutexTester<Benaphore<PreshingSemaphore>>( 4, 100000 ).Test();
+    MutexTester<Benaphore<Semaphore>>( 4, 100000 ).Test();
+    MutexTester<Benaphore<FutexSemaphore>>( 4, 100000 ).Test();
+
+    //MutexTester<RecursiveBenaphore<PlatformSemaphore>>( 4, 10000 ).Test();
+    MutexTester<RecursiveBenaphore<PreshingSemaphore>>( 4, 100000 ).Test();
+    MutexTester<RecursiveBenaphore<Semaphore>>( 4, 100000 ).Test();
+    MutexTester<RecursiveBenaphore<FutexSemaphore>>( 4, 100000 ).Test();
+}
+
+struct EventTester
+{
+    static constexpr int roundCount = 10000;
+
+    FutexSemaphore ping;
+    FutexSemaphore pong;
+    AutoResetEvent request;
+    AutoResetEvent reply;
+    Event start;
+    atomic_i32 started;
+    atomic_i32 value;
+};
+
+PLATFORM_THREAD_FUNC(PingPongThread)
+{
+    EventTester* t = (EventTester*)userdata;
+    for( int i = 0; i < EventTester::roundCount; ++i )
+    {
+        t->ping.Wait();
+        t->value.fetch_add( 1, std::memory_order_relaxed );
+        t->pong.Signal();
+    }
+    for( int i = 0; i < EventTester::roundCount; ++i )
+    {
+        t->request.Wait();
+        t->value.fetch_add( 1, std::memory_order_relaxed );
+        t->reply.Set();
+    }
+    return 0;
+}
+
+PLATFORM_THREAD_FUNC(EventWaiterThread)
+{
+    EventTester* t = (EventTester*)userdata;
+    t->started.fetch_add( 1 );
+    t->start.Wait();
+    t->value.fetch_add( 1 );
+    return 0;
+}
+
+TEST( Threading, FutexPrimitives )
+{
+    // Hand control back and forth, so every wait has to actually block (or spin) on the other thread
+    {
+        EventTester t;
+        t.value = 0;
+        Platform::ThreadHandle thread = Core::CreateThread( "Test thread", PingPongThread, &t, {} );
+
+        for( int i = 0; i < EventTester::roundCount; ++i )
+        {
+            t.ping.Signal();
+            t.pong.Wait();
+            ASSERT_EQ( t.value.LOAD_RELAXED(), i + 1 );
+        }
+        for( int i = 0; i < EventTester::roundCount; ++i )
+        {
+            t.request.Set();
+            t.reply.Wait();
+            ASSERT_EQ( t.value.LOAD_RELAXED(), EventTester::roundCount + i + 1 );
+        }
+        Core::JoinThread( thread );
+
+        ASSERT_FALSE( t.ping.TryWait() );
+        ASSERT_FALSE( t.pong.TryWait() );
+    }
+
+    // Semaphore signals accumulate, while setting an already set auto-reset event does nothing
+    {
+        FutexSemaphore s( 2 );
+        s.Signal( 3 );
+        for( int i = 0; i < 5; ++i )
+            ASSERT_TRUE( s.TryWait() );
+        ASSERT_FALSE( s.TryWait() );
+
+        AutoResetEvent e;
+        e.Set();
+        e.Set();
+        e.Wait();
+    }
+
+    // A manual-reset event lets everybody through
+    {
+        const int threadCount = 8;
+        EventTester t;
+        t.started = 0;
+        t.value = 0;
+
+        Platform::ThreadHandle threads[threadCount];
+        for( Platform::ThreadHandle& thread : threads )
+            thread = Core::CreateThread( "Test thread", EventWaiterThread, &t, {} );
+        while( t.started.load() < threadCount )
+            Yield();
+        ASSERT_EQ( t.value.load(), 0 );
+
+        t.start.Set();
+        for( Platform::ThreadHandle& thread : threads )
+            Core::JoinThread( thread );
+        ASSERT_EQ( t.value.load(), threadCount );
+
+        ASSERT_TRUE( t.start.IsSet() );
+        t.start.Wait();
+        t.start.Reset();
+        ASSERT_FALSE( t.start.IsSet() );
+    }
+}
+
+// SyncQueue is unbounded, so pushing always succeeds
+INLINE bool TryPush( SyncRingBuffer<u32>& q, u32 item ) { return q.Push( item ); }
+INLINE bool TryPush( SyncQueue<u32>& q, u32 item ) { q.Push( item ); return true; }
+
+template <typename QueueType>
+struct QueueTester
+{
+    static constexpr int producerCount = 4;
+    static constexpr int consumerCount = 4;
+    static constexpr int itemsPerProducer = 20000;
+    static constexpr int totalCount = producerCount * itemsPerProducer;
+
+    // Small enough that the ring buffer is full or empty most of the time, and the queue needs lots of blocks
+    QueueType queue;
+    atomic_i32 nextProducerIndex;
+    atomic_i32 poppedCount;
+    atomic_i32 failed;
+    // Number of times each item has been popped
+    atomic_i32* seen;
+
+    QueueTester()
+        : queue( 64 )
+        , nextProducerIndex( 0 )
+        , poppedCount( 0 )
+        , failed( 0 )
+    {
+        seen = new atomic_i32[totalCount]();
+    }
+    ~QueueTester()
+    {
+        delete[] seen;
+    }
+
+    static PLATFORM_THREAD_FUNC(Producer)
+    {
+        QueueTester* tester = (QueueTester*)userdata;
+        u32 p = (u32)tester->nextProducerIndex.fetch_add( 1 );
+
+        for( u32 i = 0; i < itemsPerProducer; ++i )
+            while( !TryPush( tester->queue, (p << 24) | i ) )
+                std::this_thread::yield();
+        return 0;
+    }
+
+    static PLATFORM_THREAD_FUNC(Consumer)
+    {
+        QueueTester* tester = (QueueTester*)userdata;
+
+        // Items from any given producer must come out in the order they were pushed
+        i32 lastIndex[producerCount];
+        for( i32& i : lastIndex )
+            i = -1;
+
+        while( tester->poppedCount.LOAD_RELAXED() < totalCount )
+        {
+            u32 item;
+            if( !tester->queue.TryPop( &item ) )
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            u32 p = item >> 24;
+            i32 i = (i32)(item & 0xFFFFFF);
+            if( p >= producerCount || i <= lastIndex[p] )
+                tester->failed.STORE_RELAXED( 1 );
+            lastIndex[p] = i;
+
+            tester->seen[p * itemsPerProducer + i].fetch_add( 1 );
+            tester->poppedCount.fetch_add( 1 );
+        }
+        return 0;
+    }
+
+    void Test()
+    {
+        Platform::ThreadHandle threads[producerCount + consumerCount];
+        for( int i = 0; i < ARRAYCOUNT(threads); ++i )
+            threads[i] = Core::CreateThread( "Test thread", i < producerCount ? Producer : Consumer, this, {} );
+        for( Platform::ThreadHandle& t : threads )
+            Core::JoinThread( t );
+
+        ASSERT_EQ( failed.LOAD_RELAXED(), 0 );
+        ASSERT_TRUE( queue.Empty() );
+        // Every item popped exactly once
+        for( int i = 0; i < totalCount; ++i )
+            ASSERT_EQ( seen[i].LOAD_RELAXED(), 1 );
+    }
+};
+
+TEST( Threading, SyncRingBufferStress )
+{
+    QueueTester<SyncRingBuffer<u32>>().Test();
+}
+
+TEST( Threading, SyncQueueStress )
+{
+    QueueTester<SyncQueue<u32>>().Test();
+
+    // Blocks are cache line aligned even when the allocator can't do that for us
+    {
+        LazyAllocator lazy;
+        SyncQueue<u32, LazyAllocator> queue( 16, &lazy );
+        for( u32 i = 0; i < 100; ++i )
+            queue.Push( i );
+
+        u32 value;
+        for( u32 i = 0; i < 100; ++i )
+        {
+            ASSERT_TRUE( queue.TryPop( &value ) );
+            ASSERT_EQ( value, i );
+        }
+        ASSERT_FALSE( queue.TryPop( &value ) );
+    }
+}
+
+struct SpscQueueTester
+{
+    static constexpr int itemCount = 200000;
+
+    SpscQueue<int> queue;
+    i64 sum;
+
+    SpscQueueTester()
+        : queue( 256 )
+        , sum( 0 )
+    {}
+};
+PLATFORM_THREAD_FUNC(SpscQueueProducer)
+{
+    SpscQueueTester* tester = (SpscQueueTester*)userdata;
+
+    // Mix single and batched pushes
+    int batch[32];
+    for( int i = 0; i < SpscQueueTester::itemCount; )
+    {
+        int pushed = 0;
+        if( i % 3 )
+            pushed = tester->queue.Push( i ) ? 1 : 0;
+        else
+        {
+            int n = Min( I32( ARRAYCOUNT(batch) ), SpscQueueTester::itemCount - i );
+            for( int j = 0; j < n; ++j )
+                batch[j] = i + j;
+            pushed = tester->queue.PushN( batch, n );
+        }
+
+        if( !pushed )
+            std::this_thread::yield();
+        i += pushed;
+    }
+    return 0;
+}
+
+TEST( Threading, SpscQueue )
+{
+    SpscQueueTester tester;
+    Platform::ThreadHandle producer = Core::CreateThread( "Test thread", SpscQueueProducer, &tester, {} );
+
+    // Block while the queue is empty, and check everything comes out in order
+    int next = 0;
+    int batch[16];
+    while( next < SpscQueueTester::itemCount )
+    {
+        int n = tester.queue.PopNWait( batch, I32( ARRAYCOUNT(batch) ) );
+        for( int i = 0; i < n; ++i )
+            ASSERT_EQ( batch[i], next++ );
+    }
+    Core::JoinThread( producer );
+    ASSERT_TRUE( tester.queue.Empty() );
+}
+
+// Readers check they never see a half-written value
+struct CheckedValue
+{
+    u64 a, b;
+};
+// Not trivially copyable, so reads go through the shard locks instead
+struct LockedCheckedValue : public CheckedValue
+{
+    LockedCheckedValue() = default;
+    LockedCheckedValue( LockedCheckedValue const& other ) : CheckedValue( other ) {}
+    LockedCheckedValue& operator =( LockedCheckedValue const& other ) { a = other.a; b = other.b; return *this; }
+};
+
+template <typename ValueType>
+PLATFORM_THREAD_FUNC(ConcurrentHashtableTesterThread);
+template <typename ValueType>
+struct ConcurrentHashtableTester
+{
+    static constexpr int threadCount = 4;
+    static constexpr int keysPerThread = 1000;
+    static constexpr int iterationCount = 20000;
+
+    LazyAllocator allocator;
+    ConcurrentHashtable<u64, ValueType, LazyAllocator> table;
+    atomic_i32 nextThreadIndex;
+
+    ConcurrentHashtableTester()
+        : table( 0, &allocator )
+        , nextThreadIndex( 0 )
+    {}
+
+    void Test()
+    {
+        Platform::ThreadHandle threads[threadCount];
+        for( Platform::ThreadHandle& t : threads )
+            t = Core::CreateThread( "Test thread", ConcurrentHashtableTesterThread<ValueType>, this, {} );
+        int failedCount = 0;
+        for( Platform::ThreadHandle& t : threads )
+            failedCount += Core::JoinThread( t );
+        ASSERT_EQ( failedCount, 0 );
+
+        // Every thread leaves all its keys in
+        ASSERT_EQ( table.Count(), threadCount * keysPerThread );
+    }
+};
+template <typename ValueType>
+PLATFORM_THREAD_FUNC(ConcurrentHashtableTesterThread)
+{
+    using TesterType = ConcurrentHashtableTester<ValueType>;
+    TesterType* tester = (TesterType*)userdata;
+    int t = tester->nextThreadIndex.fetch_add( 1 );
+
+    // Each thread writes to its own range of keys, but reads from all of them
+    srand( 1234 + t );
+    bool ok = true;
+    for( int i = 0; i < TesterType::iterationCount; ++i )
+    {
+        u64 key = (u64)(t * TesterType::keysPerThread + rand() % TesterType::keysPerThread + 1);
+        int op = rand() % 8;
+        if( op == 0 )
+            tester->table.Remove( key );
+        else if( op < 3 )
+        {
+            ValueType value;
+            value.a = (u64)i;
+            value.b = ~value.a;
+            tester->table.Put( key, value );
+        }
+        else
+        {
+            u64 otherKey = (u64)(rand() % (TesterType::threadCount * TesterType::keysPerThread) + 1);
+            ValueType value;
+            if( tester->table.Get( otherKey, &value ) )
+                ok = ok && value.b == ~value.a;
+        }
+    }
+
+    for( int i = 0; i < TesterType::keysPerThread; ++i )
+    {
+        ValueType value;
+        value.a = 0;
+        value.b = ~value.a;
+        tester->table.Put( (u64)(t * TesterType::keysPerThread + i + 1), value );
+    }
+    return ok ? 0 : 1;
+}
+
+TEST( Threading, ConcurrentHashtable )
+{
+    static_assert( ConcurrentHashtable<u64, CheckedValue, LazyAllocator>::OptimisticReads, "" );
+    static_assert( !ConcurrentHashtable<u64, LockedCheckedValue, LazyAllocator>::OptimisticReads, "" );
+    // String keys would be dereferenced while comparing
+    static_assert( !ConcurrentHashtable<char const*, u64, LazyAllocator>::OptimisticReads, "" );
+
+    ConcurrentHashtableTester<CheckedValue>().Test();
+    ConcurrentHashtableTester<LockedCheckedValue>().Test();
+}
+
+struct SyncHeapTester
+{
+    static constexpr int threadCount = 4;
+    static constexpr int blockCount = 2000;
+
+    SyncHeap heap;
+    u8* blocks[threadCount][blockCount];
+    sz sizes[threadCount][blockCount];
+    atomic_i32 nextThreadIndex;
+    atomic_i32 barrier;
+
+    SyncHeapTester()
+        : heap( MEGABYTES(1) )
+        , nextThreadIndex( 0 )
+        , barrier( 0 )
+    {}
+
+    void Wait( int phase )
+    {
+        barrier.fetch_add( 1 );
+        while( barrier.LOAD_ACQUIRE() < phase * threadCount )
+            ;
+    }
+};
+PLATFORM_THREAD_FUNC(SyncHeapTesterThread)
+{
+    SyncHeapTester* tester = (SyncHeapTester*)userdata;
+    int t = tester->nextThreadIndex.fetch_add( 1 );
+
+    srand( 1234 + t );
+    for( int i = 0; i < SyncHeapTester::blockCount; ++i )
+    {
+        // Make some of them go to the central heap directly
+        sz size = i % 100 ? 1 + rand() % 2000 : KILOBYTES(64);
+        u8* block = (u8*)ALLOC( &tester->heap, size );
+        memset( block, t, SizeT( size ) );
+        tester->blocks[t][i] = block;
+        tester->sizes[t][i] = size;
+    }
+    tester->Wait( 1 );
+
+    // Check and free all blocks from the next thread
+    int other = (t + 1) % SyncHeapTester::threadCount;
+    bool ok = true;
+    for( int i = 0; i < SyncHeapTester::blockCount; ++i )
+    {
+        u8* block = tester->blocks[other][i];
+        for( sz j = 0; j < tester->sizes[other][i]; ++j )
+            ok = ok && block[j] == other;
+        FREE( &tester->heap, block );
+    }
+    tester->Wait( 2 );
+
+    // Allocate again, which should reuse blocks freed by the previous thread
+    for( int i = 0; i < SyncHeapTester::blockCount; ++i )
+        tester->blocks[t][i] = (u8*)ALLOC( &tester->heap, 1 + rand() % 2000 );
+    for( int i = 0; i < SyncHeapTester::blockCount; ++i )
+        FREE( &tester->heap, tester->blocks[t][i] );
+
+    tester->heap.FlushThreadCache();
+    return ok ? 0 : 1;
+}
+
+TEST( Threading, SyncHeap )
+{
+    SyncHeapTester* tester = new SyncHeapTester;
+
+    Platform::ThreadHandle threads[SyncHeapTester::threadCount];
+    for( Platform::ThreadHandle& t : threads )
+        t = Core::CreateThread( "Test thread", SyncHeapTesterThread, tester, {} );
+    for( Platform::ThreadHandle& t : threads )
+        ASSERT_EQ( Core::JoinThread( t ), 0 );
+
+    // Everything should be back in the central heap
+    ASSERT_EQ( tester->heap.central.allocatedBlocks, 0 );
+    ASSERT_EQ( tester->heap.central.chunkCount, 1 );
+
+    delete tester;
+}
+
+TEST( Threading, SyncHeapTooManyThreads )
+{
+    SyncHeap heap( MEGABYTES(1) );
+
+    // Pretend every cache slot is already taken by some other thread
+    for( int i = 0; i < SyncHeap::MaxThreads; ++i )
+        heap.caches[i].threadId.STORE_RELAXED( U32MAX - i );
+    heap.cacheCount.STORE_RELAXED( SyncHeap::MaxThreads );
+
+    u8* blocks[100];
+    for( int i = 0; i < ARRAYCOUNT(blocks); ++i )
+    {
+        blocks[i] = (u8*)ALLOC( &heap, 16 + i );
+        memset( blocks[i], i, SizeT( 16 + i ) );
+    }
+    ASSERT_EQ( heap.cacheCount.LOAD_RELAXED(), SyncHeap::MaxThreads );
+    // Everything went straight to the central heap
+    ASSERT_EQ( heap.central.allocatedBlocks, ARRAYCOUNT(blocks) );
+
+    for( int i = 0; i < ARRAYCOUNT(blocks); ++i )
+    {
+        for( int j = 0; j < 16 + i; ++j )
+            ASSERT_EQ( blocks[i][j], i );
+        FREE( &heap, blocks[i] );
+    }
+    heap.FlushThreadCache();
+    ASSERT_EQ( heap.central.allocatedBlocks, 0 );
+}
+
+JOB_FUNC(CountJob)
+{
+    ((atomic_i32*)userdata)->fetch_add( 1, std::memory_order_relaxed );
+}
+
+// Splits its range in two until it's small enough, then spawns & waits for both halves
+struct SumRange
+{
+    u32 const* data;
+    int begin;
+    int end;
+    u64 result;
+    atomic_i32* failures;
+};
+JOB_FUNC(SumRangeJob)
+{
+    SumRange* r = (SumRange*)userdata;
+    if( Jobs::WorkerIndex() < 0 || !CTX.jobState )
+        r->failures->fetch_add( 1 );
+
+    if( r->end - r->begin <= 1000 )
+    {
+        // Every worker has its own temporary memory
+        int count = r->end - r->begin;
+        u32* tmp = ALLOC_ARRAY( CTX_TMPALLOC, u32, count );
+        COPYP( r->data + r->begin, tmp, count * SIZEOF(u32) );
+
+        r->result = 0;
+        for( int i = 0; i < count; ++i )
+            r->result += tmp[i];
+        return;
+    }
+
+    int mid = (r->begin + r->end) / 2;
+    SumRange halves[2] =
+    {
+        { r->data, r->begin, mid, 0, r->failures },
+        { r->data, mid, r->end, 0, r->failures },
+    };
+    Jobs::Counter counter;
+    Jobs::Run( SumRangeJob, &halves[0], &counter );
+    Jobs::Run( SumRangeJob, &halves[1], &counter );
+    Jobs::WaitForCounter( &counter );
+
+    r->result = halves[0].result + halves[1].result;
+}
 
-    ASSERT_TRUE( before == after );
+struct JobStage
+{
+    int values[256];
+    int sum;
+};
+JOB_FUNC(FillStageJob)
+{
+    *(int*)userdata = 1;
+}
+JOB_FUNC(SumStageJob)
+{
+    JobStage* stage = (JobStage*)userdata;
+    stage->sum = 0;
+    for( int v : stage->values )
+        stage->sum += v;
+}
+JOB_FUNC(WaitForFlagJob)
+{
+    atomic_bool* flag = (atomic_bool*)userdata;
+    while( !flag->LOAD_ACQUIRE() )
+        Yield();
 }
 
-TEST( Serialization, SerializeReorderedAttribute )
+TEST( Threading, JobSystem )
 {
-    BucketArray<u8> buffer( 128, CTX_TMPALLOC );
-    BinaryWriter w( &buffer );
+    Jobs::State state;
+    Jobs::Init( &state, 4 );
+    ASSERT_EQ( Jobs::WorkerCount(), 4 );
+    ASSERT_EQ( Jobs::WorkerIndex(), 0 );
 
-    SerialTypeComplex before = { { 42 }, {}, "Hello sailor" };
-    INIT( before.nums )( { 0, 1, 2, 3, 4, 5, 6, 7 } );
+    // Lots of tiny jobs
+    {
+        atomic_i32 runCount( 0 );
+        Jobs::Counter counter;
+        for( int i = 0; i < 10000; ++i )
+            Jobs::Run( CountJob, &runCount, &counter );
+        Jobs::WaitForCounter( &counter );
+        ASSERT_EQ( runCount.load(), 10000 );
+        ASSERT_TRUE( counter.Done() );
+    }
 
-    ReflectResult ret = Reflect( w, before );
-    ASSERT_TRUE( (bool)ret );
+    // Nested jobs waiting on their children
+    {
+        const int N = 1000000;
+        u32* data = ALLOC_ARRAY( CTX_ALLOC, u32, N );
+        u64 expected = 0;
+        for( int i = 0; i < N; ++i )
+        {
+            data[i] = (u32)i * 2654435761u;
+            expected += data[i];
+        }
 
-    BinaryReader r( &buffer );
-    SerialTypeComplex2 after;
+        atomic_i32 failures( 0 );
+        SumRange root = { data, 0, N, 0, &failures };
+        Jobs::Counter counter;
+        Jobs::Run( SumRangeJob, &root, &counter );
+        Jobs::WaitForCounter( &counter );
+        ASSERT_EQ( root.result, expected );
+        ASSERT_EQ( failures.load(), 0 );
 
-    ret = Reflect( r, after );
-    ASSERT_TRUE( (bool)ret );
+        FREE( CTX_ALLOC, data );
+    }
 
-    ASSERT_TRUE( after == before );
+    // Dependencies
+    {
+        JobStage stage = {};
+        Jobs::Counter filled, summed;
+
+        Jobs::JobDecl fills[ARRAYCOUNT(stage.values)];
+        for( int i = 0; i < (int)ARRAYCOUNT(fills); ++i )
+            fills[i] = { FillStageJob, &stage.values[i] };
+        Jobs::Run( fills, (int)ARRAYCOUNT(fills), &filled );
+        Jobs::RunAfter( &filled, SumStageJob, &stage, &summed );
+        Jobs::WaitForCounter( &summed );
+        ASSERT_TRUE( filled.Done() );
+        ASSERT_EQ( stage.sum, (int)ARRAYCOUNT(stage.values) );
+
+        // Nothing can start until the gate job finishes
+        atomic_bool flag( false );
+        Jobs::Counter gate;
+        Jobs::Run( WaitForFlagJob, &flag, &gate );
+        stage.sum = 0;
+        atomic_i32 released( 0 );
+        Jobs::RunAfter( &gate, SumStageJob, &stage, &summed );
+        Jobs::RunAfter( &gate, CountJob, &released, &summed );
+        ASSERT_FALSE( summed.Done() );
+        ASSERT_EQ( stage.sum, 0 );
+        ASSERT_EQ( released.load(), 0 );
+
+        flag.STORE_RELEASE( true );
+        Jobs::WaitForCounter( &summed );
+        ASSERT_EQ( stage.sum, (int)ARRAYCOUNT(stage.values) );
+        ASSERT_EQ( released.load(), 1 );
+
+        // Already done
+        Jobs::RunAfter( &gate, SumStageJob, &stage, &summed );
+        Jobs::WaitForCounter( &summed );
+    }
+
+    Jobs::Shutdown( &state );
+    ASSERT_EQ( Jobs::WorkerIndex(), -1 );
 }
 
-TEST( Serialization, SerializeRemovedAttribute )
+struct GateWait
 {
-    BucketArray<u8> buffer( 128, CTX_TMPALLOC );
-    BinaryWriter w( &buffer );
+    Jobs::Counter* gate;
+    atomic_i32* failures;
+    MemoryArena arena;
+};
+JOB_FUNC(GateWaitJob)
+{
+    GateWait* w = (GateWait*)userdata;
+    MemoryArena* scratch = Jobs::ScratchArena();
 
-    SerialTypeComplex before = { { 42 }, {}, "Hello sailor" };
-    INIT( before.nums )( { 0, 1, 2, 3, 4, 5, 6, 7 } );
-    ReflectResult ret = Reflect( w, before );
-    ASSERT_TRUE( (bool)ret );
+    // Our own Context has to survive the wait, even if we come back on a different thread
+    Context ctx = CTX;
+    ctx.allocator = Allocator::CreateFrom( &w->arena );
+    WITH_CONTEXT( ctx );
 
-    BinaryReader r( &buffer );
-    SerialTypeComplex3 after;
-    ret = Reflect( r, after );
-    ASSERT_TRUE( (bool)ret );
+    Jobs::WaitForCounter( w->gate );
 
-    ASSERT_TRUE( after == before );
+    u8* p = (u8*)ALLOC( CTX_ALLOC, 16 );
+    if( p < w->arena.base || p >= w->arena.base + w->arena.size || Jobs::ScratchArena() != scratch )
+        w->failures->fetch_add( 1 );
 }
-
-TEST( Serialization, SerializeChunkyType )
+struct Gate
 {
-    BucketArray<u8> buffer( 2048, CTX_TMPALLOC );
-    BinaryWriter w( &buffer );
+    Jobs::State* state;
+    int waiterCount;
+    atomic_i32* failures;
+};
+JOB_FUNC(OpenGateJob)
+{
+    // Only opens once all waiters are suspended, which can't happen if waiting blocks the worker
+    Gate* g = (Gate*)userdata;
+    f64 start = globalPlatform.ElapsedTimeMillis();
+    while( g->state->suspendedCount.LOAD_ACQUIRE() < g->waiterCount )
+    {
+        if( globalPlatform.ElapsedTimeMillis() - start > 10000 )
+        {
+            g->failures->fetch_add( 1 );
+            break;
+        }
+        Yield();
+    }
+}
+JOB_FUNC(SlowJob)
+{
+    f64 start = globalPlatform.ElapsedTimeMillis();
+    while( globalPlatform.ElapsedTimeMillis() - start < 100 )
+        Yield();
+}
 
-    SerialTypeDeeper deeper =
+TEST( Threading, JobFibers )
+{
+    // Blocked jobs don't block their workers
     {
-        { // SerialTypeDeep
-            { { 42 }, {}, "Hello sailor" }, // SerialTypeComplex
-            666
-        },
-        "Apartense vacas, que la vida es corta"
-    };
-    INIT( deeper.deep.complexx.nums )( { 0, 1, 2, 3, 4, 5, 6, 7 } );
+        Jobs::State state;
+        Jobs::Init( &state, 2 );
 
-    SerialTypeChunky before;
-    before.deeper.Reset( 8000 );
-    for( int i = 0; i < before.deeper.capacity; ++i )
-        before.deeper.Push( MOVE( deeper ) );
-    ReflectResult ret = Reflect( w, before );
-    ASSERT_TRUE( (bool)ret );
+        const int N = 100;
+        atomic_i32 failures( 0 );
+        Jobs::Counter gate, done;
+        Gate g = { &state, N, &failures };
+        Jobs::Run( OpenGateJob, &g, &gate );
 
-    LOG( "Size of serialized SerialTypeChunky: %I64d", buffer.count );
+        GateWait* waits = ALLOC_ARRAY( CTX_ALLOC, GateWait, N );
+        for( int i = 0; i < N; ++i )
+        {
+            waits[i] = { &gate, &failures };
+            InitArena( &waits[i].arena );
+            Jobs::Run( GateWaitJob, &waits[i], &done );
+        }
+        Jobs::WaitForCounter( &done );
+        ASSERT_EQ( failures.load(), 0 );
+        ASSERT_EQ( state.suspendedCount.load(), 0 );
+
+        for( int i = 0; i < N; ++i )
+            ReleaseArena( &waits[i].arena );
+        FREE( CTX_ALLOC, waits );
+        Jobs::Shutdown( &state );
+    }
 
-    BinaryReader r( &buffer );
-    SerialTypeChunky after;
-    ret = Reflect( r, after );
-    ASSERT_TRUE( (bool)ret );
+    // Running out of fibers just means waiting jobs run others on top of themselves
+    {
+        Jobs::State state;
+        Jobs::Init( &state, 4, 6 );
 
-    ASSERT_TRUE( after == before );
-}
+        const int N = 100000;
+        u32* data = ALLOC_ARRAY( CTX_ALLOC, u32, N );
+        u64 expected = 0;
+        for( int i = 0; i < N; ++i )
+        {
+            data[i] = (u32)i * 2654435761u;
+            expected += data[i];
+        }
 
-//// Data types
+        atomic_i32 failures( 0 );
+        SumRange root = { data, 0, N, 0, &failures };
+        Jobs::Counter counter;
+        Jobs::Run( SumRangeJob, &root, &counter );
+        Jobs::WaitForCounter( &counter );
+        ASSERT_EQ( root.result, expected );
+        ASSERT_EQ( failures.load(), 0 );
 
-class DatatypesTest : public testing::Test
-{
-protected:
-    // Per-test-suite set-up.
-    // Called before the first test in this test suite.
-    // Can be omitted if not needed.
-    static void SetUpTestCase()
-    {
+        FREE( CTX_ALLOC, data );
+        Jobs::Shutdown( &state );
     }
 
-    // Per-test-suite tear-down.
-    // Called after the last test in this test suite.
-    // Can be omitted if not needed.
-    static void TearDownTestCase()
+    // More jobs waiting to run than descriptor slots don't overwrite each other
     {
-    }
+        Jobs::State state;
+        Jobs::Init( &state, 2 );
+
+        const int N = Jobs::MaxPendingJobs + 1000;
+        atomic_i32 count( 0 );
+        Jobs::Counter gate, done;
+        Jobs::Run( SlowJob, nullptr, &gate );
+        for( int i = 0; i < N; ++i )
+        {
+            Jobs::RunAfter( &gate, CountJob, &count, &done );
+            Jobs::Run( CountJob, &count, &done );
+        }
+        Jobs::WaitForCounter( &done );
+        ASSERT_EQ( count.load(), 2 * N );
 
-    // Per-test setup/teardown
-    virtual void SetUp()
-    { }
-    virtual void TearDown()
-    { }
-};
+        Jobs::Shutdown( &state );
+    }
+}
 
-TEST_F( DatatypesTest, ArrayBasics )
+template <typename T>
+static void CheckParallelSort( sz count, T (*gen)() )
 {
-    Array<int> array( 100 );
-
-    // TODO 
+    Array<T> keys( (i32)count );
+    keys.Resize( (i32)count );
+    for( T& k : keys )
+        k = gen();
+    std::vector<T> expected( keys.data, keys.data + count );
+    std::sort( expected.begin(), expected.end() );
+
+    ParallelSort( keys, 16 * 1024 );
+    for( sz i = 0; i < count; ++i )
+        ASSERT_EQ( keys[i], expected[i] );
 }
 
-TEST_F( DatatypesTest, HashtablePutGet )
+TEST( Threading, ParallelAlgorithms )
 {
-    persistent LazyAllocator lazyAllocator;
-    Hashtable<void*, void*, LazyAllocator> table( 0, &lazyAllocator );
+    Jobs::State state;
+    Jobs::Init( &state, 4 );
 
-    const int N = 128 * 1024;
-    for( int i = 1; i < N; ++i )
-        table.Put( (void*)i, (void*)(i + 1) );
-    for( int i = 1; i < N; ++i )
-        ASSERT_EQ( *table.Get( (void*)i ), (void*)(i + 1) );
-}
+    const int N = 1000000;
+    Buffer<u32> data( ALLOC_ARRAY( CTX_ALLOC, u32, N ), N );
 
-template <typename DataType>
-void TestPushPop()
-{
-    DataType buffer( 128 );
-    ASSERT_EQ( buffer.Count(), 0 );
+    // Every item visited exactly once, with a fresh scratch arena per chunk
+    {
+        atomic_i32 failures( 0 );
+        ParallelFor( data, 10000, [&]( Buffer<u32> chunk, sz first )
+        {
+            u32* tmp = ALLOC_ARRAY( CTX_TMPALLOC, u32, chunk.length );
+            MemoryArena* scratch = Jobs::WorkerIndex() >= 0 ? Jobs::ScratchArena() : nullptr;
+            if( !scratch || (u8*)tmp < scratch->base || (u8*)tmp >= scratch->base + scratch->size )
+                failures.fetch_add( 1 );
+
+            for( sz i = 0; i < chunk.length; ++i )
+                tmp[i] = (u32)(first + i);
+            COPYP( tmp, chunk.data, chunk.length * SIZEOF(u32) );
+        } );
+        ASSERT_EQ( failures.load(), 0 );
+        for( int i = 0; i < N; ++i )
+            ASSERT_EQ( data[i], (u32)i );
+    }
 
-    for( int i = 0; i < buffer.Capacity(); ++i )
-        buffer.Push( i );
-    ASSERT_EQ( buffer.Count(), buffer.Capacity() );
+    // Reduce
+    {
+        u64 sum = ParallelReduce( data, 4096, (u64)0, []( Buffer<u32> chunk )
+        {
+            u64 s = 0;
+            for( u32 v : chunk )
+                s += v;
+            return s;
+        }, []( u64 a, u64 b ) { return a + b; } );
+        ASSERT_EQ( sum, (u64)N * (N - 1) / 2 );
+
+        // Partials are combined in chunk order
+        String joined = ParallelReduce( Buffer<u32>( data.data, 100 ), 10, String(), [&]( Buffer<u32> chunk )
+        {
+            return String::FromFormat( "%u,", chunk[0] );
+        }, []( String a, String b ) { return String::FromFormat( "%.*s%.*s", a.length, a.data, b.length, b.data ); } );
+        ASSERT_STREQ( joined.c(), "0,10,20,30,40,50,60,70,80,90," );
+    }
 
-    for( int i = 0; i < buffer.Capacity(); ++i )
+    // BucketArray, one chunk per bucket
     {
-        int x;
-        bool res = buffer.TryPop( &x );
-        ASSERT_TRUE( res );
-        ASSERT_EQ( x, i );
+        BucketArray<u32> buckets( 1000 );
+        for( u32 i = 0; i < 12345; ++i )
+            buckets.Push( i );
+
+        atomic_i32 chunkCount( 0 );
+        atomic_i32 failures( 0 );
+        ParallelFor( buckets, [&]( Buffer<u32> chunk, sz first )
+        {
+            chunkCount.fetch_add( 1 );
+            for( sz i = 0; i < chunk.length; ++i )
+                if( chunk[i] != (u32)(first + i) )
+                    failures.fetch_add( 1 );
+        } );
+        ASSERT_EQ( chunkCount.load(), 13 );
+        ASSERT_EQ( failures.load(), 0 );
     }
-    ASSERT_EQ( buffer.Count(), 0 );
 
-    for( int i = 0; i < buffer.Capacity(); ++i )
-        buffer.Push( i );
-    ASSERT_EQ( buffer.Count(), buffer.Capacity() );
+    // Sort
+    {
+        srand( 42 );
+        for( sz n : { (sz)0, (sz)1000, (sz)100000, (sz)500001 } )
+        {
+            CheckParallelSort<u32>( n, []() { return (u32)rand() * 7919u; } );
+            CheckParallelSort<i64>( n, []() { return ((i64)rand() << 20) - ((i64)RAND_MAX << 19); } );
+            CheckParallelSort<f32>( n, []() { return (f32)(rand() - RAND_MAX / 2) / 1000.f; } );
+            // Lots of repeated digits
+            CheckParallelSort<u64>( n, []() { return (u64)(rand() & 0xF) << 40; } );
+        }
+    }
 
-    for( int i = 0; i < buffer.Capacity(); ++i )
+    FREE( CTX_ALLOC, data.data );
+    Jobs::Shutdown( &state );
+
+    // Everything still works without a job system
     {
-        int x;
-        bool res = buffer.TryPopHead( &x );
-        ASSERT_TRUE( res );
-        ASSERT_EQ( x, buffer.Capacity() - i - 1 );
+        u64 sum = ParallelReduce( Buffer<u32>(), 16, (u64)7, []( Buffer<u32> ) { return (u64)1; },
+                                  []( u64 a, u64 b ) { return a + b; } );
+        ASSERT_EQ( sum, 7u );
+        CheckParallelSort<u32>( 100000, []() { return (u32)rand(); } );
     }
-    ASSERT_EQ( buffer.Count(), 0 );
 }
 
-TEST_F( DatatypesTest, RingBufferBasics )
+
+static Task<int> AddAsync( int a, int b )
 {
-    TestPushPop< RingBuffer<int> >();
-    TestPushPop< SyncRingBuffer<int> >();
+    co_return a + b;
 }
 
-TEST_F( DatatypesTest, SyncQueuePushPop )
+static Task<int> SumAsync( int n )
 {
-    SyncQueue<int> q( 128 );
-
-    const int N = 128 * 1024;
-    for( int i = 0; i < N; ++i )
-        q.Push( i );
-    for( int i = 0; i < N; ++i )
-    {
-        int it;
-        bool res = q.TryPop( &it );
-        ASSERT_TRUE( res );
-        ASSERT_EQ( it, i );
-    }
+    int result = 0;
+    for( int i = 0; i < n; ++i )
+        result += co_await AddAsync( i, 1 );
+    co_return result;
 }
 
+static Task<String> NameAsync( int n )
+{
+    co_return String::FromFormat( "task%d", n );
+}
 
-//// Threading
+static Task<> SetOnLoopAsync( Tasks::MainLoop* loop, bool* done )
+{
+    co_await Tasks::ResumeOn( &loop->executor );
+    *done = Core::IsMainThread();
+}
 
-template <typename T>
-PLATFORM_THREAD_FUNC(MutexTesterThread);
-template <typename T>
-struct MutexTester
+static JOB_FUNC(IncrementJob)
 {
-    T mutex;
-    const int iterationCount;
-    const int threadCount;
-    i64 value;
+    ((atomic_i32*)userdata)->fetch_add( 1 );
+}
 
-    MutexTester( int threadCount_, int iterationCount_ )
-        : iterationCount( iterationCount_ )
-        , threadCount( threadCount_ )
-        , value( 0 )
-    {}
+static Task<int> RoundTripAsync( Tasks::MainLoop* loop, bool* ranOnWorker, bool* resumedOnMain )
+{
+    co_await Tasks::ResumeOn( Tasks::JobExecutor() );
+    *ranOnWorker = !Core::IsMainThread() && Jobs::WorkerIndex() > 0;
+
+    atomic_i32 count( 0 );
+    Jobs::Counter counter;
+    for( int i = 0; i < 100; ++i )
+        Jobs::Run( IncrementJob, &count, &counter );
+    co_await Tasks::WaitForCounter( &counter );
+    int result = count.load();
+
+    co_await Tasks::ResumeOn( &loop->executor );
+    *resumedOnMain = Core::IsMainThread();
+    co_return result;
+}
 
-    void Test()
+TEST( Threading, Tasks )
+{
+    // Plain chaining
     {
-        value = 0;
-
-        Array<Platform::ThreadHandle> threads( threadCount );
-        for (int i = 0; i < threadCount; i++)
-            threads.Push( Core::CreateThread( "Test thread", MutexTesterThread<T>, this, {} ) );
-        for( Platform::ThreadHandle& t : threads )
-            Core::JoinThread( t );
+        Task<int> task = SumAsync( 10 );
+        ASSERT_FALSE( task.Done() );
+        task.Start();
+        ASSERT_TRUE( task.Done() );
+        ASSERT_EQ( task.Result(), 55 );
+
+        Task<String> name = NameAsync( 42 );
+        name.Start();
+        ASSERT_TRUE( name.Result() == "task42" );
+    }
 
-        ASSERT_EQ( value, threadCount * iterationCount );
+    // Frames come from whatever allocator is set
+    {
+        MemoryArena arena;
+        InitArena( &arena );
+        Allocator allocator = Allocator::CreateFrom( &arena );
+        Tasks::SetFrameAllocator( &allocator );
+
+        sz used = arena.used;
+        Task<int> task = SumAsync( 100 );
+        ASSERT_GT( arena.used, used );
+        task.Start();
+        ASSERT_EQ( task.Result(), 5050 );
+        task.Destroy();
+
+        Tasks::SetFrameAllocator( nullptr );
+        ReleaseArena( &arena );
     }
-};
-template <typename T>
-PLATFORM_THREAD_FUNC(MutexTesterThread)
-{
-    MutexTester<T>* tester = (MutexTester<T>*)userdata;
 
-    for( int i = 0; i < tester->iterationCount; i++ )
+    // Resuming on the main loop
     {
-        tester->mutex.Lock();
-        tester->value++;
-        tester->mutex.Unlock();
+        Tasks::MainLoop loop;
+        bool done = false;
+        Tasks::Spawn( SetOnLoopAsync( &loop, &done ) );
+        ASSERT_FALSE( done );
+        ASSERT_EQ( loop.RunPending(), 1 );
+        ASSERT_TRUE( done );
+        ASSERT_EQ( loop.RunPending(), 0 );
     }
-    return 0;
-}
 
-TEST( Threading, MutexTest )
-{
-    MutexTester<Mutex>( 4, 100000 ).Test();
+    // Hopping over to the workers, waiting on jobs from there, and back to the main loop
+    {
+        Jobs::State state;
+        Jobs::Init( &state, 2 );
+        Tasks::MainLoop loop;
 
-    //MutexTester<Benaphore<PlatformSemaphore>>( 4, 10000 ).Test();
-    MutexTester<Benaphore<PreshingSemaphore>>( 4, 100000 ).Test();
-    MutexTester<Benaphore<Semaphore>>( 4, 100000 ).Test();
+        bool ranOnWorker = false, resumedOnMain = false;
+        Task<int> task = RoundTripAsync( &loop, &ranOnWorker, &resumedOnMain );
+        task.Start();
 
-    //MutexTester<RecursiveBenaphore<PlatformSemaphore>>( 4, 10000 ).Test();
-    MutexTester<RecursiveBenaphore<PreshingSemaphore>>( 4, 100000 ).Test();
-    MutexTester<RecursiveBenaphore<Semaphore>>( 4, 100000 ).Test();
+        f64 start = globalPlatform.ElapsedTimeMillis();
+        while( !task.Done() && globalPlatform.ElapsedTimeMillis() - start < 10000 )
+        {
+            loop.RunPending();
+            Yield();
+        }
+        ASSERT_TRUE( task.Done() );
+        ASSERT_EQ( task.Result(), 100 );
+        ASSERT_TRUE( ranOnWorker );
+        ASSERT_TRUE( resumedOnMain );
+
+        Jobs::Shutdown( &state );
+    }
 }
 
 
@@ -477,6 +2809,27 @@ TEST_F( HttpTest, Post )
     ASSERT_TRUE( done );
 }
 
+static Task<> GetAsyncTask( bool* done )
+{
+    Http::Response response = co_await Http::GetAsync( &globalState.http, "https://httpbin.org/get?message=https_client" );
+    *done = true;
+
+    EXPECT_EQ( response.statusCode, 200 );
+    EXPECT_TRUE( response.body.ValidCString() );
+}
+
+TEST_F( HttpTest, GetAsync )
+{
+    bool done = false;
+    Tasks::Spawn( GetAsyncTask( &done ) );
+
+    f32 start = Clock::AppTimeSeconds();
+    while( !done && (IsDebuggerPresent() || Clock::AppTimeSeconds() - start < 10.f) )
+        Http::ProcessResponses( &globalState.http );
+
+    ASSERT_TRUE( done );
+}
+
 TEST_F( HttpTest, GetChunked )
 {
     bool done = false;
@@ -810,9 +3163,11 @@ TEST(HttpsToHttpRedirectTest3, SimpleInterface) {
 
 GTEST_API_ int main(int argc, char **argv)
 {
-#if 1
+#if _WIN32
     // TODO Doesnt seem to work at all inside Google Test
     SetUnhandledExceptionFilter( Win32::ExceptionHandler );
+#else
+    Linux::InstallDefaultCrashHandler();
 #endif
 
     Logging::ChannelDecl channels[] =
@@ -821,7 +3176,11 @@ GTEST_API_ int main(int argc, char **argv)
         { "Core" },
         { "Net" },
     };
+#if _WIN32
     Win32::InitGlobalPlatform( (Buffer<Logging::ChannelDecl>)channels );
+#else
+    Linux::InitGlobalPlatform( (Buffer<Logging::ChannelDecl>)channels );
+#endif
 
     if( !globalPlatform.TestConnectivity() )
     {
@@ -832,7 +3191,7 @@ GTEST_API_ int main(int argc, char **argv)
 
 
     bool result = Http::Init( &globalState.http );
-    ASSERT_EQ( result, true ) << "Http::Init failed";
+    ASSERT( result, "Http::Init failed" );
 
     testing::InitGoogleTest(&argc, argv);
     int testResult = RUN_ALL_TESTS();
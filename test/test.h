@@ -140,3 +140,25 @@ REFLECT( SerialTypeChunky )
     return ReflectOk;
 }
 
+
+
+struct SoATypeParticle
+{
+    f32 x, y;
+    f32 mass;
+    SerialTypeSimple simple;
+    u8 flags;
+    // Not reflected
+    u32 scratch;
+};
+
+REFLECT( SoATypeParticle )
+{
+    BEGIN_FIELDS;
+    FIELD( 1, x );
+    FIELD( 2, y );
+    FIELD( 3, mass );
+    FIELD( 4, simple );
+    FIELD( 5, flags );
+    return ReflectOk;
+}